@@ -25,17 +25,25 @@
  */
 
 #define DEBUG
+#include <linux/moduleparam.h>
 #include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
+#include <linux/bitops.h>
+#include <linux/bitrev.h>
 #include <linux/input.h>
 #include <linux/input/mt.h>
 #include <linux/serio.h>
 #include <linux/libps2.h>
 
 #include "psmouse.h"
+#include "psmouse-trace.h"
 #include "alps.h"
 
 #define ALPS_CMD_NIBBLE_10	0x01f2
 
+#define ALPS_INTERLEAVE_TIMEOUT_MS	20	/* Upper bound for the flush timer */
+
 static const struct alps_nibble_commands alps_v3_nibble_commands[] = {
 	{ PSMOUSE_CMD_SETPOLL,		0x00 }, /* 0 */
 	{ PSMOUSE_CMD_RESET_DIS,	0x00 }, /* 1 */
@@ -124,12 +132,6 @@ static const struct alps_model_info alps_model_data[] = {
 	{ { 0x73, 0x03, 0x50 }, 0x02, ALPS_PROTO_V6, 0xc8, 0xc8, 0 },
 };
 
-/* Set these based upon protocol version */
-static int ALPS_X_MAX;		/* right edge */
-static int ALPS_Y_MAX;		/* bottom edge */
-static int ALPS_BITMAP_X_BITS;	/* mt number of x bits */
-static int ALPS_BITMAP_Y_BITS;	/* mt number of y bits */
-
 /*
  * XXX - this entry is suspicious. First byte has zero lower nibble,
  * which is what a normal mouse would report. Also, the value 0x0e
@@ -273,6 +275,51 @@ static void alps_process_packet_v1_v2(struct psmouse *psmouse)
 	input_sync(dev);
 }
 
+struct alps_bitmap_point {
+	int start_bit;
+	int num_bits;
+};
+
+/*
+ * Extract the contacts of one axis bitmap, lowest position in bit 0.
+ * Returns the number of runs of set bits. low receives the first run and
+ * high the last one; runs after the first that are separated by a single
+ * clear bit are counted into high as one contact.
+ */
+static int alps_get_bitmap_runs(unsigned long map,
+				struct alps_bitmap_point *low,
+				struct alps_bitmap_point *high)
+{
+	unsigned long starts, rest, bridged, below;
+	int fingers, top, first;
+
+	/* The lowest bit of every run */
+	starts = map & ~(map << 1);
+	fingers = hweight_long(starts);
+	if (!fingers)
+		return 0;
+
+	low->start_bit = __ffs(map);
+	low->num_bits = ffz(map >> low->start_bit);
+	if (fingers < 2)
+		return fingers;
+
+	high->start_bit = __fls(starts);
+
+	/*
+	 * Drop the first run, fill single-bit holes and find where the
+	 * filled run containing the topmost bit begins.
+	 */
+	rest = map & ~((2UL << (low->start_bit + low->num_bits - 1)) - 1);
+	bridged = rest | ((rest << 1) & (rest >> 1));
+	top = __fls(rest);
+	below = ~bridged & ((1UL << top) - 1);
+	first = below ? __fls(below) + 1 : 0;
+	high->num_bits = hweight_long(rest >> first);
+
+	return fingers;
+}
+
 /*
  * Process bitmap data from v3/v4/v5/v6 protocols. Returns the number of
  * fingers detected. A return value of 0 means at least one of the
@@ -283,67 +330,29 @@ static void alps_process_packet_v1_v2(struct psmouse *psmouse)
  * These points are returned in x1, y1, x2, and y2 when the return value
  * is greater than 0.
  */
-static int alps_process_bitmap(unsigned int x_map, unsigned int y_map,
+static int alps_process_bitmap(struct alps_data *priv,
+			       unsigned int x_map, unsigned int y_map,
 			       int *x1, int *y1, int *x2, int *y2)
 {
-	struct alps_bitmap_point {
-		int start_bit;
-		int num_bits;
-	};
-
-	int fingers_x = 0, fingers_y = 0, fingers;
-	int i, bit, prev_bit;
+	int fingers_x, fingers_y, fingers;
+	int i;
 	struct alps_bitmap_point x_low = {0,}, x_high = {0,};
 	struct alps_bitmap_point y_low = {0,}, y_high = {0,};
-	struct alps_bitmap_point *point;
+
+	/*
+	 * y bitmap is reversed for what we need (lower positions are in
+	 * higher bits), so flip it within its width.
+	 */
+	y_map = bitrev32(y_map << (sizeof(y_map) * BITS_PER_BYTE -
+				   priv->y_bits));
 
 	if (!x_map || !y_map)
 		return 0;
 
 	*x1 = *y1 = *x2 = *y2 = 0;
 
-	prev_bit = 0;
-	point = &x_low;
-	for (i = 0; x_map != 0; i++, x_map >>= 1) {
-		bit = x_map & 1;
-		if (bit) {
-			if (!prev_bit) {
-				point->start_bit = i;
-				fingers_x++;
-			}
-			point->num_bits++;
-		} else {
-			if (prev_bit)
-				point = &x_high;
-			else
-				point->num_bits = 0;
-		}
-		prev_bit = bit;
-	}
-
-	/*
-	 * y bitmap is reversed for what we need (lower positions are in
-	 * higher bits), so we process from the top end.
-	 */
-	y_map = y_map << (sizeof(y_map) * BITS_PER_BYTE - ALPS_BITMAP_Y_BITS);
-	prev_bit = 0;
-	point = &y_low;
-	for (i = 0; y_map != 0; i++, y_map <<= 1) {
-		bit = y_map & (1 << (sizeof(y_map) * BITS_PER_BYTE - 1));
-		if (bit) {
-			if (!prev_bit) {
-				point->start_bit = i;
-				fingers_y++;
-			}
-			point->num_bits++;
-		} else {
-			if (prev_bit)
-				point = &y_high;
-			else
-				point->num_bits = 0;
-		}
-		prev_bit = bit;
-	}
+	fingers_x = alps_get_bitmap_runs(x_map, &x_low, &x_high);
+	fingers_y = alps_get_bitmap_runs(y_map, &y_low, &y_high);
 
 	/*
 	 * Fingers can overlap, so we use the maximum count of fingers
@@ -371,21 +380,32 @@ static int alps_process_bitmap(unsigned int x_map, unsigned int y_map,
 		}
 	}
 
-	*x1 = (ALPS_X_MAX * (2 * x_low.start_bit + x_low.num_bits - 1)) /
-		(2 * (ALPS_BITMAP_X_BITS - 1));
-	*y1 = (ALPS_Y_MAX * (2 * y_low.start_bit + y_low.num_bits - 1)) /
-		(2 * (ALPS_BITMAP_Y_BITS - 1));
+	*x1 = priv->x_bitmap_coord[2 * x_low.start_bit + x_low.num_bits - 1];
+	*y1 = priv->y_bitmap_coord[2 * y_low.start_bit + y_low.num_bits - 1];
 
 	if (fingers > 1) {
-		*x2 = (ALPS_X_MAX * (2 * x_high.start_bit + x_high.num_bits - 1)) /
-			(2 * (ALPS_BITMAP_X_BITS - 1));
-		*y2 = (ALPS_Y_MAX * (2 * y_high.start_bit + y_high.num_bits - 1)) /
-			(2 * (ALPS_BITMAP_Y_BITS - 1));
+		*x2 = priv->x_bitmap_coord[2 * x_high.start_bit +
+					   x_high.num_bits - 1];
+		*y2 = priv->y_bitmap_coord[2 * y_high.start_bit +
+					   y_high.num_bits - 1];
 	}
 
 	return fingers;
 }
 
+/*
+ * Fill a bitmap to coordinate table for one axis. Entry i holds the
+ * coordinate of a contact with 2 * start_bit + num_bits - 1 == i, so that
+ * alps_process_bitmap() does not need to divide on every packet.
+ */
+static void alps_init_bitmap_coords(u16 *coord, int max, int bits)
+{
+	int i;
+
+	for (i = 0; i < 3 * ALPS_BITMAP_MAX_BITS; i++)
+		coord[i] = (max * i) / (2 * (bits - 1));
+}
+
 static void alps_set_slot(struct input_dev *dev, int slot, bool active,
 			  int x, int y)
 {
@@ -505,7 +525,7 @@ static void alps_process_touchpad_packet_v3_v5(struct psmouse *psmouse)
                         }
 
 			bmap_fingers =
-				alps_process_bitmap(x_bitmap, y_bitmap,
+				alps_process_bitmap(priv, x_bitmap, y_bitmap,
 						    &x1, &y1, &x2, &y2);
 
 			/*
@@ -665,7 +685,7 @@ static void alps_process_packet_v4(struct psmouse *psmouse)
 			((priv->multi_data[3] & 0x1f) << 5) |
 			(priv->multi_data[1] & 0x1f);
 
-		fingers = alps_process_bitmap(x_bitmap, y_bitmap,
+		fingers = alps_process_bitmap(priv, x_bitmap, y_bitmap,
 					      &x1, &y1, &x2, &y2);
 
 		/* Store MT data.*/
@@ -750,7 +770,7 @@ static void alps_process_packet_v6(struct psmouse *psmouse)
 			y_bitmap = (packet[1] & 0x7f) |
 				((packet[2] & 0x1f) << 7);
 
-			alps_process_bitmap(x_bitmap, y_bitmap,
+			alps_process_bitmap(priv, x_bitmap, y_bitmap,
 					    &x1, &y1, &x2, &y2);
 
 			packet = priv->multi_data;
@@ -808,10 +828,42 @@ static void alps_process_packet_v6(struct psmouse *psmouse)
 	input_sync(dev);
 }
 
+#ifdef ALPS_DECODE_TIMING
+/*
+ * Per packet decode time. Two clock reads per packet are too much for the
+ * interrupt path of a production build, so this is only compiled in when
+ * ALPS_DECODE_TIMING is defined; tools/replay measures the decoders
+ * without it.
+ */
+static u64 alps_decode_start(void)
+{
+	return local_clock();
+}
+
+static void alps_update_decode_stats(struct alps_data *priv, u64 start)
+{
+	u64 delta = local_clock() - start;
+
+	priv->decode_ns += delta;
+	if (delta > priv->decode_ns_max)
+		priv->decode_ns_max = delta;
+}
+#else
+static inline u64 alps_decode_start(void)
+{
+	return 0;
+}
+
+static inline void alps_update_decode_stats(struct alps_data *priv, u64 start)
+{
+}
+#endif
+
 static void alps_process_packet(struct psmouse *psmouse)
 {
 	struct alps_data *priv = psmouse->private;
 	const struct alps_model_info *model = priv->i;
+	u64 start = alps_decode_start();
 
 	switch (model->proto_version) {
 	case ALPS_PROTO_V1:
@@ -831,6 +883,9 @@ static void alps_process_packet(struct psmouse *psmouse)
 		alps_process_packet_v6(psmouse);
 		break;
 	}
+
+	priv->packets++;
+	alps_update_decode_stats(priv, start);
 }
 
 static void alps_report_bare_ps2_packet(struct psmouse *psmouse,
@@ -839,6 +894,7 @@ static void alps_report_bare_ps2_packet(struct psmouse *psmouse,
 {
 	struct alps_data *priv = psmouse->private;
 	struct input_dev *dev2 = priv->dev2;
+	u64 start = alps_decode_start();
 
 	if (report_buttons)
 		alps_report_buttons(psmouse, dev2, psmouse->dev,
@@ -856,23 +912,91 @@ static void alps_report_bare_ps2_packet(struct psmouse *psmouse,
 		    ((packet[0] << 3) & 0x100) - packet[2]);
 
 	input_sync(dev2);
+
+	priv->ps2_packets++;
+	alps_update_decode_stats(priv, start);
+}
+
+/*
+ * Track the average gap between bytes of the same packet; it is a
+ * function of the KBC clock and the report rate and tells us how long
+ * the 7th byte of an interleaved sequence can take to show up.
+ */
+static void alps_update_byte_gap(struct alps_data *priv, int pktcnt)
+{
+	u64 now = local_clock();
+	u64 gap = now - priv->last_byte_ns;
+
+	priv->last_byte_ns = now;
+
+	if (pktcnt < 2 || gap > ALPS_INTERLEAVE_TIMEOUT_MS * NSEC_PER_MSEC)
+		return;
+
+	if (!priv->byte_gap_ns)
+		priv->byte_gap_ns = gap;
+	else
+		priv->byte_gap_ns += ((s64)gap - priv->byte_gap_ns) >> 3;
+}
+
+/*
+ * Can bytes 3-5 be anything but the tail of an ALPS packet? A PS/2
+ * header never has the overflow bits set, and a sign bit without the
+ * high bit of the matching delta would mean a movement of more than
+ * 128 counts, which trackpoints do not produce.
+ */
+static bool alps_is_alps_tail(const unsigned char *packet)
+{
+	if ((packet[3] | packet[4] | packet[5]) & 0x80)
+		return false;
+
+	return (packet[3] & 0xf0) != 0;
+}
+
+/*
+ * How long to wait for the 7th byte of a possibly interleaved packet. The
+ * rest of an interleaved packet follows at the usual byte rate, so a few
+ * byte times are enough to decide if we are getting more data or not;
+ * 20 ms is the upper bound.
+ */
+static u32 alps_flush_timeout_us(struct alps_data *priv)
+{
+	u32 timeout_us = ALPS_INTERLEAVE_TIMEOUT_MS * USEC_PER_MSEC;
+
+	if (priv->byte_gap_ns)
+		timeout_us = min_t(u32, timeout_us,
+				   4 * priv->byte_gap_ns / NSEC_PER_USEC);
+
+	return timeout_us;
 }
 
 static psmouse_ret_t alps_handle_interleaved_ps2(struct psmouse *psmouse)
 {
 	struct alps_data *priv = psmouse->private;
+	u32 timeout_us;
 
 	if (psmouse->pktcnt < 6)
 		return PSMOUSE_GOOD_DATA;
 
 	if (psmouse->pktcnt == 6) {
+		if (alps_is_alps_tail(psmouse->packet)) {
+			alps_process_packet(psmouse);
+			priv->early_decisions++;
+			/* The fixed timer this packet used to wait for */
+			priv->latency_saved_us += ALPS_INTERLEAVE_TIMEOUT_MS *
+						  USEC_PER_MSEC;
+			return PSMOUSE_FULL_PACKET;
+		}
+
 		/*
 		 * Start a timer to flush the packet if it ends up last
 		 * 6-byte packet in the stream. Timer needs to fire
-		 * psmouse core times out itself. 20 ms should be enough
-		 * to decide if we are getting more data or not.
+		 * psmouse core times out itself.
 		 */
-		mod_timer(&priv->timer, jiffies + msecs_to_jiffies(20));
+		timeout_us = alps_flush_timeout_us(priv);
+		priv->flush_timeout_us = timeout_us;
+
+		mod_timer(&priv->timer,
+			  jiffies + usecs_to_jiffies(timeout_us) + 1);
 		return PSMOUSE_GOOD_DATA;
 	}
 
@@ -899,6 +1023,8 @@ static psmouse_ret_t alps_handle_interleaved_ps2(struct psmouse *psmouse)
 		}
 
 		alps_process_packet(psmouse);
+		psmouse->stats.packets++;
+		psmouse_account_latency(psmouse);
 
 		/* Continue with the next packet */
 		psmouse->packet[0] = psmouse->packet[6];
@@ -924,6 +1050,7 @@ static psmouse_ret_t alps_handle_interleaved_ps2(struct psmouse *psmouse)
 
 		alps_report_bare_ps2_packet(psmouse, &psmouse->packet[3],
 					    false);
+		psmouse->stats.interleaved++;
 
 		/*
 		 * Continue with the standard ALPS protocol handling,
@@ -942,8 +1069,9 @@ static psmouse_ret_t alps_handle_interleaved_ps2(struct psmouse *psmouse)
 static void alps_flush_packet(unsigned long data)
 {
 	struct psmouse *psmouse = (struct psmouse *)data;
+	struct alps_data *priv = psmouse->private;
 
-	serio_pause_rx(psmouse->ps2dev.serio);
+	psmouse_pause_rx(psmouse);
 
 	if (psmouse->pktcnt == psmouse->pktsize) {
 
@@ -963,9 +1091,16 @@ static void alps_flush_packet(unsigned long data)
 			alps_process_packet(psmouse);
 		}
 		psmouse->pktcnt = 0;
+
+		psmouse->stats.timer_flushes++;
+		psmouse->stats.packets++;
+		psmouse_account_latency(psmouse);
+
+		priv->latency_saved_us += ALPS_INTERLEAVE_TIMEOUT_MS *
+					  USEC_PER_MSEC - priv->flush_timeout_us;
 	}
 
-	serio_continue_rx(psmouse->ps2dev.serio);
+	psmouse_continue_rx(psmouse);
 }
 
 static psmouse_ret_t alps_process_byte(struct psmouse *psmouse)
@@ -983,6 +1118,9 @@ static psmouse_ret_t alps_process_byte(struct psmouse *psmouse)
 
 	/* Check for PS/2 packet stuffed in the middle of ALPS packet. */
 
+	if (model->flags & ALPS_PS2_INTERLEAVED)
+		alps_update_byte_gap(priv, psmouse->pktcnt);
+
 	if ((model->flags & ALPS_PS2_INTERLEAVED) &&
 	    psmouse->pktcnt >= 4 && (psmouse->packet[3] & 0x0f) == 0x0f) {
 		return alps_handle_interleaved_ps2(psmouse);
@@ -1021,85 +1159,305 @@ static psmouse_ret_t alps_process_byte(struct psmouse *psmouse)
 	return PSMOUSE_GOOD_DATA;
 }
 
-static int alps_command_mode_send_nibble(struct psmouse *psmouse, int nibble)
+static bool alps_validate_header(struct psmouse *psmouse)
+{
+	struct alps_data *priv = psmouse->private;
+
+	/* Bare PS/2 packets are accepted as well, see alps_process_byte() */
+	return (psmouse->packet[0] & 0xc8) == 0x08 ||
+	       alps_is_valid_first_byte(priv->i, psmouse->packet[0]);
+}
+
+/*
+ * Burst handler for deferred mode: decodes whole ALPS packets straight
+ * from the queue. Bare and interleaved PS/2 packets, partial packets
+ * and anything alps_process_byte() would refuse are left to it.
+ */
+static int alps_process_burst(struct psmouse *psmouse,
+			      const unsigned char *data, const u64 *time,
+			      int count, int *packets)
+{
+	struct alps_data *priv = psmouse->private;
+	const struct alps_model_info *model = priv->i;
+	int pktsize = psmouse->pktsize;
+	const unsigned char *p;
+	unsigned char hibits;
+	int i, n = 0;
+
+	*packets = 0;
+
+	if (model->flags & ALPS_PS2_INTERLEAVED)
+		return 0;
+
+	while (count - n >= pktsize) {
+		p = data + n;
+
+		if (p[0] == PSMOUSE_RET_BAT || (p[0] & 0xc8) == 0x08 ||
+		    !alps_is_valid_first_byte(model, p[0]))
+			break;
+
+		/* Same high bit test as alps_process_byte() */
+		if (model->proto_version != ALPS_PROTO_V6) {
+			hibits = 0;
+			for (i = 1; i < pktsize; i++)
+				if (i != 5 || model->proto_version != ALPS_PROTO_V5)
+					hibits |= p[i];
+			if (hibits & 0x80)
+				break;
+		}
+
+		memcpy(psmouse->packet, p, pktsize);
+		psmouse->pktcnt = pktsize;
+		alps_process_packet(psmouse);
+		psmouse->pktcnt = 0;
+
+		psmouse->irq_time = time[n + pktsize - 1];
+		psmouse_account_latency(psmouse);
+		(*packets)++;
+		n += pktsize;
+	}
+
+	return n;
+}
+
+/*
+ * Command mode register accesses are sent as one psmouse_command_seq()
+ * each. The helpers below fill in the sequence; dummy receives the
+ * responses of nibble commands that return data and is shared by all
+ * of them.
+ */
+#define ALPS_NIBBLE_SEQ_MAX	7	/* Address command, 4 + 2 nibbles */
+
+static int alps_nibble_seq(struct psmouse *psmouse, struct psmouse_cmd *seq,
+			   unsigned char *dummy, int nibble)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	struct alps_data *priv = psmouse->private;
 	int command;
-	unsigned char *param;
-	unsigned char dummy[4];
 
 	BUG_ON(nibble > 0xf);
 
 	command = priv->nibble_commands[nibble].command;
-	param = (command & 0x0f00) ?
+	seq->command = command;
+	seq->param = (command & 0x0f00) ?
 		dummy : (unsigned char *)&priv->nibble_commands[nibble].data;
 
-	if (ps2_command(ps2dev, param, command))
-		return -1;
-
-	return 0;
+	return 1;
 }
 
-static int alps_command_mode_set_addr(struct psmouse *psmouse, int addr)
+static int alps_set_addr_seq(struct psmouse *psmouse, struct psmouse_cmd *seq,
+			     unsigned char *dummy, int addr)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	struct alps_data *priv = psmouse->private;
-	int i, nibble;
+	int i, n = 0;
 
-	if (ps2_command(ps2dev, NULL, priv->addr_command))
-		return -1;
+	seq[n].command = priv->addr_command;
+	seq[n++].param = NULL;
 
-	for (i = 12; i >= 0; i -= 4) {
-		nibble = (addr >> i) & 0xf;
-		if (alps_command_mode_send_nibble(psmouse, nibble))
-			return -1;
-	}
+	for (i = 12; i >= 0; i -= 4)
+		n += alps_nibble_seq(psmouse, seq + n, dummy, (addr >> i) & 0xf);
+
+	return n;
+}
+
+static int alps_command_mode_send_nibble(struct psmouse *psmouse, int nibble)
+{
+	struct psmouse_cmd seq[1];
+	unsigned char dummy[4];
+
+	alps_nibble_seq(psmouse, seq, dummy, nibble);
+
+	if (psmouse_command_seq(psmouse, seq, 1, PSMOUSE_CMD_SEQ_TIMEOUT, NULL))
+		return -1;
 
 	return 0;
 }
 
+/* Selects and reads the register at addr in one sequence */
 static int __alps_command_mode_read_reg(struct psmouse *psmouse, int addr)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
+	struct psmouse_cmd seq[ALPS_NIBBLE_SEQ_MAX];
+	unsigned char dummy[4];
 	unsigned char param[4];
+	int n, error;
+
+	n = alps_set_addr_seq(psmouse, seq, dummy, addr);
+	seq[n].command = PSMOUSE_CMD_GETINFO;
+	seq[n++].param = param;
 
-	if (ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO))
+	error = psmouse_command_seq(psmouse, seq, n, PSMOUSE_CMD_SEQ_TIMEOUT,
+				    NULL);
+	if (error) {
+		trace_alps_reg(psmouse, addr, -1, false, error);
 		return -1;
+	}
 
 	/*
 	 * The address being read is returned in the first two bytes
 	 * of the result. Check that this address matches the expected
 	 * address.
 	 */
-	if (addr != ((param[0] << 8) | param[1]))
+	if (addr != ((param[0] << 8) | param[1])) {
+		trace_alps_reg(psmouse, addr, -1, false, -EIO);
 		return -1;
+	}
+
+	trace_alps_reg(psmouse, addr, param[2], false, 0);
 
 	return param[2];
 }
 
+static struct alps_reg_cache_entry *alps_reg_cache_find(struct alps_data *priv,
+						       int addr)
+{
+	int i;
+
+	for (i = 0; i < priv->reg_cache_count; i++)
+		if (priv->reg_cache[i].addr == addr)
+			return &priv->reg_cache[i];
+
+	return NULL;
+}
+
+/*
+ * Record a register value. from_read tells whether the value was read
+ * back from the device rather than written by us; the first value read
+ * after a reset is kept as the power-on default.
+ */
+static void alps_reg_cache_store(struct alps_data *priv, int addr, u8 value,
+				 bool from_read)
+{
+	struct alps_reg_cache_entry *entry = alps_reg_cache_find(priv, addr);
+
+	if (!entry) {
+		if (priv->reg_cache_count == ALPS_REG_CACHE_SIZE)
+			return;
+
+		entry = &priv->reg_cache[priv->reg_cache_count++];
+		entry->addr = addr;
+		entry->dflt = value;
+		entry->has_dflt = from_read;
+	}
+
+	entry->value = value;
+}
+
+/*
+ * The touchpad has been reset, so the registers are back at their
+ * power-on values. Forget everything we wrote and keep the defaults.
+ */
+static void alps_reg_cache_revert(struct alps_data *priv)
+{
+	int i, n = 0;
+
+	for (i = 0; i < priv->reg_cache_count; i++) {
+		if (!priv->reg_cache[i].has_dflt)
+			continue;
+
+		priv->reg_cache[n] = priv->reg_cache[i];
+		priv->reg_cache[n].value = priv->reg_cache[n].dflt;
+		n++;
+	}
+
+	priv->reg_cache_count = n;
+}
+
 static int alps_command_mode_read_reg(struct psmouse *psmouse, int addr)
 {
-	if (alps_command_mode_set_addr(psmouse, addr))
-		return -1;
-	return __alps_command_mode_read_reg(psmouse, addr);
+	struct alps_data *priv = psmouse->private;
+	int reg_val;
+
+	reg_val = __alps_command_mode_read_reg(psmouse, addr);
+	if (reg_val >= 0)
+		alps_reg_cache_store(priv, addr, reg_val, true);
+
+	return reg_val;
 }
 
-static int __alps_command_mode_write_reg(struct psmouse *psmouse, u8 value)
+/*
+ * Like alps_command_mode_read_reg(), but answer from the register cache
+ * when the value is known. The address is not necessarily set afterwards,
+ * so use alps_command_mode_write_reg() to write it back.
+ */
+static int alps_command_mode_read_reg_cached(struct psmouse *psmouse, int addr)
 {
-	if (alps_command_mode_send_nibble(psmouse, (value >> 4) & 0xf))
-		return -1;
-	if (alps_command_mode_send_nibble(psmouse, value & 0xf))
-		return -1;
-	return 0;
+	struct alps_data *priv = psmouse->private;
+	struct alps_reg_cache_entry *entry = alps_reg_cache_find(priv, addr);
+
+	if (entry) {
+		priv->reg_cache_hits++;
+		return entry->value;
+	}
+
+	priv->reg_cache_misses++;
+	return alps_command_mode_read_reg(psmouse, addr);
+}
+
+/*
+ * Writes value to the register at addr. The address is not sent again
+ * if set_addr is false, since reading a register leaves it selected.
+ */
+static int __alps_command_mode_write_reg(struct psmouse *psmouse, int addr,
+					 u8 value, bool set_addr)
+{
+	struct psmouse_cmd seq[ALPS_NIBBLE_SEQ_MAX];
+	unsigned char dummy[4];
+	int n = 0, error;
+
+	if (set_addr)
+		n = alps_set_addr_seq(psmouse, seq, dummy, addr);
+	n += alps_nibble_seq(psmouse, seq + n, dummy, (value >> 4) & 0xf);
+	n += alps_nibble_seq(psmouse, seq + n, dummy, value & 0xf);
+
+	error = psmouse_command_seq(psmouse, seq, n, PSMOUSE_CMD_SEQ_TIMEOUT,
+				    NULL);
+	trace_alps_reg(psmouse, addr, value, true, error);
+
+	return error ? -1 : 0;
 }
 
 static int alps_command_mode_write_reg(struct psmouse *psmouse, int addr,
 				       u8 value)
 {
-	if (alps_command_mode_set_addr(psmouse, addr))
+	if (__alps_command_mode_write_reg(psmouse, addr, value, true))
+		return -1;
+
+	alps_reg_cache_store(psmouse->private, addr, value, false);
+	return 0;
+}
+
+/*
+ * Read-modify-write a register: clear the bits in mask, then set the
+ * ones in bits. The read is skipped when the register cache knows the
+ * value. Return -1 on error, and the previous register value otherwise.
+ */
+static int alps_command_mode_update_reg(struct psmouse *psmouse, int addr,
+					u8 mask, u8 bits)
+{
+	struct alps_data *priv = psmouse->private;
+	struct alps_reg_cache_entry *entry = alps_reg_cache_find(priv, addr);
+	int reg_val;
+	u8 value;
+
+	if (entry) {
+		priv->reg_cache_hits++;
+		reg_val = entry->value;
+		value = (reg_val & ~mask) | bits;
+		if (alps_command_mode_write_reg(psmouse, addr, value))
+			return -1;
+		return reg_val;
+	}
+
+	priv->reg_cache_misses++;
+	reg_val = alps_command_mode_read_reg(psmouse, addr);
+	if (reg_val < 0)
+		return -1;
+
+	value = (reg_val & ~mask) | bits;
+	if (__alps_command_mode_write_reg(psmouse, addr, value, false))
 		return -1;
-	return __alps_command_mode_write_reg(psmouse, value);
+
+	alps_reg_cache_store(priv, addr, value, false);
+	return reg_val;
 }
 
 
@@ -1125,16 +1483,12 @@ static int alps_command_mode_check_reg(struct psmouse * psmouse, int addr, u8 va
  * Return -1 on error, and the previous register value otherwise */
 static int alps_command_mode_checkset_reg(struct psmouse * psmouse, int addr, u8 value)
 {
-        int reg_val = alps_command_mode_read_reg(psmouse, addr);
+        int reg_val = alps_command_mode_update_reg(psmouse, addr, 0xff, value);
         if (reg_val < 0) {
-                psmouse_err(psmouse, "register %04x: cannot set address", addr);
-                return -1;
-        }
-        psmouse_info(psmouse, "register %04x: previous value %2.2x, now setting %2.2x", addr, reg_val, value);
-        if (__alps_command_mode_write_reg(psmouse, value)) {
-                psmouse_info(psmouse, "register %04x: error setting value %2.2x", addr, value);
+                psmouse_err(psmouse, "register %04x: error setting value %2.2x", addr, value);
                 return -1;
         }
+        psmouse_info(psmouse, "register %04x: previous value %2.2x, now set to %2.2x", addr, reg_val, value);
         return reg_val;
 }
 
@@ -1142,12 +1496,11 @@ static int alps_enter_command_mode(struct psmouse *psmouse,
 				   unsigned char *resp)
 {
 	unsigned char param[4];
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 
-	if (ps2_command(ps2dev, NULL, PSMOUSE_CMD_RESET_WRAP) ||
-	    ps2_command(ps2dev, NULL, PSMOUSE_CMD_RESET_WRAP) ||
-	    ps2_command(ps2dev, NULL, PSMOUSE_CMD_RESET_WRAP) ||
-	    ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO)) {
+	if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_RESET_WRAP) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_RESET_WRAP) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_RESET_WRAP) ||
+	    psmouse_command(psmouse, param, PSMOUSE_CMD_GETINFO)) {
 		psmouse_err(psmouse, "failed to enter command mode\n");
 		return -1;
 	}
@@ -1174,28 +1527,26 @@ static int alps_enter_command_mode(struct psmouse *psmouse,
 
 static inline int alps_exit_command_mode(struct psmouse *psmouse)
 {
-        struct ps2dev *ps2dev = &psmouse->ps2dev;
-        if (ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSTREAM))
+        if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSTREAM))
                 return -1;
         return 0;
 }
 
 static int alps_get_e6_report(struct psmouse *psmouse, unsigned char param[])
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
         /* FIXME. Is the setres(0) really important ? Unclear. */
         param[0] = 0;
-        if (ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES) ||
-            ps2_command(ps2dev,	 NULL, PSMOUSE_CMD_SETSCALE11) ||
-            ps2_command(ps2dev,	 NULL, PSMOUSE_CMD_SETSCALE11) ||
-            ps2_command(ps2dev,	 NULL, PSMOUSE_CMD_SETSCALE11))
+        if (psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES) ||
+            psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11) ||
+            psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11) ||
+            psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11))
         {
                 psmouse_info(psmouse, "E6 report: failed");
                 return -1;
         }
         param[0] = param[1] = param[2] = 0xff;
 
-        if (ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO)) {
+        if (psmouse_command(psmouse, param, PSMOUSE_CMD_GETINFO)) {
                 psmouse_info(psmouse, "E6 report: failed");
         } else {
                 psmouse_info(psmouse, "E6 report: %2.2x %2.2x %2.2x",
@@ -1206,21 +1557,20 @@ static int alps_get_e6_report(struct psmouse *psmouse, unsigned char param[])
 
 static int alps_get_e7_report(struct psmouse *psmouse, unsigned char param[])
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
         /* FIXME. Some call locations have a setres(0) here interpreted
          * as being part of the command. Judging by traces from the
          * windows driver, it is unclear.
          */
-        if (ps2_command(ps2dev,	 NULL, PSMOUSE_CMD_SETSCALE21) ||
-            ps2_command(ps2dev,	 NULL, PSMOUSE_CMD_SETSCALE21) ||
-            ps2_command(ps2dev,	 NULL, PSMOUSE_CMD_SETSCALE21))
+        if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE21) ||
+            psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE21) ||
+            psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE21))
         {
                 psmouse_info(psmouse, "E7 report: failed");
                 return -1;
         }
         param[0] = param[1] = param[2] = 0xff;
 
-        if (ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO)) {
+        if (psmouse_command(psmouse, param, PSMOUSE_CMD_GETINFO)) {
                 psmouse_info(psmouse, "E7 report: failed");
         } else {
                 psmouse_info(psmouse, "E7 report: %2.2x %2.2x %2.2x",
@@ -1231,7 +1581,6 @@ static int alps_get_e7_report(struct psmouse *psmouse, unsigned char param[])
 
 static const struct alps_model_info *alps_get_model(struct psmouse *psmouse, int *version)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	static const unsigned char rates[] = { 0, 10, 20, 40, 60, 80, 100, 200 };
 	unsigned char param[4];
 	const struct alps_model_info *model = NULL;
@@ -1258,7 +1607,7 @@ static const struct alps_model_info *alps_get_model(struct psmouse *psmouse, int
          * keeping it. After all, it's perhaps innocuous.
          */
 	param[0] = 0;
-	if (ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES))
+	if (psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES))
             return NULL;
         alps_get_e7_report(psmouse, param);
 
@@ -1317,13 +1666,12 @@ static const struct alps_model_info *alps_get_model(struct psmouse *psmouse, int
  */
 static int alps_passthrough_mode_v2(struct psmouse *psmouse, bool enable)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	int cmd = enable ? PSMOUSE_CMD_SETSCALE21 : PSMOUSE_CMD_SETSCALE11;
 
-	if (ps2_command(ps2dev, NULL, cmd) ||
-	    ps2_command(ps2dev, NULL, cmd) ||
-	    ps2_command(ps2dev, NULL, cmd) ||
-	    ps2_command(ps2dev, NULL, PSMOUSE_CMD_DISABLE))
+	if (psmouse_command(psmouse, NULL, cmd) ||
+	    psmouse_command(psmouse, NULL, cmd) ||
+	    psmouse_command(psmouse, NULL, cmd) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE))
 		return -1;
 
 	/* we may get 3 more bytes, just ignore them */
@@ -1334,32 +1682,28 @@ static int alps_passthrough_mode_v2(struct psmouse *psmouse, bool enable)
 
 static int alps_absolute_mode_v1_v2(struct psmouse *psmouse)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
-
 	/* Try ALPS magic knock - 4 disable before enable */
-	if (ps2_command(ps2dev, NULL, PSMOUSE_CMD_DISABLE) ||
-	    ps2_command(ps2dev, NULL, PSMOUSE_CMD_DISABLE) ||
-	    ps2_command(ps2dev, NULL, PSMOUSE_CMD_DISABLE) ||
-	    ps2_command(ps2dev, NULL, PSMOUSE_CMD_DISABLE) ||
-	    ps2_command(ps2dev, NULL, PSMOUSE_CMD_ENABLE))
+	if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_ENABLE))
 		return -1;
 
 	/*
 	 * Switch mouse to poll (remote) mode so motion data will not
 	 * get in our way
 	 */
-	return ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_SETPOLL);
+	return psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETPOLL);
 }
 
 static int alps_get_status(struct psmouse *psmouse, char *param)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
-
 	/* Get status: 0xF5 0xF5 0xF5 0xE9 */
-	if (ps2_command(ps2dev, NULL, PSMOUSE_CMD_DISABLE) ||
-	    ps2_command(ps2dev, NULL, PSMOUSE_CMD_DISABLE) ||
-	    ps2_command(ps2dev, NULL, PSMOUSE_CMD_DISABLE) ||
-	    ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO))
+	if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE) ||
+	    psmouse_command(psmouse, param, PSMOUSE_CMD_GETINFO))
 		return -1;
 
 	psmouse_dbg(psmouse, "Status: %2.2x %2.2x %2.2x",
@@ -1379,15 +1723,14 @@ static int alps_get_status(struct psmouse *psmouse, char *param)
  */
 static int alps_tap_mode(struct psmouse *psmouse, int enable)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	int cmd = enable ? PSMOUSE_CMD_SETRATE : PSMOUSE_CMD_SETRES;
 	unsigned char tap_arg = enable ? 0x0A : 0x00;
 	unsigned char param[4];
 
-	if (ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO) ||
-	    ps2_command(ps2dev, NULL, PSMOUSE_CMD_DISABLE) ||
-	    ps2_command(ps2dev, NULL, PSMOUSE_CMD_DISABLE) ||
-	    ps2_command(ps2dev, &tap_arg, cmd))
+	if (psmouse_command(psmouse, param, PSMOUSE_CMD_GETINFO) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE) ||
+	    psmouse_command(psmouse, &tap_arg, cmd))
 		return -1;
 
 	if (alps_get_status(psmouse, param))
@@ -1403,26 +1746,39 @@ static int alps_tap_mode(struct psmouse *psmouse, int enable)
 static int alps_poll(struct psmouse *psmouse)
 {
 	struct alps_data *priv = psmouse->private;
+	const struct alps_model_info *model = priv->i;
 	unsigned char buf[sizeof(psmouse->packet)];
+	bool legacy = model->proto_version <= ALPS_PROTO_V2;
 	bool poll_failed;
 
-	if (priv->i->flags & ALPS_PASS)
+	/*
+	 * Whatever half of a multi-packet sequence we were holding on
+	 * to is stale now; the polled packet starts from scratch.
+	 */
+	priv->multi_packet = 0;
+
+	if (legacy && (model->flags & ALPS_PASS))
 		alps_passthrough_mode_v2(psmouse, true);
 
-	poll_failed = ps2_command(&psmouse->ps2dev, buf,
-				  PSMOUSE_CMD_POLL | (psmouse->pktsize << 8)) < 0;
+	poll_failed = psmouse_command(psmouse, buf,
+				      PSMOUSE_CMD_POLL | (psmouse->pktsize << 8)) < 0;
 
-	if (priv->i->flags & ALPS_PASS)
+	if (legacy && (model->flags & ALPS_PASS))
 		alps_passthrough_mode_v2(psmouse, false);
 
-	if (poll_failed || (buf[0] & priv->i->mask0) != priv->i->byte0)
+	if (poll_failed || !alps_is_valid_first_byte(model, buf[0]))
 		return -1;
 
-	if ((psmouse->badbyte & 0xc8) == 0x08) {
+	/*
+	 * V3 and later report trackstick data in their own 6-byte
+	 * packets (packet[5] == 0x3f), which the poll above returns and
+	 * the protocol handler decodes like any other packet.
+	 */
+	if (legacy && (psmouse->badbyte & 0xc8) == 0x08) {
 /*
  * Poll the track stick ...
  */
-		if (ps2_command(&psmouse->ps2dev, buf, PSMOUSE_CMD_POLL | (3 << 8)))
+		if (psmouse_command(psmouse, buf, PSMOUSE_CMD_POLL | (3 << 8)))
 			return -1;
 	}
 
@@ -1456,7 +1812,7 @@ static int alps_hw_init_v1_v2(struct psmouse *psmouse)
 	}
 
 	/* ALPS needs stream mode, otherwise it won't report any data */
-	if (ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_SETSTREAM)) {
+	if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSTREAM)) {
 		psmouse_err(psmouse, "Failed to enable stream mode\n");
 		return -1;
 	}
@@ -1472,35 +1828,10 @@ static int alps_passthrough_mode_v3_v5(struct psmouse *psmouse, bool enable)
 {
 	struct alps_data *priv = psmouse->private;
 	const struct alps_model_info *model = priv->i;
-	int reg_val;
         int reg_base = (model->proto_version == ALPS_PROTO_V5) ? 0xc2c0 : 0;
 
-	reg_val = alps_command_mode_read_reg(psmouse, reg_base + 0x8);
-	if (reg_val == -1)
-		return -1;
-
-	if (enable)
-		reg_val |= 0x01;
-	else
-		reg_val &= ~0x01;
-
-	if (__alps_command_mode_write_reg(psmouse, reg_val))
-		return -1;
-
-	return 0;
-}
-
-/* Must be in command mode when calling this function */
-static int alps_absolute_mode_v3(struct psmouse *psmouse)
-{
-	int reg_val;
-
-	reg_val = alps_command_mode_read_reg(psmouse, 0x0004);
-	if (reg_val == -1)
-		return -1;
-
-	reg_val |= 0x06;
-	if (__alps_command_mode_write_reg(psmouse, reg_val))
+	if (alps_command_mode_update_reg(psmouse, reg_base + 0x8,
+					 0x01, enable ? 0x01 : 0x00) < 0)
 		return -1;
 
 	return 0;
@@ -1508,7 +1839,6 @@ static int alps_absolute_mode_v3(struct psmouse *psmouse)
 
 static int alps_e6_sort_of_setmode(struct psmouse * psmouse, u8 byte)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
         /*
          * Not sure what this does, but it is absolutely essential for V3
          * and V5.  Without it, the touchpad does not work at all and the
@@ -1520,9 +1850,9 @@ static int alps_e6_sort_of_setmode(struct psmouse * psmouse, u8 byte)
          *
          * The relationship with E6 lies in the SETSCALE11^3 sequence.
          */
-        if (ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSCALE11) ||
-            ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSCALE11) ||
-            ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSCALE11) ||
+        if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11) ||
+            psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11) ||
+            psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11) ||
             alps_command_mode_send_nibble(psmouse, (byte>>4)) ||
             alps_command_mode_send_nibble(psmouse, byte & 0xf))
         {
@@ -1535,11 +1865,10 @@ static int alps_e6_sort_of_setmode(struct psmouse * psmouse, u8 byte)
 static int alps_set_rate_and_enable(struct psmouse * psmouse, u8 rate)
 {
         /* Set rate and enable data reporting */
-        struct ps2dev *ps2dev = &psmouse->ps2dev;
         unsigned char param[4];
-        param[0] = 0x64;
-        if (ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE) ||
-            ps2_command(ps2dev, NULL, PSMOUSE_CMD_ENABLE))
+        param[0] = rate;
+        if (psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE) ||
+            psmouse_command(psmouse, NULL, PSMOUSE_CMD_ENABLE))
         {
 		psmouse_err(psmouse, "Failed to enable data reporting\n");
                 return -1;
@@ -1547,6 +1876,154 @@ static int alps_set_rate_and_enable(struct psmouse * psmouse, u8 rate)
         return 0;
 }
 
+static bool alps_init_skip_optional;
+module_param_named(alps_init_skip_optional, alps_init_skip_optional, bool, 0644);
+MODULE_PARM_DESC(alps_init_skip_optional,
+		 "Skip ALPS init steps marked as optional (for testing).");
+
+static const char * const alps_init_op_names[] = {
+	[ALPS_INIT_CMD]			= "cmd",
+	[ALPS_INIT_NIBBLE]		= "nibble",
+	[ALPS_INIT_RESET]		= "reset",
+	[ALPS_INIT_ENTER_CMD_MODE]	= "enter_cmd_mode",
+	[ALPS_INIT_EXIT_CMD_MODE]	= "exit_cmd_mode",
+	[ALPS_INIT_E6_REPORT]		= "e6_report",
+	[ALPS_INIT_E7_REPORT]		= "e7_report",
+	[ALPS_INIT_WRITE_REG]		= "write_reg",
+	[ALPS_INIT_UPDATE_REG]		= "update_reg",
+	[ALPS_INIT_CHECKSET_REG]	= "checkset_reg",
+	[ALPS_INIT_RATE_ENABLE]		= "rate_enable",
+	[ALPS_INIT_CALL]		= "call",
+};
+
+static int alps_init_step_cmd(struct psmouse *psmouse,
+			      const struct alps_init_step *step)
+{
+	unsigned char param[4];
+	int nrecv = (step->command >> 8) & 0xf;
+
+	memcpy(param, step->param, sizeof(step->param));
+	if (psmouse_command(psmouse, param, step->command))
+		return -1;
+
+	if ((step->flags & ALPS_STEP_EXPECT) &&
+	    memcmp(param, step->param, min(nrecv, 3)))
+		psmouse_info(psmouse,
+			     "command %04x: got %2.2x %2.2x %2.2x, expected %2.2x %2.2x %2.2x\n",
+			     step->command, param[0], param[1], param[2],
+			     step->param[0], step->param[1], step->param[2]);
+
+	return 0;
+}
+
+static int alps_init_step_exec(struct psmouse *psmouse,
+			       const struct alps_init_step *step)
+{
+	unsigned char param[4];
+
+	switch (step->op) {
+	case ALPS_INIT_CMD:
+		return alps_init_step_cmd(psmouse, step);
+	case ALPS_INIT_NIBBLE:
+		return alps_command_mode_send_nibble(psmouse, step->command);
+	case ALPS_INIT_RESET:
+		return psmouse_reset(psmouse);
+	case ALPS_INIT_ENTER_CMD_MODE:
+		return alps_enter_command_mode(psmouse, NULL);
+	case ALPS_INIT_EXIT_CMD_MODE:
+		return alps_exit_command_mode(psmouse);
+	case ALPS_INIT_E6_REPORT:
+		return alps_get_e6_report(psmouse, param);
+	case ALPS_INIT_E7_REPORT:
+		return alps_get_e7_report(psmouse, param);
+	case ALPS_INIT_WRITE_REG:
+		return alps_command_mode_write_reg(psmouse, step->command,
+						   step->param[0]);
+	case ALPS_INIT_UPDATE_REG:
+		return alps_command_mode_update_reg(psmouse, step->command,
+						    step->param[0],
+						    step->param[1]) < 0 ? -1 : 0;
+	case ALPS_INIT_CHECKSET_REG:
+		return alps_command_mode_checkset_reg(psmouse, step->command,
+						      step->param[0]) < 0 ? -1 : 0;
+	case ALPS_INIT_RATE_ENABLE:
+		return alps_set_rate_and_enable(psmouse, step->param[0]);
+	case ALPS_INIT_CALL:
+		return step->fn(psmouse);
+	}
+
+	return -1;
+}
+
+/*
+ * Run an initialization sequence. The first failing step which is not
+ * marked ALPS_STEP_NOFAIL aborts the sequence; if the touchpad was left
+ * in command mode we leave it, since staying there would render the
+ * touchpad unusable until the machine reboots. Every step is timed and
+ * reported through the alps_init_step tracepoint, so that optional
+ * steps can be measured before they are pruned.
+ */
+static int alps_run_init_seq(struct psmouse *psmouse, const char *name,
+			     const struct alps_init_step *seq, int len)
+{
+	const struct alps_init_step *step;
+	bool command_mode = false;
+	u64 start, step_start;
+	int i, error, skipped = 0, ignored = 0;
+
+	start = local_clock();
+
+	for (i = 0; i < len; i++) {
+		step = &seq[i];
+
+		if ((step->flags & ALPS_STEP_OPTIONAL) &&
+		    alps_init_skip_optional) {
+			trace_alps_init_step(psmouse, name, i,
+					     alps_init_op_names[step->op],
+					     step->command, true, 0, 0);
+			skipped++;
+			continue;
+		}
+
+		step_start = local_clock();
+		error = alps_init_step_exec(psmouse, step);
+		trace_alps_init_step(psmouse, name, i,
+				     alps_init_op_names[step->op],
+				     step->command, false, error,
+				     local_clock() - step_start);
+
+		/* A failed enter may still have left us in command mode */
+		if (step->op == ALPS_INIT_ENTER_CMD_MODE)
+			command_mode = true;
+		else if (step->op == ALPS_INIT_EXIT_CMD_MODE)
+			command_mode = false;
+
+		if (error && !(step->flags & ALPS_STEP_NOFAIL)) {
+			psmouse_err(psmouse, "%s init: step %d (%s %04x) failed\n",
+				    name, i, alps_init_op_names[step->op],
+				    step->command);
+			if (command_mode)
+				alps_exit_command_mode(psmouse);
+			return -1;
+		}
+
+		if (error) {
+			psmouse_dbg(psmouse,
+				    "%s init: step %d (%s %04x) failed, ignored\n",
+				    name, i, alps_init_op_names[step->op],
+				    step->command);
+			ignored++;
+		}
+	}
+
+	psmouse_dbg(psmouse,
+		    "%s init: %d steps (%d skipped, %d failed) in %llu us\n",
+		    name, len, skipped, ignored,
+		    div_u64(local_clock() - start, NSEC_PER_USEC));
+
+	return 0;
+}
+
 /* This does the common trackstick-related part of the initialization for
  * v3 and v5 touchpads.  This function must be called from command mode,
  * but leaves it temporarily.
@@ -1561,7 +2038,7 @@ static int alps_hw_init_v3_v5_trackstick_stuff(struct psmouse *psmouse)
         int z = 0;
 
 	/* Check for trackstick */
-	reg_val = alps_command_mode_read_reg(psmouse, reg_base + 0x8);
+	reg_val = alps_command_mode_read_reg_cached(psmouse, reg_base + 0x8);
 	if (reg_val == -1)
                 return -1;
 
@@ -1619,86 +2096,84 @@ error_passthrough:
         return -1;
 }
 
+static const struct alps_init_step alps_v3_init_seq[] = {
+	{ ALPS_INIT_ENTER_CMD_MODE },
+	{ ALPS_INIT_CALL, .fn = alps_hw_init_v3_v5_trackstick_stuff },
+	/* Absolute mode */
+	{ ALPS_INIT_UPDATE_REG,		0, 0x0004, { 0x00, 0x06 } },
+	{ ALPS_INIT_UPDATE_REG,		0, 0x0006, { 0x00, 0x01 } },
+	{ ALPS_INIT_UPDATE_REG,		0, 0x0007, { 0x00, 0x01 } },
+	{ ALPS_INIT_CHECKSET_REG,	0, 0x0144, { 0x04 } },
+	{ ALPS_INIT_CHECKSET_REG,	0, 0x0159, { 0x03 } },
+	{ ALPS_INIT_CHECKSET_REG,	0, 0x0163, { 0x03 } },
+	{ ALPS_INIT_CHECKSET_REG,	0, 0x0162, { 0x04 } },
+	/*
+	 * This ensures the trackstick packets are in the format
+	 * supported by this driver. If bit 1 isn't set the packet
+	 * format is different.
+	 *
+	 * FIXME I doubt that this is correct when there is no
+	 * trackstick. If there is one, the register below has
+	 * already been set in the trackstick init code. On my
+	 * dell e6230 which has v5 format and no trackstick,
+	 * setting c2c8 to 0x82 has no effect (and is useless,
+	 * but does no harm).
+	 */
+	{ ALPS_INIT_WRITE_REG,		0, 0x0008, { 0x82 } },
+	{ ALPS_INIT_EXIT_CMD_MODE },
+	{ ALPS_INIT_RATE_ENABLE,	0, 0, { 0x64 } },
+};
+
+static const struct alps_init_step alps_v5_init_seq[] = {
+	{ ALPS_INIT_ENTER_CMD_MODE },
+	{ ALPS_INIT_CALL, .fn = alps_hw_init_v3_v5_trackstick_stuff },
+	{ ALPS_INIT_WRITE_REG,		0, 0xc2c4, { 0x02 } },
+	/* windows code also checks c2d9 being 0 */
+	{ ALPS_INIT_WRITE_REG,		0, 0xc2cb, { 0x00 } },
+	{ ALPS_INIT_EXIT_CMD_MODE },
+	{ ALPS_INIT_RATE_ENABLE,	0, 0, { 0x64 } },
+};
+
 static int alps_hw_init_v3_v5(struct psmouse *psmouse)
 {
 	struct alps_data *priv = psmouse->private;
-	int reg_val;
 	const struct alps_model_info *model = priv->i;
-        int z = 0;      /* error marker */
 
 	priv->nibble_commands = alps_v3_nibble_commands;
 	priv->addr_command = PSMOUSE_CMD_RESET_WRAP;
 
-	if (alps_enter_command_mode(psmouse, NULL))
-                return -1;
-        if (alps_hw_init_v3_v5_trackstick_stuff(psmouse)) {
-                alps_exit_command_mode(psmouse);
-                return -1;
-	}
+	if (model->proto_version == ALPS_PROTO_V3)
+		return alps_run_init_seq(psmouse, "v3", alps_v3_init_seq,
+					 ARRAY_SIZE(alps_v3_init_seq));
 
-        if (model->proto_version == ALPS_PROTO_V3) {
-                z = z || alps_absolute_mode_v3(psmouse);
-                reg_val = alps_command_mode_read_reg(psmouse, 0x0006);
-                z = z || reg_val < 0;
-                z = z || __alps_command_mode_write_reg(psmouse, reg_val | 0x01);
-
-                reg_val = alps_command_mode_read_reg(psmouse, 0x0007);
-                z = z || reg_val < 0;
-                z = z || __alps_command_mode_write_reg(psmouse, reg_val | 0x01);
-
-                z = z || alps_command_mode_checkset_reg(psmouse, 0x0144, 0x04);
-                z = z || alps_command_mode_checkset_reg(psmouse, 0x0159, 0x03);
-                z = z || alps_command_mode_checkset_reg(psmouse, 0x0163, 0x03);
-                z = z || alps_command_mode_checkset_reg(psmouse, 0x0162, 0x04);
-                /*
-                 * This ensures the trackstick packets are in the format
-                 * supported by this driver. If bit 1 isn't set the packet
-                 * format is different.
-                 *
-                 * FIXME I doubt that this is correct when there is no
-                 * trackstick. If there is one, the register below has
-                 * already been set in the trackstick init code. On my
-                 * dell e6230 which has v5 format and no trackstick,
-                 * setting c2c8 to 0x82 has no effect (and is useless,
-                 * but does no harm).
-                 */
-                z = z || alps_command_mode_write_reg(psmouse, 0x0008, 0x82);
-        } else {
-                z = z || alps_command_mode_write_reg(psmouse, 0xc2c4, 0x02);
-                // windows code also checks c2d9 being 0
-                z = z || alps_command_mode_write_reg(psmouse, 0xc2cb, 0x00);
-        }
+	return alps_run_init_seq(psmouse, "v5", alps_v5_init_seq,
+				 ARRAY_SIZE(alps_v5_init_seq));
+}
 
+static const struct alps_init_step alps_v4_init_seq[] = {
+	{ ALPS_INIT_ENTER_CMD_MODE },
+	/* Absolute mode */
+	{ ALPS_INIT_UPDATE_REG,		0, 0x0004, { 0x00, 0x02 } },
+	{ ALPS_INIT_WRITE_REG,		0, 0x0007, { 0x8c } },
+	{ ALPS_INIT_WRITE_REG,		0, 0x0149, { 0x03 } },
+	{ ALPS_INIT_WRITE_REG,		0, 0x0160, { 0x03 } },
+	{ ALPS_INIT_WRITE_REG,		0, 0x017f, { 0x15 } },
+	{ ALPS_INIT_WRITE_REG,		0, 0x0151, { 0x01 } },
+	{ ALPS_INIT_WRITE_REG,		0, 0x0168, { 0x03 } },
+	{ ALPS_INIT_WRITE_REG,		0, 0x014a, { 0x03 } },
+	{ ALPS_INIT_WRITE_REG,		0, 0x0161, { 0x03 } },
+	{ ALPS_INIT_EXIT_CMD_MODE,	ALPS_STEP_NOFAIL },
 	/*
-         * Leaving the touchpad in command mode will essentially render
-         * it unusable until the machine reboots, so we make the
-         * exit_command_mode call unconditional to be safe
+	 * This sequence changes the output from a 9-byte to an
+	 * 8-byte format. All the same data seems to be present,
+	 * just in a more compact format.
 	 */
-        z = alps_exit_command_mode(psmouse) || z;
-        if (z) return -1;
-
-	if (alps_set_rate_and_enable(psmouse, 0x64)) {
-		psmouse_err(psmouse, "Failed to enable data reporting\n");
-		return -1;
-	}
-	return 0;
-}
-
-/* Must be in command mode when calling this function */
-static int alps_absolute_mode_v4(struct psmouse *psmouse)
-{
-	int reg_val;
-
-	reg_val = alps_command_mode_read_reg(psmouse, 0x0004);
-	if (reg_val == -1)
-		return -1;
-
-	reg_val |= 0x02;
-	if (__alps_command_mode_write_reg(psmouse, reg_val))
-		return -1;
-
-	return 0;
-}
+	{ ALPS_INIT_NIBBLE,		0, 0x9 },
+	{ ALPS_INIT_NIBBLE,		0, 0x8 },
+	{ ALPS_INIT_NIBBLE,		0, 0x7 },
+	{ ALPS_INIT_NIBBLE,		0, 0xa },
+	{ ALPS_INIT_RATE_ENABLE,	0, 0, { 0x64 } },
+};
 
 static int alps_hw_init_v4(struct psmouse *psmouse)
 {
@@ -1707,174 +2182,119 @@ static int alps_hw_init_v4(struct psmouse *psmouse)
 	priv->nibble_commands = alps_v4_nibble_commands;
 	priv->addr_command = PSMOUSE_CMD_DISABLE;
 
-	if (alps_enter_command_mode(psmouse, NULL))
-		goto error;
-
-	if (alps_absolute_mode_v4(psmouse)) {
-		psmouse_err(psmouse, "Failed to enter absolute mode\n");
-		goto error;
-	}
-
-	if (alps_command_mode_write_reg(psmouse, 0x0007, 0x8c))
-		goto error;
+	return alps_run_init_seq(psmouse, "v4", alps_v4_init_seq,
+				 ARRAY_SIZE(alps_v4_init_seq));
+}
 
-	if (alps_command_mode_write_reg(psmouse, 0x0149, 0x03))
-		goto error;
+/*
+ * The V6 sequence is replayed from captures of the windows driver; we
+ * have no idea which parts of it matter, so all errors are ignored.
+ */
+#define V6_STEP(op, flags, ...)	{ op, (flags) | ALPS_STEP_NOFAIL, __VA_ARGS__ }
 
-	if (alps_command_mode_write_reg(psmouse, 0x0160, 0x03))
-		goto error;
+static const struct alps_init_step alps_v6_init_seq[] = {
+	{ ALPS_INIT_RESET },
 
-	if (alps_command_mode_write_reg(psmouse, 0x017f, 0x15))
-		goto error;
+	/*
+	 * The sequence below leads me to think that we can probably
+	 * jump-start on after the reset which ends it.
+	 */
+	V6_STEP(ALPS_INIT_NIBBLE,	ALPS_STEP_OPTIONAL, 0xa),
+	V6_STEP(ALPS_INIT_E6_REPORT,	ALPS_STEP_OPTIONAL),
+	V6_STEP(ALPS_INIT_NIBBLE,	ALPS_STEP_OPTIONAL, 0xe),
+	V6_STEP(ALPS_INIT_NIBBLE,	ALPS_STEP_OPTIONAL, 0x9),
+	V6_STEP(ALPS_INIT_NIBBLE,	ALPS_STEP_OPTIONAL, 0x8),
+	V6_STEP(ALPS_INIT_NIBBLE,	ALPS_STEP_OPTIONAL, 0x7),
+	V6_STEP(ALPS_INIT_NIBBLE,	ALPS_STEP_OPTIONAL, 0xa),
+	V6_STEP(ALPS_INIT_NIBBLE,	ALPS_STEP_OPTIONAL, 0x9),
+	V6_STEP(ALPS_INIT_NIBBLE,	ALPS_STEP_OPTIONAL, 0x9),
+	V6_STEP(ALPS_INIT_NIBBLE,	ALPS_STEP_OPTIONAL, 0x7),
+	V6_STEP(ALPS_INIT_NIBBLE,	ALPS_STEP_OPTIONAL, 0xa),
+	V6_STEP(ALPS_INIT_NIBBLE,	ALPS_STEP_OPTIONAL, 0x8),
+	V6_STEP(ALPS_INIT_NIBBLE,	ALPS_STEP_OPTIONAL, 0xf),
+	V6_STEP(ALPS_INIT_CMD,		ALPS_STEP_OPTIONAL, PSMOUSE_CMD_ENABLE),
+	V6_STEP(ALPS_INIT_CMD,		ALPS_STEP_OPTIONAL, PSMOUSE_CMD_DISABLE),
+	V6_STEP(ALPS_INIT_RESET,	ALPS_STEP_OPTIONAL),
+	V6_STEP(ALPS_INIT_E7_REPORT,	0),
 
-	if (alps_command_mode_write_reg(psmouse, 0x0151, 0x01))
-		goto error;
+	/* This enter/exit sequence is quite probably useless */
+	V6_STEP(ALPS_INIT_ENTER_CMD_MODE, ALPS_STEP_OPTIONAL),
+	V6_STEP(ALPS_INIT_EXIT_CMD_MODE, ALPS_STEP_OPTIONAL),
 
-	if (alps_command_mode_write_reg(psmouse, 0x0168, 0x03))
-		goto error;
+	/* The real v6 init probably begins here */
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETPOLL),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETPOLL),
+	V6_STEP(ALPS_INIT_CMD,	ALPS_STEP_EXPECT, PSMOUSE_CMD_GETINFO,
+		{ 0xbf, 0x1a, 0x04 }),
 
-	if (alps_command_mode_write_reg(psmouse, 0x014a, 0x03))
-		goto error;
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETSTREAM),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETSTREAM),
+	V6_STEP(ALPS_INIT_CMD,	ALPS_STEP_EXPECT, PSMOUSE_CMD_GETINFO,
+		{ 0x89, 0x95, 0x84 }),
 
-	if (alps_command_mode_write_reg(psmouse, 0x0161, 0x03))
-		goto error;
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETPOLL),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETPOLL),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETRATE, { 0x28 }),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETRATE, { 0x50 }),
 
-	alps_exit_command_mode(psmouse);
+	V6_STEP(ALPS_INIT_ENTER_CMD_MODE, 0),
+	V6_STEP(ALPS_INIT_WRITE_REG,	0, 0x001f, { 0x08 }),
 
 	/*
-	 * This sequence changes the output from a 9-byte to an
-	 * 8-byte format. All the same data seems to be present,
-	 * just in a more compact format.
+	 * The next sequence would be close to setting register 0x228 to
+	 * 0x00, except that we're missing one nibble on the register set
+	 * part....
 	 */
-        if (alps_command_mode_send_nibble(psmouse, 0x9) ||
-            alps_command_mode_send_nibble(psmouse, 0x8) ||
-            alps_command_mode_send_nibble(psmouse, 0x7) ||
-            alps_command_mode_send_nibble(psmouse, 0xa))
-		return -1;
-
-	if (alps_set_rate_and_enable(psmouse, 0x64)) {
-		psmouse_err(psmouse, "Failed to enable data reporting\n");
-		return -1;
-	}
-
-
-	return 0;
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_RESET_WRAP),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETPOLL),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETSCALE21),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETSCALE21),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETRATE, { 0x64 }),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETPOLL),
+
+	V6_STEP(ALPS_INIT_EXIT_CMD_MODE, 0),
+
+	/* This sequence looks very weird */
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_DISABLE),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETSTREAM),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETSTREAM),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETRATE, { 0x64 }),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETRATE, { 0x28 }),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETSTREAM),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETSTREAM),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETRATE, { 0x50 }),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETRATE, { 0x0a }),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETSTREAM),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETRATE, { 0x50 }),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETSCALE11),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_SETRES, { 0x03 }),
+	V6_STEP(ALPS_INIT_CMD,	0, PSMOUSE_CMD_ENABLE),
+};
 
-error:
-	/*
-	 * Leaving the touchpad in command mode will essentially render
-	 * it unusable until the machine reboots, so exit it here just
-	 * to be safe
-	 */
-	alps_exit_command_mode(psmouse);
-	return -1;
-}
+#undef V6_STEP
 
 static int alps_hw_init_v6(struct psmouse *psmouse)
 {
 	struct alps_data *priv = psmouse->private;
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
-	unsigned char param[4];
 
 	priv->nibble_commands = alps_v3_nibble_commands;
 	priv->addr_command = PSMOUSE_CMD_RESET_WRAP;
 
-        if (psmouse_reset(psmouse))
-                return -1;
-
-        alps_command_mode_send_nibble(psmouse, 0xa);
-        alps_get_e6_report(psmouse, param);
-        alps_command_mode_send_nibble(psmouse, 0xe);
-        alps_command_mode_send_nibble(psmouse, 0x9);
-        alps_command_mode_send_nibble(psmouse, 0x8);
-        alps_command_mode_send_nibble(psmouse, 0x7);
-        alps_command_mode_send_nibble(psmouse, 0xa);
-        alps_command_mode_send_nibble(psmouse, 0x9);
-        alps_command_mode_send_nibble(psmouse, 0x9);
-        alps_command_mode_send_nibble(psmouse, 0x7);
-        alps_command_mode_send_nibble(psmouse, 0xa);
-        alps_command_mode_send_nibble(psmouse, 0x8);
-        alps_command_mode_send_nibble(psmouse, 0xf);
-
-        /* The sequence below leads me to think that we can probably
-         * jump-start on after the reset below */
-        ps2_command(ps2dev, NULL, PSMOUSE_CMD_ENABLE);
-        ps2_command(ps2dev, NULL, PSMOUSE_CMD_DISABLE);
-        psmouse_reset(psmouse);
-        alps_get_e7_report(psmouse, param);
-
-	/* This enter/exit sequence is quite probably useless */
-	alps_enter_command_mode(psmouse, param);
-        alps_exit_command_mode(psmouse);
-
-        /* The real v6 init probably begins here */
-
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETPOLL);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETPOLL);
-	ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO);
-	/* param should be bf 1a 04 */
-
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSTREAM);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSTREAM);
-	ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO);
-	/* param should be 89 95 84 */
-
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETPOLL);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETPOLL);
-	param[0] = 0x28;
-	param[1] = 0x50;
-	ps2_command(ps2dev, &param[0], PSMOUSE_CMD_SETRATE);
-	ps2_command(ps2dev, &param[1], PSMOUSE_CMD_SETRATE);
-
-	/* Enter command mode */
-	alps_enter_command_mode(psmouse, param);
-
-        alps_command_mode_write_reg(psmouse, 0x001f, 0x08);
-
-        /* The next sequence would be close to setting register 0x228 to
-         * 0x00, except that we're missing one nibble on the register set
-         * part....*/
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_RESET_WRAP);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETPOLL);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSCALE21);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSCALE21);
-	param[0] = 0x64;
-	ps2_command(ps2dev, &param[0], PSMOUSE_CMD_SETRATE);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETPOLL);
-
-        alps_exit_command_mode(psmouse);
-
-        /* This sequence looks very weird */
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_DISABLE);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSTREAM);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSTREAM);
-	param[0] = 0x64;
-	param[1] = 0x28;
-	ps2_command(ps2dev, &param[0], PSMOUSE_CMD_SETRATE);
-	ps2_command(ps2dev, &param[1], PSMOUSE_CMD_SETRATE);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSTREAM);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSTREAM);
-	param[0] = 0x50;
-	param[1] = 0x0a;
-	ps2_command(ps2dev, &param[0], PSMOUSE_CMD_SETRATE);
-	ps2_command(ps2dev, &param[1], PSMOUSE_CMD_SETRATE);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSTREAM);
-	param[0] = 0x50;
-	ps2_command(ps2dev, &param[0], PSMOUSE_CMD_SETRATE);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSCALE11);
-	param[0] = 0x03;
-	ps2_command(ps2dev, &param[0], PSMOUSE_CMD_SETRES);
-	ps2_command(ps2dev, NULL, PSMOUSE_CMD_ENABLE);
-
-	return 0;
+	return alps_run_init_seq(psmouse, "v6", alps_v6_init_seq,
+				 ARRAY_SIZE(alps_v6_init_seq));
 }
 
 static int alps_hw_init(struct psmouse *psmouse)
 {
 	struct alps_data *priv = psmouse->private;
 	const struct alps_model_info *model = priv->i;
+	unsigned long hits = priv->reg_cache_hits;
+	unsigned long misses = priv->reg_cache_misses;
 	int ret = -1;
 
+	/* We always get here right after the touchpad has been reset */
+	alps_reg_cache_revert(priv);
+
 	switch (model->proto_version) {
 	case ALPS_PROTO_V1:
 	case ALPS_PROTO_V2:
@@ -1892,15 +2312,143 @@ static int alps_hw_init(struct psmouse *psmouse)
 		break;
 	}
 
+	psmouse_dbg(psmouse, "register cache: %lu hits, %lu misses\n",
+		    priv->reg_cache_hits - hits,
+		    priv->reg_cache_misses - misses);
+
 	return ret;
 }
 
+static void alps_reset_decode_stats(struct alps_data *priv)
+{
+	priv->stats_start = jiffies;
+	priv->packets = 0;
+	priv->ps2_packets = 0;
+#ifdef ALPS_DECODE_TIMING
+	priv->decode_ns = 0;
+	priv->decode_ns_max = 0;
+#endif
+	priv->early_decisions = 0;
+	priv->latency_saved_us = 0;
+}
+
+/*
+ * Decoder statistics. These allow measuring the load of the packet path
+ * without enabling the packet debug output; decode times are only there
+ * with ALPS_DECODE_TIMING. Writing 0 resets them.
+ */
+static ssize_t alps_attr_show_decode_stats(struct psmouse *psmouse,
+					   void *data, char *buf)
+{
+	struct alps_data *priv = psmouse->private;
+	ssize_t len;
+
+	len = sprintf(buf,
+		      "protocol: %d\n"
+		      "elapsed_ms: %u\n"
+		      "packets: %lu\n"
+		      "ps2_packets: %lu\n"
+		      "byte_gap_us: %u\n"
+		      "early_decisions: %lu\n"
+		      "latency_saved_us: %llu\n",
+		      priv->i->proto_version + 1,
+		      jiffies_to_msecs(jiffies - priv->stats_start),
+		      priv->packets, priv->ps2_packets,
+		      (u32)(priv->byte_gap_ns / NSEC_PER_USEC),
+		      priv->early_decisions,
+		      (unsigned long long)priv->latency_saved_us);
+
+#ifdef ALPS_DECODE_TIMING
+	{
+		unsigned long total = priv->packets + priv->ps2_packets;
+
+		len += sprintf(buf + len,
+			       "ns_per_packet: %llu\n"
+			       "max_ns: %llu\n",
+			       total ? (unsigned long long)
+					div64_u64(priv->decode_ns, total) :
+					0ULL,
+			       (unsigned long long)priv->decode_ns_max);
+	}
+#endif
+
+	return len;
+}
+
+static ssize_t alps_attr_set_decode_stats(struct psmouse *psmouse,
+					  void *data, const char *buf,
+					  size_t count)
+{
+	unsigned long value;
+
+	if (strict_strtoul(buf, 10, &value) || value != 0)
+		return -EINVAL;
+
+	alps_reset_decode_stats(psmouse->private);
+	return count;
+}
+
+PSMOUSE_DEFINE_ATTR(decode_stats, S_IWUSR | S_IRUGO, NULL,
+		    alps_attr_show_decode_stats, alps_attr_set_decode_stats);
+
+/*
+ * Each hit is a register read (one GETINFO round trip) that was not
+ * sent to the touchpad during (re)initialization.
+ */
+static ssize_t alps_attr_show_reg_cache(struct psmouse *psmouse,
+					void *data, char *buf)
+{
+	struct alps_data *priv = psmouse->private;
+
+	return sprintf(buf, "hits: %lu\nmisses: %lu\nentries: %d\n",
+		       priv->reg_cache_hits, priv->reg_cache_misses,
+		       priv->reg_cache_count);
+}
+
+PSMOUSE_DEFINE_RO_ATTR(reg_cache, S_IRUGO, NULL, alps_attr_show_reg_cache);
+
+static struct attribute *alps_attributes[] = {
+	&psmouse_attr_decode_stats.dattr.attr,
+	&psmouse_attr_reg_cache.dattr.attr,
+	NULL
+};
+
+static struct attribute_group alps_attr_group = {
+	.attrs = alps_attributes,
+};
+
+/*
+ * Cheap identity check for reconnect: a single E7 report compared with
+ * the signature of the model found by alps_init. This skips the E6 report
+ * and the command mode round trip alps_get_model() needs to tell
+ * v3/v4/v6 models apart; the touchpad we resume is the one we identified
+ * at init, unless the E7 signature says otherwise.
+ */
+static bool alps_signature_matches(struct psmouse *psmouse)
+{
+	struct alps_data *priv = psmouse->private;
+	unsigned char param[4];
+
+	param[0] = 0;
+	if (psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES) ||
+	    alps_get_e7_report(psmouse, param))
+		return false;
+
+	return !memcmp(param, priv->i->signature, sizeof(priv->i->signature));
+}
+
 static int alps_reconnect(struct psmouse *psmouse)
 {
 	const struct alps_model_info *model;
 
 	psmouse_reset(psmouse);
 
+	if (alps_signature_matches(psmouse))
+		return alps_hw_init(psmouse);
+
+	psmouse_dbg(psmouse, "signature changed, doing full identification\n");
+	psmouse_reset(psmouse);
+
 	model = alps_get_model(psmouse, NULL);
 	if (!model)
 		return -1;
@@ -1912,6 +2460,7 @@ static void alps_disconnect(struct psmouse *psmouse)
 {
 	struct alps_data *priv = psmouse->private;
 
+	sysfs_remove_group(&psmouse->ps2dev.serio->dev.kobj, &alps_attr_group);
 	psmouse_reset(psmouse);
 	del_timer_sync(&priv->timer);
 	input_unregister_device(priv->dev2);
@@ -1924,6 +2473,7 @@ int alps_init(struct psmouse *psmouse)
 	const struct alps_model_info *model;
 	struct input_dev *dev1 = psmouse->dev, *dev2;
 	int version;
+	int error;
         
 	priv = kzalloc(sizeof(struct alps_data), GFP_KERNEL);
 	dev2 = input_allocate_device();
@@ -1975,64 +2525,71 @@ int alps_init(struct psmouse *psmouse)
 	case ALPS_PROTO_V4:
 		set_bit(INPUT_PROP_SEMI_MT, dev1->propbit);
 		input_mt_init_slots(dev1, 2);
-		ALPS_BITMAP_X_BITS = 15;
-		ALPS_BITMAP_Y_BITS = 11;
-		ALPS_X_MAX = 2000;
-		ALPS_Y_MAX = 1400;
+		priv->x_bits = 15;
+		priv->y_bits = 11;
+		priv->x_max = 2000;
+		priv->y_max = 1400;
 		input_set_abs_params(dev1,
-				     ABS_MT_POSITION_X, 0, ALPS_X_MAX, 0, 0);
+				     ABS_MT_POSITION_X, 0, priv->x_max, 0, 0);
 		input_set_abs_params(dev1,
-				     ABS_MT_POSITION_Y, 0, ALPS_Y_MAX, 0, 0);
+				     ABS_MT_POSITION_Y, 0, priv->y_max, 0, 0);
 
 		set_bit(BTN_TOOL_DOUBLETAP, dev1->keybit);
 		set_bit(BTN_TOOL_TRIPLETAP, dev1->keybit);
 		set_bit(BTN_TOOL_QUADTAP, dev1->keybit);
 
-		input_set_abs_params(dev1, ABS_X, 0, ALPS_X_MAX, 0, 0);
-		input_set_abs_params(dev1, ABS_Y, 0, ALPS_Y_MAX, 0, 0);
+		input_set_abs_params(dev1, ABS_X, 0, priv->x_max, 0, 0);
+		input_set_abs_params(dev1, ABS_Y, 0, priv->y_max, 0, 0);
 		break;
 	case ALPS_PROTO_V5:
 		set_bit(INPUT_PROP_SEMI_MT, dev1->propbit);
 		input_mt_init_slots(dev1, 2);
-		ALPS_BITMAP_X_BITS = 16;
-		ALPS_BITMAP_Y_BITS = 12;
-		ALPS_X_MAX = 2000;
-		ALPS_Y_MAX = 1400;
+		priv->x_bits = 16;
+		priv->y_bits = 12;
+		priv->x_max = 2000;
+		priv->y_max = 1400;
 		input_set_abs_params(dev1,
-				     ABS_MT_POSITION_X, 0, ALPS_X_MAX, 0, 0);
+				     ABS_MT_POSITION_X, 0, priv->x_max, 0, 0);
 		input_set_abs_params(dev1,
-				     ABS_MT_POSITION_Y, 0, ALPS_Y_MAX, 0, 0);
+				     ABS_MT_POSITION_Y, 0, priv->y_max, 0, 0);
 
 		set_bit(BTN_TOOL_DOUBLETAP, dev1->keybit);
 		set_bit(BTN_TOOL_TRIPLETAP, dev1->keybit);
 		set_bit(BTN_TOOL_QUADTAP, dev1->keybit);
 
-		input_set_abs_params(dev1, ABS_X, 0, ALPS_X_MAX, 0, 0);
-		input_set_abs_params(dev1, ABS_Y, 0, ALPS_Y_MAX, 0, 0);
+		input_set_abs_params(dev1, ABS_X, 0, priv->x_max, 0, 0);
+		input_set_abs_params(dev1, ABS_Y, 0, priv->y_max, 0, 0);
 		break;
 	case ALPS_PROTO_V6:
 		set_bit(INPUT_PROP_SEMI_MT, dev1->propbit);
-		ALPS_BITMAP_X_BITS = 23;
-		ALPS_BITMAP_Y_BITS = 12;
-		ALPS_X_MAX = 1360;
-		ALPS_Y_MAX =  660;
+		priv->x_bits = 23;
+		priv->y_bits = 12;
+		priv->x_max = 1360;
+		priv->y_max = 660;
 
 		input_mt_init_slots(dev1, 2);
 		input_set_abs_params(dev1,
-				     ABS_MT_POSITION_X, 0, ALPS_X_MAX, 0, 0);
+				     ABS_MT_POSITION_X, 0, priv->x_max, 0, 0);
 		input_set_abs_params(dev1,
-				     ABS_MT_POSITION_Y, 0, ALPS_Y_MAX, 0, 0);
+				     ABS_MT_POSITION_Y, 0, priv->y_max, 0, 0);
 
 		set_bit(BTN_TOOL_DOUBLETAP, dev1->keybit);
 		set_bit(BTN_TOOL_TRIPLETAP, dev1->keybit);
 		set_bit(BTN_TOOL_QUADTAP, dev1->keybit);
 
-		input_set_abs_params(dev1, ABS_X, 0, ALPS_X_MAX, 0, 0);
-		input_set_abs_params(dev1, ABS_Y, 0, ALPS_Y_MAX, 0, 0);
+		input_set_abs_params(dev1, ABS_X, 0, priv->x_max, 0, 0);
+		input_set_abs_params(dev1, ABS_Y, 0, priv->y_max, 0, 0);
 
 		break;
 	}
 
+	if (model->proto_version > ALPS_PROTO_V2) {
+		alps_init_bitmap_coords(priv->x_bitmap_coord,
+					priv->x_max, priv->x_bits);
+		alps_init_bitmap_coords(priv->y_bitmap_coord,
+					priv->y_max, priv->y_bits);
+	}
+
 	input_set_abs_params(dev1, ABS_PRESSURE, 0, 127, 0, 0);
 
 	if (model->flags & ALPS_WHEEL) {
@@ -2071,17 +2628,40 @@ int alps_init(struct psmouse *psmouse)
 	if (input_register_device(priv->dev2))
 		goto init_fail;
 
+	alps_reset_decode_stats(priv);
+
+	error = sysfs_create_group(&psmouse->ps2dev.serio->dev.kobj,
+				   &alps_attr_group);
+	if (error) {
+		psmouse_err(psmouse,
+			    "failed to create sysfs attributes, error: %d\n",
+			    error);
+		goto err_unregister_dev2;
+	}
+
 	psmouse->protocol_handler = alps_process_byte;
+	psmouse->validate_header = alps_validate_header;
+	psmouse->burst_handler = alps_process_burst;
 	psmouse->poll = alps_poll;
 	psmouse->disconnect = alps_disconnect;
 	psmouse->reconnect = alps_reconnect;
 	psmouse->pktsize = model->proto_version == ALPS_PROTO_V4 ? 8 : 6;
 
-	/* We are having trouble resyncing ALPS touchpads so disable it for now */
-	psmouse->resync_time = 0;
+	/*
+	 * We are having trouble resyncing V1/V2 touchpads, and V4 has
+	 * never been tested, so disable it for those. The others answer
+	 * a poll with a regular packet, so a lost byte costs a single
+	 * poll rather than a full reconnect.
+	 */
+	if (model->proto_version <= ALPS_PROTO_V2 ||
+	    model->proto_version == ALPS_PROTO_V4)
+		psmouse->resync_time = 0;
 
 	return 0;
 
+err_unregister_dev2:
+	input_unregister_device(dev2);
+	dev2 = NULL;	/* so we don't try to free it below */
 init_fail:
 	psmouse_reset(psmouse);
 	input_free_device(dev2);
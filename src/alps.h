@@ -19,6 +19,8 @@
 #define ALPS_PROTO_V5   4
 #define ALPS_PROTO_V6   5
 
+#define ALPS_BITMAP_MAX_BITS	23	/* Widest finger bitmap (V6 x axis) */
+
 struct alps_model_info {
     unsigned char signature[3];
 	unsigned char command_mode_resp; /* v3/v4 only */
@@ -27,11 +29,58 @@ struct alps_model_info {
     unsigned char flags;
 };
 
+#define ALPS_REG_CACHE_SIZE	16
+
+/*
+ * Shadow copy of a command mode register. dflt is the value read back
+ * after the touchpad was reset, value is the last one read or written.
+ */
+struct alps_reg_cache_entry {
+	u16 addr;
+	u8 value;
+	u8 dflt;
+	bool has_dflt;
+};
+
 struct alps_nibble_commands {
 	int command;
 	unsigned char data;
 };
 
+/* Operations understood by the init sequence interpreter */
+enum alps_init_op {
+	ALPS_INIT_CMD,		/* ps2_command(command, param) */
+	ALPS_INIT_NIBBLE,	/* Command mode nibble command */
+	ALPS_INIT_RESET,	/* psmouse_reset() */
+	ALPS_INIT_ENTER_CMD_MODE,
+	ALPS_INIT_EXIT_CMD_MODE,
+	ALPS_INIT_E6_REPORT,
+	ALPS_INIT_E7_REPORT,
+	ALPS_INIT_WRITE_REG,	/* Write param[0] to register command */
+	ALPS_INIT_UPDATE_REG,	/* Set bits param[1] under mask param[0] */
+	ALPS_INIT_CHECKSET_REG,	/* Log old value, write param[0] */
+	ALPS_INIT_RATE_ENABLE,	/* Set rate param[0] and enable reporting */
+	ALPS_INIT_CALL,		/* Call fn() for steps which need logic */
+};
+
+#define ALPS_STEP_OPTIONAL	0x01	/* Skipped when skip_optional is set */
+#define ALPS_STEP_NOFAIL	0x02	/* Errors are logged and ignored */
+#define ALPS_STEP_EXPECT	0x04	/* param holds the expected response */
+
+/*
+ * One step of an initialization sequence. command is either a PS/2
+ * command, a nibble or a register address depending on op. param holds
+ * the bytes sent with the command or, with ALPS_STEP_EXPECT, the bytes
+ * the device should answer with.
+ */
+struct alps_init_step {
+	u8 op;
+	u8 flags;
+	u16 command;
+	u8 param[3];
+	int (*fn)(struct psmouse *psmouse);
+};
+
 struct alps_data {
 	struct input_dev *dev2;		/* Relative device */
 	char phys[32];			/* Phys */
@@ -43,8 +92,37 @@ struct alps_data {
 	unsigned char multi_data[6];	/* Saved multi-packet data */
     int x1, x2, y1, y2;     /* Coordinates from last MT report */
     int fingers;            /* Number of fingers from MT report */
+	int x_max, y_max;		/* Range of MT coordinates */
+	int x_bits, y_bits;		/* Number of bits in finger bitmaps */
+	/*
+	 * Bitmap position to coordinate tables, indexed by
+	 * 2 * start_bit + num_bits - 1 of a contact.
+	 */
+	u16 x_bitmap_coord[3 * ALPS_BITMAP_MAX_BITS];
+	u16 y_bitmap_coord[3 * ALPS_BITMAP_MAX_BITS];
 	u8 quirks;
 	struct timer_list timer;
+
+	struct alps_reg_cache_entry reg_cache[ALPS_REG_CACHE_SIZE];
+	int reg_cache_count;
+	unsigned long reg_cache_hits;	/* Register reads avoided */
+	unsigned long reg_cache_misses;	/* Register reads sent to the device */
+
+	/* Decoder statistics, reported through the decode_stats attribute */
+	unsigned long stats_start;	/* jiffies when counters were reset */
+	unsigned long packets;		/* ALPS packets decoded */
+	unsigned long ps2_packets;	/* Bare PS/2 packets decoded */
+#ifdef ALPS_DECODE_TIMING
+	u64 decode_ns;			/* Total time spent decoding */
+	u64 decode_ns_max;		/* Slowest single packet */
+#endif
+
+	/* Interleaved PS/2 lookahead, see alps_handle_interleaved_ps2() */
+	u64 last_byte_ns;		/* local_clock() of the previous byte */
+	u32 byte_gap_ns;		/* Average gap between bytes of a packet */
+	u32 flush_timeout_us;		/* Timeout the flush timer was armed with */
+	unsigned long early_decisions;	/* Packets decided without waiting */
+	u64 latency_saved_us;		/* Compared to the fixed 20 ms timeout */
 };
 
 #define ALPS_QUIRK_TRACKSTICK_BUTTONS	1 /* trakcstick buttons in trackstick packet */
@@ -33,8 +33,16 @@
 static int synaptics_send_cmd(struct psmouse *psmouse, unsigned char c,
 				unsigned char *param)
 {
-	if (psmouse_sliced_command(psmouse, c) ||
-	    ps2_command(&psmouse->ps2dev, param, PSMOUSE_CMD_GETINFO)) {
+	struct psmouse_cmd seq[PSMOUSE_SLICED_CMDS + 1];
+	unsigned char nibbles[4];
+	int n;
+
+	n = psmouse_sliced_seq(seq, nibbles, c);
+	seq[n].command = PSMOUSE_CMD_GETINFO;
+	seq[n].param = param;
+
+	if (psmouse_command_seq(psmouse, seq, n + 1,
+				PSMOUSE_CMD_SEQ_TIMEOUT, NULL)) {
 		psmouse_err(psmouse, "%s query 0x%02x failed.\n", __func__, c);
 		return -1;
 	}
@@ -43,32 +51,62 @@ static int synaptics_send_cmd(struct psmouse *psmouse, unsigned char c,
 }
 
 /*
- * A retrying version of ps2_command
+ * Send a command sequence, retrying each command that fails
  */
-static int elantech_ps2_command(struct psmouse *psmouse,
-				unsigned char *param, int command)
+static int elantech_ps2_command_seq(struct psmouse *psmouse,
+				    const struct psmouse_cmd *seq, int count)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	struct elantech_data *etd = psmouse->private;
-	int rc;
 	int tries = ETP_PS2_COMMAND_TRIES;
+	int done = 0, failed;
+	int rc;
 
-	do {
-		rc = ps2_command(ps2dev, param, command);
+	for (;;) {
+		rc = psmouse_command_seq(psmouse, seq + done, count - done,
+					 PSMOUSE_CMD_SEQ_TIMEOUT, &failed);
 		if (rc == 0)
 			break;
-		tries--;
-		elantech_debug("retrying ps2 command 0x%02x (%d).\n",
-				command, tries);
-		msleep(ETP_PS2_COMMAND_DELAY);
-	} while (tries > 0);
 
-	if (rc)
-		psmouse_err(psmouse, "ps2 command 0x%02x failed.\n", command);
+		/* Some progress, the next command gets all its tries */
+		if (failed) {
+			done += failed;
+			tries = ETP_PS2_COMMAND_TRIES;
+		}
+
+		if (--tries == 0) {
+			psmouse_err(psmouse, "ps2 command 0x%02x failed.\n",
+				    seq[done].command);
+			break;
+		}
+
+		elantech_debug("retrying ps2 command 0x%02x (%d).\n",
+				seq[done].command, tries);
+		msleep(psmouse_retry_delay(psmouse,
+					   ETP_PS2_COMMAND_TRIES - 1 - tries,
+					   ETP_PS2_COMMAND_DELAY));
+	}
 
 	return rc;
 }
 
+/*
+ * Fill seq with each byte of cmds sent as an Elantech custom command
+ */
+static int elantech_custom_seq(struct psmouse_cmd *seq,
+			       const unsigned char *cmds, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		seq[2 * i].command = ETP_PS2_CUSTOM_COMMAND;
+		seq[2 * i].param = NULL;
+		seq[2 * i + 1].command = cmds[i];
+		seq[2 * i + 1].param = NULL;
+	}
+
+	return 2 * count;
+}
+
 /*
  * Send an Elantech style special command to read a value from a register
  */
@@ -76,10 +114,13 @@ static int elantech_read_reg(struct psmouse *psmouse, unsigned char reg,
 				unsigned char *val)
 {
 	struct elantech_data *etd = psmouse->private;
+	struct psmouse_cmd seq[2 * PSMOUSE_SLICED_CMDS + 1];
+	unsigned char nibbles[8];
+	unsigned char cmds[2];
 	unsigned char param[3];
-	int rc = 0;
+	int n, rc = 0;
 
-	if (reg < 0x07 || reg > 0x26)
+	if (reg < ETP_REG_FIRST || reg > ETP_REG_LAST)
 		return -1;
 
 	if (reg > 0x11 && reg < 0x20)
@@ -87,42 +128,33 @@ static int elantech_read_reg(struct psmouse *psmouse, unsigned char reg,
 
 	switch (etd->hw_version) {
 	case 1:
-		if (psmouse_sliced_command(psmouse, ETP_REGISTER_READ) ||
-		    psmouse_sliced_command(psmouse, reg) ||
-		    ps2_command(&psmouse->ps2dev, param, PSMOUSE_CMD_GETINFO)) {
-			rc = -1;
-		}
-		break;
-
-	case 2:
-		if (elantech_ps2_command(psmouse,  NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse,  NULL, ETP_REGISTER_READ) ||
-		    elantech_ps2_command(psmouse,  NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse,  NULL, reg) ||
-		    elantech_ps2_command(psmouse, param, PSMOUSE_CMD_GETINFO)) {
-			rc = -1;
-		}
+		n = psmouse_sliced_seq(seq, nibbles, ETP_REGISTER_READ);
+		n += psmouse_sliced_seq(seq + n, nibbles + 4, reg);
+		seq[n].command = PSMOUSE_CMD_GETINFO;
+		seq[n++].param = param;
+		rc = psmouse_command_seq(psmouse, seq, n,
+					 PSMOUSE_CMD_SEQ_TIMEOUT, NULL);
 		break;
 
-	case 3 ... 4:
-		if (elantech_ps2_command(psmouse, NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_REGISTER_READWRITE) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse, NULL, reg) ||
-		    elantech_ps2_command(psmouse, param, PSMOUSE_CMD_GETINFO)) {
-			rc = -1;
-		}
+	case 2 ... 4:
+		cmds[0] = etd->hw_version == 2 ?
+				ETP_REGISTER_READ : ETP_REGISTER_READWRITE;
+		cmds[1] = reg;
+		n = elantech_custom_seq(seq, cmds, 2);
+		seq[n].command = PSMOUSE_CMD_GETINFO;
+		seq[n++].param = param;
+		rc = elantech_ps2_command_seq(psmouse, seq, n);
 		break;
 	}
 
-	if (rc)
+	if (rc) {
 		psmouse_err(psmouse, "failed to read register 0x%02x.\n", reg);
-	else if (etd->hw_version != 4)
-		*val = param[0];
-	else
-		*val = param[1];
+		return rc;
+	}
 
-	return rc;
+	*val = etd->hw_version != 4 ? param[0] : param[1];
+
+	return 0;
 }
 
 /*
@@ -132,9 +164,12 @@ static int elantech_write_reg(struct psmouse *psmouse, unsigned char reg,
 				unsigned char val)
 {
 	struct elantech_data *etd = psmouse->private;
-	int rc = 0;
+	struct psmouse_cmd seq[3 * PSMOUSE_SLICED_CMDS + 1];
+	unsigned char nibbles[12];
+	unsigned char cmds[4];
+	int n = 0, rc = 0;
 
-	if (reg < 0x07 || reg > 0x26)
+	if (reg < ETP_REG_FIRST || reg > ETP_REG_LAST)
 		return -1;
 
 	if (reg > 0x11 && reg < 0x20)
@@ -142,50 +177,35 @@ static int elantech_write_reg(struct psmouse *psmouse, unsigned char reg,
 
 	switch (etd->hw_version) {
 	case 1:
-		if (psmouse_sliced_command(psmouse, ETP_REGISTER_WRITE) ||
-		    psmouse_sliced_command(psmouse, reg) ||
-		    psmouse_sliced_command(psmouse, val) ||
-		    ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_SETSCALE11)) {
-			rc = -1;
-		}
+		n = psmouse_sliced_seq(seq, nibbles, ETP_REGISTER_WRITE);
+		n += psmouse_sliced_seq(seq + n, nibbles + 4, reg);
+		n += psmouse_sliced_seq(seq + n, nibbles + 8, val);
+		seq[n].command = PSMOUSE_CMD_SETSCALE11;
+		seq[n++].param = NULL;
+		rc = psmouse_command_seq(psmouse, seq, n,
+					 PSMOUSE_CMD_SEQ_TIMEOUT, NULL);
 		break;
 
-	case 2:
-		if (elantech_ps2_command(psmouse, NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_REGISTER_WRITE) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse, NULL, reg) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse, NULL, val) ||
-		    elantech_ps2_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11)) {
-			rc = -1;
-		}
-		break;
-
-	case 3:
-		if (elantech_ps2_command(psmouse, NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_REGISTER_READWRITE) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse, NULL, reg) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse, NULL, val) ||
-		    elantech_ps2_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11)) {
-			rc = -1;
-		}
+	case 2 ... 3:
+		cmds[0] = etd->hw_version == 2 ?
+				ETP_REGISTER_WRITE : ETP_REGISTER_READWRITE;
+		cmds[1] = reg;
+		cmds[2] = val;
+		n = elantech_custom_seq(seq, cmds, 3);
+		seq[n].command = PSMOUSE_CMD_SETSCALE11;
+		seq[n++].param = NULL;
+		rc = elantech_ps2_command_seq(psmouse, seq, n);
 		break;
 
 	case 4:
-		if (elantech_ps2_command(psmouse, NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_REGISTER_READWRITE) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse, NULL, reg) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_REGISTER_READWRITE) ||
-		    elantech_ps2_command(psmouse, NULL, ETP_PS2_CUSTOM_COMMAND) ||
-		    elantech_ps2_command(psmouse, NULL, val) ||
-		    elantech_ps2_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11)) {
-			rc = -1;
-		}
+		cmds[0] = ETP_REGISTER_READWRITE;
+		cmds[1] = reg;
+		cmds[2] = ETP_REGISTER_READWRITE;
+		cmds[3] = val;
+		n = elantech_custom_seq(seq, cmds, 4);
+		seq[n].command = PSMOUSE_CMD_SETSCALE11;
+		seq[n++].param = NULL;
+		rc = elantech_ps2_command_seq(psmouse, seq, n);
 		break;
 	}
 
@@ -462,24 +482,84 @@ static void elantech_report_absolute_v3(struct psmouse *psmouse,
 	input_sync(dev);
 }
 
+/*
+ * v4 hardware reports a scan frame as a series of packets, each covering
+ * one or two fingers. Rather than syncing after every packet, slot updates
+ * are collected until each finger that is down has been reported, and the
+ * whole frame is sent with one input_sync(). A packet for a slot already
+ * in the frame starts a new one; a frame that stays incomplete is flushed
+ * by frame_timer.
+ */
 static void elantech_input_sync_v4(struct psmouse *psmouse)
 {
 	struct input_dev *dev = psmouse->dev;
-	unsigned char *packet = psmouse->packet;
+	struct elantech_data *etd = psmouse->private;
 
-	input_report_key(dev, BTN_LEFT, packet[0] & 0x01);
-	input_report_key(dev, BTN_RIGHT, packet[0] & 0x02);
+	input_report_key(dev, BTN_LEFT, etd->frame_buttons & 0x01);
+	input_report_key(dev, BTN_RIGHT, etd->frame_buttons & 0x02);
 	input_mt_report_pointer_emulation(dev, true);
 	input_sync(dev);
+
+	etd->frame_slots = 0;
+}
+
+/*
+ * Called before a packet updating the slots in mask is reported
+ */
+static void elantech_frame_start_v4(struct psmouse *psmouse,
+				    unsigned char mask)
+{
+	struct elantech_data *etd = psmouse->private;
+
+	if (etd->frame_slots & mask)
+		elantech_input_sync_v4(psmouse);
+
+	etd->frame_buttons = psmouse->packet[0] & 0x03;
+}
+
+/*
+ * Called after a packet updating the slots in mask has been reported
+ */
+static void elantech_frame_v4(struct psmouse *psmouse, unsigned char mask)
+{
+	struct elantech_data *etd = psmouse->private;
+
+	etd->frame_slots |= mask;
+	etd->frame_fingers |= mask;
+
+	if ((etd->frame_slots & etd->frame_fingers) == etd->frame_fingers) {
+		elantech_input_sync_v4(psmouse);
+		del_timer(&etd->frame_timer);
+	} else {
+		/* One more jiffy, so a coarse HZ cannot cut the wait short */
+		mod_timer(&etd->frame_timer,
+			  jiffies + msecs_to_jiffies(ETP_V4_FRAME_TIMEOUT) + 1);
+	}
+}
+
+static void elantech_frame_timeout_v4(unsigned long data)
+{
+	struct psmouse *psmouse = (struct psmouse *)data;
+	struct elantech_data *etd = psmouse->private;
+
+	psmouse_pause_rx(psmouse);
+
+	if (etd->frame_slots)
+		elantech_input_sync_v4(psmouse);
+
+	psmouse_continue_rx(psmouse);
 }
 
 static void process_packet_status_v4(struct psmouse *psmouse)
 {
 	struct input_dev *dev = psmouse->dev;
+	struct elantech_data *etd = psmouse->private;
 	unsigned char *packet = psmouse->packet;
 	unsigned fingers;
 	int i;
 
+	elantech_frame_start_v4(psmouse, 0);
+
 	/* notify finger state change */
 	fingers = packet[1] & 0x1f;
 	for (i = 0; i < ETP_MAX_FINGERS; i++) {
@@ -489,7 +569,10 @@ static void process_packet_status_v4(struct psmouse *psmouse)
 		}
 	}
 
+	/* Finger state changes are reported right away */
+	etd->frame_fingers = fingers;
 	elantech_input_sync_v4(psmouse);
+	del_timer(&etd->frame_timer);
 }
 
 static void process_packet_head_v4(struct psmouse *psmouse)
@@ -503,6 +586,8 @@ static void process_packet_head_v4(struct psmouse *psmouse)
 	if (id < 0)
 		return;
 
+	elantech_frame_start_v4(psmouse, 1 << id);
+
 	etd->mt[id].x = ((packet[1] & 0x0f) << 8) | packet[2];
 	etd->mt[id].y = etd->y_max - (((packet[4] & 0x0f) << 8) | packet[5]);
 	pres = (packet[1] & 0xf0) | ((packet[4] & 0xf0) >> 4);
@@ -518,7 +603,7 @@ static void process_packet_head_v4(struct psmouse *psmouse)
 	/* report this for backwards compatibility */
 	input_report_abs(dev, ABS_TOOL_WIDTH, traces);
 
-	elantech_input_sync_v4(psmouse);
+	elantech_frame_v4(psmouse, 1 << id);
 }
 
 static void process_packet_motion_v4(struct psmouse *psmouse)
@@ -528,12 +613,17 @@ static void process_packet_motion_v4(struct psmouse *psmouse)
 	unsigned char *packet = psmouse->packet;
 	int weight, delta_x1 = 0, delta_y1 = 0, delta_x2 = 0, delta_y2 = 0;
 	int id, sid;
+	unsigned char mask;
 
 	id = ((packet[0] & 0xe0) >> 5) - 1;
 	if (id < 0)
 		return;
 
 	sid = ((packet[3] & 0xe0) >> 5) - 1;
+	mask = (1 << id) | (sid >= 0 ? 1 << sid : 0);
+
+	elantech_frame_start_v4(psmouse, mask);
+
 	weight = (packet[0] & 0x10) ? ETP_WEIGHT_VALUE : 1;
 	/*
 	 * Motion packets give us the delta of x, y values of specific fingers,
@@ -559,7 +649,7 @@ static void process_packet_motion_v4(struct psmouse *psmouse)
 		input_report_abs(dev, ABS_MT_POSITION_Y, etd->mt[sid].y);
 	}
 
-	elantech_input_sync_v4(psmouse);
+	elantech_frame_v4(psmouse, mask);
 }
 
 static void elantech_report_absolute_v4(struct psmouse *psmouse,
@@ -585,6 +675,22 @@ static void elantech_report_absolute_v4(struct psmouse *psmouse,
 	}
 }
 
+/*
+ * Odd parity bit of every byte value, as sent by v1 hardware: 1 when the
+ * byte has an even number of bits set.
+ */
+#define ETP_P2(n)	n, n ^ 1, n ^ 1, n
+#define ETP_P4(n)	ETP_P2(n), ETP_P2(n ^ 1), ETP_P2(n ^ 1), ETP_P2(n)
+#define ETP_P6(n)	ETP_P4(n), ETP_P4(n ^ 1), ETP_P4(n ^ 1), ETP_P4(n)
+
+static const unsigned char elantech_parity[256] = {
+	ETP_P6(1), ETP_P6(0), ETP_P6(0), ETP_P6(1)
+};
+
+#undef ETP_P6
+#undef ETP_P4
+#undef ETP_P2
+
 static int elantech_packet_check_v1(struct psmouse *psmouse)
 {
 	struct elantech_data *etd = psmouse->private;
@@ -604,9 +710,9 @@ static int elantech_packet_check_v1(struct psmouse *psmouse)
 
 	p3 = (packet[0] & 0x04) >> 2;
 
-	return etd->parity[packet[1]] == p1 &&
-	       etd->parity[packet[2]] == p2 &&
-	       etd->parity[packet[3]] == p3;
+	return elantech_parity[packet[1]] == p1 &&
+	       elantech_parity[packet[2]] == p2 &&
+	       elantech_parity[packet[3]] == p3;
 }
 
 static int elantech_debounce_check_v2(struct psmouse *psmouse)
@@ -694,22 +800,51 @@ static int elantech_packet_check_v4(struct psmouse *psmouse)
 }
 
 /*
- * Process byte stream from mouse and handle complete packets
+ * Check the constant bits of byte 0 only, so psmouse core can find the
+ * start of the next packet after a bad one.
  */
-static psmouse_ret_t elantech_process_byte(struct psmouse *psmouse)
+static bool elantech_validate_header(struct psmouse *psmouse)
 {
 	struct elantech_data *etd = psmouse->private;
+	unsigned char byte0 = psmouse->packet[0];
+
+	switch (etd->hw_version) {
+	case 1:
+		return (byte0 & 0x08) == 0x08;
+
+	case 2:
+		if (etd->reports_pressure)
+			return (byte0 & 0x0c) == 0x04;
+		return (byte0 & 0x0c) == 0x0c;
+
+	case 3:
+		/* head, tail and debounce packets all have bit 2 set */
+		return (byte0 & 0x04) == 0x04;
+
+	case 4:
+		return (byte0 & 0x0c) == 0x04;
+	}
+
+	return true;
+}
+
+/*
+ * Process byte stream from mouse and handle complete packets. This is
+ * instantiated below for each hardware version, with and without parity
+ * checking, so that complete packets go straight to the right decoder.
+ */
+static __always_inline psmouse_ret_t
+__elantech_process_byte(struct psmouse *psmouse, const int hw_version,
+			const bool paritycheck)
+{
 	int packet_type;
 
 	if (psmouse->pktcnt < psmouse->pktsize)
 		return PSMOUSE_GOOD_DATA;
 
-	if (etd->debug > 1)
-		elantech_packet_dump(psmouse);
-
-	switch (etd->hw_version) {
+	switch (hw_version) {
 	case 1:
-		if (etd->paritycheck && !elantech_packet_check_v1(psmouse))
+		if (paritycheck && !elantech_packet_check_v1(psmouse))
 			return PSMOUSE_BAD_DATA;
 
 		elantech_report_absolute_v1(psmouse);
@@ -720,7 +855,7 @@ static psmouse_ret_t elantech_process_byte(struct psmouse *psmouse)
 		if (elantech_debounce_check_v2(psmouse))
 			return PSMOUSE_FULL_PACKET;
 
-		if (etd->paritycheck && !elantech_packet_check_v2(psmouse))
+		if (paritycheck && !elantech_packet_check_v2(psmouse))
 			return PSMOUSE_BAD_DATA;
 
 		elantech_report_absolute_v2(psmouse);
@@ -750,6 +885,138 @@ static psmouse_ret_t elantech_process_byte(struct psmouse *psmouse)
 	return PSMOUSE_FULL_PACKET;
 }
 
+#define ELANTECH_PROCESS_BYTE(name, hw_version, paritycheck)		\
+static psmouse_ret_t elantech_process_byte_##name(struct psmouse *psmouse) \
+{									\
+	return __elantech_process_byte(psmouse, hw_version, paritycheck); \
+}
+
+ELANTECH_PROCESS_BYTE(v1, 1, true)
+ELANTECH_PROCESS_BYTE(v1_nocheck, 1, false)
+ELANTECH_PROCESS_BYTE(v2, 2, true)
+ELANTECH_PROCESS_BYTE(v2_nocheck, 2, false)
+ELANTECH_PROCESS_BYTE(v3, 3, false)
+ELANTECH_PROCESS_BYTE(v4, 4, false)
+
+/*
+ * Generic handler, only used while packets are being dumped (debug > 1)
+ */
+static psmouse_ret_t elantech_process_byte(struct psmouse *psmouse)
+{
+	struct elantech_data *etd = psmouse->private;
+
+	if (psmouse->pktcnt < psmouse->pktsize)
+		return PSMOUSE_GOOD_DATA;
+
+	elantech_packet_dump(psmouse);
+
+	return __elantech_process_byte(psmouse, etd->hw_version,
+				       etd->paritycheck);
+}
+
+/*
+ * Install the protocol handler matching the hardware version and the
+ * current debug and paritycheck settings.
+ */
+static void elantech_select_handler(struct psmouse *psmouse)
+{
+	struct elantech_data *etd = psmouse->private;
+
+	if (etd->debug > 1) {
+		psmouse->protocol_handler = elantech_process_byte;
+		return;
+	}
+
+	switch (etd->hw_version) {
+	case 1:
+		psmouse->protocol_handler = etd->paritycheck ?
+			elantech_process_byte_v1 : elantech_process_byte_v1_nocheck;
+		break;
+	case 2:
+		psmouse->protocol_handler = etd->paritycheck ?
+			elantech_process_byte_v2 : elantech_process_byte_v2_nocheck;
+		break;
+	case 3:
+		psmouse->protocol_handler = elantech_process_byte_v3;
+		break;
+	case 4:
+		psmouse->protocol_handler = elantech_process_byte_v4;
+		break;
+	default:
+		psmouse->protocol_handler = elantech_process_byte;
+		break;
+	}
+}
+
+/*
+ * Burst handler for deferred mode: feeds whole packets from the queue to
+ * the protocol handler. A packet it refuses is left in the queue so the
+ * byte path can deal with it.
+ */
+static int elantech_process_burst(struct psmouse *psmouse,
+				  const unsigned char *data, const u64 *time,
+				  int count, int *packets)
+{
+	int pktsize = psmouse->pktsize;
+	psmouse_ret_t rc;
+	int n = 0;
+
+	*packets = 0;
+
+	while (count - n >= pktsize && data[n] != PSMOUSE_RET_BAT) {
+		memcpy(psmouse->packet, data + n, pktsize);
+		psmouse->pktcnt = pktsize;
+		rc = psmouse->protocol_handler(psmouse);
+		psmouse->pktcnt = 0;
+
+		if (rc != PSMOUSE_FULL_PACKET)
+			break;
+
+		psmouse->irq_time = time[n + pktsize - 1];
+		psmouse_account_latency(psmouse);
+		(*packets)++;
+		n += pktsize;
+	}
+
+	return n;
+}
+
+/*
+ * Set a register while putting the touchpad into absolute mode, which
+ * always follows a reset. On v3 and v4 hardware a read is much cheaper
+ * than a write, so the first init reads the value the register has
+ * after a reset and remembers it. From then on, on every reconnect, the
+ * register is only written if that default differs from val.
+ * *verified tells the caller that no read-back is needed.
+ */
+static int elantech_init_reg(struct psmouse *psmouse, unsigned char reg,
+			     unsigned char val, bool *verified)
+{
+	struct elantech_data *etd = psmouse->private;
+	u32 bit = 1U << (reg - ETP_REG_FIRST);
+	unsigned char def;
+
+	BUILD_BUG_ON(ETP_REG_COUNT > 32);
+
+	*verified = false;
+
+	if (etd->hw_version >= 3 && !(etd->reg_default_valid & bit) &&
+	    elantech_read_reg(psmouse, reg, &def) == 0) {
+		etd->reg_default[reg - ETP_REG_FIRST] = def;
+		etd->reg_default_valid |= bit;
+	}
+
+	if ((etd->reg_default_valid & bit) &&
+	    etd->reg_default[reg - ETP_REG_FIRST] == val) {
+		elantech_debug("register 0x%02x defaults to 0x%02x.\n",
+			       reg, val);
+		*verified = true;
+		return 0;
+	}
+
+	return elantech_write_reg(psmouse, reg, val);
+}
+
 /*
  * Put the touchpad into absolute mode
  */
@@ -758,6 +1025,7 @@ static int elantech_set_absolute_mode(struct psmouse *psmouse)
 	struct elantech_data *etd = psmouse->private;
 	unsigned char val;
 	int tries = ETP_READ_BACK_TRIES;
+	bool verified = false;
 	int rc = 0;
 
 	switch (etd->hw_version) {
@@ -784,20 +1052,20 @@ static int elantech_set_absolute_mode(struct psmouse *psmouse)
 
 	case 3:
 		etd->reg_10 = 0x0b;
-		if (elantech_write_reg(psmouse, 0x10, etd->reg_10))
+		if (elantech_init_reg(psmouse, 0x10, etd->reg_10, &verified))
 			rc = -1;
 
 		break;
 
 	case 4:
 		etd->reg_07 = 0x01;
-		if (elantech_write_reg(psmouse, 0x07, etd->reg_07))
+		if (elantech_init_reg(psmouse, 0x07, etd->reg_07, &verified))
 			rc = -1;
 
 		goto skip_readback_reg_10; /* v4 has no reg 0x10 to read */
 	}
 
-	if (rc == 0) {
+	if (rc == 0 && !verified) {
 		/*
 		 * Read back reg 0x10. For hardware version 1 we must make
 		 * sure the absolute mode bit is set. For hardware version 2
@@ -1054,6 +1322,10 @@ static ssize_t elantech_set_int_attr(struct psmouse *psmouse,
 	if (!attr->reg || elantech_write_reg(psmouse, attr->reg, value) == 0)
 		*reg = value;
 
+	/* debug and paritycheck decide which packet handler is used */
+	if (!attr->reg)
+		elantech_select_handler(psmouse);
+
 	return count;
 }
 
@@ -1123,16 +1395,15 @@ static bool elantech_is_signature_valid(const unsigned char *param)
  */
 int elantech_detect(struct psmouse *psmouse, bool set_properties)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[3];
 
-	ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_RESET_DIS);
+	psmouse_command(psmouse, NULL, PSMOUSE_CMD_RESET_DIS);
 
-	if (ps2_command(ps2dev,  NULL, PSMOUSE_CMD_DISABLE) ||
-	    ps2_command(ps2dev,  NULL, PSMOUSE_CMD_SETSCALE11) ||
-	    ps2_command(ps2dev,  NULL, PSMOUSE_CMD_SETSCALE11) ||
-	    ps2_command(ps2dev,  NULL, PSMOUSE_CMD_SETSCALE11) ||
-	    ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO)) {
+	if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11) ||
+	    psmouse_command(psmouse, param, PSMOUSE_CMD_GETINFO)) {
 		psmouse_dbg(psmouse, "sending Elantech magic knock failed.\n");
 		return -1;
 	}
@@ -1182,6 +1453,9 @@ int elantech_detect(struct psmouse *psmouse, bool set_properties)
  */
 static void elantech_disconnect(struct psmouse *psmouse)
 {
+	struct elantech_data *etd = psmouse->private;
+
+	del_timer_sync(&etd->frame_timer);
 	sysfs_remove_group(&psmouse->ps2dev.serio->dev.kobj,
 			   &elantech_attr_group);
 	kfree(psmouse->private);
@@ -1193,6 +1467,13 @@ static void elantech_disconnect(struct psmouse *psmouse)
  */
 static int elantech_reconnect(struct psmouse *psmouse)
 {
+	struct elantech_data *etd = psmouse->private;
+
+	/* Forget the v4 frame that was being assembled */
+	del_timer_sync(&etd->frame_timer);
+	etd->frame_slots = 0;
+	etd->frame_fingers = 0;
+
 	if (elantech_detect(psmouse, 0))
 		return -1;
 
@@ -1263,16 +1544,15 @@ static int elantech_set_properties(struct elantech_data *etd)
 int elantech_init(struct psmouse *psmouse)
 {
 	struct elantech_data *etd;
-	int i, error;
+	int error;
 	unsigned char param[3];
 
 	psmouse->private = etd = kzalloc(sizeof(struct elantech_data), GFP_KERNEL);
 	if (!etd)
 		return -ENOMEM;
 
-	etd->parity[0] = 1;
-	for (i = 1; i < 256; i++)
-		etd->parity[i] = etd->parity[i & (i - 1)] ^ 1;
+	setup_timer(&etd->frame_timer, elantech_frame_timeout_v4,
+		    (unsigned long)psmouse);
 
 	/*
 	 * Do the version query again so we can store the result
@@ -1321,7 +1601,9 @@ int elantech_init(struct psmouse *psmouse)
 		goto init_fail;
 	}
 
-	psmouse->protocol_handler = elantech_process_byte;
+	elantech_select_handler(psmouse);
+	psmouse->validate_header = elantech_validate_header;
+	psmouse->burst_handler = elantech_process_burst;
 	psmouse->disconnect = elantech_disconnect;
 	psmouse->reconnect = elantech_reconnect;
 	psmouse->pktsize = etd->hw_version > 1 ? 6 : 4;
@@ -34,7 +34,8 @@
 #define ETP_PS2_CUSTOM_COMMAND		0xf8
 
 /*
- * Times to retry a ps2_command and millisecond delay between tries
+ * Times to retry a ps2_command and the longest millisecond delay between
+ * tries, see psmouse_retry_delay()
  */
 #define ETP_PS2_COMMAND_TRIES		3
 #define ETP_PS2_COMMAND_DELAY		500
@@ -45,6 +46,13 @@
 #define ETP_READ_BACK_TRIES		5
 #define ETP_READ_BACK_DELAY		2000
 
+/*
+ * Range of register addresses
+ */
+#define ETP_REG_FIRST			0x07
+#define ETP_REG_LAST			0x26
+#define ETP_REG_COUNT			(ETP_REG_LAST - ETP_REG_FIRST + 1)
+
 /*
  * Register bitmasks for hardware version 1
  */
@@ -104,6 +112,17 @@
  */
 #define ETP_WEIGHT_VALUE		5
 
+/*
+ * Milliseconds to wait for the rest of a v4 scan frame before it is
+ * reported incomplete. The packets of a frame are sent back to back,
+ * and a 6 byte packet takes 4 to 6.6 ms on the wire at the 10 to 16.7 kHz
+ * PS/2 clock, so the next packet of a frame is complete well within 8 ms
+ * of the previous one. With two or three fingers down a whole report
+ * takes 8 to 20 ms to send, so waiting much longer would hold a frame
+ * that lost a packet back for about one more report interval.
+ */
+#define ETP_V4_FRAME_TIMEOUT		8
+
 /*
  * The base position for one finger, v4 hardware
  */
@@ -134,7 +153,16 @@ struct elantech_data {
 	unsigned int y_max;
 	unsigned int width;
 	struct finger_pos mt[ETP_MAX_FINGERS];
-	unsigned char parity[256];
+
+	/* v4 scan frame being assembled, see elantech_frame_v4() */
+	unsigned char frame_slots;		/* Slots updated since last sync */
+	unsigned char frame_fingers;		/* Slots with a finger down */
+	unsigned char frame_buttons;		/* Buttons of the latest packet */
+	struct timer_list frame_timer;
+
+	/* Register values after a reset, see elantech_init_reg() */
+	unsigned char reg_default[ETP_REG_COUNT];
+	u32 reg_default_valid;			/* Bit per register */
 };
 
 #ifdef CONFIG_MOUSE_PS2_ELANTECH
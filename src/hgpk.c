@@ -497,7 +497,6 @@ static psmouse_ret_t hgpk_process_byte(struct psmouse *psmouse)
 
 static int hgpk_select_mode(struct psmouse *psmouse)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	struct hgpk_data *priv = psmouse->private;
 	int i;
 	int cmd;
@@ -523,14 +522,14 @@ static int hgpk_select_mode(struct psmouse *psmouse)
 
 		/* Switch to 'Advanced mode.', four disables in a row. */
 		for (i = 0; i < ARRAY_SIZE(advanced_init); i++)
-			if (ps2_command(ps2dev, NULL, advanced_init[i]))
+			if (psmouse_command(psmouse, NULL, advanced_init[i]))
 				return -EIO;
 
 		/* select between GlideSensor (mouse) or PenTablet */
 		cmd = priv->mode == HGPK_MODE_GLIDESENSOR ?
 			PSMOUSE_CMD_SETSCALE11 : PSMOUSE_CMD_SETSCALE21;
 
-		if (ps2_command(ps2dev, NULL, cmd))
+		if (psmouse_command(psmouse, NULL, cmd))
 			return -EIO;
 		break;
 
@@ -613,13 +612,11 @@ static int hgpk_reset_device(struct psmouse *psmouse, bool recalibrate)
 	psmouse_reset(psmouse);
 
 	if (recalibrate) {
-		struct ps2dev *ps2dev = &psmouse->ps2dev;
-
 		/* send the recalibrate request */
-		if (ps2_command(ps2dev, NULL, 0xf5) ||
-		    ps2_command(ps2dev, NULL, 0xf5) ||
-		    ps2_command(ps2dev, NULL, 0xe6) ||
-		    ps2_command(ps2dev, NULL, 0xf5)) {
+		if (psmouse_command(psmouse, NULL, 0xf5) ||
+		    psmouse_command(psmouse, NULL, 0xf5) ||
+		    psmouse_command(psmouse, NULL, 0xe6) ||
+		    psmouse_command(psmouse, NULL, 0xf5)) {
 			return -1;
 		}
 
@@ -697,7 +694,6 @@ static int hgpk_force_recalibrate(struct psmouse *psmouse)
  */
 static int hgpk_toggle_powersave(struct psmouse *psmouse, int enable)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	int timeo;
 	int err;
 
@@ -734,9 +730,9 @@ static int hgpk_toggle_powersave(struct psmouse *psmouse, int enable)
 	} else {
 		psmouse_dbg(psmouse, "Powering off touchpad.\n");
 
-		if (ps2_command(ps2dev, NULL, 0xec) ||
-		    ps2_command(ps2dev, NULL, 0xec) ||
-		    ps2_command(ps2dev, NULL, 0xea)) {
+		if (psmouse_command(psmouse, NULL, 0xec) ||
+		    psmouse_command(psmouse, NULL, 0xec) ||
+		    psmouse_command(psmouse, NULL, 0xea)) {
 			return -1;
 		}
 
@@ -1013,14 +1009,13 @@ alloc_fail:
 
 static enum hgpk_model_t hgpk_get_model(struct psmouse *psmouse)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[3];
 
 	/* E7, E7, E7, E9 gets us a 3 byte identifier */
-	if (ps2_command(ps2dev,  NULL, PSMOUSE_CMD_SETSCALE21) ||
-	    ps2_command(ps2dev,  NULL, PSMOUSE_CMD_SETSCALE21) ||
-	    ps2_command(ps2dev,  NULL, PSMOUSE_CMD_SETSCALE21) ||
-	    ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO)) {
+	if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE21) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE21) ||
+	    psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE21) ||
+	    psmouse_command(psmouse, param, PSMOUSE_CMD_GETINFO)) {
 		return -EIO;
 	}
 
@@ -204,7 +204,6 @@ static psmouse_ret_t lifebook_process_byte(struct psmouse *psmouse)
 
 static int lifebook_absolute_mode(struct psmouse *psmouse)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param;
 
 	if (psmouse_reset(psmouse))
@@ -216,17 +215,16 @@ static int lifebook_absolute_mode(struct psmouse *psmouse)
 	 * absolute coordinates
 	 */
 	param = lifebook_use_6byte_proto ? 0x08 : 0x07;
-	ps2_command(ps2dev, &param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, &param, PSMOUSE_CMD_SETRES);
 
 	return 0;
 }
 
 static void lifebook_relative_mode(struct psmouse *psmouse)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param = 0x06;
 
-	ps2_command(ps2dev, &param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, &param, PSMOUSE_CMD_SETRES);
 }
 
 static void lifebook_set_resolution(struct psmouse *psmouse, unsigned int resolution)
@@ -238,7 +236,7 @@ static void lifebook_set_resolution(struct psmouse *psmouse, unsigned int resolu
 		resolution = 400;
 
 	p = params[resolution / 100];
-	ps2_command(&psmouse->ps2dev, &p, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, &p, PSMOUSE_CMD_SETRES);
 	psmouse->resolution = 50 << p;
 }
 
@@ -113,10 +113,16 @@ static psmouse_ret_t ps2pp_process_byte(struct psmouse *psmouse)
 
 static int ps2pp_cmd(struct psmouse *psmouse, unsigned char *param, unsigned char command)
 {
-	if (psmouse_sliced_command(psmouse, command))
-		return -1;
+	struct psmouse_cmd seq[PSMOUSE_SLICED_CMDS + 1];
+	unsigned char nibbles[4];
+	int n;
+
+	n = psmouse_sliced_seq(seq, nibbles, command);
+	seq[n].command = PSMOUSE_CMD_POLL | 0x0300;
+	seq[n].param = param;
 
-	if (ps2_command(&psmouse->ps2dev, param, PSMOUSE_CMD_POLL | 0x0300))
+	if (psmouse_command_seq(psmouse, seq, n + 1,
+				PSMOUSE_CMD_SEQ_TIMEOUT, NULL))
 		return -1;
 
 	return 0;
@@ -132,18 +138,17 @@ static int ps2pp_cmd(struct psmouse *psmouse, unsigned char *param, unsigned cha
 
 static void ps2pp_set_smartscroll(struct psmouse *psmouse, bool smartscroll)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[4];
 
 	ps2pp_cmd(psmouse, param, 0x32);
 
 	param[0] = 0;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES);
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES);
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES);
 
 	param[0] = smartscroll;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES);
 }
 
 static ssize_t ps2pp_attr_show_smartscroll(struct psmouse *psmouse,
@@ -177,13 +182,12 @@ PSMOUSE_DEFINE_ATTR(smartscroll, S_IWUSR | S_IRUGO, NULL,
 static void ps2pp_set_resolution(struct psmouse *psmouse, unsigned int resolution)
 {
 	if (resolution > 400) {
-		struct ps2dev *ps2dev = &psmouse->ps2dev;
 		unsigned char param = 3;
 
-		ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSCALE11);
-		ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSCALE11);
-		ps2_command(ps2dev, NULL, PSMOUSE_CMD_SETSCALE11);
-		ps2_command(ps2dev, &param, PSMOUSE_CMD_SETRES);
+		psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11);
+		psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11);
+		psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11);
+		psmouse_command(psmouse, &param, PSMOUSE_CMD_SETRES);
 		psmouse->resolution = 800;
 	} else
 		psmouse_set_resolution(psmouse, resolution);
@@ -322,7 +326,6 @@ static void ps2pp_set_model_properties(struct psmouse *psmouse,
 
 int ps2pp_init(struct psmouse *psmouse, bool set_properties)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[4];
 	unsigned char model, buttons;
 	const struct ps2pp_info *model_info;
@@ -330,12 +333,12 @@ int ps2pp_init(struct psmouse *psmouse, bool set_properties)
 	int error;
 
 	param[0] = 0;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES);
-	ps2_command(ps2dev,  NULL, PSMOUSE_CMD_SETSCALE11);
-	ps2_command(ps2dev,  NULL, PSMOUSE_CMD_SETSCALE11);
-	ps2_command(ps2dev,  NULL, PSMOUSE_CMD_SETSCALE11);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11);
+	psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11);
+	psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11);
 	param[1] = 0;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_GETINFO);
 
 	model = ((param[0] >> 4) & 0x07) | ((param[0] << 3) & 0x78);
 	buttons = param[1];
@@ -353,16 +356,16 @@ int ps2pp_init(struct psmouse *psmouse, bool set_properties)
 
 			/* Unprotect RAM */
 			param[0] = 0x11; param[1] = 0x04; param[2] = 0x68;
-			ps2_command(ps2dev, param, 0x30d1);
+			psmouse_command(psmouse, param, 0x30d1);
 			/* Enable features */
 			param[0] = 0x11; param[1] = 0x05; param[2] = 0x0b;
-			ps2_command(ps2dev, param, 0x30d1);
+			psmouse_command(psmouse, param, 0x30d1);
 			/* Enable PS2++ */
 			param[0] = 0x11; param[1] = 0x09; param[2] = 0xc3;
-			ps2_command(ps2dev, param, 0x30d1);
+			psmouse_command(psmouse, param, 0x30d1);
 
 			param[0] = 0;
-			if (!ps2_command(ps2dev, param, 0x13d1) &&
+			if (!psmouse_command(psmouse, param, 0x13d1) &&
 			    param[0] == 0x06 && param[1] == 0x00 && param[2] == 0x14) {
 				use_ps2pp = true;
 			}
@@ -23,8 +23,14 @@
 #include <linux/init.h>
 #include <linux/libps2.h>
 #include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/log2.h>
+#include <linux/kfifo.h>
 
 #include "psmouse.h"
+
+#define CREATE_TRACE_POINTS
+#include "psmouse-trace.h"
 #include "synaptics.h"
 #include "logips2pp.h"
 #include "alps.h"
@@ -52,6 +58,15 @@ static struct kernel_param_ops param_ops_proto_abbrev = {
 module_param_named(proto, psmouse_max_proto, proto_abbrev, 0644);
 MODULE_PARM_DESC(proto, "Highest protocol extension to probe (bare, imps, exps, any). Useful for KVM switches.");
 
+static int psmouse_set_probe_hint(const char *val, const struct kernel_param *kp);
+static int psmouse_get_probe_hint(char *buffer, const struct kernel_param *kp);
+static struct kernel_param_ops param_ops_probe_hint = {
+	.set = psmouse_set_probe_hint,
+	.get = psmouse_get_probe_hint,
+};
+module_param_cb(probe_hint, &param_ops_probe_hint, NULL, 0644);
+MODULE_PARM_DESC(probe_hint, "Protocol to probe first, per port (phys=protocol[,phys=protocol]). Updated after every successful detection.");
+
 static unsigned int psmouse_resolution = 200;
 module_param_named(resolution, psmouse_resolution, uint, 0644);
 MODULE_PARM_DESC(resolution, "Resolution, in dpi.");
@@ -72,6 +87,14 @@ static unsigned int psmouse_resync_time;
 module_param_named(resync_time, psmouse_resync_time, uint, 0644);
 MODULE_PARM_DESC(resync_time, "How long can mouse stay idle before forcing resync (in seconds, 0 = never).");
 
+static bool psmouse_async_probe;
+module_param_named(async_probe, psmouse_async_probe, bool, 0644);
+MODULE_PARM_DESC(async_probe, "Detect and initialize mice in the background (default false).");
+
+static bool psmouse_latency_stats;
+module_param_named(latency_stats, psmouse_latency_stats, bool, 0644);
+MODULE_PARM_DESC(latency_stats, "Count packet latencies in the stats attribute (default false).");
+
 PSMOUSE_DEFINE_ATTR(protocol, S_IWUSR | S_IRUGO,
 			NULL,
 			psmouse_attr_show_protocol, psmouse_attr_set_protocol);
@@ -87,6 +110,10 @@ PSMOUSE_DEFINE_ATTR(resetafter, S_IWUSR | S_IRUGO,
 PSMOUSE_DEFINE_ATTR(resync_time, S_IWUSR | S_IRUGO,
 			(void *) offsetof(struct psmouse, resync_time),
 			psmouse_show_int_attr, psmouse_set_int_attr);
+PSMOUSE_DEFINE_RO_ATTR(stats, S_IRUGO, NULL, psmouse_attr_show_stats);
+PSMOUSE_DEFINE_ATTR(deferred, S_IWUSR | S_IRUGO, NULL,
+			psmouse_attr_show_deferred, psmouse_attr_set_deferred);
+PSMOUSE_DEFINE_RO_ATTR(rtt, S_IRUGO, NULL, psmouse_attr_show_rtt);
 
 static struct attribute *psmouse_attributes[] = {
 	&psmouse_attr_protocol.dattr.attr,
@@ -94,6 +121,9 @@ static struct attribute *psmouse_attributes[] = {
 	&psmouse_attr_resolution.dattr.attr,
 	&psmouse_attr_resetafter.dattr.attr,
 	&psmouse_attr_resync_time.dattr.attr,
+	&psmouse_attr_stats.dattr.attr,
+	&psmouse_attr_deferred.dattr.attr,
+	&psmouse_attr_rtt.dattr.attr,
 	NULL
 };
 
@@ -102,11 +132,13 @@ static struct attribute_group psmouse_attribute_group = {
 };
 
 /*
- * psmouse_mutex protects all operations changing state of mouse
+ * psmouse->lock protects all operations changing state of mouse
  * (connecting, disconnecting, changing rate or resolution via
- * sysfs). We could use a per-device semaphore but since there
- * rarely more than one PS/2 mouse connected and since semaphore
- * is taken in "slow" paths it is not worth it.
+ * sysfs). Operations on a pass-through port have to deactivate the
+ * parent device as well, so pass-through ports share the lock of
+ * their parent and each physical port is serialized on its own.
+ *
+ * psmouse_mutex only protects global state (probe hints).
  */
 static DEFINE_MUTEX(psmouse_mutex);
 
@@ -216,14 +248,37 @@ void psmouse_queue_work(struct psmouse *psmouse, struct delayed_work *work,
 	queue_delayed_work(kpsmoused_wq, work, delay);
 }
 
+/*
+ * Queue of bytes waiting to be decoded in deferred mode, see
+ * psmouse_rx_work().
+ */
+
+#define PSMOUSE_RX_QUEUE_SIZE	64	/* Must be a power of 2 */
+#define PSMOUSE_RX_BURST	24	/* Whole 3, 4, 6 and 8 byte packets */
+
+struct psmouse_rx_byte {
+	u64 time;
+	unsigned char data;
+};
+
+struct psmouse_rx_queue {
+	DECLARE_KFIFO(fifo, struct psmouse_rx_byte, PSMOUSE_RX_QUEUE_SIZE);
+	struct work_struct work;
+	struct psmouse *psmouse;
+};
+
 /*
  * __psmouse_set_state() sets new psmouse state and resets all flags.
  */
 
 static inline void __psmouse_set_state(struct psmouse *psmouse, enum psmouse_state new_state)
 {
+	trace_psmouse_state(psmouse, new_state);
+
 	psmouse->state = new_state;
 	psmouse->pktcnt = psmouse->out_of_sync_cnt = 0;
+	if (psmouse->rxq)
+		kfifo_reset(&psmouse->rxq->fifo);
 	psmouse->ps2dev.flags = 0;
 	psmouse->last = jiffies;
 }
@@ -232,14 +287,158 @@ static inline void __psmouse_set_state(struct psmouse *psmouse, enum psmouse_sta
 /*
  * psmouse_set_state() sets new psmouse state and resets all flags and
  * counters while holding serio lock so fighting with interrupt handler
- * is not a concern.
+ * is not a concern. In deferred mode it also holds rx_lock and waits for
+ * the work item, so that no byte queued for the old state is decoded
+ * once it returns. Must not be called from the decoding path, which uses
+ * psmouse_rx_set_state().
  */
 
 void psmouse_set_state(struct psmouse *psmouse, enum psmouse_state new_state)
 {
+	struct psmouse_rx_queue *rxq;
+
+	spin_lock_bh(&psmouse->rx_lock);
 	serio_pause_rx(psmouse->ps2dev.serio);
 	__psmouse_set_state(psmouse, new_state);
+	rxq = psmouse->rxq;
 	serio_continue_rx(psmouse->ps2dev.serio);
+	spin_unlock_bh(&psmouse->rx_lock);
+
+	if (rxq) {
+		cancel_work_sync(&rxq->work);
+		/* Bytes queued since the reset belong to the new state */
+		if (kfifo_len(&rxq->fifo))
+			schedule_work(&rxq->work);
+	}
+}
+
+/*
+ * psmouse_rx_set_state() changes the state from the decoding path. In
+ * deferred mode that is psmouse_rx_work(), which holds rx_lock but not
+ * the serio lock; otherwise psmouse_interrupt() already holds the latter.
+ */
+
+static void psmouse_rx_set_state(struct psmouse *psmouse,
+				 enum psmouse_state new_state)
+{
+	if (psmouse->rxq) {
+		serio_pause_rx(psmouse->ps2dev.serio);
+		__psmouse_set_state(psmouse, new_state);
+		serio_continue_rx(psmouse->ps2dev.serio);
+	} else {
+		__psmouse_set_state(psmouse, new_state);
+	}
+}
+
+/*
+ * psmouse_pause_rx() and psmouse_continue_rx() keep the decoding path
+ * out, for protocol timers and other code touching decoder state from
+ * outside of it. Decoding runs under rx_lock in deferred mode and under
+ * the serio lock otherwise; psmouse->rxq only changes with both held, so
+ * it cannot change in between.
+ */
+
+void psmouse_pause_rx(struct psmouse *psmouse)
+{
+	spin_lock_bh(&psmouse->rx_lock);
+	if (!psmouse->rxq)
+		serio_pause_rx(psmouse->ps2dev.serio);
+}
+EXPORT_SYMBOL(psmouse_pause_rx);
+
+void psmouse_continue_rx(struct psmouse *psmouse)
+{
+	if (!psmouse->rxq)
+		serio_continue_rx(psmouse->ps2dev.serio);
+	spin_unlock_bh(&psmouse->rx_lock);
+}
+EXPORT_SYMBOL(psmouse_continue_rx);
+
+/*
+ * psmouse_account_latency() records how long it took from the
+ * interrupt delivering the last byte of a packet until it was reported.
+ * Every completed packet passes through here, so the clock is only read
+ * when the latency_stats parameter asks for the histogram.
+ */
+
+void psmouse_account_latency(struct psmouse *psmouse)
+{
+	u64 us;
+	int bucket;
+
+	trace_psmouse_packet(psmouse);
+
+	if (!psmouse_latency_stats)
+		return;
+
+	us = div_u64(local_clock() - psmouse->irq_time, NSEC_PER_USEC);
+	bucket = us ? ilog2(us) : 0;
+	if (bucket >= PSMOUSE_LATENCY_BUCKETS)
+		bucket = PSMOUSE_LATENCY_BUCKETS - 1;
+
+	psmouse->stats.latency[bucket]++;
+}
+
+/*
+ * psmouse_realign() is called when the protocol handler rejects the
+ * packet being assembled. Rather than dropping all buffered bytes it
+ * looks for a later byte the protocol accepts as a packet header and
+ * replays the stream from there. A packet completed by the replay is
+ * reported and the bytes after it are replayed the same way, so that a
+ * short packet (a bare PS/2 packet from an ALPS touchpad, for example)
+ * does not take the start of the next one with it. Returns true if
+ * anything was salvaged.
+ */
+
+static bool psmouse_realign(struct psmouse *psmouse)
+{
+	unsigned char window[sizeof(psmouse->packet)];
+	int len = psmouse->pktcnt;
+	psmouse_ret_t rc = PSMOUSE_GOOD_DATA;
+	bool reported = false;
+	int start, i;
+
+	if (!psmouse->validate_header || len < 2)
+		return false;
+
+	memcpy(window, psmouse->packet, len);
+
+	start = 1;
+	while (start < len) {
+		psmouse->packet[0] = window[start];
+		if (!psmouse->validate_header(psmouse)) {
+			start++;
+			continue;
+		}
+
+		psmouse->pktcnt = 0;
+		for (i = start; i < len; i++) {
+			psmouse->packet[psmouse->pktcnt++] = window[i];
+			rc = psmouse->protocol_handler(psmouse);
+			if (rc != PSMOUSE_GOOD_DATA)
+				break;
+		}
+
+		if (i == len)
+			return true;
+
+		if (rc == PSMOUSE_BAD_DATA) {
+			start++;
+			continue;
+		}
+
+		/*
+		 * The packet has been reported, so we cannot go back
+		 * any more. Whatever is left starts a new packet.
+		 */
+		psmouse->stats.packets++;
+		psmouse_account_latency(psmouse);
+		reported = true;
+		start = i + 1;
+	}
+
+	psmouse->pktcnt = 0;
+	return reported;
 }
 
 /*
@@ -251,15 +450,37 @@ static int psmouse_handle_byte(struct psmouse *psmouse)
 {
 	psmouse_ret_t rc = psmouse->protocol_handler(psmouse);
 
+	psmouse->stats.bytes++;
+
 	switch (rc) {
 	case PSMOUSE_BAD_DATA:
+		psmouse->stats.bad_data++;
 		if (psmouse->state == PSMOUSE_ACTIVATED) {
+			if (psmouse_realign(psmouse)) {
+				psmouse->stats.realigned++;
+				psmouse_dbg(psmouse,
+					    "%s at %s realigned, %d bytes kept\n",
+					    psmouse->name, psmouse->phys,
+					    psmouse->pktcnt);
+				break;
+			}
 			psmouse_warn(psmouse,
 				     "%s at %s lost sync at byte %d\n",
 				     psmouse->name, psmouse->phys,
 				     psmouse->pktcnt);
 			if (++psmouse->out_of_sync_cnt == psmouse->resetafter) {
-				__psmouse_set_state(psmouse, PSMOUSE_IGNORE);
+				/*
+				 * If the device can be polled, try to
+				 * resync before resorting to a reconnect;
+				 * psmouse_resync() reconnects if it fails.
+				 */
+				if (psmouse->resync_time) {
+					psmouse->badbyte = psmouse->packet[0];
+					psmouse_rx_set_state(psmouse, PSMOUSE_RESYNCING);
+					psmouse_queue_work(psmouse, &psmouse->resync_work, 0);
+					return -1;
+				}
+				psmouse_rx_set_state(psmouse, PSMOUSE_IGNORE);
 				psmouse_notice(psmouse,
 						"issuing reconnect request\n");
 				serio_reconnect(psmouse->ps2dev.serio);
@@ -270,6 +491,8 @@ static int psmouse_handle_byte(struct psmouse *psmouse)
 		break;
 
 	case PSMOUSE_FULL_PACKET:
+		psmouse->stats.packets++;
+		psmouse_account_latency(psmouse);
 		psmouse->pktcnt = 0;
 		if (psmouse->out_of_sync_cnt) {
 			psmouse->out_of_sync_cnt = 0;
@@ -286,49 +509,51 @@ static int psmouse_handle_byte(struct psmouse *psmouse)
 }
 
 /*
- * psmouse_interrupt() handles incoming characters, either passing them
- * for normal processing or gathering them as command response.
+ * psmouse_trace_byte() appends a byte to the debugfs trace ring. There
+ * is a single producer per device, the interrupt handler, so all it
+ * takes is filling in the entry and publishing the new head.
  */
 
-static irqreturn_t psmouse_interrupt(struct serio *serio,
-		unsigned char data, unsigned int flags)
+static inline void psmouse_trace_byte(struct psmouse *psmouse,
+				      unsigned char data, unsigned int flags)
 {
-	struct psmouse *psmouse = serio_get_drvdata(serio);
-
-	if (psmouse->state == PSMOUSE_IGNORE)
-		goto out;
-
-	if (unlikely((flags & SERIO_TIMEOUT) ||
-		     ((flags & SERIO_PARITY) && !psmouse->ignore_parity))) {
-
-		if (psmouse->state == PSMOUSE_ACTIVATED)
-			psmouse_warn(psmouse,
-				     "bad data from KBC -%s%s\n",
-				     flags & SERIO_TIMEOUT ? " timeout" : "",
-				     flags & SERIO_PARITY ? " bad parity" : "");
-		ps2_cmd_aborted(&psmouse->ps2dev);
-		goto out;
-	}
-
-	if (unlikely(psmouse->ps2dev.flags & PS2_FLAG_ACK))
-		if  (ps2_handle_ack(&psmouse->ps2dev, data))
-			goto out;
-
-	if (unlikely(psmouse->ps2dev.flags & PS2_FLAG_CMD))
-		if  (ps2_handle_response(&psmouse->ps2dev, data))
-			goto out;
+	struct psmouse_trace *trace = psmouse->trace;
+	struct psmouse_trace_entry *entry;
+	u32 head;
+
+	if (!trace)
+		return;
+
+	head = trace->head;
+	entry = &trace->entry[head & (trace->size - 1)];
+	entry->time = local_clock();
+	entry->data = data;
+	entry->flags = flags;
+	entry->state = psmouse->state;
+	entry->pktcnt = psmouse->pktcnt;
+
+	smp_wmb();
+	ACCESS_ONCE(trace->head) = head + 1;
+}
 
-	if (psmouse->state <= PSMOUSE_RESYNCING)
-		goto out;
+/*
+ * psmouse_receive_byte() adds a byte of motion data to the packet being
+ * assembled and hands it to the protocol handler. It runs either from
+ * psmouse_interrupt() with the serio lock held or, in deferred mode,
+ * from psmouse_rx_work() with rx_lock held.
+ */
 
+static void psmouse_receive_byte(struct psmouse *psmouse, unsigned char data)
+{
 	if (psmouse->state == PSMOUSE_ACTIVATED &&
 	    psmouse->pktcnt && time_after(jiffies, psmouse->last + HZ/2)) {
 		psmouse_info(psmouse, "%s at %s lost synchronization, throwing %d bytes away.\n",
 			     psmouse->name, psmouse->phys, psmouse->pktcnt);
+		psmouse->stats.bad_timeout++;
 		psmouse->badbyte = psmouse->packet[0];
-		__psmouse_set_state(psmouse, PSMOUSE_RESYNCING);
+		psmouse_rx_set_state(psmouse, PSMOUSE_RESYNCING);
 		psmouse_queue_work(psmouse, &psmouse->resync_work, 0);
-		goto out;
+		return;
 	}
 
 	psmouse->packet[psmouse->pktcnt++] = data;
@@ -338,22 +563,22 @@ static irqreturn_t psmouse_interrupt(struct serio *serio,
 	if (unlikely(psmouse->packet[0] == PSMOUSE_RET_BAT && psmouse->pktcnt <= 2)) {
 		if (psmouse->pktcnt == 1) {
 			psmouse->last = jiffies;
-			goto out;
+			return;
 		}
 
 		if (psmouse->packet[1] == PSMOUSE_RET_ID ||
 		    (psmouse->type == PSMOUSE_HGPK &&
 		     psmouse->packet[1] == PSMOUSE_RET_BAT)) {
-			__psmouse_set_state(psmouse, PSMOUSE_IGNORE);
-			serio_reconnect(serio);
-			goto out;
+			psmouse_rx_set_state(psmouse, PSMOUSE_IGNORE);
+			serio_reconnect(psmouse->ps2dev.serio);
+			return;
 		}
 /*
  * Not a new device, try processing first byte normally
  */
 		psmouse->pktcnt = 1;
 		if (psmouse_handle_byte(psmouse))
-			goto out;
+			return;
 
 		psmouse->packet[psmouse->pktcnt++] = data;
 	}
@@ -365,13 +590,211 @@ static irqreturn_t psmouse_interrupt(struct serio *serio,
 	    psmouse->pktcnt == 1 && psmouse->resync_time &&
 	    time_after(jiffies, psmouse->last + psmouse->resync_time * HZ)) {
 		psmouse->badbyte = psmouse->packet[0];
-		__psmouse_set_state(psmouse, PSMOUSE_RESYNCING);
+		psmouse_rx_set_state(psmouse, PSMOUSE_RESYNCING);
 		psmouse_queue_work(psmouse, &psmouse->resync_work, 0);
-		goto out;
+		return;
 	}
 
 	psmouse->last = jiffies;
 	psmouse_handle_byte(psmouse);
+}
+
+/*
+ * Deferred decoding. In this mode psmouse_interrupt() only queues the
+ * byte and its timestamp, and protocol handlers run from a work item.
+ * The serio lock is only held to take bytes off the queue; decoding
+ * runs under psmouse->rx_lock, with interrupts enabled. Protocol timers
+ * and other code touching decoder state synchronize with it through
+ * psmouse_pause_rx(), and psmouse_set_state() takes both locks.
+ */
+
+static void psmouse_rx_queue(struct psmouse *psmouse, unsigned char data,
+			     u64 time)
+{
+	struct psmouse_rx_queue *rxq = psmouse->rxq;
+	struct psmouse_rx_byte rx = {
+		.time = time,
+		.data = data,
+	};
+
+	if (!kfifo_put(&rxq->fifo, &rx))
+		psmouse->stats.rx_overruns++;
+
+	schedule_work(&rxq->work);
+}
+
+/*
+ * psmouse_receive_burst() decodes a run of queued bytes, letting the
+ * protocol's burst handler take whole packets whenever we are at a
+ * packet boundary and falling back to psmouse_receive_byte() for
+ * everything else.
+ */
+
+static void psmouse_receive_burst(struct psmouse *psmouse,
+				  const unsigned char *data, const u64 *time,
+				  int count)
+{
+	int n = 0, used, packets;
+
+	while (n < count) {
+		/* A byte may have changed the state, see psmouse_rx_set_state() */
+		if (psmouse->state <= PSMOUSE_RESYNCING)
+			break;
+
+		if (psmouse->burst_handler &&
+		    psmouse->state == PSMOUSE_ACTIVATED && !psmouse->pktcnt &&
+		    !(psmouse->resync_time &&
+		      time_after(jiffies,
+				 psmouse->last + psmouse->resync_time * HZ))) {
+
+			used = psmouse->burst_handler(psmouse, data + n,
+						      time + n, count - n,
+						      &packets);
+			if (used) {
+				psmouse->stats.bytes += used;
+				psmouse->stats.packets += packets;
+				psmouse->last = jiffies;
+				if (packets && psmouse->out_of_sync_cnt) {
+					psmouse->out_of_sync_cnt = 0;
+					psmouse_notice(psmouse,
+						"%s at %s - driver resynced.\n",
+						psmouse->name, psmouse->phys);
+				}
+				n += used;
+				continue;
+			}
+		}
+
+		psmouse->irq_time = time[n];
+		psmouse_receive_byte(psmouse, data[n]);
+		n++;
+	}
+}
+
+static void psmouse_rx_work(struct work_struct *work)
+{
+	struct psmouse_rx_queue *rxq =
+		container_of(work, struct psmouse_rx_queue, work);
+	struct psmouse *psmouse = rxq->psmouse;
+	struct serio *serio = psmouse->ps2dev.serio;
+	struct psmouse_rx_byte rx[PSMOUSE_RX_BURST];
+	unsigned char data[PSMOUSE_RX_BURST];
+	u64 time[PSMOUSE_RX_BURST];
+	int i, count;
+
+	for (;;) {
+		spin_lock_bh(&psmouse->rx_lock);
+
+		serio_pause_rx(serio);
+		count = kfifo_out(&rxq->fifo, rx, PSMOUSE_RX_BURST);
+		serio_continue_rx(serio);
+
+		if (!count) {
+			spin_unlock_bh(&psmouse->rx_lock);
+			break;
+		}
+
+		/* Queue is flushed on state changes, but be careful */
+		if (psmouse->state > PSMOUSE_RESYNCING) {
+			for (i = 0; i < count; i++) {
+				data[i] = rx[i].data;
+				time[i] = rx[i].time;
+			}
+			psmouse_receive_burst(psmouse, data, time, count);
+		}
+
+		spin_unlock_bh(&psmouse->rx_lock);
+	}
+}
+
+static int psmouse_set_deferred(struct psmouse *psmouse, bool enable)
+{
+	struct serio *serio = psmouse->ps2dev.serio;
+	struct psmouse_rx_queue *rxq;
+
+	if (enable == !!psmouse->rxq)
+		return 0;
+
+	if (enable) {
+		rxq = kzalloc(sizeof(*rxq), GFP_KERNEL);
+		if (!rxq)
+			return -ENOMEM;
+
+		INIT_KFIFO(rxq->fifo);
+		INIT_WORK(&rxq->work, psmouse_rx_work);
+		rxq->psmouse = psmouse;
+
+		spin_lock_bh(&psmouse->rx_lock);
+		serio_pause_rx(serio);
+		psmouse->rxq = rxq;
+		serio_continue_rx(serio);
+		spin_unlock_bh(&psmouse->rx_lock);
+	} else {
+		rxq = psmouse->rxq;
+
+		/* Bytes still queued are dropped */
+		spin_lock_bh(&psmouse->rx_lock);
+		serio_pause_rx(serio);
+		kfifo_reset(&rxq->fifo);
+		psmouse->rxq = NULL;
+		serio_continue_rx(serio);
+		spin_unlock_bh(&psmouse->rx_lock);
+
+		cancel_work_sync(&rxq->work);
+		kfree(rxq);
+	}
+
+	return 0;
+}
+
+/*
+ * psmouse_interrupt() handles incoming characters, either passing them
+ * for normal processing or gathering them as command response.
+ */
+
+static irqreturn_t psmouse_interrupt(struct serio *serio,
+		unsigned char data, unsigned int flags)
+{
+	struct psmouse *psmouse = serio_get_drvdata(serio);
+
+	psmouse_trace_byte(psmouse, data, flags);
+	trace_psmouse_byte(psmouse, data, flags);
+
+	if (psmouse->state == PSMOUSE_IGNORE)
+		goto out;
+
+	if (unlikely((flags & SERIO_TIMEOUT) ||
+		     ((flags & SERIO_PARITY) && !psmouse->ignore_parity))) {
+
+		psmouse->stats.kbc_errors++;
+		if (psmouse->state == PSMOUSE_ACTIVATED)
+			psmouse_warn(psmouse,
+				     "bad data from KBC -%s%s\n",
+				     flags & SERIO_TIMEOUT ? " timeout" : "",
+				     flags & SERIO_PARITY ? " bad parity" : "");
+		ps2_cmd_aborted(&psmouse->ps2dev);
+		goto out;
+	}
+
+	if (unlikely(psmouse->ps2dev.flags & PS2_FLAG_ACK))
+		if  (ps2_handle_ack(&psmouse->ps2dev, data))
+			goto out;
+
+	if (unlikely(psmouse->ps2dev.flags & PS2_FLAG_CMD))
+		if  (ps2_handle_response(&psmouse->ps2dev, data))
+			goto out;
+
+	if (psmouse->state <= PSMOUSE_RESYNCING)
+		goto out;
+
+	/* In deferred mode nothing is decoded here, see psmouse_rx_work() */
+	if (psmouse->rxq) {
+		psmouse_rx_queue(psmouse, data, local_clock());
+		goto out;
+	}
+
+	psmouse->irq_time = local_clock();
+	psmouse_receive_byte(psmouse, data);
 
  out:
 	return IRQ_HANDLED;
@@ -387,18 +810,258 @@ static irqreturn_t psmouse_interrupt(struct serio *serio,
  */
 int psmouse_sliced_command(struct psmouse *psmouse, unsigned char command)
 {
-	int i;
+	struct psmouse_cmd seq[PSMOUSE_SLICED_CMDS];
+	unsigned char nibbles[4];
 
-	if (ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_SETSCALE11))
+	psmouse_sliced_seq(seq, nibbles, command);
+
+	if (psmouse_command_seq(psmouse, seq, PSMOUSE_SLICED_CMDS,
+				PSMOUSE_CMD_SEQ_TIMEOUT, NULL))
 		return -1;
 
-	for (i = 6; i >= 0; i -= 2) {
-		unsigned char d = (command >> i) & 3;
-		if (ps2_command(&psmouse->ps2dev, &d, PSMOUSE_CMD_SETRES))
-			return -1;
+	return 0;
+}
+
+/*
+ * Command round trip estimate. Every command that only expects an ACK
+ * is timed and fed into a smoothed mean and mean deviation, the same
+ * way TCP estimates its retransmission timeout. ACK timeouts which used
+ * to be sized for the slowest devices can then follow what this device
+ * actually does, with the old constant as the upper limit. Delays
+ * before retrying a failed command start from the same estimate, see
+ * psmouse_retry_delay(). Waits for answers other than an ACK keep their
+ * constants.
+ */
+
+#define PSMOUSE_RTT_MIN_MS	10
+
+static void psmouse_rtt_sample(struct psmouse *psmouse, u64 start)
+{
+	u64 sample = div_u64(local_clock() - start, NSEC_PER_USEC);
+	unsigned int rtt = min_t(u64, sample, UINT_MAX / 8);
+	int err;
+
+	if (!psmouse->rtt_samples++) {
+		psmouse->srtt_us = rtt;
+		psmouse->rttvar_us = rtt / 2;
+		return;
 	}
 
-	return 0;
+	err = rtt - psmouse->srtt_us;
+	psmouse->srtt_us += err / 8;
+	psmouse->rttvar_us += ((err < 0 ? -err : err) -
+			       (int)psmouse->rttvar_us) / 4;
+}
+
+/*
+ * psmouse_rtt_timeout() returns an ACK timeout, in ms, derived from
+ * the round trip estimate but no longer than max_timeout, which is also
+ * used as long as nothing has been measured.
+ */
+unsigned int psmouse_rtt_timeout(struct psmouse *psmouse,
+				 unsigned int max_timeout)
+{
+	unsigned int timeout;
+
+	if (!psmouse->rtt_samples)
+		return max_timeout;
+
+	timeout = DIV_ROUND_UP(psmouse->srtt_us + 4 * psmouse->rttvar_us,
+			       USEC_PER_MSEC);
+	/* Jiffy based waits may end up to a jiffy early */
+	timeout = max3(timeout, (unsigned int)PSMOUSE_RTT_MIN_MS,
+		       jiffies_to_msecs(2));
+
+	return min(timeout, max_timeout);
+}
+
+/*
+ * psmouse_retry_delay() returns how long to wait, in ms, before retry
+ * number retry (counting from 0) of a command that failed: the ACK
+ * timeout from psmouse_rtt_timeout(), doubled for every earlier retry,
+ * and never longer than max_delay. A device that answers quickly gets
+ * retried quickly, one that keeps failing soon waits as long as before.
+ */
+unsigned int psmouse_retry_delay(struct psmouse *psmouse, int retry,
+				 unsigned int max_delay)
+{
+	unsigned int delay = psmouse_rtt_timeout(psmouse, max_delay);
+
+	while (retry-- > 0 && delay < max_delay)
+		delay *= 2;
+
+	return min(delay, max_delay);
+}
+
+/*
+ * psmouse_sendbyte() is ps2_sendbyte() with the timeout adapted to the
+ * device, see psmouse_rtt_timeout(). If the shorter timeout runs out
+ * without an answer the byte is not sent again: an ACK that is merely
+ * late would be taken for the answer to the second copy, and the device
+ * would see the byte twice, which breaks sequences such as Sentelic's
+ * register access. Instead the same transaction keeps waiting until
+ * max_timeout is used up. The caller must have begun a command as for
+ * ps2_sendbyte().
+ */
+int psmouse_sendbyte(struct psmouse *psmouse, unsigned char byte,
+		     unsigned int max_timeout)
+{
+	struct ps2dev *ps2dev = &psmouse->ps2dev;
+	unsigned int timeout = psmouse_rtt_timeout(psmouse, max_timeout);
+	u64 start = local_clock();
+	int error;
+
+	serio_pause_rx(ps2dev->serio);
+	ps2dev->nak = 1;
+	ps2dev->flags |= PS2_FLAG_ACK;
+	serio_continue_rx(ps2dev->serio);
+
+	if (serio_write(ps2dev->serio, byte) == 0 &&
+	    !wait_event_timeout(ps2dev->wait,
+				!(ps2dev->flags & PS2_FLAG_ACK),
+				msecs_to_jiffies(timeout)) &&
+	    timeout < max_timeout) {
+		/* Slower than expected, back off */
+		if (psmouse->rttvar_us < UINT_MAX / 8)
+			psmouse->rttvar_us = 2 * psmouse->rttvar_us +
+					     USEC_PER_MSEC;
+
+		wait_event_timeout(ps2dev->wait,
+				   !(ps2dev->flags & PS2_FLAG_ACK),
+				   msecs_to_jiffies(max_timeout - timeout));
+	}
+
+	serio_pause_rx(ps2dev->serio);
+	ps2dev->flags &= ~PS2_FLAG_ACK;
+	error = -ps2dev->nak;
+	serio_continue_rx(ps2dev->serio);
+
+	trace_psmouse_command(psmouse, byte, error, local_clock() - start);
+	if (!error)
+		psmouse_rtt_sample(psmouse, start);
+
+	return error;
+}
+
+/*
+ * psmouse_sendbyte_nak() sends a byte the device is expected to refuse,
+ * such as the out of range sample rates of the Sentelic register access
+ * sequences. A NAK may take the device longer than an ACK, so the full
+ * timeout applies and nothing is learned about the round trip time.
+ */
+int psmouse_sendbyte_nak(struct psmouse *psmouse, unsigned char byte,
+			 unsigned int timeout)
+{
+	u64 start = local_clock();
+	int error;
+
+	error = ps2_sendbyte(&psmouse->ps2dev, byte, timeout);
+	trace_psmouse_command(psmouse, byte, error, local_clock() - start);
+
+	return error;
+}
+
+/*
+ * psmouse_command() is ps2_command() with the command traced like the
+ * ones above, so every command a protocol sends shows up in the trace.
+ * __psmouse_command() is the same for __ps2_command(), for callers that
+ * have begun a command themselves.
+ */
+int psmouse_command(struct psmouse *psmouse, unsigned char *param, int command)
+{
+	u64 start = local_clock();
+	int error;
+
+	error = ps2_command(&psmouse->ps2dev, param, command);
+	trace_psmouse_command(psmouse, command, error, local_clock() - start);
+
+	return error;
+}
+
+int __psmouse_command(struct psmouse *psmouse, unsigned char *param,
+		      int command)
+{
+	u64 start = local_clock();
+	int error;
+
+	error = __ps2_command(&psmouse->ps2dev, param, command);
+	trace_psmouse_command(psmouse, command, error, local_clock() - start);
+
+	return error;
+}
+
+/*
+ * psmouse_sliced_seq() fills seq with the commands psmouse_sliced_command()
+ * would send, so they can be part of a longer sequence. nibbles needs room
+ * for 4 bytes and has to stay around until the sequence is sent. Returns
+ * the number of commands used, PSMOUSE_SLICED_CMDS.
+ */
+int psmouse_sliced_seq(struct psmouse_cmd *seq, unsigned char *nibbles,
+		       unsigned char command)
+{
+	int i;
+
+	seq[0].command = PSMOUSE_CMD_SETSCALE11;
+	seq[0].param = NULL;
+
+	for (i = 0; i < 4; i++) {
+		nibbles[i] = (command >> (6 - 2 * i)) & 3;
+		seq[i + 1].command = PSMOUSE_CMD_SETRES;
+		seq[i + 1].param = &nibbles[i];
+	}
+
+	return PSMOUSE_SLICED_CMDS;
+}
+
+/*
+ * psmouse_command_seq() sends a sequence of PS/2 commands while holding
+ * the port for the whole sequence instead of taking and releasing it
+ * for every command. It stops at the first failure or, between commands,
+ * once the sequence took longer than timeout_ms. The index of the
+ * command that failed or was not sent is then stored in *failed, if
+ * failed is not NULL, so callers can resume or report it.
+ */
+int psmouse_command_seq(struct psmouse *psmouse, const struct psmouse_cmd *seq,
+			int count, unsigned int timeout_ms, int *failed)
+{
+	struct ps2dev *ps2dev = &psmouse->ps2dev;
+	unsigned long deadline = jiffies + msecs_to_jiffies(timeout_ms);
+	int i, error = 0;
+	u64 start;
+
+	ps2_begin_command(ps2dev);
+
+	for (i = 0; i < count; i++) {
+		if (i && time_after(jiffies, deadline)) {
+			error = -ETIMEDOUT;
+			break;
+		}
+
+		start = local_clock();
+		error = __ps2_command(ps2dev, seq[i].param, seq[i].command);
+		trace_psmouse_command(psmouse, seq[i].command, error,
+				      local_clock() - start);
+		if (error) {
+			error = -EIO;
+			break;
+		}
+
+		/* Only ACK round trips, responses take longer */
+		if (!((seq[i].command >> 8) & 0xf))
+			psmouse_rtt_sample(psmouse, start);
+	}
+
+	ps2_end_command(ps2dev);
+
+	if (error) {
+		psmouse_dbg(psmouse, "command %d/%d (%#04x) %s\n",
+			    i + 1, count, seq[i].command,
+			    error == -ETIMEDOUT ? "out of time" : "failed");
+		if (failed)
+			*failed = i;
+	}
+
+	return error;
 }
 
 
@@ -409,7 +1072,7 @@ int psmouse_reset(struct psmouse *psmouse)
 {
 	unsigned char param[2];
 
-	if (ps2_command(&psmouse->ps2dev, param, PSMOUSE_CMD_RESET_BAT))
+	if (psmouse_command(psmouse, param, PSMOUSE_CMD_RESET_BAT))
 		return -1;
 
 	if (param[0] != PSMOUSE_RET_BAT && param[1] != PSMOUSE_RET_ID)
@@ -424,15 +1087,14 @@ int psmouse_reset(struct psmouse *psmouse)
  */
 static int genius_detect(struct psmouse *psmouse, bool set_properties)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[4];
 
 	param[0] = 3;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES);
-	ps2_command(ps2dev,  NULL, PSMOUSE_CMD_SETSCALE11);
-	ps2_command(ps2dev,  NULL, PSMOUSE_CMD_SETSCALE11);
-	ps2_command(ps2dev,  NULL, PSMOUSE_CMD_SETSCALE11);
-	ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11);
+	psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11);
+	psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_GETINFO);
 
 	if (param[0] != 0x00 || param[1] != 0x33 || param[2] != 0x55)
 		return -1;
@@ -456,16 +1118,15 @@ static int genius_detect(struct psmouse *psmouse, bool set_properties)
  */
 static int intellimouse_detect(struct psmouse *psmouse, bool set_properties)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[2];
 
 	param[0] = 200;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
 	param[0] = 100;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
 	param[0] =  80;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
-	ps2_command(ps2dev, param, PSMOUSE_CMD_GETID);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_GETID);
 
 	if (param[0] != 3)
 		return -1;
@@ -489,29 +1150,28 @@ static int intellimouse_detect(struct psmouse *psmouse, bool set_properties)
  */
 static int im_explorer_detect(struct psmouse *psmouse, bool set_properties)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[2];
 
 	intellimouse_detect(psmouse, 0);
 
 	param[0] = 200;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
 	param[0] = 200;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
 	param[0] =  80;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
-	ps2_command(ps2dev, param, PSMOUSE_CMD_GETID);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_GETID);
 
 	if (param[0] != 4)
 		return -1;
 
 /* Magic to enable horizontal scrolling on IntelliMouse 4.0 */
 	param[0] = 200;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
 	param[0] =  80;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
 	param[0] =  40;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
 
 	if (set_properties) {
 		__set_bit(BTN_MIDDLE, psmouse->dev->keybit);
@@ -535,20 +1195,19 @@ static int im_explorer_detect(struct psmouse *psmouse, bool set_properties)
  */
 static int thinking_detect(struct psmouse *psmouse, bool set_properties)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[2];
 	static const unsigned char seq[] = { 20, 60, 40, 20, 20, 60, 40, 20, 20 };
 	int i;
 
 	param[0] = 10;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
 	param[0] = 0;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES);
 	for (i = 0; i < ARRAY_SIZE(seq); i++) {
 		param[0] = seq[i];
-		ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
+		psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
 	}
-	ps2_command(ps2dev, param, PSMOUSE_CMD_GETID);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_GETID);
 
 	if (param[0] != 2)
 		return -1;
@@ -599,16 +1258,38 @@ static int cortron_detect(struct psmouse *psmouse, bool set_properties)
 		__set_bit(BTN_SIDE, psmouse->dev->keybit);
 	}
 
-	return 0;
+	return 0;
+}
+
+/* Adds a probe to the summary psmouse_extensions() logs */
+static void psmouse_log_probe(struct psmouse *psmouse, const char *name,
+			      u64 start, int error)
+{
+	size_t len = strlen(psmouse->probe_log);
+
+	scnprintf(psmouse->probe_log + len, sizeof(psmouse->probe_log) - len,
+		  "%s%s %llu us%s", len ? ", " : "", name,
+		  div_u64(local_clock() - start, NSEC_PER_USEC),
+		  error ? " failed" : "");
 }
 
+/* Evaluates probe and records how long it took */
+#define psmouse_timed_probe(psmouse, name, probe)			\
+({									\
+	u64 __start = local_clock();					\
+	int __error = (probe);						\
+									\
+	psmouse_log_probe(psmouse, name, __start, __error);		\
+	__error;							\
+})
+
 /*
- * psmouse_extensions() probes for any extensions to the basic PS/2 protocol
- * the mouse may have.
+ * psmouse_probe_extensions() probes for any extensions to the basic PS/2
+ * protocol the mouse may have.
  */
 
-static int psmouse_extensions(struct psmouse *psmouse,
-			      unsigned int max_proto, bool set_properties)
+static int psmouse_probe_extensions(struct psmouse *psmouse,
+				    unsigned int max_proto, bool set_properties)
 {
 	bool synaptics_hardware = false;
 
@@ -628,7 +1309,8 @@ static int psmouse_extensions(struct psmouse *psmouse,
  * upsets the thinkingmouse).
  */
 
-	if (max_proto > PSMOUSE_IMEX && thinking_detect(psmouse, set_properties) == 0)
+	if (max_proto > PSMOUSE_IMEX && psmouse_timed_probe(psmouse, "thinkps",
+				thinking_detect(psmouse, set_properties)) == 0)
 		return PSMOUSE_THINKPS;
 
 /*
@@ -636,7 +1318,8 @@ static int psmouse_extensions(struct psmouse *psmouse,
  * support is disabled in config - we need to know if it is synaptics so we
  * can reset it properly after probing for intellimouse.
  */
-	if (max_proto > PSMOUSE_PS2 && synaptics_detect(psmouse, set_properties) == 0) {
+	if (max_proto > PSMOUSE_PS2 && psmouse_timed_probe(psmouse, "synaptics",
+				synaptics_detect(psmouse, set_properties)) == 0) {
 		synaptics_hardware = true;
 
 		if (max_proto > PSMOUSE_IMEX) {
@@ -666,8 +1349,9 @@ static int psmouse_extensions(struct psmouse *psmouse,
  * Try ALPS TouchPad
  */
 	if (max_proto > PSMOUSE_IMEX) {
-		ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_RESET_DIS);
-		if (alps_detect(psmouse, set_properties) == 0) {
+		psmouse_command(psmouse, NULL, PSMOUSE_CMD_RESET_DIS);
+		if (psmouse_timed_probe(psmouse, "alps",
+				alps_detect(psmouse, set_properties)) == 0) {
 			if (!set_properties || alps_init(psmouse) == 0)
 				return PSMOUSE_ALPS;
 /*
@@ -681,7 +1365,8 @@ static int psmouse_extensions(struct psmouse *psmouse,
  * Try OLPC HGPK touchpad.
  */
 	if (max_proto > PSMOUSE_IMEX &&
-			hgpk_detect(psmouse, set_properties) == 0) {
+			psmouse_timed_probe(psmouse, "hgpk",
+				hgpk_detect(psmouse, set_properties)) == 0) {
 		if (!set_properties || hgpk_init(psmouse) == 0)
 			return PSMOUSE_HGPK;
 /*
@@ -694,7 +1379,8 @@ static int psmouse_extensions(struct psmouse *psmouse,
  * Try Elantech touchpad.
  */
 	if (max_proto > PSMOUSE_IMEX &&
-			elantech_detect(psmouse, set_properties) == 0) {
+			psmouse_timed_probe(psmouse, "elantech",
+				elantech_detect(psmouse, set_properties)) == 0) {
 		if (!set_properties || elantech_init(psmouse) == 0)
 			return PSMOUSE_ELANTECH;
 /*
@@ -705,16 +1391,20 @@ static int psmouse_extensions(struct psmouse *psmouse,
 
 
 	if (max_proto > PSMOUSE_IMEX) {
-		if (genius_detect(psmouse, set_properties) == 0)
+		if (psmouse_timed_probe(psmouse, "genius",
+				genius_detect(psmouse, set_properties)) == 0)
 			return PSMOUSE_GENPS;
 
-		if (ps2pp_init(psmouse, set_properties) == 0)
+		if (psmouse_timed_probe(psmouse, "logitech",
+				ps2pp_init(psmouse, set_properties)) == 0)
 			return PSMOUSE_PS2PP;
 
-		if (trackpoint_detect(psmouse, set_properties) == 0)
+		if (psmouse_timed_probe(psmouse, "trackpoint",
+				trackpoint_detect(psmouse, set_properties)) == 0)
 			return PSMOUSE_TRACKPOINT;
 
-		if (touchkit_ps2_detect(psmouse, set_properties) == 0)
+		if (psmouse_timed_probe(psmouse, "touchkit",
+				touchkit_ps2_detect(psmouse, set_properties)) == 0)
 			return PSMOUSE_TOUCHKIT_PS2;
 	}
 
@@ -723,7 +1413,8 @@ static int psmouse_extensions(struct psmouse *psmouse,
  * Trackpoint devices (causing TP_READ_ID command to time out).
  */
 	if (max_proto > PSMOUSE_IMEX) {
-		if (fsp_detect(psmouse, set_properties) == 0) {
+		if (psmouse_timed_probe(psmouse, "fsp",
+				fsp_detect(psmouse, set_properties)) == 0) {
 			if (!set_properties || fsp_init(psmouse) == 0)
 				return PSMOUSE_FSP;
 /*
@@ -738,7 +1429,7 @@ static int psmouse_extensions(struct psmouse *psmouse,
  * protocol probes. Note that we follow up with full reset because
  * some mice put themselves to sleep when they see PSMOUSE_RESET_DIS.
  */
-	ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_RESET_DIS);
+	psmouse_command(psmouse, NULL, PSMOUSE_CMD_RESET_DIS);
 	psmouse_reset(psmouse);
 
 	if (max_proto >= PSMOUSE_IMEX && im_explorer_detect(psmouse, set_properties) == 0)
@@ -922,6 +1613,174 @@ static const struct psmouse_protocol *psmouse_protocol_by_name(const char *name,
 }
 
 
+/*
+ * Probe hints. psmouse_probe_extensions() walks through every protocol
+ * we know of and a probe for the wrong one can take a while to time
+ * out, so we remember which protocol was found on each port and try
+ * that one first next time (on resume, rebind or protocol switch).
+ * The hints can also be seeded or cleared through the probe_hint
+ * module parameter. All of this is protected by psmouse_mutex.
+ */
+
+#define PSMOUSE_PROBE_HINTS	4
+
+struct psmouse_probe_hint {
+	char phys[32];
+	enum psmouse_type type;
+};
+
+static struct psmouse_probe_hint psmouse_probe_hints[PSMOUSE_PROBE_HINTS];
+
+/*
+ * Only protocols whose detect() checks for a device signature can be
+ * tried out of order. Generic ones (ImPS/2, ImExPS/2) would claim any
+ * intellimouse compatible device, HGPK and Lifebook need more than
+ * their table entry provides.
+ */
+static bool psmouse_can_hint(enum psmouse_type type)
+{
+	switch (type) {
+	case PSMOUSE_PS2PP:
+	case PSMOUSE_THINKPS:
+	case PSMOUSE_GENPS:
+	case PSMOUSE_SYNAPTICS:
+	case PSMOUSE_ALPS:
+	case PSMOUSE_TRACKPOINT:
+	case PSMOUSE_TOUCHKIT_PS2:
+	case PSMOUSE_ELANTECH:
+	case PSMOUSE_FSP:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static struct psmouse_probe_hint *psmouse_find_probe_hint(const char *phys)
+{
+	int i;
+
+	for (i = 0; i < PSMOUSE_PROBE_HINTS; i++)
+		if (psmouse_probe_hints[i].type != PSMOUSE_NONE &&
+		    !strcmp(psmouse_probe_hints[i].phys, phys))
+			return &psmouse_probe_hints[i];
+
+	return NULL;
+}
+
+static int psmouse_store_probe_hint(struct psmouse_probe_hint *hints,
+				    const char *phys, size_t len,
+				    enum psmouse_type type)
+{
+	struct psmouse_probe_hint *hint = NULL;
+	int i;
+
+	if (len >= sizeof(hint->phys))
+		return -EINVAL;
+
+	for (i = 0; i < PSMOUSE_PROBE_HINTS; i++) {
+		if (hints[i].type == PSMOUSE_NONE) {
+			if (!hint)
+				hint = &hints[i];
+		} else if (strlen(hints[i].phys) == len &&
+			   !strncmp(hints[i].phys, phys, len)) {
+			hint = &hints[i];
+			break;
+		}
+	}
+
+	if (!hint)
+		return -ENOSPC;
+
+	memcpy(hint->phys, phys, len);
+	hint->phys[len] = '\0';
+	hint->type = psmouse_can_hint(type) ? type : PSMOUSE_NONE;
+
+	return 0;
+}
+
+/*
+ * psmouse_try_probe_hint() tries the protocol last found on this port.
+ * Returns its type or PSMOUSE_NONE if there is no hint or it was wrong,
+ * in which case the device is reset for the full probe.
+ */
+static enum psmouse_type psmouse_try_probe_hint(struct psmouse *psmouse,
+						unsigned int max_proto,
+						bool set_properties)
+{
+	const struct psmouse_probe_hint *hint;
+	const struct psmouse_protocol *proto;
+	enum psmouse_type type = PSMOUSE_NONE;
+
+	if (max_proto <= PSMOUSE_IMEX)
+		return PSMOUSE_NONE;
+
+	mutex_lock(&psmouse_mutex);
+	hint = psmouse_find_probe_hint(psmouse->ps2dev.serio->phys);
+	if (hint)
+		type = hint->type;
+	mutex_unlock(&psmouse_mutex);
+
+	if (type == PSMOUSE_NONE)
+		return PSMOUSE_NONE;
+
+	proto = psmouse_protocol_by_type(type);
+	if (proto->type != type || !proto->detect)
+		return PSMOUSE_NONE;
+
+	/* Same as in psmouse_probe_extensions() */
+	if (proto->type == PSMOUSE_ALPS)
+		psmouse_command(psmouse, NULL, PSMOUSE_CMD_RESET_DIS);
+
+	if (psmouse_timed_probe(psmouse, proto->alias,
+				proto->detect(psmouse, set_properties)) == 0 &&
+	    (!set_properties || !proto->init || proto->init(psmouse) == 0))
+		return proto->type;
+
+	psmouse_dbg(psmouse, "probe hint %s was wrong\n", proto->name);
+
+	psmouse_command(psmouse, NULL, PSMOUSE_CMD_RESET_DIS);
+	psmouse_reset(psmouse);
+
+	return PSMOUSE_NONE;
+}
+
+/*
+ * psmouse_extensions() finds out which protocol the mouse speaks, trying
+ * the hinted protocol before going through the full probe.
+ */
+
+static int psmouse_extensions(struct psmouse *psmouse,
+			      unsigned int max_proto, bool set_properties)
+{
+	u64 start = local_clock();
+	enum psmouse_type type;
+	bool hinted = true;
+
+	psmouse->probe_log[0] = '\0';
+
+	type = psmouse_try_probe_hint(psmouse, max_proto, set_properties);
+	if (type == PSMOUSE_NONE) {
+		hinted = false;
+		type = psmouse_probe_extensions(psmouse, max_proto,
+						set_properties);
+	}
+
+	mutex_lock(&psmouse_mutex);
+	psmouse_store_probe_hint(psmouse_probe_hints,
+				 psmouse->ps2dev.serio->phys,
+				 strlen(psmouse->ps2dev.serio->phys), type);
+	mutex_unlock(&psmouse_mutex);
+
+	/* On reconnect too, that is where probe hints save the most */
+	psmouse_info(psmouse, "%s detected in %llu ms%s: %s\n",
+		     psmouse_protocol_by_type(type)->name,
+		     div_u64(local_clock() - start, NSEC_PER_MSEC),
+		     hinted ? " (probe hint)" : "", psmouse->probe_log);
+
+	return type;
+}
+
 /*
  * psmouse_probe() probes for a PS/2 mouse.
  */
@@ -939,7 +1798,7 @@ static int psmouse_probe(struct psmouse *psmouse)
  */
 
 	param[0] = 0xa5;
-	if (ps2_command(ps2dev, param, PSMOUSE_CMD_GETID))
+	if (psmouse_command(psmouse, param, PSMOUSE_CMD_GETID))
 		return -1;
 
 	if (param[0] != 0x00 && param[0] != 0x03 &&
@@ -950,7 +1809,7 @@ static int psmouse_probe(struct psmouse *psmouse)
  * Then we reset and disable the mouse so that it doesn't generate events.
  */
 
-	if (ps2_command(ps2dev, NULL, PSMOUSE_CMD_RESET_DIS))
+	if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_RESET_DIS))
 		psmouse_warn(psmouse, "Failed to reset mouse on %s\n",
 			     ps2dev->serio->phys);
 
@@ -970,7 +1829,7 @@ void psmouse_set_resolution(struct psmouse *psmouse, unsigned int resolution)
 		resolution = 200;
 
 	p = params[resolution / 50];
-	ps2_command(&psmouse->ps2dev, &p, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, &p, PSMOUSE_CMD_SETRES);
 	psmouse->resolution = 25 << p;
 }
 
@@ -986,7 +1845,7 @@ static void psmouse_set_rate(struct psmouse *psmouse, unsigned int rate)
 
 	while (rates[i] > rate) i++;
 	r = rates[i];
-	ps2_command(&psmouse->ps2dev, &r, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, &r, PSMOUSE_CMD_SETRATE);
 	psmouse->rate = r;
 }
 
@@ -1003,7 +1862,7 @@ static void psmouse_initialize(struct psmouse *psmouse)
 	if (psmouse_max_proto != PSMOUSE_PS2) {
 		psmouse->set_rate(psmouse, psmouse->rate);
 		psmouse->set_resolution(psmouse, psmouse->resolution);
-		ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_SETSCALE11);
+		psmouse_command(psmouse, NULL, PSMOUSE_CMD_SETSCALE11);
 	}
 }
 
@@ -1013,7 +1872,7 @@ static void psmouse_initialize(struct psmouse *psmouse)
 
 int psmouse_activate(struct psmouse *psmouse)
 {
-	if (ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_ENABLE)) {
+	if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_ENABLE)) {
 		psmouse_warn(psmouse, "Failed to enable mouse on %s\n",
 			     psmouse->ps2dev.serio->phys);
 		return -1;
@@ -1030,7 +1889,7 @@ int psmouse_activate(struct psmouse *psmouse)
 
 int psmouse_deactivate(struct psmouse *psmouse)
 {
-	if (ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_DISABLE)) {
+	if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE)) {
 		psmouse_warn(psmouse, "Failed to deactivate mouse on %s\n",
 			     psmouse->ps2dev.serio->phys);
 		return -1;
@@ -1046,8 +1905,8 @@ int psmouse_deactivate(struct psmouse *psmouse)
 
 static int psmouse_poll(struct psmouse *psmouse)
 {
-	return ps2_command(&psmouse->ps2dev, psmouse->packet,
-			   PSMOUSE_CMD_POLL | (psmouse->pktsize << 8));
+	return psmouse_command(psmouse, psmouse->packet,
+			       PSMOUSE_CMD_POLL | (psmouse->pktsize << 8));
 }
 
 
@@ -1064,7 +1923,7 @@ static void psmouse_resync(struct work_struct *work)
 	bool failed = false, enabled = false;
 	int i;
 
-	mutex_lock(&psmouse_mutex);
+	mutex_lock(psmouse->lock);
 
 	if (psmouse->state != PSMOUSE_RESYNCING)
 		goto out;
@@ -1086,7 +1945,7 @@ static void psmouse_resync(struct work_struct *work)
  */
 	psmouse->num_resyncs++;
 
-	if (ps2_sendbyte(&psmouse->ps2dev, PSMOUSE_CMD_DISABLE, 20)) {
+	if (psmouse_sendbyte(psmouse, PSMOUSE_CMD_DISABLE, 20)) {
 		if (psmouse->num_resyncs < 3 || psmouse->acks_disable_command)
 			failed = true;
 	} else
@@ -1121,11 +1980,11 @@ static void psmouse_resync(struct work_struct *work)
  * mouse.
  */
 	for (i = 0; i < 5; i++) {
-		if (!ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_ENABLE)) {
+		if (!psmouse_command(psmouse, NULL, PSMOUSE_CMD_ENABLE)) {
 			enabled = true;
 			break;
 		}
-		msleep(200);
+		msleep(psmouse_retry_delay(psmouse, i, 200));
 	}
 
 	if (!enabled) {
@@ -1134,6 +1993,8 @@ static void psmouse_resync(struct work_struct *work)
 		failed = true;
 	}
 
+	trace_psmouse_resync(psmouse, failed);
+
 	if (failed) {
 		psmouse_set_state(psmouse, PSMOUSE_IGNORE);
 		psmouse_info(psmouse,
@@ -1145,7 +2006,7 @@ static void psmouse_resync(struct work_struct *work)
 	if (parent)
 		psmouse_activate(parent);
  out:
-	mutex_unlock(&psmouse_mutex);
+	mutex_unlock(psmouse->lock);
 }
 
 /*
@@ -1157,7 +2018,10 @@ static void psmouse_cleanup(struct serio *serio)
 	struct psmouse *psmouse = serio_get_drvdata(serio);
 	struct psmouse *parent = NULL;
 
-	mutex_lock(&psmouse_mutex);
+	/* Let a background connect finish first */
+	flush_work(&psmouse->connect_work);
+
+	mutex_lock(psmouse->lock);
 
 	if (serio->parent && serio->id.type == SERIO_PS_PSTHRU) {
 		parent = serio_get_drvdata(serio->parent);
@@ -1169,7 +2033,7 @@ static void psmouse_cleanup(struct serio *serio)
 	/*
 	 * Disable stream mode so cleanup routine can proceed undisturbed.
 	 */
-	if (ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_DISABLE))
+	if (psmouse_command(psmouse, NULL, PSMOUSE_CMD_DISABLE))
 		psmouse_warn(psmouse, "Failed to disable mouse on %s\n",
 			     psmouse->ps2dev.serio->phys);
 
@@ -1179,13 +2043,13 @@ static void psmouse_cleanup(struct serio *serio)
 /*
  * Reset the mouse to defaults (bare PS/2 protocol).
  */
-	ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_RESET_DIS);
+	psmouse_command(psmouse, NULL, PSMOUSE_CMD_RESET_DIS);
 
 /*
  * Some boxes, such as HP nx7400, get terribly confused if mouse
  * is not fully enabled before suspending/shutting down.
  */
-	ps2_command(&psmouse->ps2dev, NULL, PSMOUSE_CMD_ENABLE);
+	psmouse_command(psmouse, NULL, PSMOUSE_CMD_ENABLE);
 
 	if (parent) {
 		if (parent->pt_deactivate)
@@ -1194,7 +2058,7 @@ static void psmouse_cleanup(struct serio *serio)
 		psmouse_activate(parent);
 	}
 
-	mutex_unlock(&psmouse_mutex);
+	mutex_unlock(psmouse->lock);
 }
 
 /*
@@ -1207,16 +2071,21 @@ static void psmouse_disconnect(struct serio *serio)
 
 	psmouse = serio_get_drvdata(serio);
 
-	sysfs_remove_group(&serio->dev.kobj, &psmouse_attribute_group);
+	/* Let a background connect finish first */
+	flush_work(&psmouse->connect_work);
 
-	mutex_lock(&psmouse_mutex);
+	/* psmouse->dev is only NULL if background connect failed */
+	if (psmouse->dev)
+		sysfs_remove_group(&serio->dev.kobj, &psmouse_attribute_group);
+
+	mutex_lock(psmouse->lock);
 
 	psmouse_set_state(psmouse, PSMOUSE_CMD_MODE);
 
 	/* make sure we don't have a resync in progress */
-	mutex_unlock(&psmouse_mutex);
+	mutex_unlock(psmouse->lock);
 	flush_workqueue(kpsmoused_wq);
-	mutex_lock(&psmouse_mutex);
+	mutex_lock(psmouse->lock);
 
 	if (serio->parent && serio->id.type == SERIO_PS_PSTHRU) {
 		parent = serio_get_drvdata(serio->parent);
@@ -1233,13 +2102,17 @@ static void psmouse_disconnect(struct serio *serio)
 
 	serio_close(serio);
 	serio_set_drvdata(serio, NULL);
-	input_unregister_device(psmouse->dev);
-	kfree(psmouse);
+	if (psmouse->dev)
+		input_unregister_device(psmouse->dev);
+	psmouse_set_deferred(psmouse, false);
+	psmouse_trace_exit(psmouse);
 
 	if (parent)
 		psmouse_activate(parent);
 
-	mutex_unlock(&psmouse_mutex);
+	/* psmouse->lock may point into psmouse itself */
+	mutex_unlock(psmouse->lock);
+	kfree(psmouse);
 }
 
 static int psmouse_switch_protocol(struct psmouse *psmouse,
@@ -1259,6 +2132,8 @@ static int psmouse_switch_protocol(struct psmouse *psmouse,
 	psmouse->set_resolution = psmouse_set_resolution;
 	psmouse->poll = psmouse_poll;
 	psmouse->protocol_handler = psmouse_process_byte;
+	psmouse->validate_header = NULL;
+	psmouse->burst_handler = NULL;
 	psmouse->pktsize = 3;
 
 	if (proto && (proto->detect || proto->init)) {
@@ -1308,6 +2183,90 @@ static int psmouse_switch_protocol(struct psmouse *psmouse,
 	return 0;
 }
 
+/*
+ * psmouse_connect_finish() detects the protocol and registers the input
+ * device, which for some touchpads takes a good while. It is called
+ * from psmouse_connect() or, with async_probe, from a work item so the
+ * serio core can go on with other ports. psmouse->lock must be held
+ * and the parent, if any, deactivated. On failure psmouse->dev is
+ * unregistered and set to NULL if it was registered already.
+ */
+static int psmouse_connect_finish(struct psmouse *psmouse,
+				  struct psmouse *parent)
+{
+	struct serio *serio = psmouse->ps2dev.serio;
+	int error;
+
+	psmouse_switch_protocol(psmouse, NULL);
+
+	psmouse_set_state(psmouse, PSMOUSE_CMD_MODE);
+	psmouse_initialize(psmouse);
+
+	error = input_register_device(psmouse->dev);
+	if (error)
+		goto err_protocol_disconnect;
+
+	if (parent && parent->pt_activate)
+		parent->pt_activate(parent);
+
+	error = sysfs_create_group(&serio->dev.kobj, &psmouse_attribute_group);
+	if (error)
+		goto err_pt_deactivate;
+
+	psmouse_activate(psmouse);
+
+	return 0;
+
+ err_pt_deactivate:
+	if (parent && parent->pt_deactivate)
+		parent->pt_deactivate(parent);
+	input_unregister_device(psmouse->dev);
+	psmouse->dev = NULL;
+ err_protocol_disconnect:
+	if (psmouse->disconnect)
+		psmouse->disconnect(psmouse);
+	/* Protocol data is gone, don't let anybody call into it again */
+	psmouse->disconnect = NULL;
+	psmouse->cleanup = NULL;
+	psmouse->pt_activate = NULL;
+	psmouse->pt_deactivate = NULL;
+	psmouse_set_state(psmouse, PSMOUSE_IGNORE);
+	return error;
+}
+
+static void psmouse_connect_work(struct work_struct *work)
+{
+	struct psmouse *psmouse =
+		container_of(work, struct psmouse, connect_work);
+	struct serio *serio = psmouse->ps2dev.serio;
+	struct psmouse *parent = NULL;
+	int error;
+
+	mutex_lock(psmouse->lock);
+
+	if (serio->parent && serio->id.type == SERIO_PS_PSTHRU) {
+		parent = serio_get_drvdata(serio->parent);
+		psmouse_deactivate(parent);
+	}
+
+	error = psmouse_connect_finish(psmouse, parent);
+	if (error) {
+		/*
+		 * We can't fail the bind any more. Leave the port
+		 * ignored, psmouse_disconnect() will clean up.
+		 */
+		psmouse_err(psmouse, "failed to set up mouse on %s: %d\n",
+			    serio->phys, error);
+		input_free_device(psmouse->dev);
+		psmouse->dev = NULL;
+	}
+
+	if (parent)
+		psmouse_activate(parent);
+
+	mutex_unlock(psmouse->lock);
+}
+
 /*
  * psmouse_connect() is a callback from the serio module when
  * an unhandled serio port is found.
@@ -1318,26 +2277,36 @@ static int psmouse_connect(struct serio *serio, struct serio_driver *drv)
 	struct input_dev *input_dev;
 	int retval = 0, error = -ENOMEM;
 
-	mutex_lock(&psmouse_mutex);
+	psmouse = kzalloc(sizeof(struct psmouse), GFP_KERNEL);
+	input_dev = input_allocate_device();
+	if (!psmouse || !input_dev) {
+		input_free_device(input_dev);
+		kfree(psmouse);
+		return -ENOMEM;
+	}
+
+	if (serio->parent && serio->id.type == SERIO_PS_PSTHRU)
+		parent = serio_get_drvdata(serio->parent);
+
+	mutex_init(&psmouse->mutex);
+	spin_lock_init(&psmouse->rx_lock);
+	psmouse->lock = parent ? parent->lock : &psmouse->mutex;
+	INIT_WORK(&psmouse->connect_work, psmouse_connect_work);
+
+	mutex_lock(psmouse->lock);
 
 	/*
 	 * If this is a pass-through port deactivate parent so the device
 	 * connected to this port can be successfully identified
 	 */
-	if (serio->parent && serio->id.type == SERIO_PS_PSTHRU) {
-		parent = serio_get_drvdata(serio->parent);
+	if (parent)
 		psmouse_deactivate(parent);
-	}
-
-	psmouse = kzalloc(sizeof(struct psmouse), GFP_KERNEL);
-	input_dev = input_allocate_device();
-	if (!psmouse || !input_dev)
-		goto err_free;
 
 	ps2_init(&psmouse->ps2dev, serio);
 	INIT_DELAYED_WORK(&psmouse->resync_work, psmouse_resync);
 	psmouse->dev = input_dev;
 	snprintf(psmouse->phys, sizeof(psmouse->phys), "%s/input0", serio->phys);
+	psmouse_trace_init(psmouse);
 
 	psmouse_set_state(psmouse, PSMOUSE_INITIALIZING);
 
@@ -1358,54 +2327,45 @@ static int psmouse_connect(struct serio *serio, struct serio_driver *drv)
 	psmouse->resync_time = parent ? 0 : psmouse_resync_time;
 	psmouse->smartscroll = psmouse_smartscroll;
 
-	psmouse_switch_protocol(psmouse, NULL);
-
-	psmouse_set_state(psmouse, PSMOUSE_CMD_MODE);
-	psmouse_initialize(psmouse);
-
-	error = input_register_device(psmouse->dev);
-	if (error)
-		goto err_protocol_disconnect;
-
-	if (parent && parent->pt_activate)
-		parent->pt_activate(parent);
-
-	error = sysfs_create_group(&serio->dev.kobj, &psmouse_attribute_group);
-	if (error)
-		goto err_pt_deactivate;
+	/*
+	 * We know it is a mouse, the rest can be done in the background.
+	 * A pass-through child connecting meanwhile waits on our lock.
+	 */
+	if (psmouse_async_probe) {
+		queue_work(system_long_wq, &psmouse->connect_work);
+		goto out;
+	}
 
-	psmouse_activate(psmouse);
+	error = psmouse_connect_finish(psmouse, parent);
+	if (error) {
+		input_dev = psmouse->dev;
+		goto err_close_serio;
+	}
 
  out:
 	/* If this is a pass-through port the parent needs to be re-activated */
 	if (parent)
 		psmouse_activate(parent);
 
-	mutex_unlock(&psmouse_mutex);
+	mutex_unlock(psmouse->lock);
 	return retval;
 
- err_pt_deactivate:
-	if (parent && parent->pt_deactivate)
-		parent->pt_deactivate(parent);
-	input_unregister_device(psmouse->dev);
-	input_dev = NULL; /* so we don't try to free it below */
- err_protocol_disconnect:
-	if (psmouse->disconnect)
-		psmouse->disconnect(psmouse);
-	psmouse_set_state(psmouse, PSMOUSE_IGNORE);
  err_close_serio:
 	serio_close(serio);
  err_clear_drvdata:
 	serio_set_drvdata(serio, NULL);
- err_free:
 	input_free_device(input_dev);
+	psmouse_trace_exit(psmouse);
+
+	if (parent)
+		psmouse_activate(parent);
+
+	mutex_unlock(psmouse->lock);
 	kfree(psmouse);
 
-	retval = error;
-	goto out;
+	return error;
 }
 
-
 static int psmouse_reconnect(struct serio *serio)
 {
 	struct psmouse *psmouse = serio_get_drvdata(serio);
@@ -1420,7 +2380,14 @@ static int psmouse_reconnect(struct serio *serio)
 		return -1;
 	}
 
-	mutex_lock(&psmouse_mutex);
+	/* Let a background connect finish first */
+	flush_work(&psmouse->connect_work);
+
+	/* Background connect failed, have serio core start over */
+	if (!psmouse->dev)
+		return -1;
+
+	mutex_lock(psmouse->lock);
 
 	if (serio->parent && serio->id.type == SERIO_PS_PSTHRU) {
 		parent = serio_get_drvdata(serio->parent);
@@ -1462,7 +2429,7 @@ out:
 	if (parent)
 		psmouse_activate(parent);
 
-	mutex_unlock(&psmouse_mutex);
+	mutex_unlock(psmouse->lock);
 	return rc;
 }
 
@@ -1517,12 +2484,12 @@ ssize_t psmouse_attr_set_helper(struct device *dev, struct device_attribute *dev
 	struct psmouse *psmouse, *parent = NULL;
 	int retval;
 
-	retval = mutex_lock_interruptible(&psmouse_mutex);
+	psmouse = serio_get_drvdata(serio);
+
+	retval = mutex_lock_interruptible(psmouse->lock);
 	if (retval)
 		goto out;
 
-	psmouse = serio_get_drvdata(serio);
-
 	if (attr->protect) {
 		if (psmouse->state == PSMOUSE_IGNORE) {
 			retval = -ENODEV;
@@ -1548,7 +2515,7 @@ ssize_t psmouse_attr_set_helper(struct device *dev, struct device_attribute *dev
 	}
 
  out_unlock:
-	mutex_unlock(&psmouse_mutex);
+	mutex_unlock(psmouse->lock);
  out:
 	return retval;
 }
@@ -1609,9 +2576,9 @@ static ssize_t psmouse_attr_set_protocol(struct psmouse *psmouse, void *data, co
 			return -EIO;
 		}
 
-		mutex_unlock(&psmouse_mutex);
+		mutex_unlock(psmouse->lock);
 		serio_unregister_child_port(serio);
-		mutex_lock(&psmouse_mutex);
+		mutex_lock(psmouse->lock);
 
 		if (serio->drv != &psmouse_drv) {
 			input_free_device(new_dev);
@@ -1696,6 +2663,68 @@ static ssize_t psmouse_attr_set_resolution(struct psmouse *psmouse, void *data,
 	return count;
 }
 
+static ssize_t psmouse_attr_show_rtt(struct psmouse *psmouse, void *data, char *buf)
+{
+	return sprintf(buf,
+		       "srtt_us: %u\n"
+		       "rttvar_us: %u\n"
+		       "samples: %lu\n"
+		       "timeout_ms: %u\n",
+		       psmouse->srtt_us, psmouse->rttvar_us,
+		       psmouse->rtt_samples,
+		       psmouse_rtt_timeout(psmouse, UINT_MAX));
+}
+
+static ssize_t psmouse_attr_show_stats(struct psmouse *psmouse, void *data, char *buf)
+{
+	const struct psmouse_stats *stats = &psmouse->stats;
+	int i, len;
+
+	len = sprintf(buf,
+		      "bytes: %lu\n"
+		      "packets: %lu\n"
+		      "bad_data: %lu\n"
+		      "realigned: %lu\n"
+		      "bad_timeout: %lu\n"
+		      "kbc_errors: %lu\n"
+		      "interleaved: %lu\n"
+		      "timer_flushes: %lu\n"
+		      "rx_overruns: %lu\n"
+		      "out_of_sync: %lu\n"
+		      "resyncs: %lu\n"
+		      "latency_us:",
+		      stats->bytes, stats->packets, stats->bad_data,
+		      stats->realigned, stats->bad_timeout, stats->kbc_errors,
+		      stats->interleaved, stats->timer_flushes, stats->rx_overruns,
+		      psmouse->out_of_sync_cnt, psmouse->num_resyncs);
+
+	for (i = 0; i < PSMOUSE_LATENCY_BUCKETS; i++)
+		len += sprintf(buf + len, " %lu", stats->latency[i]);
+
+	len += sprintf(buf + len, "\n");
+
+	return len;
+}
+
+static ssize_t psmouse_attr_show_deferred(struct psmouse *psmouse, void *data, char *buf)
+{
+	return sprintf(buf, "%d\n", psmouse->rxq != NULL);
+}
+
+static ssize_t psmouse_attr_set_deferred(struct psmouse *psmouse, void *data, const char *buf, size_t count)
+{
+	unsigned long value;
+	int error;
+
+	if (strict_strtoul(buf, 10, &value) || value > 1)
+		return -EINVAL;
+
+	error = psmouse_set_deferred(psmouse, value);
+	if (error)
+		return error;
+
+	return count;
+}
 
 static int psmouse_set_maxproto(const char *val, const struct kernel_param *kp)
 {
@@ -1721,6 +2750,66 @@ static int psmouse_get_maxproto(char *buffer, const struct kernel_param *kp)
 	return sprintf(buffer, "%s", psmouse_protocol_by_type(type)->name);
 }
 
+static int psmouse_set_probe_hint(const char *val,
+				  const struct kernel_param *kp)
+{
+	struct psmouse_probe_hint hints[PSMOUSE_PROBE_HINTS];
+	const struct psmouse_protocol *proto;
+	const char *end, *eq;
+	int i, error;
+
+	if (!val)
+		return -EINVAL;
+
+	/* Parsed aside, so that a malformed list leaves the hints alone */
+	for (i = 0; i < PSMOUSE_PROBE_HINTS; i++)
+		hints[i].type = PSMOUSE_NONE;
+
+	while (*val && *val != '\n') {
+		end = val + strcspn(val, ",\n");
+		eq = memchr(val, '=', end - val);
+		if (!eq)
+			return -EINVAL;
+
+		proto = psmouse_protocol_by_name(eq + 1, end - eq - 1);
+		if (!proto || !psmouse_can_hint(proto->type))
+			return -EINVAL;
+
+		error = psmouse_store_probe_hint(hints, val, eq - val,
+						 proto->type);
+		if (error)
+			return error;
+
+		val = *end == ',' ? end + 1 : end;
+	}
+
+	mutex_lock(&psmouse_mutex);
+	memcpy(psmouse_probe_hints, hints, sizeof(hints));
+	mutex_unlock(&psmouse_mutex);
+
+	return 0;
+}
+
+static int psmouse_get_probe_hint(char *buffer, const struct kernel_param *kp)
+{
+	const struct psmouse_probe_hint *hint;
+	int i, len = 0;
+
+	mutex_lock(&psmouse_mutex);
+
+	for (i = 0; i < PSMOUSE_PROBE_HINTS; i++) {
+		hint = &psmouse_probe_hints[i];
+		if (hint->type != PSMOUSE_NONE)
+			len += sprintf(buffer + len, "%s%s=%s", len ? "," : "",
+				       hint->phys,
+				       psmouse_protocol_by_type(hint->type)->alias);
+	}
+
+	mutex_unlock(&psmouse_mutex);
+
+	return len;
+}
+
 static int __init psmouse_init(void)
 {
 	int err;
@@ -1735,9 +2824,13 @@ static int __init psmouse_init(void)
 		return -ENOMEM;
 	}
 
+	psmouse_debugfs_init();
+
 	err = serio_register_driver(&psmouse_drv);
-	if (err)
+	if (err) {
+		psmouse_debugfs_exit();
 		destroy_workqueue(kpsmoused_wq);
+	}
 
 	return err;
 }
@@ -1745,6 +2838,7 @@ static int __init psmouse_init(void)
 static void __exit psmouse_exit(void)
 {
 	serio_unregister_driver(&psmouse_drv);
+	psmouse_debugfs_exit();
 	destroy_workqueue(kpsmoused_wq);
 }
 
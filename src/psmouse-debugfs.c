@@ -0,0 +1,186 @@
+/*
+ * PS/2 mouse driver - raw byte trace through debugfs
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt)		KBUILD_MODNAME ": " fmt
+#define psmouse_fmt(fmt)	fmt
+
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/dcache.h>
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/serio.h>
+#include <linux/libps2.h>
+
+#include "psmouse.h"
+
+static unsigned int psmouse_trace_size;
+module_param_named(trace_size, psmouse_trace_size, uint, 0644);
+MODULE_PARM_DESC(trace_size, "Entries in the per-device byte trace ring, rounded up to a power of 2 (0 = disabled).");
+
+static struct dentry *psmouse_debugfs_root;
+
+/*
+ * The ring may outlive the device: the device and every open trace file
+ * hold a reference. Pages mapped by userspace are pinned by the mapping
+ * itself. psmouse_trace_mutex orders opens against removal of the file.
+ */
+struct psmouse_trace_buf {
+	struct kref kref;
+	struct psmouse_trace *trace;
+};
+
+static DEFINE_MUTEX(psmouse_trace_mutex);
+
+static void psmouse_trace_buf_release(struct kref *kref)
+{
+	struct psmouse_trace_buf *buf =
+		container_of(kref, struct psmouse_trace_buf, kref);
+
+	vfree(buf->trace);
+	kfree(buf);
+}
+
+static int psmouse_trace_open(struct inode *inode, struct file *file)
+{
+	struct psmouse_trace_buf *buf;
+	int error = 0;
+
+	mutex_lock(&psmouse_trace_mutex);
+
+	/* The device is gone if the file was removed while we got here */
+	if (d_unhashed(file->f_path.dentry)) {
+		error = -ENODEV;
+	} else {
+		buf = inode->i_private;
+		kref_get(&buf->kref);
+		file->private_data = buf;
+	}
+
+	mutex_unlock(&psmouse_trace_mutex);
+
+	return error;
+}
+
+static int psmouse_trace_release(struct inode *inode, struct file *file)
+{
+	struct psmouse_trace_buf *buf = file->private_data;
+
+	kref_put(&buf->kref, psmouse_trace_buf_release);
+	return 0;
+}
+
+/*
+ * The ring is mapped read-only; the producer never waits for readers,
+ * so a reader has to check trace->head again after copying entries
+ * to find out which of them may have been overwritten meanwhile.
+ */
+static int psmouse_trace_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct psmouse_trace_buf *buf = file->private_data;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	/* Nor may mprotect() make it writable later */
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	return remap_vmalloc_range(vma, buf->trace, vma->vm_pgoff);
+}
+
+static const struct file_operations psmouse_trace_fops = {
+	.owner		= THIS_MODULE,
+	.open		= psmouse_trace_open,
+	.release	= psmouse_trace_release,
+	.mmap		= psmouse_trace_mmap,
+	.llseek		= noop_llseek,
+};
+
+void psmouse_trace_init(struct psmouse *psmouse)
+{
+	struct serio *serio = psmouse->ps2dev.serio;
+	struct psmouse_trace_buf *buf;
+	unsigned int entries;
+	size_t size;
+
+	if (!psmouse_trace_size || !psmouse_debugfs_root)
+		return;
+
+	entries = roundup_pow_of_two(psmouse_trace_size);
+	size = sizeof(struct psmouse_trace) +
+		entries * sizeof(struct psmouse_trace_entry);
+
+	buf = kzalloc(sizeof(struct psmouse_trace_buf), GFP_KERNEL);
+	if (!buf)
+		return;
+
+	buf->trace = vmalloc_user(PAGE_ALIGN(size));
+	if (!buf->trace) {
+		psmouse_warn(psmouse, "cannot allocate %zu byte trace ring\n",
+			     size);
+		kfree(buf);
+		return;
+	}
+
+	kref_init(&buf->kref);
+	buf->trace->magic = PSMOUSE_TRACE_MAGIC;
+	buf->trace->size = entries;
+
+	psmouse->trace_dentry = debugfs_create_file(dev_name(&serio->dev),
+						    S_IRUSR,
+						    psmouse_debugfs_root,
+						    buf,
+						    &psmouse_trace_fops);
+	if (IS_ERR_OR_NULL(psmouse->trace_dentry)) {
+		psmouse->trace_dentry = NULL;
+		kref_put(&buf->kref, psmouse_trace_buf_release);
+		return;
+	}
+
+	psmouse->trace_buf = buf;
+	psmouse->trace = buf->trace;
+}
+
+/*
+ * Called once the port is closed, so the interrupt handler no longer
+ * writes to the ring.
+ */
+void psmouse_trace_exit(struct psmouse *psmouse)
+{
+	struct psmouse_trace_buf *buf = psmouse->trace_buf;
+
+	if (!buf)
+		return;
+
+	mutex_lock(&psmouse_trace_mutex);
+	debugfs_remove(psmouse->trace_dentry);
+	mutex_unlock(&psmouse_trace_mutex);
+
+	psmouse->trace_dentry = NULL;
+	psmouse->trace = NULL;
+	psmouse->trace_buf = NULL;
+
+	kref_put(&buf->kref, psmouse_trace_buf_release);
+}
+
+void __init psmouse_debugfs_init(void)
+{
+	psmouse_debugfs_root = debugfs_create_dir("psmouse", NULL);
+	if (IS_ERR(psmouse_debugfs_root))
+		psmouse_debugfs_root = NULL;
+}
+
+void psmouse_debugfs_exit(void)
+{
+	debugfs_remove_recursive(psmouse_debugfs_root);
+}
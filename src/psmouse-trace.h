@@ -0,0 +1,245 @@
+/*
+ * PS/2 mouse driver - tracepoints
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM psmouse
+
+#if !defined(_PSMOUSE_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _PSMOUSE_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/serio.h>
+#include "psmouse.h"
+
+#define show_psmouse_state(state)					\
+	__print_symbolic(state,						\
+			 { PSMOUSE_IGNORE,	 "ignore" },		\
+			 { PSMOUSE_INITIALIZING, "initializing" },	\
+			 { PSMOUSE_RESYNCING,	 "resyncing" },		\
+			 { PSMOUSE_CMD_MODE,	 "cmd_mode" },		\
+			 { PSMOUSE_ACTIVATED,	 "activated" })
+
+/* Every byte received from the port, before anything looks at it */
+TRACE_EVENT(psmouse_byte,
+
+	TP_PROTO(struct psmouse *psmouse, unsigned char data,
+		 unsigned int flags),
+
+	TP_ARGS(psmouse, data, flags),
+
+	TP_STRUCT__entry(
+		__string(	phys,	psmouse->ps2dev.serio->phys	)
+		__field(	u8,	data				)
+		__field(	u8,	flags				)
+		__field(	u8,	state				)
+		__field(	u8,	pktcnt				)
+	),
+
+	TP_fast_assign(
+		__assign_str(phys, psmouse->ps2dev.serio->phys);
+		__entry->data	= data;
+		__entry->flags	= flags;
+		__entry->state	= psmouse->state;
+		__entry->pktcnt	= psmouse->pktcnt;
+	),
+
+	TP_printk("%s: %02x flags=%02x state=%s pktcnt=%u",
+		  __get_str(phys), __entry->data, __entry->flags,
+		  show_psmouse_state(__entry->state), __entry->pktcnt)
+);
+
+/*
+ * A complete packet, latency is counted from its last byte. The clock
+ * is only read while the event is enabled.
+ */
+TRACE_EVENT(psmouse_packet,
+
+	TP_PROTO(struct psmouse *psmouse),
+
+	TP_ARGS(psmouse),
+
+	TP_STRUCT__entry(
+		__string(	phys,	psmouse->ps2dev.serio->phys	)
+		__field(	u8,	type				)
+		__field(	u8,	pktsize				)
+		__array(	u8,	packet,	8			)
+		__field(	u64,	latency_ns			)
+	),
+
+	TP_fast_assign(
+		__assign_str(phys, psmouse->ps2dev.serio->phys);
+		__entry->type		= psmouse->type;
+		__entry->pktsize	= psmouse->pktsize;
+		memcpy(__entry->packet, psmouse->packet, 8);
+		__entry->latency_ns	= local_clock() - psmouse->irq_time;
+	),
+
+	TP_printk("%s: type=%u [%s] latency=%llu ns",
+		  __get_str(phys), __entry->type,
+		  __print_hex(__entry->packet, __entry->pktsize),
+		  (unsigned long long)__entry->latency_ns)
+);
+
+TRACE_EVENT(psmouse_state,
+
+	TP_PROTO(struct psmouse *psmouse, enum psmouse_state new_state),
+
+	TP_ARGS(psmouse, new_state),
+
+	TP_STRUCT__entry(
+		__string(	phys,	psmouse->ps2dev.serio->phys	)
+		__field(	u8,	old_state			)
+		__field(	u8,	new_state			)
+	),
+
+	TP_fast_assign(
+		__assign_str(phys, psmouse->ps2dev.serio->phys);
+		__entry->old_state	= psmouse->state;
+		__entry->new_state	= new_state;
+	),
+
+	TP_printk("%s: %s -> %s", __get_str(phys),
+		  show_psmouse_state(__entry->old_state),
+		  show_psmouse_state(__entry->new_state))
+);
+
+TRACE_EVENT(psmouse_resync,
+
+	TP_PROTO(struct psmouse *psmouse, bool failed),
+
+	TP_ARGS(psmouse, failed),
+
+	TP_STRUCT__entry(
+		__string(	phys,		psmouse->ps2dev.serio->phys	)
+		__field(	unsigned long,	num_resyncs			)
+		__field(	bool,		failed				)
+	),
+
+	TP_fast_assign(
+		__assign_str(phys, psmouse->ps2dev.serio->phys);
+		__entry->num_resyncs	= psmouse->num_resyncs;
+		__entry->failed		= failed;
+	),
+
+	TP_printk("%s: resync #%lu %s", __get_str(phys),
+		  __entry->num_resyncs,
+		  __entry->failed ? "failed" : "succeeded")
+);
+
+/*
+ * A command sent with psmouse_command(), psmouse_command_seq() or
+ * psmouse_sendbyte()
+ */
+TRACE_EVENT(psmouse_command,
+
+	TP_PROTO(struct psmouse *psmouse, int command, int error,
+		 u64 duration_ns),
+
+	TP_ARGS(psmouse, command, error, duration_ns),
+
+	TP_STRUCT__entry(
+		__string(	phys,	psmouse->ps2dev.serio->phys	)
+		__field(	int,	command				)
+		__field(	int,	error				)
+		__field(	u64,	duration_ns			)
+	),
+
+	TP_fast_assign(
+		__assign_str(phys, psmouse->ps2dev.serio->phys);
+		__entry->command	= command;
+		__entry->error		= error;
+		__entry->duration_ns	= duration_ns;
+	),
+
+	TP_printk("%s: command=%04x error=%d duration=%llu ns",
+		  __get_str(phys), __entry->command, __entry->error,
+		  (unsigned long long)__entry->duration_ns)
+);
+
+/*
+ * ALPS command mode register access once the touchpad has answered,
+ * value is -1 if a read failed
+ */
+TRACE_EVENT(alps_reg,
+
+	TP_PROTO(struct psmouse *psmouse, int addr, int value, bool write,
+		 int error),
+
+	TP_ARGS(psmouse, addr, value, write, error),
+
+	TP_STRUCT__entry(
+		__string(	phys,	psmouse->ps2dev.serio->phys	)
+		__field(	int,	addr				)
+		__field(	int,	value				)
+		__field(	bool,	write				)
+		__field(	int,	error				)
+	),
+
+	TP_fast_assign(
+		__assign_str(phys, psmouse->ps2dev.serio->phys);
+		__entry->addr	= addr;
+		__entry->value	= value;
+		__entry->write	= write;
+		__entry->error	= error;
+	),
+
+	TP_printk("%s: %s %04x = %d, error %d", __get_str(phys),
+		  __entry->write ? "write" : "read",
+		  __entry->addr, __entry->value, __entry->error)
+);
+
+/*
+ * One step of an ALPS init sequence, see alps_run_init_seq(); skipped
+ * optional steps are reported with no duration
+ */
+TRACE_EVENT(alps_init_step,
+
+	TP_PROTO(struct psmouse *psmouse, const char *seq, int index,
+		 const char *op, int command, bool skipped, int error,
+		 u64 duration_ns),
+
+	TP_ARGS(psmouse, seq, index, op, command, skipped, error,
+		duration_ns),
+
+	TP_STRUCT__entry(
+		__string(	phys,	psmouse->ps2dev.serio->phys	)
+		__string(	seq,	seq				)
+		__field(	int,	index				)
+		__string(	op,	op				)
+		__field(	int,	command				)
+		__field(	bool,	skipped				)
+		__field(	int,	error				)
+		__field(	u64,	duration_ns			)
+	),
+
+	TP_fast_assign(
+		__assign_str(phys, psmouse->ps2dev.serio->phys);
+		__assign_str(seq, seq);
+		__entry->index		= index;
+		__assign_str(op, op);
+		__entry->command	= command;
+		__entry->skipped	= skipped;
+		__entry->error		= error;
+		__entry->duration_ns	= duration_ns;
+	),
+
+	TP_printk("%s: %s step %d (%s %04x) %s error=%d duration=%llu ns",
+		  __get_str(phys), __get_str(seq), __entry->index,
+		  __get_str(op), __entry->command,
+		  __entry->skipped ? "skipped" : "run", __entry->error,
+		  (unsigned long long)__entry->duration_ns)
+);
+
+#endif /* _PSMOUSE_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE psmouse-trace
+
+#include <trace/define_trace.h>
@@ -36,11 +36,60 @@ typedef enum {
 	PSMOUSE_FULL_PACKET
 } psmouse_ret_t;
 
+#define PSMOUSE_LATENCY_BUCKETS	16
+
+/*
+ * Per-device counters, exported through the stats attribute. latency
+ * is a histogram of the time from the interrupt delivering the last
+ * byte of a packet to the packet being reported; bucket n counts
+ * packets which took [2^n, 2^(n+1)) microseconds. It is only kept with
+ * the latency_stats module parameter set.
+ */
+struct psmouse_stats {
+	unsigned long bytes;		/* Bytes passed to the protocol */
+	unsigned long packets;		/* Full packets */
+	unsigned long bad_data;		/* Rejected by the protocol handler */
+	unsigned long realigned;	/* ... of which were realigned */
+	unsigned long bad_timeout;	/* Dropped after an idle gap */
+	unsigned long kbc_errors;	/* Timeout or parity error from KBC */
+	unsigned long interleaved;	/* PS/2 packets inside ALPS packets */
+	unsigned long timer_flushes;	/* Packets completed by a timer */
+	unsigned long rx_overruns;	/* Bytes lost, deferred queue full */
+	unsigned long latency[PSMOUSE_LATENCY_BUCKETS];
+};
+
+#define PSMOUSE_TRACE_MAGIC	0x70737472	/* "pstr" */
+
+/*
+ * Raw byte trace, one entry per byte seen by psmouse_interrupt(). The
+ * ring is exported through debugfs for mmap; head counts the entries
+ * ever written, the latest one is entry[(head - 1) & (size - 1)].
+ */
+struct psmouse_trace_entry {
+	u64 time;		/* local_clock() */
+	u8 data;
+	u8 flags;		/* SERIO_TIMEOUT, SERIO_PARITY */
+	u8 state;		/* enum psmouse_state */
+	u8 pktcnt;		/* Bytes buffered before this one */
+	u32 reserved;
+};
+
+struct psmouse_trace {
+	u32 magic;
+	u32 size;		/* Number of entries, a power of 2 */
+	u32 head;
+	u32 reserved;
+	struct psmouse_trace_entry entry[];
+};
+
 struct psmouse {
 	void *private;
 	struct input_dev *dev;
 	struct ps2dev ps2dev;
 	struct delayed_work resync_work;
+	struct work_struct connect_work;	/* Used with async_probe */
+	struct mutex mutex;
+	struct mutex *lock;		/* Shared with pass-through children */
 	char *vendor;
 	char *name;
 	unsigned char packet[8];
@@ -54,6 +103,19 @@ struct psmouse {
 	unsigned long last;
 	unsigned long out_of_sync_cnt;
 	unsigned long num_resyncs;
+	u64 irq_time;		/* local_clock() of the last byte */
+	char probe_log[128];	/* Probe times, see psmouse_extensions() */
+	struct psmouse_stats stats;
+
+	/* Command round trip estimate, see psmouse_rtt_timeout() */
+	unsigned int srtt_us;
+	unsigned int rttvar_us;
+	unsigned long rtt_samples;
+	struct psmouse_trace *trace;
+	struct psmouse_trace_buf *trace_buf;	/* Owns trace */
+	struct dentry *trace_dentry;
+	struct psmouse_rx_queue *rxq;	/* Non-NULL in deferred mode */
+	spinlock_t rx_lock;		/* Decoding in deferred mode */
 	enum psmouse_state state;
 	char devname[64];
 	char phys[32];
@@ -65,6 +127,19 @@ struct psmouse {
 	bool smartscroll;	/* Logitech only */
 
 	psmouse_ret_t (*protocol_handler)(struct psmouse *psmouse);
+	/* Can packet[0] start a packet? Used to realign after bad data */
+	bool (*validate_header)(struct psmouse *psmouse);
+	/*
+	 * Optional fast path for deferred mode, called at a packet
+	 * boundary with count queued bytes and their arrival times.
+	 * Returns the number of bytes consumed and sets *packets to the
+	 * number of packets completed. It must stop before anything it
+	 * would not accept and before a PSMOUSE_RET_BAT packet start;
+	 * psmouse_handle_byte() takes care of those.
+	 */
+	int (*burst_handler)(struct psmouse *psmouse,
+			     const unsigned char *data, const u64 *time,
+			     int count, int *packets);
 	void (*set_rate)(struct psmouse *psmouse, unsigned int rate);
 	void (*set_resolution)(struct psmouse *psmouse, unsigned int resolution);
 
@@ -100,11 +175,59 @@ enum psmouse_type {
 void psmouse_queue_work(struct psmouse *psmouse, struct delayed_work *work,
 		unsigned long delay);
 int psmouse_sliced_command(struct psmouse *psmouse, unsigned char command);
+
+/* One command of a psmouse_command_seq() sequence, as for ps2_command() */
+struct psmouse_cmd {
+	int command;
+	unsigned char *param;
+};
+
+#define PSMOUSE_CMD_SEQ_TIMEOUT	500	/* ms, for a whole sequence */
+#define PSMOUSE_SLICED_CMDS	5	/* Commands in a sliced command */
+
+int psmouse_sendbyte(struct psmouse *psmouse, unsigned char byte,
+		     unsigned int max_timeout);
+int psmouse_sendbyte_nak(struct psmouse *psmouse, unsigned char byte,
+			 unsigned int timeout);
+int psmouse_command(struct psmouse *psmouse, unsigned char *param, int command);
+int __psmouse_command(struct psmouse *psmouse, unsigned char *param,
+		      int command);
+unsigned int psmouse_rtt_timeout(struct psmouse *psmouse,
+				 unsigned int max_timeout);
+unsigned int psmouse_retry_delay(struct psmouse *psmouse, int retry,
+				 unsigned int max_delay);
+int psmouse_command_seq(struct psmouse *psmouse, const struct psmouse_cmd *seq,
+			int count, unsigned int timeout_ms, int *failed);
+int psmouse_sliced_seq(struct psmouse_cmd *seq, unsigned char *nibbles,
+		       unsigned char command);
 int psmouse_reset(struct psmouse *psmouse);
 void psmouse_set_state(struct psmouse *psmouse, enum psmouse_state new_state);
 void psmouse_set_resolution(struct psmouse *psmouse, unsigned int resolution);
 int psmouse_activate(struct psmouse *psmouse);
 int psmouse_deactivate(struct psmouse *psmouse);
+void psmouse_account_latency(struct psmouse *psmouse);
+void psmouse_pause_rx(struct psmouse *psmouse);
+void psmouse_continue_rx(struct psmouse *psmouse);
+
+#ifdef CONFIG_DEBUG_FS
+void psmouse_trace_init(struct psmouse *psmouse);
+void psmouse_trace_exit(struct psmouse *psmouse);
+void psmouse_debugfs_init(void);
+void psmouse_debugfs_exit(void);
+#else
+static inline void psmouse_trace_init(struct psmouse *psmouse)
+{
+}
+static inline void psmouse_trace_exit(struct psmouse *psmouse)
+{
+}
+static inline void psmouse_debugfs_init(void)
+{
+}
+static inline void psmouse_debugfs_exit(void)
+{
+}
+#endif
 
 struct psmouse_attribute {
 	struct device_attribute dattr;
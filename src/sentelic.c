@@ -32,7 +32,10 @@
 #include "sentelic.h"
 
 /*
- * Timeout for FSP PS/2 command only (in milliseconds).
+ * Timeout for FSP PS/2 command only (in milliseconds). FSP_CMD_TIMEOUT is
+ * the upper limit for bytes the pad ACKs, psmouse_sendbyte() waits as
+ * long as the device needs. Bytes the pad refuses always get the full
+ * timeout, see psmouse_sendbyte_nak().
  */
 #define	FSP_CMD_TIMEOUT		200
 #define	FSP_CMD_TIMEOUT2	30
@@ -81,115 +84,263 @@ static unsigned char fsp_test_invert_cmd(unsigned char reg_val)
 	}
 }
 
-static int fsp_reg_read(struct psmouse *psmouse, int reg_addr, int *reg_val)
+/* One register access of a transaction, see fsp_reg_transaction() */
+struct fsp_reg_op {
+	unsigned char	reg;
+	bool		write;
+	int		val;	/* Value to write, or value read */
+	int		rc;
+};
+
+/*
+ * Register access primitives. The caller holds the command lock and,
+ * for reads, has the device deactivated; see fsp_reg_transaction().
+ */
+static int __fsp_reg_read(struct psmouse *psmouse, int reg_addr, int *reg_val)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[3];
 	unsigned char addr;
 	int rc = -1;
 
-	/*
-	 * We need to shut off the device and switch it into command
-	 * mode so we don't confuse our protocol handler. We don't need
-	 * to do that for writes because sysfs set helper does this for
-	 * us.
-	 */
-	psmouse_deactivate(psmouse);
-
-	ps2_begin_command(ps2dev);
-
-	if (ps2_sendbyte(ps2dev, 0xf3, FSP_CMD_TIMEOUT) < 0)
+	if (psmouse_sendbyte(psmouse, 0xf3, FSP_CMD_TIMEOUT) < 0)
 		goto out;
 
 	/* should return 0xfe(request for resending) */
-	ps2_sendbyte(ps2dev, 0x66, FSP_CMD_TIMEOUT2);
+	psmouse_sendbyte_nak(psmouse, 0x66, FSP_CMD_TIMEOUT2);
 	/* should return 0xfc(failed) */
-	ps2_sendbyte(ps2dev, 0x88, FSP_CMD_TIMEOUT2);
+	psmouse_sendbyte_nak(psmouse, 0x88, FSP_CMD_TIMEOUT2);
 
-	if (ps2_sendbyte(ps2dev, 0xf3, FSP_CMD_TIMEOUT) < 0)
+	if (psmouse_sendbyte(psmouse, 0xf3, FSP_CMD_TIMEOUT) < 0)
 		goto out;
 
 	if ((addr = fsp_test_invert_cmd(reg_addr)) != reg_addr) {
-		ps2_sendbyte(ps2dev, 0x68, FSP_CMD_TIMEOUT2);
+		psmouse_sendbyte_nak(psmouse, 0x68, FSP_CMD_TIMEOUT2);
 	} else if ((addr = fsp_test_swap_cmd(reg_addr)) != reg_addr) {
 		/* swapping is required */
-		ps2_sendbyte(ps2dev, 0xcc, FSP_CMD_TIMEOUT2);
+		psmouse_sendbyte_nak(psmouse, 0xcc, FSP_CMD_TIMEOUT2);
 		/* expect 0xfe */
 	} else {
 		/* swapping isn't necessary */
-		ps2_sendbyte(ps2dev, 0x66, FSP_CMD_TIMEOUT2);
+		psmouse_sendbyte_nak(psmouse, 0x66, FSP_CMD_TIMEOUT2);
 		/* expect 0xfe */
 	}
 	/* should return 0xfc(failed) */
-	ps2_sendbyte(ps2dev, addr, FSP_CMD_TIMEOUT);
+	psmouse_sendbyte_nak(psmouse, addr, FSP_CMD_TIMEOUT);
 
-	if (__ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO) < 0)
+	if (__psmouse_command(psmouse, param, PSMOUSE_CMD_GETINFO) < 0)
 		goto out;
 
 	*reg_val = param[2];
 	rc = 0;
 
  out:
-	ps2_end_command(ps2dev);
-	psmouse_activate(psmouse);
 	psmouse_dbg(psmouse,
 		    "READ REG: 0x%02x is 0x%02x (rc = %d)\n",
 		    reg_addr, *reg_val, rc);
 	return rc;
 }
 
-static int fsp_reg_write(struct psmouse *psmouse, int reg_addr, int reg_val)
+static int __fsp_reg_write(struct psmouse *psmouse, int reg_addr, int reg_val)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char v;
 	int rc = -1;
 
-	ps2_begin_command(ps2dev);
-
-	if (ps2_sendbyte(ps2dev, 0xf3, FSP_CMD_TIMEOUT) < 0)
+	if (psmouse_sendbyte(psmouse, 0xf3, FSP_CMD_TIMEOUT) < 0)
 		goto out;
 
 	if ((v = fsp_test_invert_cmd(reg_addr)) != reg_addr) {
 		/* inversion is required */
-		ps2_sendbyte(ps2dev, 0x74, FSP_CMD_TIMEOUT2);
+		psmouse_sendbyte_nak(psmouse, 0x74, FSP_CMD_TIMEOUT2);
 	} else {
 		if ((v = fsp_test_swap_cmd(reg_addr)) != reg_addr) {
 			/* swapping is required */
-			ps2_sendbyte(ps2dev, 0x77, FSP_CMD_TIMEOUT2);
+			psmouse_sendbyte_nak(psmouse, 0x77, FSP_CMD_TIMEOUT2);
 		} else {
 			/* swapping isn't necessary */
-			ps2_sendbyte(ps2dev, 0x55, FSP_CMD_TIMEOUT2);
+			psmouse_sendbyte_nak(psmouse, 0x55, FSP_CMD_TIMEOUT2);
 		}
 	}
 	/* write the register address in correct order */
-	ps2_sendbyte(ps2dev, v, FSP_CMD_TIMEOUT2);
+	psmouse_sendbyte_nak(psmouse, v, FSP_CMD_TIMEOUT2);
 
-	if (ps2_sendbyte(ps2dev, 0xf3, FSP_CMD_TIMEOUT) < 0)
+	if (psmouse_sendbyte(psmouse, 0xf3, FSP_CMD_TIMEOUT) < 0)
 		goto out;
 
 	if ((v = fsp_test_invert_cmd(reg_val)) != reg_val) {
 		/* inversion is required */
-		ps2_sendbyte(ps2dev, 0x47, FSP_CMD_TIMEOUT2);
+		psmouse_sendbyte_nak(psmouse, 0x47, FSP_CMD_TIMEOUT2);
 	} else if ((v = fsp_test_swap_cmd(reg_val)) != reg_val) {
 		/* swapping is required */
-		ps2_sendbyte(ps2dev, 0x44, FSP_CMD_TIMEOUT2);
+		psmouse_sendbyte_nak(psmouse, 0x44, FSP_CMD_TIMEOUT2);
 	} else {
 		/* swapping isn't necessary */
-		ps2_sendbyte(ps2dev, 0x33, FSP_CMD_TIMEOUT2);
+		psmouse_sendbyte_nak(psmouse, 0x33, FSP_CMD_TIMEOUT2);
 	}
 
 	/* write the register value in correct order */
-	ps2_sendbyte(ps2dev, v, FSP_CMD_TIMEOUT2);
+	psmouse_sendbyte_nak(psmouse, v, FSP_CMD_TIMEOUT2);
 	rc = 0;
 
  out:
-	ps2_end_command(ps2dev);
 	psmouse_dbg(psmouse,
 		    "WRITE REG: 0x%02x to 0x%02x (rc = %d)\n",
 		    reg_addr, reg_val, rc);
 	return rc;
 }
 
+/*
+ * Run a list of register reads and writes in one go. Each operation leaves
+ * its result in op->rc. The list is abandoned at the first failure, since
+ * the device is unlikely to get the rest right, and the operations that
+ * were not attempted get -1 as well. The return value is -EIO if any
+ * operation failed.
+ */
+static int fsp_reg_transaction(struct psmouse *psmouse,
+			       struct fsp_reg_op *ops, int count)
+{
+	struct ps2dev *ps2dev = &psmouse->ps2dev;
+	bool reads = false;
+	int i, rc = 0;
+
+	for (i = 0; i < count; i++)
+		if (!ops[i].write)
+			reads = true;
+
+	/*
+	 * We need to shut off the device and switch it into command
+	 * mode so we don't confuse our protocol handler. We don't need
+	 * to do that for writes because sysfs set helper does this for
+	 * us. This is done once for the whole list rather than for
+	 * every register.
+	 */
+	if (reads)
+		psmouse_deactivate(psmouse);
+
+	ps2_begin_command(ps2dev);
+
+	for (i = 0; i < count; i++) {
+		if (rc)
+			ops[i].rc = -1;
+		else if (ops[i].write)
+			ops[i].rc = __fsp_reg_write(psmouse, ops[i].reg,
+						    ops[i].val);
+		else
+			ops[i].rc = __fsp_reg_read(psmouse, ops[i].reg,
+						   &ops[i].val);
+		if (ops[i].rc)
+			rc = -EIO;
+	}
+
+	ps2_end_command(ps2dev);
+
+	if (reads)
+		psmouse_activate(psmouse);
+
+	return rc;
+}
+
+static int fsp_reg_read(struct psmouse *psmouse, int reg_addr, int *reg_val)
+{
+	struct fsp_reg_op op = { .reg = reg_addr };
+
+	fsp_reg_transaction(psmouse, &op, 1);
+	if (op.rc == 0)
+		*reg_val = op.val;
+
+	return op.rc;
+}
+
+static int fsp_reg_write(struct psmouse *psmouse, int reg_addr, int reg_val)
+{
+	struct fsp_reg_op op = {
+		.reg = reg_addr,
+		.write = true,
+		.val = reg_val,
+	};
+
+	fsp_reg_transaction(psmouse, &op, 1);
+
+	return op.rc;
+}
+
+/* Append a write of val to reg to ops, returns the new count */
+static int fsp_reg_op_write(struct fsp_reg_op *ops, int n, unsigned char reg,
+			    int val)
+{
+	ops[n].reg = reg;
+	ops[n].write = true;
+	ops[n].val = val;
+	ops[n].rc = 0;
+
+	return n + 1;
+}
+
+/*
+ * Register values for the features below, computed from the current
+ * value v so that the setup in fsp_activate_protocol() and the functions
+ * switching a single feature agree on which bits are involved.
+ */
+static int fsp_reg_clk_val(int v, bool enable)
+{
+	return enable ? v | FSP_BIT_EN_REG_CLK : v & ~FSP_BIT_EN_REG_CLK;
+}
+
+static int fsp_opc_tag_val(int v, bool enable)
+{
+	return enable ? v | FSP_BIT_EN_OPC_TAG : v & ~FSP_BIT_EN_OPC_TAG;
+}
+
+static int fsp_onpad_vscr_val(int v, bool enable)
+{
+	if (enable)
+		return v | FSP_BIT_FIX_VSCR | FSP_BIT_ONPAD_ENABLE;
+
+	return v & ~FSP_BIT_FIX_VSCR;
+}
+
+static int fsp_onpad_hscr_val(int v, bool enable)
+{
+	if (enable)
+		return v | FSP_BIT_FIX_HSCR | FSP_BIT_ONPAD_ENABLE;
+
+	return v & ~FSP_BIT_FIX_HSCR;
+}
+
+/* Horizontal scrolling packet output, in FSP_REG_SYSCTL5 */
+static int fsp_hscr_packets_val(int v, bool enable)
+{
+	if (enable)
+		return v | FSP_BIT_EN_MSID6;
+
+	return v & ~(FSP_BIT_EN_MSID6 | FSP_BIT_EN_MSID7 | FSP_BIT_EN_MSID8);
+}
+
+/*
+ * Append the writes that set the OPC tag bit of opc, the value of
+ * FSP_REG_OPC_QDOWN, to ops. The write needs register clock gating, so
+ * it is wrapped in writes of sysctl1, the value of FSP_REG_SYSCTL1, if
+ * that is known; otherwise sysctl1 is -1 and the write is tried anyway.
+ * *idx is set to the index of the FSP_REG_OPC_QDOWN write. Returns the
+ * new count, at most 3 more than n.
+ */
+static int fsp_opc_tag_ops(struct fsp_reg_op *ops, int n, int opc,
+			   int sysctl1, bool enable, int *idx)
+{
+	if (sysctl1 >= 0)
+		n = fsp_reg_op_write(ops, n, FSP_REG_SYSCTL1,
+				     fsp_reg_clk_val(sysctl1, true));
+
+	*idx = n;
+	n = fsp_reg_op_write(ops, n, FSP_REG_OPC_QDOWN,
+			     fsp_opc_tag_val(opc, enable));
+
+	if (sysctl1 >= 0)
+		n = fsp_reg_op_write(ops, n, FSP_REG_SYSCTL1,
+				     fsp_reg_clk_val(sysctl1, false));
+
+	return n;
+}
+
 /* Enable register clock gating for writing certain registers */
 static int fsp_reg_write_enable(struct psmouse *psmouse, bool enable)
 {
@@ -198,10 +349,7 @@ static int fsp_reg_write_enable(struct psmouse *psmouse, bool enable)
 	if (fsp_reg_read(psmouse, FSP_REG_SYSCTL1, &v) == -1)
 		return -1;
 
-	if (enable)
-		nv = v | FSP_BIT_EN_REG_CLK;
-	else
-		nv = v & ~FSP_BIT_EN_REG_CLK;
+	nv = fsp_reg_clk_val(v, enable);
 
 	/* only write if necessary */
 	if (nv != v)
@@ -221,20 +369,20 @@ static int fsp_page_reg_read(struct psmouse *psmouse, int *reg_val)
 
 	ps2_begin_command(ps2dev);
 
-	if (ps2_sendbyte(ps2dev, 0xf3, FSP_CMD_TIMEOUT) < 0)
+	if (psmouse_sendbyte(psmouse, 0xf3, FSP_CMD_TIMEOUT) < 0)
 		goto out;
 
-	ps2_sendbyte(ps2dev, 0x66, FSP_CMD_TIMEOUT2);
-	ps2_sendbyte(ps2dev, 0x88, FSP_CMD_TIMEOUT2);
+	psmouse_sendbyte_nak(psmouse, 0x66, FSP_CMD_TIMEOUT2);
+	psmouse_sendbyte_nak(psmouse, 0x88, FSP_CMD_TIMEOUT2);
 
-	if (ps2_sendbyte(ps2dev, 0xf3, FSP_CMD_TIMEOUT) < 0)
+	if (psmouse_sendbyte(psmouse, 0xf3, FSP_CMD_TIMEOUT) < 0)
 		goto out;
 
-	ps2_sendbyte(ps2dev, 0x83, FSP_CMD_TIMEOUT2);
-	ps2_sendbyte(ps2dev, 0x88, FSP_CMD_TIMEOUT2);
+	psmouse_sendbyte_nak(psmouse, 0x83, FSP_CMD_TIMEOUT2);
+	psmouse_sendbyte_nak(psmouse, 0x88, FSP_CMD_TIMEOUT2);
 
 	/* get the returned result */
-	if (__ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO))
+	if (__psmouse_command(psmouse, param, PSMOUSE_CMD_GETINFO))
 		goto out;
 
 	*reg_val = param[2];
@@ -257,26 +405,26 @@ static int fsp_page_reg_write(struct psmouse *psmouse, int reg_val)
 
 	ps2_begin_command(ps2dev);
 
-	if (ps2_sendbyte(ps2dev, 0xf3, FSP_CMD_TIMEOUT) < 0)
+	if (psmouse_sendbyte(psmouse, 0xf3, FSP_CMD_TIMEOUT) < 0)
 		goto out;
 
-	ps2_sendbyte(ps2dev, 0x38, FSP_CMD_TIMEOUT2);
-	ps2_sendbyte(ps2dev, 0x88, FSP_CMD_TIMEOUT2);
+	psmouse_sendbyte_nak(psmouse, 0x38, FSP_CMD_TIMEOUT2);
+	psmouse_sendbyte_nak(psmouse, 0x88, FSP_CMD_TIMEOUT2);
 
-	if (ps2_sendbyte(ps2dev, 0xf3, FSP_CMD_TIMEOUT) < 0)
+	if (psmouse_sendbyte(psmouse, 0xf3, FSP_CMD_TIMEOUT) < 0)
 		goto out;
 
 	if ((v = fsp_test_invert_cmd(reg_val)) != reg_val) {
-		ps2_sendbyte(ps2dev, 0x47, FSP_CMD_TIMEOUT2);
+		psmouse_sendbyte_nak(psmouse, 0x47, FSP_CMD_TIMEOUT2);
 	} else if ((v = fsp_test_swap_cmd(reg_val)) != reg_val) {
 		/* swapping is required */
-		ps2_sendbyte(ps2dev, 0x44, FSP_CMD_TIMEOUT2);
+		psmouse_sendbyte_nak(psmouse, 0x44, FSP_CMD_TIMEOUT2);
 	} else {
 		/* swapping isn't necessary */
-		ps2_sendbyte(ps2dev, 0x33, FSP_CMD_TIMEOUT2);
+		psmouse_sendbyte_nak(psmouse, 0x33, FSP_CMD_TIMEOUT2);
 	}
 
-	ps2_sendbyte(ps2dev, v, FSP_CMD_TIMEOUT2);
+	psmouse_sendbyte_nak(psmouse, v, FSP_CMD_TIMEOUT2);
 	rc = 0;
 
  out:
@@ -303,7 +451,8 @@ static int fsp_get_revision(struct psmouse *psmouse, int *rev)
 	return 0;
 }
 
-static int fsp_get_buttons(struct psmouse *psmouse, int *btn)
+/* Number of buttons, from the value of FSP_REG_TMOD_STATUS */
+static int fsp_get_buttons(int tmod_status)
 {
 	static const int buttons[] = {
 		0x16, /* Left/Middle/Right/Forward/Backward & Scroll Up/Down */
@@ -311,44 +460,40 @@ static int fsp_get_buttons(struct psmouse *psmouse, int *btn)
 		0x04, /* Left/Middle/Right & Scroll Up/Down */
 		0x02, /* Left/Middle/Right */
 	};
-	int val;
-
-	if (fsp_reg_read(psmouse, FSP_REG_TMOD_STATUS, &val) == -1)
-		return -EIO;
 
-	*btn = buttons[(val & 0x30) >> 4];
-	return 0;
+	return buttons[(tmod_status & 0x30) >> 4];
 }
 
 /* Enable on-pad command tag output */
 static int fsp_opc_tag_enable(struct psmouse *psmouse, bool enable)
 {
-	int v, nv;
-	int res = 0;
+	struct fsp_reg_op rd[] = {
+		{ .reg = FSP_REG_OPC_QDOWN },
+		{ .reg = FSP_REG_SYSCTL1 },
+	};
+	struct fsp_reg_op wr[3];
+	int n, opc;
 
-	if (fsp_reg_read(psmouse, FSP_REG_OPC_QDOWN, &v) == -1) {
+	fsp_reg_transaction(psmouse, rd, ARRAY_SIZE(rd));
+	if (rd[0].rc) {
 		psmouse_err(psmouse, "Unable get OPC state.\n");
 		return -EIO;
 	}
 
-	if (enable)
-		nv = v | FSP_BIT_EN_OPC_TAG;
-	else
-		nv = v & ~FSP_BIT_EN_OPC_TAG;
-
 	/* only write if necessary */
-	if (nv != v) {
-		fsp_reg_write_enable(psmouse, true);
-		res = fsp_reg_write(psmouse, FSP_REG_OPC_QDOWN, nv);
-		fsp_reg_write_enable(psmouse, false);
-	}
+	if (fsp_opc_tag_val(rd[0].val, enable) == rd[0].val)
+		return 0;
 
-	if (res != 0) {
+	n = fsp_opc_tag_ops(wr, 0, rd[0].val, rd[1].rc ? -1 : rd[1].val,
+			    enable, &opc);
+	fsp_reg_transaction(psmouse, wr, n);
+
+	if (wr[opc].rc) {
 		psmouse_err(psmouse, "Unable to enable OPC tag.\n");
-		res = -EIO;
+		return -EIO;
 	}
 
-	return res;
+	return 0;
 }
 
 static int fsp_onpad_vscr(struct psmouse *psmouse, bool enable)
@@ -361,12 +506,8 @@ static int fsp_onpad_vscr(struct psmouse *psmouse, bool enable)
 
 	pad->vscroll = enable;
 
-	if (enable)
-		val |= (FSP_BIT_FIX_VSCR | FSP_BIT_ONPAD_ENABLE);
-	else
-		val &= ~FSP_BIT_FIX_VSCR;
-
-	if (fsp_reg_write(psmouse, FSP_REG_ONPAD_CTL, val))
+	if (fsp_reg_write(psmouse, FSP_REG_ONPAD_CTL,
+			  fsp_onpad_vscr_val(val, enable)))
 		return -EIO;
 
 	return 0;
@@ -375,24 +516,20 @@ static int fsp_onpad_vscr(struct psmouse *psmouse, bool enable)
 static int fsp_onpad_hscr(struct psmouse *psmouse, bool enable)
 {
 	struct fsp_data *pad = psmouse->private;
+	struct fsp_reg_op ops[] = {
+		{ .reg = FSP_REG_ONPAD_CTL },
+		{ .reg = FSP_REG_SYSCTL5 },
+	};
 	int val, v2;
 
-	if (fsp_reg_read(psmouse, FSP_REG_ONPAD_CTL, &val))
+	if (fsp_reg_transaction(psmouse, ops, ARRAY_SIZE(ops)))
 		return -EIO;
 
-	if (fsp_reg_read(psmouse, FSP_REG_SYSCTL5, &v2))
-		return -EIO;
+	val = fsp_onpad_hscr_val(ops[0].val, enable);
+	v2 = fsp_hscr_packets_val(ops[1].val, enable);
 
 	pad->hscroll = enable;
 
-	if (enable) {
-		val |= (FSP_BIT_FIX_HSCR | FSP_BIT_ONPAD_ENABLE);
-		v2 |= FSP_BIT_EN_MSID6;
-	} else {
-		val &= ~FSP_BIT_FIX_HSCR;
-		v2 &= ~(FSP_BIT_EN_MSID6 | FSP_BIT_EN_MSID7 | FSP_BIT_EN_MSID8);
-	}
-
 	if (fsp_reg_write(psmouse, FSP_REG_ONPAD_CTL, val))
 		return -EIO;
 
@@ -469,6 +606,64 @@ static ssize_t fsp_attr_set_getreg(struct psmouse *psmouse, void *data,
 PSMOUSE_DEFINE_ATTR(getreg, S_IWUSR | S_IRUGO, NULL,
 			fsp_attr_show_getreg, fsp_attr_set_getreg);
 
+static ssize_t fsp_attr_show_regdump(struct psmouse *psmouse,
+					void *data, char *buf)
+{
+	struct fsp_data *pad = psmouse->private;
+	int i, len = 0;
+
+	for (i = 0; i < pad->regdump_count; i++)
+		len += sprintf(buf + len, "%02x %02x\n",
+			       pad->regdump_start + i, pad->regdump[i]);
+
+	return len;
+}
+
+/*
+ * Read a range of registers in one transaction.
+ *
+ * ex: 0x90 0x10 -- read 16 registers starting at 0x90
+ */
+static ssize_t fsp_attr_set_regdump(struct psmouse *psmouse, void *data,
+					const char *buf, size_t count)
+{
+	struct fsp_data *pad = psmouse->private;
+	struct fsp_reg_op *ops;
+	unsigned long reg, num;
+	char *rest;
+	int i, error;
+
+	reg = simple_strtoul(buf, &rest, 16);
+	if (rest == buf || *rest != ' ' || reg > 0xff)
+		return -EINVAL;
+
+	if (strict_strtoul(rest + 1, 16, &num) ||
+	    num == 0 || num > FSP_REGDUMP_MAX || reg + num > 0x100)
+		return -EINVAL;
+
+	ops = kcalloc(num, sizeof(*ops), GFP_KERNEL);
+	if (!ops)
+		return -ENOMEM;
+
+	for (i = 0; i < num; i++)
+		ops[i].reg = reg + i;
+
+	error = fsp_reg_transaction(psmouse, ops, num);
+	if (!error) {
+		for (i = 0; i < num; i++)
+			pad->regdump[i] = ops[i].val;
+		pad->regdump_start = reg;
+		pad->regdump_count = num;
+	}
+
+	kfree(ops);
+
+	return error ? error : count;
+}
+
+PSMOUSE_DEFINE_ATTR(regdump, S_IWUSR | S_IRUGO, NULL,
+			fsp_attr_show_regdump, fsp_attr_set_regdump);
+
 static ssize_t fsp_attr_show_pagereg(struct psmouse *psmouse,
 					void *data, char *buf)
 {
@@ -586,14 +781,87 @@ static ssize_t fsp_attr_show_ver(struct psmouse *psmouse,
 
 PSMOUSE_DEFINE_RO_ATTR(ver, S_IRUGO, NULL, fsp_attr_show_ver);
 
+static void fsp_reset_stats(struct fsp_data *pad)
+{
+	pad->stats_start = pad->rate_start = jiffies;
+	memset(pad->pkt_cnt, 0, sizeof(pad->pkt_cnt));
+	pad->pkt_mfmc = 0;
+	pad->rate_cnt = 0;
+	pad->rate_last = 0;
+	pad->rate_max = 0;
+}
+
+/*
+ * Packets seen in the last full second.  The window only rolls over when
+ * a packet arrives, so work out here whether it has ended since: a window
+ * that ended within the last second is the last full one, anything older
+ * means the pad has been quiet for at least a second.
+ */
+static unsigned int fsp_packet_rate(struct fsp_data *pad)
+{
+	unsigned long now = jiffies;
+
+	if (!time_after(now, pad->rate_start + HZ))
+		return pad->rate_last;
+
+	if (!time_after(now, pad->rate_start + 2 * HZ))
+		return pad->rate_cnt;
+
+	return 0;
+}
+
+/*
+ * Packet counters, always collected so that the load generated by the
+ * pad (on-pad scrolling in particular) can be measured without building
+ * with FSP_DEBUG; writing 0 resets them.
+ */
+static ssize_t fsp_attr_show_packet_stats(struct psmouse *psmouse,
+					void *data, char *buf)
+{
+	struct fsp_data *pad = psmouse->private;
+
+	return sprintf(buf,
+		       "elapsed_ms: %u\n"
+		       "absolute: %lu\n"
+		       "normal: %lu\n"
+		       "notify: %lu\n"
+		       "normal_opc: %lu\n"
+		       "mfmc: %lu\n"
+		       "packets_per_sec: %u\n"
+		       "max_packets_per_sec: %u\n",
+		       jiffies_to_msecs(jiffies - pad->stats_start),
+		       pad->pkt_cnt[FSP_PKT_TYPE_ABS],
+		       pad->pkt_cnt[FSP_PKT_TYPE_NORMAL],
+		       pad->pkt_cnt[FSP_PKT_TYPE_NOTIFY],
+		       pad->pkt_cnt[FSP_PKT_TYPE_NORMAL_OPC],
+		       pad->pkt_mfmc, fsp_packet_rate(pad), pad->rate_max);
+}
+
+static ssize_t fsp_attr_set_packet_stats(struct psmouse *psmouse, void *data,
+					const char *buf, size_t count)
+{
+	unsigned long value;
+
+	if (strict_strtoul(buf, 10, &value) || value != 0)
+		return -EINVAL;
+
+	fsp_reset_stats(psmouse->private);
+	return count;
+}
+
+PSMOUSE_DEFINE_ATTR(packet_stats, S_IWUSR | S_IRUGO, NULL,
+		fsp_attr_show_packet_stats, fsp_attr_set_packet_stats);
+
 static struct attribute *fsp_attributes[] = {
 	&psmouse_attr_setreg.dattr.attr,
 	&psmouse_attr_getreg.dattr.attr,
+	&psmouse_attr_regdump.dattr.attr,
 	&psmouse_attr_page.dattr.attr,
 	&psmouse_attr_vscroll.dattr.attr,
 	&psmouse_attr_hscroll.dattr.attr,
 	&psmouse_attr_flags.dattr.attr,
 	&psmouse_attr_ver.dattr.attr,
+	&psmouse_attr_packet_stats.dattr.attr,
 	NULL
 };
 
@@ -604,8 +872,6 @@ static struct attribute_group fsp_attribute_group = {
 #ifdef	FSP_DEBUG
 static void fsp_packet_debug(struct psmouse *psmouse, unsigned char packet[])
 {
-	static unsigned int ps2_packet_cnt;
-	static unsigned int ps2_last_second;
 	unsigned int jiffies_msec;
 	const char *packet_type = "UNKNOWN";
 	unsigned short abs_x = 0, abs_y = 0;
@@ -628,19 +894,12 @@ static void fsp_packet_debug(struct psmouse *psmouse, unsigned char packet[])
 		break;
 	}
 
-	ps2_packet_cnt++;
 	jiffies_msec = jiffies_to_msecs(jiffies);
 	psmouse_dbg(psmouse,
 		    "%08dms %s packets: %02x, %02x, %02x, %02x; "
 		    "abs_x: %d, abs_y: %d\n",
 		    jiffies_msec, packet_type,
 		    packet[0], packet[1], packet[2], packet[3], abs_x, abs_y);
-
-	if (jiffies_msec - ps2_last_second > 1000) {
-		psmouse_dbg(psmouse, "PS/2 packets/sec = %d\n", ps2_packet_cnt);
-		ps2_packet_cnt = 0;
-		ps2_last_second = jiffies_msec;
-	}
 }
 #else
 static void fsp_packet_debug(struct psmouse *psmouse, unsigned char packet[])
@@ -677,12 +936,24 @@ static psmouse_ret_t fsp_process_byte(struct psmouse *psmouse)
 
 	fsp_packet_debug(psmouse, packet);
 
+	ad->pkt_cnt[packet[0] >> FSP_PKT_TYPE_SHIFT]++;
+	if (time_after(jiffies, ad->rate_start + HZ)) {
+		ad->rate_last = fsp_packet_rate(ad);
+		if (ad->rate_cnt > ad->rate_max)
+			ad->rate_max = ad->rate_cnt;
+		ad->rate_cnt = 0;
+		ad->rate_start = jiffies;
+	}
+	ad->rate_cnt++;
+
 	switch (psmouse->packet[0] >> FSP_PKT_TYPE_SHIFT) {
 	case FSP_PKT_TYPE_ABS:
 		abs_x = GET_ABS_X(packet);
 		abs_y = GET_ABS_Y(packet);
 
 		if (packet[0] & FSP_PB0_MFMC) {
+			ad->pkt_mfmc++;
+
 			/*
 			 * MFMC packet: assume that there are two fingers on
 			 * pad
@@ -805,7 +1076,6 @@ static psmouse_ret_t fsp_process_byte(struct psmouse *psmouse)
 static int fsp_activate_protocol(struct psmouse *psmouse)
 {
 	struct fsp_data *pad = psmouse->private;
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[2];
 	int val;
 
@@ -814,13 +1084,13 @@ static int fsp_activate_protocol(struct psmouse *psmouse)
 	 * (scrolling wheel, 4th and 5th buttons)
 	 */
 	param[0] = 200;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
 	param[0] = 200;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
 	param[0] =  80;
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRATE);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE);
 
-	ps2_command(ps2dev, param, PSMOUSE_CMD_GETID);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_GETID);
 	if (param[0] != 0x04) {
 		psmouse_err(psmouse,
 			    "Unable to enable 4 bytes packet format.\n");
@@ -828,19 +1098,40 @@ static int fsp_activate_protocol(struct psmouse *psmouse)
 	}
 
 	if (pad->ver < FSP_VER_STL3888_C0) {
+		/*
+		 * Everything the setup of older hardware depends on is read
+		 * in one transaction and the results written in another,
+		 * rather than deactivating the device for every register.
+		 * A transaction stops at the first failure, so the registers
+		 * the setup can do without come last.
+		 */
+		struct fsp_reg_op rd[] = {
+			{ .reg = FSP_REG_SYSCTL5 },
+			{ .reg = FSP_REG_TMOD_STATUS },
+			{ .reg = FSP_REG_OPC_QDOWN },
+			{ .reg = FSP_REG_ONPAD_CTL },
+			{ .reg = FSP_REG_SYSCTL1 },
+		};
+		struct fsp_reg_op wr[5] = { };
+		int opc = -1, n = 0;
+
+		fsp_reg_transaction(psmouse, rd, ARRAY_SIZE(rd));
+
 		/* Preparing relative coordinates output for older hardware */
-		if (fsp_reg_read(psmouse, FSP_REG_SYSCTL5, &val)) {
+		if (rd[0].rc) {
 			psmouse_err(psmouse,
 				    "Unable to read SYSCTL5 register.\n");
 			return -EIO;
 		}
 
-		if (fsp_get_buttons(psmouse, &pad->buttons)) {
+		if (rd[1].rc) {
 			psmouse_err(psmouse,
 				    "Unable to retrieve number of buttons.\n");
 			return -EIO;
 		}
+		pad->buttons = fsp_get_buttons(rd[1].val);
 
+		val = rd[0].val;
 		val &= ~(FSP_BIT_EN_MSID7 | FSP_BIT_EN_MSID8 | FSP_BIT_EN_AUTO_MSID8);
 		/* Ensure we are not in absolute mode */
 		val &= ~FSP_BIT_EN_PKT_G0;
@@ -848,26 +1139,47 @@ static int fsp_activate_protocol(struct psmouse *psmouse)
 			/* Left/Middle/Right & Scroll Up/Down/Right/Left */
 			val |= FSP_BIT_EN_MSID6;
 		}
+		/* Horizontal scrolling packets, see fsp_onpad_hscr() */
+		if (rd[3].rc == 0)
+			val = fsp_hscr_packets_val(val, true);
 
-		if (fsp_reg_write(psmouse, FSP_REG_SYSCTL5, val)) {
-			psmouse_err(psmouse,
-				    "Unable to set up required mode bits.\n");
-			return -EIO;
+		n = fsp_reg_op_write(wr, n, FSP_REG_SYSCTL5, val);
+
+		/* Enable on-pad vertical and horizontal scrolling */
+		if (rd[3].rc == 0) {
+			val = fsp_onpad_vscr_val(rd[3].val, true);
+			n = fsp_reg_op_write(wr, n, FSP_REG_ONPAD_CTL,
+					     fsp_onpad_hscr_val(val, true));
+			pad->vscroll = pad->hscroll = true;
 		}
 
 		/*
 		 * Enable OPC tags such that driver can tell the difference
-		 * between on-pad and real button click
+		 * between on-pad and real button click.
 		 */
-		if (fsp_opc_tag_enable(psmouse, true))
+		if (rd[2].rc)
+			psmouse_err(psmouse, "Unable get OPC state.\n");
+		else if (fsp_opc_tag_val(rd[2].val, true) != rd[2].val)
+			n = fsp_opc_tag_ops(wr, n, rd[2].val,
+					    rd[4].rc ? -1 : rd[4].val, true,
+					    &opc);
+
+		fsp_reg_transaction(psmouse, wr, n);
+
+		if (wr[0].rc) {
+			psmouse_err(psmouse,
+				    "Unable to set up required mode bits.\n");
+			return -EIO;
+		}
+
+		if (opc >= 0 && wr[opc].rc)
+			psmouse_err(psmouse, "Unable to enable OPC tag.\n");
+
+		if (rd[2].rc || (opc >= 0 && wr[opc].rc))
 			psmouse_warn(psmouse,
 				     "Failed to enable OPC tag mode.\n");
 		/* enable on-pad click by default */
 		pad->flags |= FSPDRV_FLAG_EN_OPC;
-
-		/* Enable on-pad vertical and horizontal scrolling */
-		fsp_onpad_vscr(psmouse, true);
-		fsp_onpad_hscr(psmouse, true);
 	} else {
 		/* Enable absolute coordinates output for Cx/Dx hardware */
 		if (fsp_reg_write(psmouse, FSP_REG_SWC1,
@@ -996,6 +1308,7 @@ int fsp_init(struct psmouse *psmouse)
 
 	priv->ver = ver;
 	priv->rev = rev;
+	fsp_reset_stats(priv);
 
 	psmouse->protocol_handler = fsp_process_byte;
 	psmouse->disconnect = fsp_disconnect;
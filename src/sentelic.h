@@ -94,6 +94,9 @@
 #define	FSP_VER_STL3888_D1	(0xE3)
 #define	FSP_VER_STL3888_E0	(0xE4)
 
+/* Registers that one write to the "regdump" attribute can read */
+#define	FSP_REGDUMP_MAX		64
+
 #ifdef __KERNEL__
 
 struct fsp_data {
@@ -109,6 +112,19 @@ struct fsp_data {
 	unsigned char	last_reg;	/* Last register we requested read from */
 	unsigned char	last_val;
 	unsigned int	last_mt_fgr;	/* Last seen finger(multitouch) */
+
+	unsigned char	regdump_start;	/* Registers read through "regdump" */
+	unsigned char	regdump_count;
+	unsigned char	regdump[FSP_REGDUMP_MAX];
+
+	/* Packet statistics, reported through "packet_stats" */
+	unsigned long	stats_start;	/* jiffies when counters were reset */
+	unsigned long	pkt_cnt[4];	/* Packets seen, by FSP_PKT_TYPE_* */
+	unsigned long	pkt_mfmc;	/* Absolute packets in MFMC mode */
+	unsigned long	rate_start;	/* jiffies the current second began */
+	unsigned int	rate_cnt;	/* Packets in the current second */
+	unsigned int	rate_last;	/* Packets in the last full second */
+	unsigned int	rate_max;	/* Busiest second seen */
 };
 
 #ifdef CONFIG_MOUSE_PS2_SENTELIC
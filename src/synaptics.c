@@ -70,23 +70,22 @@ static int synaptics_mode_cmd(struct psmouse *psmouse, unsigned char mode)
 	if (psmouse_sliced_command(psmouse, mode))
 		return -1;
 	param[0] = SYN_PS_SET_MODE2;
-	if (ps2_command(&psmouse->ps2dev, param, PSMOUSE_CMD_SETRATE))
+	if (psmouse_command(psmouse, param, PSMOUSE_CMD_SETRATE))
 		return -1;
 	return 0;
 }
 
 int synaptics_detect(struct psmouse *psmouse, bool set_properties)
 {
-	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[4];
 
 	param[0] = 0;
 
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES);
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES);
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES);
-	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES);
-	ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_SETRES);
+	psmouse_command(psmouse, param, PSMOUSE_CMD_GETINFO);
 
 	if (param[1] != 0x47)
 		return -ENODEV;
@@ -116,9 +115,16 @@ void synaptics_reset(struct psmouse *psmouse)
  */
 static int synaptics_send_cmd(struct psmouse *psmouse, unsigned char c, unsigned char *param)
 {
-	if (psmouse_sliced_command(psmouse, c))
-		return -1;
-	if (ps2_command(&psmouse->ps2dev, param, PSMOUSE_CMD_GETINFO))
+	struct psmouse_cmd seq[PSMOUSE_SLICED_CMDS + 1];
+	unsigned char nibbles[4];
+	int n;
+
+	n = psmouse_sliced_seq(seq, nibbles, c);
+	seq[n].command = PSMOUSE_CMD_GETINFO;
+	seq[n].param = param;
+
+	if (psmouse_command_seq(psmouse, seq, n + 1,
+				PSMOUSE_CMD_SEQ_TIMEOUT, NULL))
 		return -1;
 	return 0;
 }
@@ -311,7 +317,7 @@ static int synaptics_set_advanced_gesture_mode(struct psmouse *psmouse)
 
 	if (psmouse_sliced_command(psmouse, SYN_QUE_MODEL))
 		return -1;
-	if (ps2_command(&psmouse->ps2dev, &param, PSMOUSE_CMD_SETRATE))
+	if (psmouse_command(psmouse, &param, PSMOUSE_CMD_SETRATE))
 		return -1;
 
 	/* Advanced gesture mode also sends multi finger data */
@@ -330,7 +336,7 @@ static int synaptics_pt_write(struct serio *serio, unsigned char c)
 
 	if (psmouse_sliced_command(parent, c))
 		return -1;
-	if (ps2_command(&parent->ps2dev, &rate_param, PSMOUSE_CMD_SETRATE))
+	if (psmouse_command(parent, &rate_param, PSMOUSE_CMD_SETRATE))
 		return -1;
 	return 0;
 }
@@ -340,9 +346,9 @@ static int synaptics_pt_start(struct serio *serio)
 	struct psmouse *parent = serio_get_drvdata(serio->parent);
 	struct synaptics_data *priv = parent->private;
 
-	serio_pause_rx(parent->ps2dev.serio);
+	psmouse_pause_rx(parent);
 	priv->pt_port = serio;
-	serio_continue_rx(parent->ps2dev.serio);
+	psmouse_continue_rx(parent);
 
 	return 0;
 }
@@ -352,9 +358,9 @@ static void synaptics_pt_stop(struct serio *serio)
 	struct psmouse *parent = serio_get_drvdata(serio->parent);
 	struct synaptics_data *priv = parent->private;
 
-	serio_pause_rx(parent->ps2dev.serio);
+	psmouse_pause_rx(parent);
 	priv->pt_port = NULL;
-	serio_continue_rx(parent->ps2dev.serio);
+	psmouse_continue_rx(parent);
 }
 
 static int synaptics_is_pt_packet(unsigned char *buf)
@@ -424,6 +430,35 @@ static void synaptics_pt_create(struct psmouse *psmouse)
  *	Functions to interpret the absolute mode packets
  ****************************************************************************/
 
+/*
+ * Capabilities the packet decoder depends on. synaptics_select_decoder()
+ * picks a handler with these fixed at compile time, so that the per-packet
+ * path does not have to test them again.
+ */
+#define SYN_DEC_NEWABS		0x01	/* SYN_MODEL_NEWABS() */
+#define SYN_DEC_PASS_THROUGH	0x02	/* SYN_CAP_PASS_THROUGH() */
+#define SYN_DEC_ADV_GESTURE	0x04	/* SYN_CAP_ADV_GESTURE() */
+#define SYN_DEC_IMAGE_SENSOR	0x08	/* SYN_CAP_IMAGE_SENSOR() */
+#define SYN_DEC_FLAGS		0x10
+
+static unsigned int synaptics_decoder_flags(struct synaptics_data *priv)
+{
+	unsigned int dec = 0;
+
+	if (SYN_MODEL_NEWABS(priv->model_id))
+		dec |= SYN_DEC_NEWABS;
+	if (SYN_CAP_PASS_THROUGH(priv->capabilities))
+		dec |= SYN_DEC_PASS_THROUGH;
+
+	/* Image sensors are always decoded as such, AGM or not */
+	if (SYN_CAP_IMAGE_SENSOR(priv->ext_cap_0c))
+		dec |= SYN_DEC_IMAGE_SENSOR;
+	else if (SYN_CAP_ADV_GESTURE(priv->ext_cap_0c))
+		dec |= SYN_DEC_ADV_GESTURE;
+
+	return dec;
+}
+
 static void synaptics_mt_state_set(struct synaptics_mt_state *state, int count,
 				   int sgm, int agm)
 {
@@ -462,13 +497,15 @@ static void synaptics_parse_agm(const unsigned char buf[],
 	priv->agm_pending = true;
 }
 
-static int synaptics_parse_hw_state(const unsigned char buf[],
-				    struct synaptics_data *priv,
-				    struct synaptics_hw_state *hw)
+static __always_inline int
+synaptics_parse_hw_state(const unsigned char buf[],
+			 struct synaptics_data *priv,
+			 struct synaptics_hw_state *hw,
+			 const unsigned int dec)
 {
 	memset(hw, 0, sizeof(struct synaptics_hw_state));
 
-	if (SYN_MODEL_NEWABS(priv->model_id)) {
+	if (dec & SYN_DEC_NEWABS) {
 		hw->w = (((buf[0] & 0x30) >> 2) |
 			 ((buf[0] & 0x04) >> 1) |
 			 ((buf[3] & 0x04) >> 2));
@@ -495,8 +532,7 @@ static int synaptics_parse_hw_state(const unsigned char buf[],
 			hw->down = ((buf[0] ^ buf[3]) & 0x02) ? 1 : 0;
 		}
 
-		if ((SYN_CAP_ADV_GESTURE(priv->ext_cap_0c) ||
-			SYN_CAP_IMAGE_SENSOR(priv->ext_cap_0c)) &&
+		if ((dec & (SYN_DEC_ADV_GESTURE | SYN_DEC_IMAGE_SENSOR)) &&
 		    hw->w == 2) {
 			synaptics_parse_agm(buf, priv, hw);
 			return 1;
@@ -674,257 +710,291 @@ static void synaptics_report_mt_data(struct psmouse *psmouse,
 	input_sync(dev);
 }
 
-/* Handle case where mt_state->count = 0 */
-static void synaptics_image_sensor_0f(struct synaptics_data *priv,
-				      struct synaptics_mt_state *mt_state)
-{
-	synaptics_mt_state_set(mt_state, 0, -1, -1);
-	priv->mt_state_lost = false;
-}
+/*
+ * Image sensor finger tracking.
+ *
+ * The SGM packet only tells us how many fingers are on the pad now; which
+ * slots SGM and AGM report has to be worked out from that count, the
+ * previous mt_state and a few flags. Every combination is resolved once,
+ * at module load, from the rules below into synaptics_mt_table, so a
+ * packet costs a single table lookup instead of a chain of branches.
+ */
+enum synaptics_mt_row {
+	SYN_MT_0F,		/* sgm->z == 0 */
+	SYN_MT_1F,		/* sgm->w >= 4 */
+	SYN_MT_2F,		/* sgm->w == 0 */
+	SYN_MT_3F,		/* sgm->w == 1, at most 3 fingers */
+	SYN_MT_45F,		/* 4 or 5 fingers */
+	SYN_MT_1F_AGM_EMPTY,	/* 1 finger, pending AGM was (0,0,0) */
+	SYN_MT_ROWS
+};
 
-/* Handle case where mt_state->count = 1 */
-static void synaptics_image_sensor_1f(struct synaptics_data *priv,
-				      struct synaptics_mt_state *mt_state)
-{
-	struct synaptics_hw_state *agm = &priv->agm;
-	struct synaptics_mt_state *old = &priv->mt_state;
+#define SYN_MT_OLD_COUNTS	5	/* Previous count 0..3, 4 is "other" */
+#define SYN_MT_ANY		0xff	/* Rule matches any row / old count */
+
+/* Transition flags */
+#define SYN_MT_LOST		0x01	/* priv->mt_state_lost */
+#define SYN_MT_AGM_PENDING	0x02	/* priv->agm_pending */
+#define SYN_MT_SGM_MASK		0x0c	/* Class of the previous SGM slot: */
+#define SYN_MT_SGM_NONE		0x00	/*   -1 */
+#define SYN_MT_SGM_0		0x04	/*   0 (or any other value < 1) */
+#define SYN_MT_SGM_1		0x08	/*   1, also set for 2 and higher */
+#define SYN_MT_SGM_2		0x0c	/*   2 or higher */
+#define SYN_MT_AGM_HIGH		0x10	/* Previous AGM slot is 3 or higher */
+#define SYN_MT_FLAGS		0x20
+
+/* Where each value of the new mt_state comes from */
+#define SYN_MT_V(n)		((n) + 1)	/* Constant -1..3 */
+#define SYN_MT_OLD_SGM		6		/* priv->mt_state.sgm */
+#define SYN_MT_OLD_AGM		7		/* priv->mt_state.agm */
+#define SYN_MT_CUR_COUNT	8		/* Last AGM-CONTACT packet */
+#define SYN_MT_CUR_SGM		9
+#define SYN_MT_CUR_AGM		10
+#define SYN_MT_SRCS		11
+
+/* What happens to priv->mt_state_lost */
+#define SYN_MT_KEEP_LOST	0
+#define SYN_MT_CLEAR_LOST	1
+#define SYN_MT_SET_LOST		2
+
+struct synaptics_mt_rule {
+	u8 row;
+	u8 old_count;
+	u8 mask, match;		/* Transition flags */
+	u8 count, sgm, agm;	/* Sources of the new mt_state */
+	u8 lost;
+};
+
+#define SYN_MT_RULE(_row, _old, _mask, _match, _count, _sgm, _agm, _lost) \
+	{ .row = (_row), .old_count = (_old),				\
+	  .mask = (_mask), .match = (_match),				\
+	  .count = SYN_MT_V(_count), .sgm = (_sgm), .agm = (_agm),	\
+	  .lost = (_lost) }
+
+/*
+ * Rules are tried in order and the first one matching wins. Combinations
+ * not covered by any of them keep the mt_state reported by the last
+ * AGM-CONTACT packet, which is the case for 4 or 5 previous fingers and
+ * when nothing changed.
+ */
+static const struct synaptics_mt_rule synaptics_mt_rules[] = {
+	/* No fingers: everything is known again */
+	SYN_MT_RULE(SYN_MT_0F, SYN_MT_ANY, 0, 0,
+		    0, SYN_MT_V(-1), SYN_MT_V(-1), SYN_MT_CLEAR_LOST),
 
 	/*
 	 * If the last AGM was (0,0,0), and there is only one finger left,
 	 * then we absolutely know that SGM contains slot 0, and all other
 	 * fingers have been removed.
 	 */
-	if (priv->agm_pending && agm->z == 0) {
-		synaptics_mt_state_set(mt_state, 1, 0, -1);
-		priv->mt_state_lost = false;
-		return;
-	}
-
-	switch (old->count) {
-	case 0:
-		synaptics_mt_state_set(mt_state, 1, 0, -1);
-		break;
-	case 1:
-		/*
-		 * If mt_state_lost, then the previous transition was 3->1,
-		 * and SGM now contains either slot 0 or 1, but we don't know
-		 * which.  So, we just assume that the SGM now contains slot 1.
-		 *
-		 * If pending AGM and either:
-		 *   (a) the previous SGM slot contains slot 0, or
-		 *   (b) there was no SGM slot
-		 * then, the SGM now contains slot 1
-		 *
-		 * Case (a) happens with very rapid "drum roll" gestures, where
-		 * slot 0 finger is lifted and a new slot 1 finger touches
-		 * within one reporting interval.
-		 *
-		 * Case (b) happens if initially two or more fingers tap
-		 * briefly, and all but one lift before the end of the first
-		 * reporting interval.
-		 *
-		 * (In both these cases, slot 0 will becomes empty, so SGM
-		 * contains slot 1 with the new finger)
-		 *
-		 * Else, if there was no previous SGM, it now contains slot 0.
-		 *
-		 * Otherwise, SGM still contains the same slot.
-		 */
-		if (priv->mt_state_lost ||
-		    (priv->agm_pending && old->sgm <= 0))
-			synaptics_mt_state_set(mt_state, 1, 1, -1);
-		else if (old->sgm == -1)
-			synaptics_mt_state_set(mt_state, 1, 0, -1);
-		break;
-	case 2:
-		/*
-		 * If mt_state_lost, we don't know which finger SGM contains.
-		 *
-		 * So, report 1 finger, but with both slots empty.
-		 * We will use slot 1 on subsequent 1->1
-		 */
-		if (priv->mt_state_lost) {
-			synaptics_mt_state_set(mt_state, 1, -1, -1);
-			break;
-		}
-		/*
-		 * Since the last AGM was NOT (0,0,0), it was the finger in
-		 * slot 0 that has been removed.
-		 * So, SGM now contains previous AGM's slot, and AGM is now
-		 * empty.
-		 */
-		synaptics_mt_state_set(mt_state, 1, old->agm, -1);
-		break;
-	case 3:
-		/*
-		 * Since last AGM was not (0,0,0), we don't know which finger
-		 * is left.
-		 *
-		 * So, report 1 finger, but with both slots empty.
-		 * We will use slot 1 on subsequent 1->1
-		 */
-		synaptics_mt_state_set(mt_state, 1, -1, -1);
-		priv->mt_state_lost = true;
-		break;
-	case 4:
-	case 5:
-		/* mt_state was updated by AGM-CONTACT packet */
-		break;
-	}
-}
+	SYN_MT_RULE(SYN_MT_1F_AGM_EMPTY, SYN_MT_ANY, 0, 0,
+		    1, SYN_MT_V(0), SYN_MT_V(-1), SYN_MT_CLEAR_LOST),
 
-/* Handle case where mt_state->count = 2 */
-static void synaptics_image_sensor_2f(struct synaptics_data *priv,
-				      struct synaptics_mt_state *mt_state)
-{
-	struct synaptics_mt_state *old = &priv->mt_state;
+	/* 0->1 */
+	SYN_MT_RULE(SYN_MT_1F, 0, 0, 0,
+		    1, SYN_MT_V(0), SYN_MT_V(-1), SYN_MT_KEEP_LOST),
+	/*
+	 * 1->1: If mt_state_lost, then the previous transition was 3->1,
+	 * and SGM now contains either slot 0 or 1, but we don't know
+	 * which.  So, we just assume that the SGM now contains slot 1.
+	 *
+	 * If pending AGM and either:
+	 *   (a) the previous SGM slot contains slot 0, or
+	 *   (b) there was no SGM slot
+	 * then, the SGM now contains slot 1
+	 *
+	 * Case (a) happens with very rapid "drum roll" gestures, where
+	 * slot 0 finger is lifted and a new slot 1 finger touches
+	 * within one reporting interval.
+	 *
+	 * Case (b) happens if initially two or more fingers tap
+	 * briefly, and all but one lift before the end of the first
+	 * reporting interval.
+	 *
+	 * (In both these cases, slot 0 will becomes empty, so SGM
+	 * contains slot 1 with the new finger)
+	 *
+	 * Else, if there was no previous SGM, it now contains slot 0.
+	 *
+	 * Otherwise, SGM still contains the same slot.
+	 */
+	SYN_MT_RULE(SYN_MT_1F, 1, SYN_MT_LOST, SYN_MT_LOST,
+		    1, SYN_MT_V(1), SYN_MT_V(-1), SYN_MT_KEEP_LOST),
+	SYN_MT_RULE(SYN_MT_1F, 1, SYN_MT_AGM_PENDING | SYN_MT_SGM_1,
+		    SYN_MT_AGM_PENDING,
+		    1, SYN_MT_V(1), SYN_MT_V(-1), SYN_MT_KEEP_LOST),
+	SYN_MT_RULE(SYN_MT_1F, 1, SYN_MT_SGM_MASK, SYN_MT_SGM_NONE,
+		    1, SYN_MT_V(0), SYN_MT_V(-1), SYN_MT_KEEP_LOST),
+	/*
+	 * 2->1: If mt_state_lost, we don't know which finger SGM contains.
+	 *
+	 * So, report 1 finger, but with both slots empty.
+	 * We will use slot 1 on subsequent 1->1
+	 */
+	SYN_MT_RULE(SYN_MT_1F, 2, SYN_MT_LOST, SYN_MT_LOST,
+		    1, SYN_MT_V(-1), SYN_MT_V(-1), SYN_MT_KEEP_LOST),
+	/*
+	 * Since the last AGM was NOT (0,0,0), it was the finger in
+	 * slot 0 that has been removed.
+	 * So, SGM now contains previous AGM's slot, and AGM is now
+	 * empty.
+	 */
+	SYN_MT_RULE(SYN_MT_1F, 2, 0, 0,
+		    1, SYN_MT_OLD_AGM, SYN_MT_V(-1), SYN_MT_KEEP_LOST),
+	/*
+	 * 3->1: Since last AGM was not (0,0,0), we don't know which finger
+	 * is left.
+	 *
+	 * So, report 1 finger, but with both slots empty.
+	 * We will use slot 1 on subsequent 1->1
+	 */
+	SYN_MT_RULE(SYN_MT_1F, 3, 0, 0,
+		    1, SYN_MT_V(-1), SYN_MT_V(-1), SYN_MT_SET_LOST),
 
-	switch (old->count) {
-	case 0:
-		synaptics_mt_state_set(mt_state, 2, 0, 1);
-		break;
-	case 1:
-		/*
-		 * If previous SGM contained slot 1 or higher, SGM now contains
-		 * slot 0 (the newly touching finger) and AGM contains SGM's
-		 * previous slot.
-		 *
-		 * Otherwise, SGM still contains slot 0 and AGM now contains
-		 * slot 1.
-		 */
-		if (old->sgm >= 1)
-			synaptics_mt_state_set(mt_state, 2, 0, old->sgm);
-		else
-			synaptics_mt_state_set(mt_state, 2, 0, 1);
-		break;
-	case 2:
-		/*
-		 * If mt_state_lost, SGM now contains either finger 1 or 2, but
-		 * we don't know which.
-		 * So, we just assume that the SGM contains slot 0 and AGM 1.
-		 */
-		if (priv->mt_state_lost)
-			synaptics_mt_state_set(mt_state, 2, 0, 1);
-		/*
-		 * Otherwise, use the same mt_state, since it either hasn't
-		 * changed, or was updated by a recently received AGM-CONTACT
-		 * packet.
-		 */
-		break;
-	case 3:
-		/*
-		 * 3->2 transitions have two unsolvable problems:
-		 *  1) no indication is given which finger was removed
-		 *  2) no way to tell if agm packet was for finger 3
-		 *     before 3->2, or finger 2 after 3->2.
-		 *
-		 * So, report 2 fingers, but empty all slots.
-		 * We will guess slots [0,1] on subsequent 2->2.
-		 */
-		synaptics_mt_state_set(mt_state, 2, -1, -1);
-		priv->mt_state_lost = true;
-		break;
-	case 4:
-	case 5:
-		/* mt_state was updated by AGM-CONTACT packet */
-		break;
-	}
-}
+	/* 0->2 */
+	SYN_MT_RULE(SYN_MT_2F, 0, 0, 0,
+		    2, SYN_MT_V(0), SYN_MT_V(1), SYN_MT_KEEP_LOST),
+	/*
+	 * 1->2: If previous SGM contained slot 1 or higher, SGM now contains
+	 * slot 0 (the newly touching finger) and AGM contains SGM's
+	 * previous slot.
+	 *
+	 * Otherwise, SGM still contains slot 0 and AGM now contains
+	 * slot 1.
+	 */
+	SYN_MT_RULE(SYN_MT_2F, 1, SYN_MT_SGM_1, SYN_MT_SGM_1,
+		    2, SYN_MT_V(0), SYN_MT_OLD_SGM, SYN_MT_KEEP_LOST),
+	SYN_MT_RULE(SYN_MT_2F, 1, 0, 0,
+		    2, SYN_MT_V(0), SYN_MT_V(1), SYN_MT_KEEP_LOST),
+	/*
+	 * 2->2: If mt_state_lost, SGM now contains either finger 1 or 2, but
+	 * we don't know which.
+	 * So, we just assume that the SGM contains slot 0 and AGM 1.
+	 *
+	 * Otherwise, use the same mt_state, since it either hasn't
+	 * changed, or was updated by a recently received AGM-CONTACT
+	 * packet.
+	 */
+	SYN_MT_RULE(SYN_MT_2F, 2, SYN_MT_LOST, SYN_MT_LOST,
+		    2, SYN_MT_V(0), SYN_MT_V(1), SYN_MT_KEEP_LOST),
+	/*
+	 * 3->2 transitions have two unsolvable problems:
+	 *  1) no indication is given which finger was removed
+	 *  2) no way to tell if agm packet was for finger 3
+	 *     before 3->2, or finger 2 after 3->2.
+	 *
+	 * So, report 2 fingers, but empty all slots.
+	 * We will guess slots [0,1] on subsequent 2->2.
+	 */
+	SYN_MT_RULE(SYN_MT_2F, 3, 0, 0,
+		    2, SYN_MT_V(-1), SYN_MT_V(-1), SYN_MT_SET_LOST),
 
-/* Handle case where mt_state->count = 3 */
-static void synaptics_image_sensor_3f(struct synaptics_data *priv,
-				      struct synaptics_mt_state *mt_state)
-{
-	struct synaptics_mt_state *old = &priv->mt_state;
+	/* 0->3 */
+	SYN_MT_RULE(SYN_MT_3F, 0, 0, 0,
+		    3, SYN_MT_V(0), SYN_MT_V(2), SYN_MT_KEEP_LOST),
+	/*
+	 * 1->3: If previous SGM contained slot 2 or higher, SGM now contains
+	 * slot 0 (one of the newly touching fingers) and AGM contains
+	 * SGM's previous slot.
+	 *
+	 * Otherwise, SGM now contains slot 0 and AGM contains slot 2.
+	 */
+	SYN_MT_RULE(SYN_MT_3F, 1, SYN_MT_SGM_MASK, SYN_MT_SGM_2,
+		    3, SYN_MT_V(0), SYN_MT_OLD_SGM, SYN_MT_KEEP_LOST),
+	SYN_MT_RULE(SYN_MT_3F, 1, 0, 0,
+		    3, SYN_MT_V(0), SYN_MT_V(2), SYN_MT_KEEP_LOST),
+	/*
+	 * 2->3: If the AGM previously contained slot 3 or higher, then the
+	 * newly touching finger is in the lowest available slot.
+	 *
+	 * If SGM was previously 1 or higher, then the new SGM is
+	 * now slot 0 (with a new finger), otherwise, the new finger
+	 * is now in a hidden slot between 0 and AGM's slot.
+	 *
+	 * In all such cases, the SGM now contains slot 0, and the AGM
+	 * continues to contain the same slot as before.
+	 */
+	SYN_MT_RULE(SYN_MT_3F, 2, SYN_MT_AGM_HIGH, SYN_MT_AGM_HIGH,
+		    3, SYN_MT_V(0), SYN_MT_OLD_AGM, SYN_MT_KEEP_LOST),
+	/*
+	 * After some 3->1 and all 3->2 transitions, we lose track
+	 * of which slot is reported by SGM and AGM.
+	 *
+	 * For 2->3 in this state, report 3 fingers, but empty all
+	 * slots, and we will guess (0,2) on a subsequent 0->3.
+	 *
+	 * To userspace, the resulting transition will look like:
+	 *    2:[0,1] -> 3:[-1,-1] -> 3:[0,2]
+	 */
+	SYN_MT_RULE(SYN_MT_3F, 2, SYN_MT_LOST, SYN_MT_LOST,
+		    3, SYN_MT_V(-1), SYN_MT_V(-1), SYN_MT_KEEP_LOST),
+	/*
+	 * If the (SGM,AGM) really previously contained slots (0, 1),
+	 * then we cannot know what slot was just reported by the AGM,
+	 * because the 2->3 transition can occur either before or after
+	 * the AGM packet. Thus, this most recent AGM could contain
+	 * either the same old slot 1 or the new slot 2.
+	 * Subsequent AGMs will be reporting slot 2.
+	 *
+	 * To userspace, the resulting transition will look like:
+	 *    2:[0,1] -> 3:[0,-1] -> 3:[0,2]
+	 */
+	SYN_MT_RULE(SYN_MT_3F, 2, 0, 0,
+		    3, SYN_MT_V(0), SYN_MT_V(-1), SYN_MT_KEEP_LOST),
+	/*
+	 * 3->3: If, for whatever reason, the previous agm was invalid,
+	 * Assume SGM now contains slot 0, AGM now contains slot 2.
+	 *
+	 * Otherwise mt_state either hasn't changed, or was updated by a
+	 * recently received AGM-CONTACT packet.
+	 */
+	SYN_MT_RULE(SYN_MT_3F, 3, SYN_MT_AGM_HIGH, 0,
+		    3, SYN_MT_V(0), SYN_MT_V(2), SYN_MT_KEEP_LOST),
 
-	switch (old->count) {
-	case 0:
-		synaptics_mt_state_set(mt_state, 3, 0, 2);
-		break;
-	case 1:
-		/*
-		 * If previous SGM contained slot 2 or higher, SGM now contains
-		 * slot 0 (one of the newly touching fingers) and AGM contains
-		 * SGM's previous slot.
-		 *
-		 * Otherwise, SGM now contains slot 0 and AGM contains slot 2.
-		 */
-		if (old->sgm >= 2)
-			synaptics_mt_state_set(mt_state, 3, 0, old->sgm);
-		else
-			synaptics_mt_state_set(mt_state, 3, 0, 2);
-		break;
-	case 2:
-		/*
-		 * If the AGM previously contained slot 3 or higher, then the
-		 * newly touching finger is in the lowest available slot.
-		 *
-		 * If SGM was previously 1 or higher, then the new SGM is
-		 * now slot 0 (with a new finger), otherwise, the new finger
-		 * is now in a hidden slot between 0 and AGM's slot.
-		 *
-		 * In all such cases, the SGM now contains slot 0, and the AGM
-		 * continues to contain the same slot as before.
-		 */
-		if (old->agm >= 3) {
-			synaptics_mt_state_set(mt_state, 3, 0, old->agm);
-			break;
-		}
+	/* mt_state was updated correctly by AGM-CONTACT packet */
+	{ .row = SYN_MT_45F, .old_count = SYN_MT_ANY,
+	  .count = SYN_MT_CUR_COUNT, .sgm = SYN_MT_CUR_SGM,
+	  .agm = SYN_MT_CUR_AGM, .lost = SYN_MT_CLEAR_LOST },
+
+	/* Anything else: mt_state was updated by AGM-CONTACT packet */
+	{ .row = SYN_MT_ANY, .old_count = SYN_MT_ANY,
+	  .count = SYN_MT_CUR_COUNT, .sgm = SYN_MT_CUR_SGM,
+	  .agm = SYN_MT_CUR_AGM, .lost = SYN_MT_KEEP_LOST },
+};
 
-		/*
-		 * After some 3->1 and all 3->2 transitions, we lose track
-		 * of which slot is reported by SGM and AGM.
-		 *
-		 * For 2->3 in this state, report 3 fingers, but empty all
-		 * slots, and we will guess (0,2) on a subsequent 0->3.
-		 *
-		 * To userspace, the resulting transition will look like:
-		 *    2:[0,1] -> 3:[-1,-1] -> 3:[0,2]
-		 */
-		if (priv->mt_state_lost) {
-			synaptics_mt_state_set(mt_state, 3, -1, -1);
-			break;
-		}
+/* Index into synaptics_mt_rules for every row, old count and flags */
+static u8 synaptics_mt_table[SYN_MT_ROWS][SYN_MT_OLD_COUNTS][SYN_MT_FLAGS]
+	__read_mostly;
 
-		/*
-		 * If the (SGM,AGM) really previously contained slots (0, 1),
-		 * then we cannot know what slot was just reported by the AGM,
-		 * because the 2->3 transition can occur either before or after
-		 * the AGM packet. Thus, this most recent AGM could contain
-		 * either the same old slot 1 or the new slot 2.
-		 * Subsequent AGMs will be reporting slot 2.
-		 *
-		 * To userspace, the resulting transition will look like:
-		 *    2:[0,1] -> 3:[0,-1] -> 3:[0,2]
-		 */
-		synaptics_mt_state_set(mt_state, 3, 0, -1);
-		break;
-	case 3:
-		/*
-		 * If, for whatever reason, the previous agm was invalid,
-		 * Assume SGM now contains slot 0, AGM now contains slot 2.
-		 */
-		if (old->agm <= 2)
-			synaptics_mt_state_set(mt_state, 3, 0, 2);
-		/*
-		 * mt_state either hasn't changed, or was updated by a recently
-		 * received AGM-CONTACT packet.
-		 */
-		break;
+static u8 __init synaptics_mt_find_rule(int row, int old_count, int flags)
+{
+	const struct synaptics_mt_rule *rule;
+	int i;
 
-	case 4:
-	case 5:
-		/* mt_state was updated by AGM-CONTACT packet */
-		break;
+	for (i = 0; i < ARRAY_SIZE(synaptics_mt_rules) - 1; i++) {
+		rule = &synaptics_mt_rules[i];
+		if ((rule->row == SYN_MT_ANY || rule->row == row) &&
+		    (rule->old_count == SYN_MT_ANY ||
+		     rule->old_count == old_count) &&
+		    (flags & rule->mask) == rule->match)
+			break;
 	}
+
+	return i;
 }
 
-/* Handle case where mt_state->count = 4, or = 5 */
-static void synaptics_image_sensor_45f(struct synaptics_data *priv,
-				       struct synaptics_mt_state *mt_state)
+static void __init synaptics_mt_build_table(void)
 {
-	/* mt_state was updated correctly by AGM-CONTACT packet */
-	priv->mt_state_lost = false;
+	int row, old_count, flags;
+
+	BUILD_BUG_ON(ARRAY_SIZE(synaptics_mt_rules) > U8_MAX);
+
+	for (row = 0; row < SYN_MT_ROWS; row++)
+		for (old_count = 0; old_count < SYN_MT_OLD_COUNTS; old_count++)
+			for (flags = 0; flags < SYN_MT_FLAGS; flags++)
+				synaptics_mt_table[row][old_count][flags] =
+					synaptics_mt_find_rule(row, old_count,
+							       flags);
 }
 
 static void synaptics_image_sensor_process(struct psmouse *psmouse,
@@ -932,7 +1002,11 @@ static void synaptics_image_sensor_process(struct psmouse *psmouse,
 {
 	struct synaptics_data *priv = psmouse->private;
 	struct synaptics_hw_state *agm = &priv->agm;
+	struct synaptics_mt_state *old = &priv->mt_state;
+	const struct synaptics_mt_rule *rule;
 	struct synaptics_mt_state mt_state;
+	int src[SYN_MT_SRCS];
+	unsigned int row, old_count, flags;
 
 	/* Initialize using current mt_state (as updated by last agm) */
 	mt_state = agm->mt_state;
@@ -941,15 +1015,40 @@ static void synaptics_image_sensor_process(struct psmouse *psmouse,
 	 * Update mt_state using the new finger count and current mt_state.
 	 */
 	if (sgm->z == 0)
-		synaptics_image_sensor_0f(priv, &mt_state);
+		row = SYN_MT_0F;
 	else if (sgm->w >= 4)
-		synaptics_image_sensor_1f(priv, &mt_state);
+		row = priv->agm_pending && agm->z == 0 ?
+			SYN_MT_1F_AGM_EMPTY : SYN_MT_1F;
 	else if (sgm->w == 0)
-		synaptics_image_sensor_2f(priv, &mt_state);
+		row = SYN_MT_2F;
 	else if (sgm->w == 1 && mt_state.count <= 3)
-		synaptics_image_sensor_3f(priv, &mt_state);
+		row = SYN_MT_3F;
 	else
-		synaptics_image_sensor_45f(priv, &mt_state);
+		row = SYN_MT_45F;
+
+	old_count = min_t(unsigned int, old->count, SYN_MT_OLD_COUNTS - 1);
+	flags = (priv->mt_state_lost ? SYN_MT_LOST : 0) |
+		(priv->agm_pending ? SYN_MT_AGM_PENDING : 0) |
+		((old->sgm != -1) + (old->sgm >= 1) + (old->sgm >= 2)) << 2 |
+		(old->agm >= 3 ? SYN_MT_AGM_HIGH : 0);
+
+	rule = &synaptics_mt_rules[synaptics_mt_table[row][old_count][flags]];
+
+	src[SYN_MT_V(-1)] = -1;
+	src[SYN_MT_V(0)] = 0;
+	src[SYN_MT_V(1)] = 1;
+	src[SYN_MT_V(2)] = 2;
+	src[SYN_MT_V(3)] = 3;
+	src[SYN_MT_OLD_SGM] = old->sgm;
+	src[SYN_MT_OLD_AGM] = old->agm;
+	src[SYN_MT_CUR_COUNT] = mt_state.count;
+	src[SYN_MT_CUR_SGM] = mt_state.sgm;
+	src[SYN_MT_CUR_AGM] = mt_state.agm;
+
+	synaptics_mt_state_set(&mt_state, src[rule->count],
+			       src[rule->sgm], src[rule->agm]);
+	if (rule->lost != SYN_MT_KEEP_LOST)
+		priv->mt_state_lost = rule->lost == SYN_MT_SET_LOST;
 
 	/* Send resulting input events to user space */
 	synaptics_report_mt_data(psmouse, &mt_state, sgm);
@@ -962,7 +1061,8 @@ static void synaptics_image_sensor_process(struct psmouse *psmouse,
 /*
  *  called for each full received packet from the touchpad
  */
-static void synaptics_process_packet(struct psmouse *psmouse)
+static __always_inline void synaptics_process_packet(struct psmouse *psmouse,
+						     const unsigned int dec)
 {
 	struct input_dev *dev = psmouse->dev;
 	struct synaptics_data *priv = psmouse->private;
@@ -970,10 +1070,10 @@ static void synaptics_process_packet(struct psmouse *psmouse)
 	int num_fingers;
 	int finger_width;
 
-	if (synaptics_parse_hw_state(psmouse->packet, priv, &hw))
+	if (synaptics_parse_hw_state(psmouse->packet, priv, &hw, dec))
 		return;
 
-	if (SYN_CAP_IMAGE_SENSOR(priv->ext_cap_0c)) {
+	if (dec & SYN_DEC_IMAGE_SENSOR) {
 		synaptics_image_sensor_process(psmouse, &hw);
 		return;
 	}
@@ -1022,7 +1122,7 @@ static void synaptics_process_packet(struct psmouse *psmouse)
 		finger_width = 0;
 	}
 
-	if (SYN_CAP_ADV_GESTURE(priv->ext_cap_0c))
+	if (dec & SYN_DEC_ADV_GESTURE)
 		synaptics_report_semi_mt_data(dev, &hw, &priv->agm,
 					      num_fingers);
 
@@ -1053,14 +1153,15 @@ static void synaptics_process_packet(struct psmouse *psmouse)
 	input_sync(dev);
 }
 
+static const unsigned char newabs_mask[]	= { 0xC8, 0x00, 0x00, 0xC8, 0x00 };
+static const unsigned char newabs_rel_mask[]	= { 0xC0, 0x00, 0x00, 0xC0, 0x00 };
+static const unsigned char newabs_rslt[]	= { 0x80, 0x00, 0x00, 0xC0, 0x00 };
+static const unsigned char oldabs_mask[]	= { 0xC0, 0x60, 0x00, 0xC0, 0x60 };
+static const unsigned char oldabs_rslt[]	= { 0xC0, 0x00, 0x00, 0x80, 0x00 };
+
 static int synaptics_validate_byte(struct psmouse *psmouse,
 				   int idx, unsigned char pkt_type)
 {
-	static const unsigned char newabs_mask[]	= { 0xC8, 0x00, 0x00, 0xC8, 0x00 };
-	static const unsigned char newabs_rel_mask[]	= { 0xC0, 0x00, 0x00, 0xC0, 0x00 };
-	static const unsigned char newabs_rslt[]	= { 0x80, 0x00, 0x00, 0xC0, 0x00 };
-	static const unsigned char oldabs_mask[]	= { 0xC0, 0x60, 0x00, 0xC0, 0x60 };
-	static const unsigned char oldabs_rslt[]	= { 0xC0, 0x00, 0x00, 0x80, 0x00 };
 	const char *packet = psmouse->packet;
 
 	if (idx < 0 || idx > 4)
@@ -1097,26 +1198,145 @@ static unsigned char synaptics_detect_pkt_type(struct psmouse *psmouse)
 	return SYN_NEWABS_STRICT;
 }
 
-static psmouse_ret_t synaptics_process_byte(struct psmouse *psmouse)
+static bool synaptics_validate_header(struct psmouse *psmouse)
 {
 	struct synaptics_data *priv = psmouse->private;
 
-	if (psmouse->pktcnt >= 6) { /* Full packet received */
-		if (unlikely(priv->pkt_type == SYN_NEWABS))
-			priv->pkt_type = synaptics_detect_pkt_type(psmouse);
+	return synaptics_validate_byte(psmouse, 0, priv->pkt_type);
+}
+
+/*
+ * Body of all packet decoders. dec is a compile time constant in the
+ * specialised handlers, which lets the compiler drop the capability tests
+ * along with the code they guard. Bytes are checked against the masks
+ * synaptics_select_decoder() picked for the packet type.
+ */
+static __always_inline psmouse_ret_t
+__synaptics_process_byte(struct psmouse *psmouse, const unsigned int dec)
+{
+	struct synaptics_data *priv = psmouse->private;
+	int idx = psmouse->pktcnt - 1;
 
-		if (SYN_CAP_PASS_THROUGH(priv->capabilities) &&
+	if (psmouse->pktcnt >= 6) { /* Full packet received */
+		if ((dec & SYN_DEC_PASS_THROUGH) &&
 		    synaptics_is_pt_packet(psmouse->packet)) {
 			if (priv->pt_port)
 				synaptics_pass_pt_packet(priv->pt_port, psmouse->packet);
 		} else
-			synaptics_process_packet(psmouse);
+			synaptics_process_packet(psmouse, dec);
 
 		return PSMOUSE_FULL_PACKET;
 	}
 
-	return synaptics_validate_byte(psmouse, psmouse->pktcnt - 1, priv->pkt_type) ?
-		PSMOUSE_GOOD_DATA : PSMOUSE_BAD_DATA;
+	return (psmouse->packet[idx] & priv->pkt_mask[idx]) ==
+			priv->pkt_rslt[idx] ? PSMOUSE_GOOD_DATA : PSMOUSE_BAD_DATA;
+}
+
+#define SYN_DECODER(name, dec)						\
+static psmouse_ret_t synaptics_process_byte_##name(struct psmouse *psmouse) \
+{									\
+	return __synaptics_process_byte(psmouse, dec);			\
+}
+
+SYN_DECODER(oldabs, 0)
+SYN_DECODER(newabs, SYN_DEC_NEWABS)
+SYN_DECODER(newabs_pt, SYN_DEC_NEWABS | SYN_DEC_PASS_THROUGH)
+SYN_DECODER(agm, SYN_DEC_NEWABS | SYN_DEC_ADV_GESTURE)
+SYN_DECODER(agm_pt, SYN_DEC_NEWABS | SYN_DEC_ADV_GESTURE |
+		    SYN_DEC_PASS_THROUGH)
+SYN_DECODER(image_sensor, SYN_DEC_NEWABS | SYN_DEC_IMAGE_SENSOR)
+SYN_DECODER(image_sensor_pt, SYN_DEC_NEWABS | SYN_DEC_IMAGE_SENSOR |
+			     SYN_DEC_PASS_THROUGH)
+
+/* Combinations not listed here use the generic synaptics_process_byte() */
+static psmouse_ret_t (* const synaptics_decoders[SYN_DEC_FLAGS])(struct psmouse *) = {
+	[0]						= synaptics_process_byte_oldabs,
+	[SYN_DEC_NEWABS]				= synaptics_process_byte_newabs,
+	[SYN_DEC_NEWABS | SYN_DEC_PASS_THROUGH]		= synaptics_process_byte_newabs_pt,
+	[SYN_DEC_NEWABS | SYN_DEC_ADV_GESTURE]		= synaptics_process_byte_agm,
+	[SYN_DEC_NEWABS | SYN_DEC_ADV_GESTURE |
+	 SYN_DEC_PASS_THROUGH]				= synaptics_process_byte_agm_pt,
+	[SYN_DEC_NEWABS | SYN_DEC_IMAGE_SENSOR]		= synaptics_process_byte_image_sensor,
+	[SYN_DEC_NEWABS | SYN_DEC_IMAGE_SENSOR |
+	 SYN_DEC_PASS_THROUGH]				= synaptics_process_byte_image_sensor_pt,
+};
+
+static psmouse_ret_t synaptics_process_byte(struct psmouse *psmouse);
+
+/*
+ * Installs the decoder specialised for the capabilities of the touchpad.
+ * NEWABS touchpads keep the generic one until the first full packet has
+ * shown whether they need relaxed validation.
+ */
+static void synaptics_select_decoder(struct psmouse *psmouse)
+{
+	struct synaptics_data *priv = psmouse->private;
+	unsigned int dec = synaptics_decoder_flags(priv);
+
+	priv->pkt_mask = priv->pkt_type == SYN_OLDABS ? oldabs_mask :
+			 priv->pkt_type == SYN_NEWABS_STRICT ? newabs_mask :
+							      newabs_rel_mask;
+	priv->pkt_rslt = priv->pkt_type == SYN_OLDABS ? oldabs_rslt :
+							newabs_rslt;
+
+	psmouse->protocol_handler = synaptics_process_byte;
+
+	if (priv->pkt_type != SYN_NEWABS && synaptics_decoders[dec]) {
+		psmouse->protocol_handler = synaptics_decoders[dec];
+		psmouse_dbg(psmouse, "using packet decoder %#x\n", dec);
+	}
+}
+
+/* Generic decoder, tests the capabilities on every packet */
+static psmouse_ret_t synaptics_process_byte(struct psmouse *psmouse)
+{
+	struct synaptics_data *priv = psmouse->private;
+
+	if (unlikely(priv->pkt_type == SYN_NEWABS) && psmouse->pktcnt >= 6) {
+		priv->pkt_type = synaptics_detect_pkt_type(psmouse);
+		synaptics_select_decoder(psmouse);
+	}
+
+	return __synaptics_process_byte(psmouse,
+					synaptics_decoder_flags(priv));
+}
+
+/*
+ * Burst handler for deferred mode: validates and decodes whole packets
+ * straight from the queue. The first packet, which picks the validation
+ * mode and the decoder, always goes through synaptics_process_byte().
+ */
+static int synaptics_process_burst(struct psmouse *psmouse,
+				   const unsigned char *data, const u64 *time,
+				   int count, int *packets)
+{
+	struct synaptics_data *priv = psmouse->private;
+	int i, n = 0;
+
+	*packets = 0;
+
+	if (priv->pkt_type == SYN_NEWABS)
+		return 0;
+
+	while (count - n >= 6 && data[n] != PSMOUSE_RET_BAT) {
+		memcpy(psmouse->packet, data + n, 6);
+
+		for (i = 0; i < 5; i++)
+			if ((data[n + i] & priv->pkt_mask[i]) != priv->pkt_rslt[i])
+				goto out;
+
+		psmouse->pktcnt = 6;
+		psmouse->protocol_handler(psmouse);
+		psmouse->pktcnt = 0;
+
+		psmouse->irq_time = time[n + 5];
+		psmouse_account_latency(psmouse);
+		(*packets)++;
+		n += 6;
+	}
+
+out:
+	return n;
 }
 
 /*****************************************************************************
@@ -1271,6 +1491,8 @@ static int synaptics_reconnect(struct psmouse *psmouse)
 		return -1;
 	}
 
+	synaptics_select_decoder(psmouse);
+
 	return 0;
 }
 
@@ -1332,6 +1554,7 @@ void __init synaptics_module_init(void)
 {
 	impaired_toshiba_kbc = dmi_check_system(toshiba_dmi_table);
 	broken_olpc_ec = dmi_check_system(olpc_dmi_table);
+	synaptics_mt_build_table();
 }
 
 int synaptics_init(struct psmouse *psmouse)
@@ -1395,7 +1618,9 @@ int synaptics_init(struct psmouse *psmouse)
 	psmouse->model = ((priv->model_id & 0x00ff0000) >> 8) |
 			  (priv->model_id & 0x000000ff);
 
-	psmouse->protocol_handler = synaptics_process_byte;
+	synaptics_select_decoder(psmouse);
+	psmouse->validate_header = synaptics_validate_header;
+	psmouse->burst_handler = synaptics_process_burst;
 	psmouse->set_rate = synaptics_set_rate;
 	psmouse->disconnect = synaptics_disconnect;
 	psmouse->reconnect = synaptics_reconnect;
@@ -157,6 +157,8 @@ struct synaptics_data {
 	unsigned int x_min, y_min;		/* Min coordinates (from FW) */
 
 	unsigned char pkt_type;			/* packet type - old, new, etc */
+	const unsigned char *pkt_mask;		/* byte validation for pkt_type */
+	const unsigned char *pkt_rslt;
 	unsigned char mode;			/* current mode byte */
 	int scroll;
 
@@ -76,7 +76,7 @@ int touchkit_ps2_detect(struct psmouse *psmouse, bool set_properties)
 	param[1] = TOUCHKIT_CMD_ACTIVE;
 	command = TOUCHKIT_SEND_PARMS(2, 3, TOUCHKIT_CMD);
 
-	if (ps2_command(&psmouse->ps2dev, param, command))
+	if (psmouse_command(psmouse, param, command))
 		return -ENODEV;
 
 	if (param[0] != TOUCHKIT_CMD || param[1] != 0x01 ||
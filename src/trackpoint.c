@@ -22,38 +22,38 @@
 /*
  * Device IO: read, write and toggle bit
  */
-static int trackpoint_read(struct ps2dev *ps2dev, unsigned char loc, unsigned char *results)
+static int trackpoint_read(struct psmouse *psmouse, unsigned char loc, unsigned char *results)
 {
-	if (ps2_command(ps2dev, NULL, MAKE_PS2_CMD(0, 0, TP_COMMAND)) ||
-	    ps2_command(ps2dev, results, MAKE_PS2_CMD(0, 1, loc))) {
+	if (psmouse_command(psmouse, NULL, MAKE_PS2_CMD(0, 0, TP_COMMAND)) ||
+	    psmouse_command(psmouse, results, MAKE_PS2_CMD(0, 1, loc))) {
 		return -1;
 	}
 
 	return 0;
 }
 
-static int trackpoint_write(struct ps2dev *ps2dev, unsigned char loc, unsigned char val)
+static int trackpoint_write(struct psmouse *psmouse, unsigned char loc, unsigned char val)
 {
-	if (ps2_command(ps2dev, NULL, MAKE_PS2_CMD(0, 0, TP_COMMAND)) ||
-	    ps2_command(ps2dev, NULL, MAKE_PS2_CMD(0, 0, TP_WRITE_MEM)) ||
-	    ps2_command(ps2dev, NULL, MAKE_PS2_CMD(0, 0, loc)) ||
-	    ps2_command(ps2dev, NULL, MAKE_PS2_CMD(0, 0, val))) {
+	if (psmouse_command(psmouse, NULL, MAKE_PS2_CMD(0, 0, TP_COMMAND)) ||
+	    psmouse_command(psmouse, NULL, MAKE_PS2_CMD(0, 0, TP_WRITE_MEM)) ||
+	    psmouse_command(psmouse, NULL, MAKE_PS2_CMD(0, 0, loc)) ||
+	    psmouse_command(psmouse, NULL, MAKE_PS2_CMD(0, 0, val))) {
 		return -1;
 	}
 
 	return 0;
 }
 
-static int trackpoint_toggle_bit(struct ps2dev *ps2dev, unsigned char loc, unsigned char mask)
+static int trackpoint_toggle_bit(struct psmouse *psmouse, unsigned char loc, unsigned char mask)
 {
 	/* Bad things will happen if the loc param isn't in this range */
 	if (loc < 0x20 || loc >= 0x2F)
 		return -1;
 
-	if (ps2_command(ps2dev, NULL, MAKE_PS2_CMD(0, 0, TP_COMMAND)) ||
-	    ps2_command(ps2dev, NULL, MAKE_PS2_CMD(0, 0, TP_TOGGLE)) ||
-	    ps2_command(ps2dev, NULL, MAKE_PS2_CMD(0, 0, loc)) ||
-	    ps2_command(ps2dev, NULL, MAKE_PS2_CMD(0, 0, mask))) {
+	if (psmouse_command(psmouse, NULL, MAKE_PS2_CMD(0, 0, TP_COMMAND)) ||
+	    psmouse_command(psmouse, NULL, MAKE_PS2_CMD(0, 0, TP_TOGGLE)) ||
+	    psmouse_command(psmouse, NULL, MAKE_PS2_CMD(0, 0, loc)) ||
+	    psmouse_command(psmouse, NULL, MAKE_PS2_CMD(0, 0, mask))) {
 		return -1;
 	}
 
@@ -95,7 +95,7 @@ static ssize_t trackpoint_set_int_attr(struct psmouse *psmouse, void *data,
 		return -EINVAL;
 
 	*field = value;
-	trackpoint_write(&psmouse->ps2dev, attr->command, value);
+	trackpoint_write(psmouse, attr->command, value);
 
 	return count;
 }
@@ -125,7 +125,7 @@ static ssize_t trackpoint_set_bit_attr(struct psmouse *psmouse, void *data,
 
 	if (*field != value) {
 		*field = value;
-		trackpoint_toggle_bit(&psmouse->ps2dev, attr->command, attr->mask);
+		trackpoint_toggle_bit(psmouse, attr->command, attr->mask);
 	}
 
 	return count;
@@ -183,7 +183,7 @@ static int trackpoint_start_protocol(struct psmouse *psmouse, unsigned char *fir
 {
 	unsigned char param[2] = { 0 };
 
-	if (ps2_command(&psmouse->ps2dev, param, MAKE_PS2_CMD(0, 2, TP_READ_ID)))
+	if (psmouse_command(psmouse, param, MAKE_PS2_CMD(0, 2, TP_READ_ID)))
 		return -1;
 
 	if (param[0] != TP_MAGIC_IDENT)
@@ -201,44 +201,44 @@ static int trackpoint_sync(struct psmouse *psmouse)
 	unsigned char toggle;
 
 	/* Disable features that may make device unusable with this driver */
-	trackpoint_read(&psmouse->ps2dev, TP_TOGGLE_TWOHAND, &toggle);
+	trackpoint_read(psmouse, TP_TOGGLE_TWOHAND, &toggle);
 	if (toggle & TP_MASK_TWOHAND)
-		trackpoint_toggle_bit(&psmouse->ps2dev, TP_TOGGLE_TWOHAND, TP_MASK_TWOHAND);
+		trackpoint_toggle_bit(psmouse, TP_TOGGLE_TWOHAND, TP_MASK_TWOHAND);
 
-	trackpoint_read(&psmouse->ps2dev, TP_TOGGLE_SOURCE_TAG, &toggle);
+	trackpoint_read(psmouse, TP_TOGGLE_SOURCE_TAG, &toggle);
 	if (toggle & TP_MASK_SOURCE_TAG)
-		trackpoint_toggle_bit(&psmouse->ps2dev, TP_TOGGLE_SOURCE_TAG, TP_MASK_SOURCE_TAG);
+		trackpoint_toggle_bit(psmouse, TP_TOGGLE_SOURCE_TAG, TP_MASK_SOURCE_TAG);
 
-	trackpoint_read(&psmouse->ps2dev, TP_TOGGLE_MB, &toggle);
+	trackpoint_read(psmouse, TP_TOGGLE_MB, &toggle);
 	if (toggle & TP_MASK_MB)
-		trackpoint_toggle_bit(&psmouse->ps2dev, TP_TOGGLE_MB, TP_MASK_MB);
+		trackpoint_toggle_bit(psmouse, TP_TOGGLE_MB, TP_MASK_MB);
 
 	/* Push the config to the device */
-	trackpoint_write(&psmouse->ps2dev, TP_SENS, tp->sensitivity);
-	trackpoint_write(&psmouse->ps2dev, TP_INERTIA, tp->inertia);
-	trackpoint_write(&psmouse->ps2dev, TP_SPEED, tp->speed);
+	trackpoint_write(psmouse, TP_SENS, tp->sensitivity);
+	trackpoint_write(psmouse, TP_INERTIA, tp->inertia);
+	trackpoint_write(psmouse, TP_SPEED, tp->speed);
 
-	trackpoint_write(&psmouse->ps2dev, TP_REACH, tp->reach);
-	trackpoint_write(&psmouse->ps2dev, TP_DRAGHYS, tp->draghys);
-	trackpoint_write(&psmouse->ps2dev, TP_MINDRAG, tp->mindrag);
+	trackpoint_write(psmouse, TP_REACH, tp->reach);
+	trackpoint_write(psmouse, TP_DRAGHYS, tp->draghys);
+	trackpoint_write(psmouse, TP_MINDRAG, tp->mindrag);
 
-	trackpoint_write(&psmouse->ps2dev, TP_THRESH, tp->thresh);
-	trackpoint_write(&psmouse->ps2dev, TP_UP_THRESH, tp->upthresh);
+	trackpoint_write(psmouse, TP_THRESH, tp->thresh);
+	trackpoint_write(psmouse, TP_UP_THRESH, tp->upthresh);
 
-	trackpoint_write(&psmouse->ps2dev, TP_Z_TIME, tp->ztime);
-	trackpoint_write(&psmouse->ps2dev, TP_JENKS_CURV, tp->jenks);
+	trackpoint_write(psmouse, TP_Z_TIME, tp->ztime);
+	trackpoint_write(psmouse, TP_JENKS_CURV, tp->jenks);
 
-	trackpoint_read(&psmouse->ps2dev, TP_TOGGLE_PTSON, &toggle);
+	trackpoint_read(psmouse, TP_TOGGLE_PTSON, &toggle);
 	if (((toggle & TP_MASK_PTSON) == TP_MASK_PTSON) != tp->press_to_select)
-		 trackpoint_toggle_bit(&psmouse->ps2dev, TP_TOGGLE_PTSON, TP_MASK_PTSON);
+		 trackpoint_toggle_bit(psmouse, TP_TOGGLE_PTSON, TP_MASK_PTSON);
 
-	trackpoint_read(&psmouse->ps2dev, TP_TOGGLE_SKIPBACK, &toggle);
+	trackpoint_read(psmouse, TP_TOGGLE_SKIPBACK, &toggle);
 	if (((toggle & TP_MASK_SKIPBACK) == TP_MASK_SKIPBACK) != tp->skipback)
-		trackpoint_toggle_bit(&psmouse->ps2dev, TP_TOGGLE_SKIPBACK, TP_MASK_SKIPBACK);
+		trackpoint_toggle_bit(psmouse, TP_TOGGLE_SKIPBACK, TP_MASK_SKIPBACK);
 
-	trackpoint_read(&psmouse->ps2dev, TP_TOGGLE_EXT_DEV, &toggle);
+	trackpoint_read(psmouse, TP_TOGGLE_EXT_DEV, &toggle);
 	if (((toggle & TP_MASK_EXT_DEV) == TP_MASK_EXT_DEV) != tp->ext_dev)
-		trackpoint_toggle_bit(&psmouse->ps2dev, TP_TOGGLE_EXT_DEV, TP_MASK_EXT_DEV);
+		trackpoint_toggle_bit(psmouse, TP_TOGGLE_EXT_DEV, TP_MASK_EXT_DEV);
 
 	return 0;
 }
@@ -296,7 +296,7 @@ int trackpoint_detect(struct psmouse *psmouse, bool set_properties)
 	if (!set_properties)
 		return 0;
 
-	if (trackpoint_read(&psmouse->ps2dev, TP_EXT_BTN, &button_info)) {
+	if (trackpoint_read(psmouse, TP_EXT_BTN, &button_info)) {
 		printk(KERN_WARNING "trackpoint.c: failed to get extended button data\n");
 		button_info = 0;
 	}
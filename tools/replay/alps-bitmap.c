@@ -0,0 +1,372 @@
+/*
+ * ALPS finger bitmap decoding: the current alps_process_bitmap() against
+ * the implementations it replaced.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#include <linux/input.h>
+#include <linux/serio.h>
+#include <linux/libps2.h>
+
+#include "../../src/psmouse.h"
+#include "../../src/alps.h"
+#include "replay.h"
+
+struct alps_bitmap_point {
+	int start_bit;
+	int num_bits;
+};
+
+/* Geometry as the original implementation kept it, in globals */
+static int ALPS_X_MAX;
+static int ALPS_Y_MAX;
+static int ALPS_BITMAP_X_BITS;
+static int ALPS_BITMAP_Y_BITS;
+
+/*
+ * alps_process_bitmap() before the coordinate tables: two divisions per
+ * axis and contact.
+ */
+static noinline int alps_process_bitmap_div(unsigned int x_map,
+					    unsigned int y_map,
+					    int *x1, int *y1, int *x2, int *y2)
+{
+	int fingers_x = 0, fingers_y = 0, fingers;
+	int i, bit, prev_bit;
+	struct alps_bitmap_point x_low = {0,}, x_high = {0,};
+	struct alps_bitmap_point y_low = {0,}, y_high = {0,};
+	struct alps_bitmap_point *point;
+
+	if (!x_map || !y_map)
+		return 0;
+
+	*x1 = *y1 = *x2 = *y2 = 0;
+
+	prev_bit = 0;
+	point = &x_low;
+	for (i = 0; x_map != 0; i++, x_map >>= 1) {
+		bit = x_map & 1;
+		if (bit) {
+			if (!prev_bit) {
+				point->start_bit = i;
+				fingers_x++;
+			}
+			point->num_bits++;
+		} else {
+			if (prev_bit)
+				point = &x_high;
+			else
+				point->num_bits = 0;
+		}
+		prev_bit = bit;
+	}
+
+	y_map = y_map << (sizeof(y_map) * BITS_PER_BYTE - ALPS_BITMAP_Y_BITS);
+	prev_bit = 0;
+	point = &y_low;
+	for (i = 0; y_map != 0; i++, y_map <<= 1) {
+		bit = y_map & (1 << (sizeof(y_map) * BITS_PER_BYTE - 1));
+		if (bit) {
+			if (!prev_bit) {
+				point->start_bit = i;
+				fingers_y++;
+			}
+			point->num_bits++;
+		} else {
+			if (prev_bit)
+				point = &y_high;
+			else
+				point->num_bits = 0;
+		}
+		prev_bit = bit;
+	}
+
+	fingers = max(fingers_x, fingers_y);
+
+	if (fingers > 1) {
+		if (fingers_x == 1) {
+			i = x_low.num_bits / 2;
+			x_low.num_bits = x_low.num_bits - i;
+			x_high.start_bit = x_low.start_bit + i;
+			x_high.num_bits = max(i, 1);
+		} else if (fingers_y == 1) {
+			i = y_low.num_bits / 2;
+			y_low.num_bits = y_low.num_bits - i;
+			y_high.start_bit = y_low.start_bit + i;
+			y_high.num_bits = max(i, 1);
+		}
+	}
+
+	*x1 = (ALPS_X_MAX * (2 * x_low.start_bit + x_low.num_bits - 1)) /
+		(2 * (ALPS_BITMAP_X_BITS - 1));
+	*y1 = (ALPS_Y_MAX * (2 * y_low.start_bit + y_low.num_bits - 1)) /
+		(2 * (ALPS_BITMAP_Y_BITS - 1));
+
+	if (fingers > 1) {
+		*x2 = (ALPS_X_MAX * (2 * x_high.start_bit + x_high.num_bits - 1)) /
+			(2 * (ALPS_BITMAP_X_BITS - 1));
+		*y2 = (ALPS_Y_MAX * (2 * y_high.start_bit + y_high.num_bits - 1)) /
+			(2 * (ALPS_BITMAP_Y_BITS - 1));
+	}
+
+	return fingers;
+}
+
+static struct alps_data alps_bitmap_priv;
+
+/*
+ * alps_process_bitmap() with the coordinate tables but before runs were
+ * extracted a word at a time: one bit per iteration, the y axis reversed
+ * by shifting it to the top of the word.
+ */
+static noinline int alps_process_bitmap_loop(unsigned int x_map,
+					     unsigned int y_map,
+					     int *x1, int *y1, int *x2, int *y2)
+{
+	struct alps_data *priv = &alps_bitmap_priv;
+	int fingers_x = 0, fingers_y = 0, fingers;
+	int i, bit, prev_bit;
+	struct alps_bitmap_point x_low = {0,}, x_high = {0,};
+	struct alps_bitmap_point y_low = {0,}, y_high = {0,};
+	struct alps_bitmap_point *point;
+
+	if (!x_map || !y_map)
+		return 0;
+
+	*x1 = *y1 = *x2 = *y2 = 0;
+
+	prev_bit = 0;
+	point = &x_low;
+	for (i = 0; x_map != 0; i++, x_map >>= 1) {
+		bit = x_map & 1;
+		if (bit) {
+			if (!prev_bit) {
+				point->start_bit = i;
+				fingers_x++;
+			}
+			point->num_bits++;
+		} else {
+			if (prev_bit)
+				point = &x_high;
+			else
+				point->num_bits = 0;
+		}
+		prev_bit = bit;
+	}
+
+	y_map = y_map << (sizeof(y_map) * BITS_PER_BYTE - priv->y_bits);
+	prev_bit = 0;
+	point = &y_low;
+	for (i = 0; y_map != 0; i++, y_map <<= 1) {
+		bit = y_map & (1 << (sizeof(y_map) * BITS_PER_BYTE - 1));
+		if (bit) {
+			if (!prev_bit) {
+				point->start_bit = i;
+				fingers_y++;
+			}
+			point->num_bits++;
+		} else {
+			if (prev_bit)
+				point = &y_high;
+			else
+				point->num_bits = 0;
+		}
+		prev_bit = bit;
+	}
+
+	fingers = max(fingers_x, fingers_y);
+
+	if (fingers > 1) {
+		if (fingers_x == 1) {
+			i = x_low.num_bits / 2;
+			x_low.num_bits = x_low.num_bits - i;
+			x_high.start_bit = x_low.start_bit + i;
+			x_high.num_bits = max(i, 1);
+		} else if (fingers_y == 1) {
+			i = y_low.num_bits / 2;
+			y_low.num_bits = y_low.num_bits - i;
+			y_high.start_bit = y_low.start_bit + i;
+			y_high.num_bits = max(i, 1);
+		}
+	}
+
+	*x1 = priv->x_bitmap_coord[2 * x_low.start_bit + x_low.num_bits - 1];
+	*y1 = priv->y_bitmap_coord[2 * y_low.start_bit + y_low.num_bits - 1];
+
+	if (fingers > 1) {
+		*x2 = priv->x_bitmap_coord[2 * x_high.start_bit +
+					   x_high.num_bits - 1];
+		*y2 = priv->y_bitmap_coord[2 * y_high.start_bit +
+					   y_high.num_bits - 1];
+	}
+
+	return fingers;
+}
+
+static const struct alps_bitmap_geometry {
+	const char *name;
+	int x_max, x_bits;
+	int y_max, y_bits;
+} alps_bitmap_geometries[] = {
+	{ "v3", 2000, 15, 1400, 11 },
+	{ "v5", 2000, 16, 1400, 12 },
+	{ "v6", 1360, 23, 660, 12 },
+};
+
+static void alps_bitmap_setup(const struct alps_bitmap_geometry *g)
+{
+	ALPS_X_MAX = g->x_max;
+	ALPS_Y_MAX = g->y_max;
+	ALPS_BITMAP_X_BITS = g->x_bits;
+	ALPS_BITMAP_Y_BITS = g->y_bits;
+
+	replay_alps_bitmap_setup(&alps_bitmap_priv, g->x_max, g->x_bits,
+				 g->y_max, g->y_bits);
+}
+
+typedef int (*alps_bitmap_fn)(unsigned int x_map, unsigned int y_map,
+			      int *x1, int *y1, int *x2, int *y2);
+
+static noinline int alps_process_bitmap_cur(unsigned int x_map,
+					    unsigned int y_map,
+					    int *x1, int *y1, int *x2, int *y2)
+{
+	return replay_alps_process_bitmap(&alps_bitmap_priv, x_map, y_map,
+					  x1, y1, x2, y2);
+}
+
+/* Returns 1 if the two implementations disagree on the pair of bitmaps */
+static int alps_bitmap_compare(alps_bitmap_fn ref, const char *ref_name,
+			       unsigned int x_map, unsigned int y_map)
+{
+	int a[4] = { 0, }, b[4] = { 0, };
+	int fa, fb;
+
+	fa = ref(x_map, y_map, &a[0], &a[1], &a[2], &a[3]);
+	fb = alps_process_bitmap_cur(x_map, y_map, &b[0], &b[1], &b[2], &b[3]);
+
+	if (fa != fb || (fa && memcmp(a, b, sizeof(a)))) {
+		printf("%s x %#x y %#x: %d (%d,%d) (%d,%d), now %d (%d,%d) (%d,%d)\n",
+		       ref_name, x_map, y_map, fa, a[0], a[1], a[2], a[3],
+		       fb, b[0], b[1], b[2], b[3]);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Every contact, on every axis of every geometry, maps to the coordinate
+ * the division gave, and random bitmap pairs decode the same.
+ */
+int replay_check_alps_bitmap_tables(void)
+{
+	const struct alps_bitmap_geometry *g;
+	unsigned int seed = 1, x_map, y_map;
+	int i, n, failed = 0;
+
+	for (i = 0; i < ARRAY_SIZE(alps_bitmap_geometries); i++) {
+		g = &alps_bitmap_geometries[i];
+		alps_bitmap_setup(g);
+
+		/* Single contacts, start bit s and n bits wide */
+		for (x_map = 1; x_map < 1U << g->x_bits; x_map <<= 1)
+			for (n = 1; (x_map << (n - 1)) < 1U << g->x_bits; n++)
+				failed += alps_bitmap_compare(alps_process_bitmap_div,
+							      "div",
+							      x_map * ((1U << n) - 1),
+							      1);
+		for (y_map = 1; y_map < 1U << g->y_bits; y_map <<= 1)
+			for (n = 1; (y_map << (n - 1)) < 1U << g->y_bits; n++)
+				failed += alps_bitmap_compare(alps_process_bitmap_div,
+							      "div", 1,
+							      y_map * ((1U << n) - 1));
+
+		for (n = 0; n < 1000000 && failed < 10; n++) {
+			x_map = replay_rand(&seed) & ((1U << g->x_bits) - 1);
+			y_map = replay_rand(&seed) & ((1U << g->y_bits) - 1);
+			failed += alps_bitmap_compare(alps_process_bitmap_div,
+						      "div", x_map, y_map);
+		}
+	}
+
+	return failed;
+}
+
+/*
+ * Word at a time run extraction against the bit loop: the whole V3 input
+ * space, and random V5 and V6 pairs.
+ */
+int replay_check_alps_bitmap_runs(void)
+{
+	const struct alps_bitmap_geometry *g;
+	unsigned int seed = 1, x_map, y_map;
+	int i, n, failed = 0;
+
+	alps_bitmap_setup(&alps_bitmap_geometries[0]);
+	for (x_map = 0; x_map < 1U << 15 && failed < 10; x_map++)
+		for (y_map = 0; y_map < 1U << 11; y_map++)
+			failed += alps_bitmap_compare(alps_process_bitmap_loop,
+						      "loop", x_map, y_map);
+
+	for (i = 1; i < ARRAY_SIZE(alps_bitmap_geometries); i++) {
+		g = &alps_bitmap_geometries[i];
+		alps_bitmap_setup(g);
+
+		for (n = 0; n < 4000000 && failed < 10; n++) {
+			x_map = replay_rand(&seed) & ((1U << g->x_bits) - 1);
+			y_map = replay_rand(&seed) & ((1U << g->y_bits) - 1);
+			failed += alps_bitmap_compare(alps_process_bitmap_loop,
+						      "loop", x_map, y_map);
+		}
+	}
+
+	return failed;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define alps_bitmap_cycles()	__builtin_ia32_rdtsc()
+#else
+#define alps_bitmap_cycles()	0ULL
+#endif
+
+/* Decode every V3 bitmap pair once */
+static void alps_bitmap_bench_one(alps_bitmap_fn fn, const char *name)
+{
+	unsigned long calls = 0;
+	unsigned int x_map, y_map;
+	int x1, y1, x2, y2;
+	long sum = 0;
+	u64 ns, cycles;
+
+	ns = local_clock();
+	cycles = alps_bitmap_cycles();
+
+	for (x_map = 1; x_map < 1U << 15; x_map++) {
+		for (y_map = 1; y_map < 1U << 11; y_map++) {
+			sum += fn(x_map, y_map, &x1, &y1, &x2, &y2);
+			sum += x1 + y1 + x2 + y2;
+			calls++;
+		}
+	}
+
+	cycles = alps_bitmap_cycles() - cycles;
+	ns = local_clock() - ns;
+
+	printf("%-24s %12.1f %12.1f %20ld\n", name,
+	       (double)ns / calls, (double)cycles / calls, sum);
+}
+
+void replay_bench_alps_bitmap(void)
+{
+	alps_bitmap_setup(&alps_bitmap_geometries[0]);
+
+	printf("\n%-24s %12s %12s %20s\n",
+	       "alps bitmap (v3, all)", "ns/call", "cycles/call", "checksum");
+	alps_bitmap_bench_one(alps_process_bitmap_div, "divide");
+	alps_bitmap_bench_one(alps_process_bitmap_loop, "tables, bit loop");
+	alps_bitmap_bench_one(alps_process_bitmap_cur, "current");
+}
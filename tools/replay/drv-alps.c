@@ -0,0 +1,811 @@
+/*
+ * ALPS profiles for the replay harness.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#include "../../src/alps.c"
+
+#include "replay.h"
+
+/*
+ * What alps_init() does once the model is known, minus talking to the
+ * touchpad.
+ */
+static int replay_alps_init(struct psmouse *psmouse,
+			    unsigned char proto_version, unsigned char flags)
+{
+	struct alps_data *priv;
+	int i;
+
+	priv = kzalloc(sizeof(struct alps_data), GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(alps_model_data); i++) {
+		if (alps_model_data[i].proto_version == proto_version &&
+		    alps_model_data[i].flags == flags) {
+			priv->i = &alps_model_data[i];
+			break;
+		}
+	}
+
+	priv->dev2 = input_allocate_device();
+	if (!priv->i || !priv->dev2) {
+		input_free_device(priv->dev2);
+		kfree(priv);
+		return -ENODEV;
+	}
+
+	setup_timer(&priv->timer, alps_flush_packet, (unsigned long)psmouse);
+	psmouse->private = priv;
+
+	switch (proto_version) {
+	case ALPS_PROTO_V3:
+	case ALPS_PROTO_V4:
+		priv->x_bits = 15;
+		priv->y_bits = 11;
+		priv->x_max = 2000;
+		priv->y_max = 1400;
+		break;
+	case ALPS_PROTO_V5:
+		priv->x_bits = 16;
+		priv->y_bits = 12;
+		priv->x_max = 2000;
+		priv->y_max = 1400;
+		break;
+	case ALPS_PROTO_V6:
+		priv->x_bits = 23;
+		priv->y_bits = 12;
+		priv->x_max = 1360;
+		priv->y_max = 660;
+		break;
+	}
+
+	if (proto_version > ALPS_PROTO_V2) {
+		alps_init_bitmap_coords(priv->x_bitmap_coord,
+					priv->x_max, priv->x_bits);
+		alps_init_bitmap_coords(priv->y_bitmap_coord,
+					priv->y_max, priv->y_bits);
+	}
+
+	alps_reset_decode_stats(priv);
+
+	psmouse->protocol_handler = alps_process_byte;
+	psmouse->validate_header = alps_validate_header;
+	psmouse->burst_handler = alps_process_burst;
+	psmouse->poll = alps_poll;
+	psmouse->disconnect = alps_disconnect;
+	psmouse->reconnect = alps_reconnect;
+	psmouse->pktsize = proto_version == ALPS_PROTO_V4 ? 8 : 6;
+
+	return 0;
+}
+
+#define REPLAY_ALPS_INIT(name, version, flags)				\
+static int replay_alps_init_##name(struct psmouse *psmouse)		\
+{									\
+	return replay_alps_init(psmouse, version, flags);		\
+}
+
+REPLAY_ALPS_INIT(v1, ALPS_PROTO_V1, 0)
+REPLAY_ALPS_INIT(v2, ALPS_PROTO_V2, 0)
+REPLAY_ALPS_INIT(v2_interleaved, ALPS_PROTO_V2,
+		 ALPS_PASS | ALPS_DUALPOINT | ALPS_PS2_INTERLEAVED)
+REPLAY_ALPS_INIT(v3, ALPS_PROTO_V3, ALPS_DUALPOINT)
+REPLAY_ALPS_INIT(v4, ALPS_PROTO_V4, 0)
+REPLAY_ALPS_INIT(v5, ALPS_PROTO_V5, ALPS_DUALPOINT)
+REPLAY_ALPS_INIT(v6, ALPS_PROTO_V6, 0)
+
+/* Random payload bytes, high bit clear as in all but V6 packets */
+static void replay_alps_fill(unsigned char *buf, int count,
+			     unsigned int *seed)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		buf[i] = replay_rand(seed) & 0x7f;
+}
+
+static int replay_alps_packet_v1(unsigned char *buf, unsigned int *seed)
+{
+	replay_alps_fill(buf, 6, seed);
+	buf[0] = 0x88 | (replay_rand(seed) & 0x07);
+	return 6;
+}
+
+static int replay_alps_packet_v2(unsigned char *buf, unsigned int *seed)
+{
+	replay_alps_fill(buf, 6, seed);
+	buf[0] = 0xf8 | (replay_rand(seed) & 0x07);
+	return 6;
+}
+
+/*
+ * Dell E6400 style: every 8th packet has a trackstick packet stuffed in
+ * after its 3rd byte, which the touchpad flags with 0x0f in byte 3.
+ */
+static int replay_alps_packet_v2_interleaved(unsigned char *buf,
+					     unsigned int *seed)
+{
+	replay_alps_fill(buf, 9, seed);
+	buf[0] = 0xcf | (replay_rand(seed) & 0x30);
+	if (replay_rand(seed) & 7) {
+		buf[3] |= 0x10;		/* Not mistaken for a PS/2 header */
+		return 6;
+	}
+
+	buf[3] = 0x0f;
+	return 9;
+}
+
+/* Position packets, position + bitmap pairs and trackstick packets */
+static int replay_alps_packet_v3(unsigned char *buf, unsigned int *seed)
+{
+	replay_alps_fill(buf, 12, seed);
+	buf[0] = 0x8f | (replay_rand(seed) & 0x30);
+
+	switch (replay_rand(seed) % 4) {
+	case 0:
+		buf[0] |= 0x40;
+		buf[5] = 0x3f;
+		return 6;
+	case 1:
+		buf[4] |= 0x40;
+		buf[5] &= 0x3e;		/* Never the trackstick marker */
+		buf[6] = 0xcf | (replay_rand(seed) & 0x30);
+		buf[11] &= 0x3e;
+		return 12;
+	default:
+		buf[4] &= ~0x40;
+		buf[5] &= 0x3e;
+		return 6;
+	}
+}
+
+/* A bitmap split across three packets, the first with the sync bit */
+static int replay_alps_packet_v4(unsigned char *buf, unsigned int *seed)
+{
+	int i;
+
+	replay_alps_fill(buf, 24, seed);
+	for (i = 0; i < 24; i += 8) {
+		buf[i] = 0x8f | (replay_rand(seed) & 0x30);
+		buf[i + 6] &= ~0x40;
+	}
+	buf[6] |= 0x40;
+	return 24;
+}
+
+static int replay_alps_packet_v6(unsigned char *buf, unsigned int *seed)
+{
+	int i;
+
+	for (i = 0; i < 12; i++)
+		buf[i] = replay_rand(seed);
+	buf[0] = 0xc8 | (buf[0] & 0x37);
+
+	if (replay_rand(seed) & 1) {
+		buf[0] &= ~0x22;
+		return 6;
+	}
+
+	buf[0] = (buf[0] | 0x02) & ~0x20;
+	buf[6] = 0xc8 | 0x20 | (buf[6] & 0x17);
+	return 12;
+}
+
+const struct replay_profile replay_alps_profiles[] = {
+	{ "alps-v1", replay_alps_init_v1, replay_alps_packet_v1, 10000 },
+	{ "alps-v2", replay_alps_init_v2, replay_alps_packet_v2, 10000 },
+	{ "alps-v2-interleaved", replay_alps_init_v2_interleaved,
+	  replay_alps_packet_v2_interleaved, 10000 },
+	{ "alps-v3", replay_alps_init_v3, replay_alps_packet_v3, 10000 },
+	{ "alps-v4", replay_alps_init_v4, replay_alps_packet_v4, 10000 },
+	{ "alps-v5", replay_alps_init_v5, replay_alps_packet_v3, 10000 },
+	{ "alps-v6", replay_alps_init_v6, replay_alps_packet_v6, 10000 },
+	{ NULL }
+};
+
+/* For alps-bitmap.c */
+
+void replay_alps_bitmap_setup(struct alps_data *priv, int x_max, int x_bits,
+			      int y_max, int y_bits)
+{
+	priv->x_max = x_max;
+	priv->x_bits = x_bits;
+	priv->y_max = y_max;
+	priv->y_bits = y_bits;
+	alps_init_bitmap_coords(priv->x_bitmap_coord, x_max, x_bits);
+	alps_init_bitmap_coords(priv->y_bitmap_coord, y_max, y_bits);
+}
+
+int replay_alps_process_bitmap(struct alps_data *priv,
+			       unsigned int x_map, unsigned int y_map,
+			       int *x1, int *y1, int *x2, int *y2)
+{
+	return alps_process_bitmap(priv, x_map, y_map, x1, y1, x2, y2);
+}
+
+/*
+ * Init sequences on the wire. The commands alps_hw_init() sends, or the
+ * ones in a capture of the windows driver (dev/init-seq-extracted.txt,
+ * "S" for a byte sent and "R" for a byte received), are decoded into
+ * register accesses the way dev/parse-iseq.pl does it, by a model of the
+ * touchpad which can also answer the commands.
+ */
+
+#define REPLAY_ALPS_OPS_MAX	512
+#define REPLAY_ALPS_XFERS_MAX	4096
+
+enum replay_alps_op_type {
+	REPLAY_ALPS_RESET,
+	REPLAY_ALPS_ENTER,
+	REPLAY_ALPS_EXIT,
+	REPLAY_ALPS_READ,
+	REPLAY_ALPS_WRITE,
+	REPLAY_ALPS_RATE,
+	REPLAY_ALPS_ENABLE,
+	REPLAY_ALPS_OTHER,
+};
+
+struct replay_alps_op {
+	u8 type;
+	u8 value;		/* Register value, rate or command byte */
+	u16 addr;
+};
+
+/* One command as it went over the wire */
+struct replay_alps_xfer {
+	u8 cmd;
+	u8 arg;
+	u8 nsend;
+	u8 nrecv;
+	u8 resp[3];
+};
+
+struct replay_alps_wire {
+	const struct alps_nibble_commands *nibbles;
+	u8 addr_command;
+	bool cmd_mode;
+	int wraps;		/* RESET_WRAPs in a row outside command mode */
+	int addr_nibbles;	/* Of the address being sent, or -1 */
+	int value_nibbles;	/* Of the value once an address is set, or -1 */
+	u16 addr;
+	u8 value;
+	int junk;		/* Commands in command mode not understood */
+	u8 regs[0x10000];
+	struct replay_alps_op ops[REPLAY_ALPS_OPS_MAX];
+	int nops;
+};
+
+/* The nibble encoding as dev/parse-iseq.pl knows it */
+static const struct alps_nibble_commands replay_alps_iseq_nibbles[] = {
+	{ PSMOUSE_CMD_SETPOLL,		0x00 },
+	{ PSMOUSE_CMD_RESET_DIS,	0x00 },
+	{ PSMOUSE_CMD_SETSCALE21,	0x00 },
+	{ PSMOUSE_CMD_SETRATE,		0x0a },
+	{ PSMOUSE_CMD_SETRATE,		0x14 },
+	{ PSMOUSE_CMD_SETRATE,		0x28 },
+	{ PSMOUSE_CMD_SETRATE,		0x3c },
+	{ PSMOUSE_CMD_SETRATE,		0x50 },
+	{ PSMOUSE_CMD_SETRATE,		0x64 },
+	{ PSMOUSE_CMD_SETRATE,		0xc8 },
+	{ ALPS_CMD_NIBBLE_10,		0x00 },
+	{ PSMOUSE_CMD_SETRES,		0x00 },
+	{ PSMOUSE_CMD_SETRES,		0x01 },
+	{ PSMOUSE_CMD_SETRES,		0x02 },
+	{ PSMOUSE_CMD_SETRES,		0x03 },
+	{ PSMOUSE_CMD_SETSCALE11,	0x00 },
+};
+
+/* Commands found in the captures, for their argument and response size */
+static const int replay_alps_iseq_commands[] = {
+	PSMOUSE_CMD_SETSCALE11, PSMOUSE_CMD_SETSCALE21, PSMOUSE_CMD_SETRES,
+	PSMOUSE_CMD_GETINFO, PSMOUSE_CMD_SETSTREAM, PSMOUSE_CMD_SETPOLL,
+	PSMOUSE_CMD_RESET_WRAP, ALPS_CMD_NIBBLE_10, PSMOUSE_CMD_SETRATE,
+	PSMOUSE_CMD_ENABLE, PSMOUSE_CMD_DISABLE, PSMOUSE_CMD_RESET_DIS,
+	PSMOUSE_CMD_RESET_BAT,
+};
+
+static void replay_alps_wire_init(struct replay_alps_wire *w,
+				  const struct alps_nibble_commands *nibbles,
+				  int addr_command)
+{
+	memset(w, 0, sizeof(*w));
+	w->nibbles = nibbles;
+	w->addr_command = addr_command;
+	w->addr_nibbles = w->value_nibbles = -1;
+}
+
+static void replay_alps_wire_op(struct replay_alps_wire *w, int type,
+				int addr, int value)
+{
+	if (w->nops == REPLAY_ALPS_OPS_MAX)
+		return;
+
+	w->ops[w->nops].type = type;
+	w->ops[w->nops].addr = addr;
+	w->ops[w->nops].value = value;
+	w->nops++;
+}
+
+static int replay_alps_wire_nibble(const struct replay_alps_wire *w,
+				   const struct replay_alps_xfer *x)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		if ((w->nibbles[i].command & 0xff) == x->cmd &&
+		    (!x->nsend || w->nibbles[i].data == x->arg))
+			return i;
+
+	return -1;
+}
+
+/*
+ * Decode one command. With answer set the model fills in the response,
+ * otherwise it is taken as recorded.
+ */
+static void replay_alps_wire_xfer(struct replay_alps_wire *w,
+				  struct replay_alps_xfer *x, bool answer)
+{
+	static const u8 enter_resp[] = { 0x88, 0x08, 0x1d };
+	static const u8 e7_resp[] = { 0x73, 0x03, 0x0a };
+	int nibble;
+
+	if (answer)
+		memset(x->resp, 0, sizeof(x->resp));
+
+	if (x->cmd == (PSMOUSE_CMD_RESET_BAT & 0xff)) {
+		if (answer) {
+			x->resp[0] = PSMOUSE_RET_BAT;
+			x->resp[1] = PSMOUSE_RET_ID;
+		}
+		w->cmd_mode = false;
+		w->wraps = 0;
+		w->addr_nibbles = w->value_nibbles = -1;
+		replay_alps_wire_op(w, REPLAY_ALPS_RESET, 0, 0);
+		return;
+	}
+
+	if (!w->cmd_mode) {
+		if (x->cmd == (PSMOUSE_CMD_RESET_WRAP & 0xff)) {
+			w->wraps++;
+			return;
+		}
+
+		if (x->cmd == (PSMOUSE_CMD_GETINFO & 0xff) && w->wraps == 3) {
+			if (answer)
+				memcpy(x->resp, enter_resp, sizeof(enter_resp));
+			w->cmd_mode = true;
+			w->wraps = 0;
+			replay_alps_wire_op(w, REPLAY_ALPS_ENTER, 0, 0);
+			return;
+		}
+
+		w->wraps = 0;
+		switch (x->cmd) {
+		case PSMOUSE_CMD_GETINFO & 0xff:
+			if (answer)
+				memcpy(x->resp, e7_resp, sizeof(e7_resp));
+			replay_alps_wire_op(w, REPLAY_ALPS_OTHER, 0, x->cmd);
+			break;
+		case PSMOUSE_CMD_SETRATE & 0xff:
+			replay_alps_wire_op(w, REPLAY_ALPS_RATE, 0, x->arg);
+			break;
+		case PSMOUSE_CMD_ENABLE & 0xff:
+			replay_alps_wire_op(w, REPLAY_ALPS_ENABLE, 0, 0);
+			break;
+		default:
+			replay_alps_wire_op(w, REPLAY_ALPS_OTHER, 0, x->cmd);
+			break;
+		}
+		return;
+	}
+
+	if (x->cmd == (PSMOUSE_CMD_SETSTREAM & 0xff)) {
+		w->cmd_mode = false;
+		w->addr_nibbles = w->value_nibbles = -1;
+		replay_alps_wire_op(w, REPLAY_ALPS_EXIT, 0, 0);
+		return;
+	}
+
+	if (x->cmd == w->addr_command) {
+		w->addr = 0;
+		w->addr_nibbles = 0;
+		w->value_nibbles = -1;
+		return;
+	}
+
+	if (x->cmd == (PSMOUSE_CMD_GETINFO & 0xff) && w->value_nibbles == 0) {
+		if (answer) {
+			x->resp[0] = w->addr >> 8;
+			x->resp[1] = w->addr & 0xff;
+			x->resp[2] = w->regs[w->addr];
+		}
+		if (((x->resp[0] << 8) | x->resp[1]) == w->addr) {
+			w->regs[w->addr] = x->resp[2];
+			replay_alps_wire_op(w, REPLAY_ALPS_READ, w->addr,
+					    x->resp[2]);
+			return;
+		}
+	}
+
+	nibble = replay_alps_wire_nibble(w, x);
+	if (nibble >= 0 && w->addr_nibbles >= 0) {
+		w->addr = (w->addr << 4) | nibble;
+		if (++w->addr_nibbles == 4) {
+			w->addr_nibbles = -1;
+			w->value_nibbles = 0;
+			w->value = 0;
+		}
+		return;
+	}
+
+	if (nibble >= 0 && w->value_nibbles >= 0) {
+		w->value = (w->value << 4) | nibble;
+		if (++w->value_nibbles == 2) {
+			w->value_nibbles = -1;
+			w->regs[w->addr] = w->value;
+			replay_alps_wire_op(w, REPLAY_ALPS_WRITE, w->addr,
+					    w->value);
+		}
+		return;
+	}
+
+	w->addr_nibbles = w->value_nibbles = -1;
+	w->junk++;
+	replay_alps_wire_op(w, REPLAY_ALPS_OTHER, 0, x->cmd);
+}
+
+static struct replay_alps_wire replay_alps_wire;
+
+static int replay_alps_wire_command(struct ps2dev *ps2dev,
+				    unsigned char *param, int command)
+{
+	struct replay_alps_xfer x = {
+		.cmd	= command & 0xff,
+		.nsend	= (command >> 12) & 0xf,
+		.nrecv	= (command >> 8) & 0xf,
+	};
+
+	if (x.nsend)
+		x.arg = param[0];
+
+	replay_alps_wire_xfer(&replay_alps_wire, &x, true);
+
+	if (x.nrecv)
+		memcpy(param, x.resp, min_t(int, x.nrecv, sizeof(x.resp)));
+
+	return 0;
+}
+
+/*
+ * Run alps_hw_init() for a profile against replay_alps_wire, which the
+ * caller has set up. Returns what alps_hw_init() did.
+ */
+static int replay_alps_run_hw_init(const char *name)
+{
+	static struct serio serio = {
+		.phys	= "isa0060/serio1",
+	};
+	int (*command)(struct ps2dev *, unsigned char *, int) =
+		replay_ps2_command;
+	const struct replay_profile *profile;
+	struct psmouse *psmouse;
+	int error;
+
+	for (profile = replay_alps_profiles; profile->name; profile++)
+		if (!strcmp(profile->name, name))
+			break;
+
+	psmouse = profile->name ? replay_connect(&serio, profile) : NULL;
+	if (!psmouse)
+		return -ENODEV;
+
+	replay_ps2_command = replay_alps_wire_command;
+	error = alps_hw_init(psmouse);
+	replay_ps2_command = command;
+
+	replay_disconnect(psmouse);
+
+	return error;
+}
+
+static const struct {
+	const char *profile;
+	const struct alps_init_step *seq;
+	int len;
+} replay_alps_init_seqs[] = {
+	{ "alps-v3", alps_v3_init_seq, ARRAY_SIZE(alps_v3_init_seq) },
+	{ "alps-v4", alps_v4_init_seq, ARRAY_SIZE(alps_v4_init_seq) },
+	{ "alps-v5", alps_v5_init_seq, ARRAY_SIZE(alps_v5_init_seq) },
+	{ "alps-v6", alps_v6_init_seq, ARRAY_SIZE(alps_v6_init_seq) },
+};
+
+/*
+ * Every register step of a table must come out as a write of the value
+ * it asks for, nothing sent in command mode may be left undecoded, and
+ * the touchpad has to end up enabled and out of command mode.
+ */
+int replay_check_alps_init_tables(void)
+{
+	static u8 regs[0x10000];
+	struct replay_alps_wire *w = &replay_alps_wire;
+	const struct alps_init_step *step;
+	const struct replay_alps_op *op;
+	int i, n, s, failed = 0;
+	u8 value;
+
+	for (i = 0; i < ARRAY_SIZE(replay_alps_init_seqs); i++) {
+		if (replay_alps_init_seqs[i].seq == alps_v4_init_seq)
+			replay_alps_wire_init(w, alps_v4_nibble_commands,
+					      PSMOUSE_CMD_DISABLE);
+		else
+			replay_alps_wire_init(w, replay_alps_iseq_nibbles,
+					      PSMOUSE_CMD_RESET_WRAP);
+
+		if (replay_alps_run_hw_init(replay_alps_init_seqs[i].profile)) {
+			printf("%s: init failed\n",
+			       replay_alps_init_seqs[i].profile);
+			failed++;
+			continue;
+		}
+
+		memset(regs, 0, sizeof(regs));
+		n = 0;
+		for (s = 0; s < replay_alps_init_seqs[i].len; s++) {
+			step = &replay_alps_init_seqs[i].seq[s];
+
+			switch (step->op) {
+			case ALPS_INIT_WRITE_REG:
+			case ALPS_INIT_CHECKSET_REG:
+				value = step->param[0];
+				break;
+			case ALPS_INIT_UPDATE_REG:
+				value = (regs[step->command] & ~step->param[0]) |
+					step->param[1];
+				break;
+			default:
+				continue;
+			}
+			regs[step->command] = value;
+
+			while (n < w->nops && w->ops[n].type != REPLAY_ALPS_WRITE)
+				n++;
+			if (n == w->nops || w->ops[n].addr != step->command ||
+			    w->ops[n].value != value) {
+				printf("%s: step %d writes %02x to %04x, not on the wire\n",
+				       replay_alps_init_seqs[i].profile, s,
+				       value, step->command);
+				failed++;
+				break;
+			}
+			n++;
+		}
+
+		while (n < w->nops && w->ops[n].type != REPLAY_ALPS_WRITE)
+			n++;
+		op = w->nops ? &w->ops[w->nops - 1] : NULL;
+		if (n < w->nops || w->junk || w->cmd_mode ||
+		    !op || op->type != REPLAY_ALPS_ENABLE) {
+			printf("%s: %d writes not in the table, %d commands not decoded, %s at the end\n",
+			       replay_alps_init_seqs[i].profile, w->nops - n,
+			       w->junk, w->cmd_mode ? "in command mode" :
+			       op && op->type == REPLAY_ALPS_ENABLE ?
+			       "enabled" : "disabled");
+			failed++;
+		}
+	}
+
+	return failed;
+}
+
+/* Commands of a level 0 capture, see dev/parse-iseq.pl */
+static int replay_alps_read_capture(const char *path,
+				    struct replay_alps_xfer *xfers, int max)
+{
+	static char dir[2 * REPLAY_ALPS_XFERS_MAX];
+	static u8 byte[2 * REPLAY_ALPS_XFERS_MAX];
+	char line[64], d, tmp_dir;
+	unsigned int b;
+	u8 tmp_byte;
+	int i, j, k, len = 0, n = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f) && len < ARRAY_SIZE(dir)) {
+		if (sscanf(line, "%c %x", &d, &b) != 2 || (d != 'S' && d != 'R'))
+			continue;
+		dir[len] = d;
+		byte[len++] = b;
+	}
+	fclose(f);
+
+	for (i = 0; i < len && n < max; ) {
+		/* Bytes from the touchpad outside a command are data */
+		if (dir[i] != 'S') {
+			i++;
+			continue;
+		}
+
+		for (k = 0; k < ARRAY_SIZE(replay_alps_iseq_commands); k++)
+			if ((replay_alps_iseq_commands[k] & 0xff) == byte[i])
+				break;
+		if (k == ARRAY_SIZE(replay_alps_iseq_commands))
+			goto bad;
+
+		xfers[n].cmd = byte[i];
+		xfers[n].nsend = (replay_alps_iseq_commands[k] >> 12) & 0xf;
+		xfers[n].nrecv = (replay_alps_iseq_commands[k] >> 8) & 0xf;
+		i++;
+
+		/*
+		 * The windows driver sends DISABLE and RESET_BAT right
+		 * after one another and collects both ACKs afterwards.
+		 */
+		if (i + 1 < len && dir[i] == 'S' && dir[i + 1] == 'R') {
+			tmp_dir = dir[i];
+			tmp_byte = byte[i];
+			dir[i] = dir[i + 1];
+			byte[i] = byte[i + 1];
+			dir[i + 1] = tmp_dir;
+			byte[i + 1] = tmp_byte;
+		}
+
+		if (i >= len || dir[i] != 'R' || byte[i] != PSMOUSE_RET_ACK)
+			goto bad;
+		i++;
+
+		for (j = 0; j < xfers[n].nsend; j++, i += 2) {
+			if (i + 1 >= len || dir[i] != 'S' || dir[i + 1] != 'R' ||
+			    byte[i + 1] != PSMOUSE_RET_ACK)
+				goto bad;
+			xfers[n].arg = byte[i];
+		}
+
+		for (j = 0; j < xfers[n].nrecv; j++, i++) {
+			/* Reset again before the ID byte came */
+			if (i < len && dir[i] == 'S' &&
+			    xfers[n].cmd == (PSMOUSE_CMD_RESET_BAT & 0xff))
+				break;
+			if (i >= len || dir[i] != 'R')
+				goto bad;
+			xfers[n].resp[j] = byte[i];
+		}
+
+		n++;
+	}
+
+	return n;
+
+bad:
+	printf("%s: cannot parse byte %d of the capture\n", path, i);
+	return -1;
+}
+
+/*
+ * The V5 sequence against the first initialization in the capture, from
+ * entering command mode to enabling the touchpad: registers must be read
+ * and written as the windows driver does. Writes the windows driver does
+ * on top of ours are fine as long as they only write back the value the
+ * register already had, and so is reading registers we do not look at.
+ */
+int replay_check_alps_init_capture(void)
+{
+	static struct replay_alps_xfer xfers[REPLAY_ALPS_XFERS_MAX];
+	static struct replay_alps_wire capture;
+	static int shadow[0x10000];
+	const char *path = REPLAY_DEV_DIR "/init-seq-extracted.txt";
+	struct replay_alps_wire *w = &replay_alps_wire;
+	const struct replay_alps_op *op, *c;
+	int i, j, k, n, start, end;
+	int rate = -1, capture_rate = -1, failed = 0;
+
+	n = replay_alps_read_capture(path, xfers, ARRAY_SIZE(xfers));
+	if (n < 0)
+		return 1;
+
+	replay_alps_wire_init(&capture, replay_alps_iseq_nibbles,
+			      PSMOUSE_CMD_RESET_WRAP);
+	for (i = 0; i < n; i++)
+		replay_alps_wire_xfer(&capture, &xfers[i], false);
+
+	for (start = 0; start < capture.nops; start++)
+		if (capture.ops[start].type == REPLAY_ALPS_ENTER)
+			break;
+	for (end = start; end < capture.nops; end++)
+		if (capture.ops[end].type == REPLAY_ALPS_ENABLE)
+			break;
+	if (end == capture.nops) {
+		printf("%s: no initialization found\n", path);
+		return 1;
+	}
+
+	/* The touchpad we model has the registers the capture read */
+	replay_alps_wire_init(w, replay_alps_iseq_nibbles,
+			      PSMOUSE_CMD_RESET_WRAP);
+	for (i = end; i >= start; i--) {
+		c = &capture.ops[i];
+		if (c->type == REPLAY_ALPS_READ)
+			w->regs[c->addr] = c->value;
+	}
+
+	if (replay_alps_run_hw_init("alps-v5")) {
+		printf("alps-v5: init failed\n");
+		return 1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(shadow); i++)
+		shadow[i] = -1;
+
+	j = start;
+	for (i = 0; i <= w->nops; i++) {
+		op = i < w->nops ? &w->ops[i] : NULL;
+
+		if (op && op->type == REPLAY_ALPS_RATE)
+			rate = op->value;
+
+		if (op && op->type == REPLAY_ALPS_READ) {
+			for (k = start; k < end; k++)
+				if (capture.ops[k].type == REPLAY_ALPS_READ &&
+				    capture.ops[k].addr == op->addr)
+					break;
+			if (k == end) {
+				printf("alps-v5: reads %04x, the capture does not\n",
+				       op->addr);
+				failed++;
+			}
+		}
+
+		if (op && op->type != REPLAY_ALPS_WRITE)
+			continue;
+
+		/* Up to the matching write, or to the end for the last one */
+		for (; j < end; j++) {
+			c = &capture.ops[j];
+			if (c->type == REPLAY_ALPS_RATE)
+				capture_rate = c->value;
+			if (c->type == REPLAY_ALPS_READ)
+				shadow[c->addr] = c->value;
+			if (c->type != REPLAY_ALPS_WRITE)
+				continue;
+			if (op && c->addr == op->addr && c->value == op->value)
+				break;
+			if (shadow[c->addr] != c->value) {
+				printf("alps-v5: capture writes %02x to %04x, the table does not\n",
+				       c->value, c->addr);
+				failed++;
+			}
+			shadow[c->addr] = c->value;
+		}
+
+		if (op && j == end) {
+			printf("alps-v5: writes %02x to %04x, the capture does not\n",
+			       op->value, op->addr);
+			return failed + 1;
+		}
+
+		if (op)
+			shadow[capture.ops[j++].addr] = op->value;
+	}
+
+	op = w->nops ? &w->ops[w->nops - 1] : NULL;
+	if (!op || op->type != REPLAY_ALPS_ENABLE || rate != capture_rate) {
+		printf("alps-v5: rate %d, capture rate %d, %s at the end\n",
+		       rate, capture_rate,
+		       op && op->type == REPLAY_ALPS_ENABLE ?
+		       "enabled" : "disabled");
+		failed++;
+	}
+
+	return failed;
+}
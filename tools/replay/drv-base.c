@@ -0,0 +1,103 @@
+/*
+ * The psmouse core, built with its static functions visible to the
+ * harness. replay_connect() does what psmouse_connect() does, except that
+ * the protocol is set up by a replay profile instead of being probed.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#include "../../src/psmouse-base.c"
+
+#include "replay.h"
+
+static const struct replay_profile *replay_profile;
+
+static int replay_protocol_init(struct psmouse *psmouse)
+{
+	return replay_profile->init(psmouse);
+}
+
+struct psmouse *replay_connect(struct serio *serio,
+			       const struct replay_profile *profile)
+{
+	struct psmouse_protocol proto = {
+		.type	= PSMOUSE_PS2,
+		.name	= profile->name,
+		.init	= replay_protocol_init,
+	};
+	struct psmouse *psmouse;
+
+	replay_next_tag = 0;
+	replay_profile = profile;
+
+	psmouse = kzalloc(sizeof(struct psmouse), GFP_KERNEL);
+	if (!psmouse)
+		return NULL;
+
+	psmouse->dev = input_allocate_device();
+	if (!psmouse->dev) {
+		kfree(psmouse);
+		return NULL;
+	}
+
+	mutex_init(&psmouse->mutex);
+	spin_lock_init(&psmouse->rx_lock);
+	psmouse->lock = &psmouse->mutex;
+	INIT_WORK(&psmouse->connect_work, psmouse_connect_work);
+	ps2_init(&psmouse->ps2dev, serio);
+	INIT_DELAYED_WORK(&psmouse->resync_work, psmouse_resync);
+	snprintf(psmouse->phys, sizeof(psmouse->phys), "%s/input0",
+		 serio->phys);
+
+	psmouse_set_state(psmouse, PSMOUSE_INITIALIZING);
+	serio_set_drvdata(serio, psmouse);
+	serio->drv = &psmouse_drv;
+
+	psmouse->vendor = "Replay";
+	psmouse->name = "Device";
+	psmouse->rate = psmouse_rate;
+	psmouse->resolution = psmouse_resolution;
+	psmouse->resetafter = psmouse_resetafter;
+	psmouse->smartscroll = psmouse_smartscroll;
+
+	if (psmouse_switch_protocol(psmouse, &proto)) {
+		input_free_device(psmouse->dev);
+		kfree(psmouse);
+		return NULL;
+	}
+
+	psmouse_set_state(psmouse, PSMOUSE_CMD_MODE);
+	psmouse_activate(psmouse);
+
+	return psmouse;
+}
+
+void replay_disconnect(struct psmouse *psmouse)
+{
+	struct serio *serio = psmouse->ps2dev.serio;
+
+	psmouse_set_state(psmouse, PSMOUSE_IGNORE);
+	psmouse_set_deferred(psmouse, false);
+
+	if (psmouse->disconnect)
+		psmouse->disconnect(psmouse);
+
+	serio_set_drvdata(serio, NULL);
+	input_free_device(psmouse->dev);
+	kfree(psmouse);
+}
+
+int replay_set_deferred(struct psmouse *psmouse, bool enable)
+{
+	return psmouse_set_deferred(psmouse, enable);
+}
+
+void replay_bytes(struct serio *serio, const unsigned char *data, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		serio_interrupt(serio, data[i], 0);
+}
@@ -0,0 +1,449 @@
+/*
+ * Elantech profiles for the replay harness.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#include "../../src/elantech.c"
+
+#include "replay.h"
+
+/* Keep the generic handler instead of the per-version ones */
+bool replay_elantech_generic;
+
+/* Range of v3 and v4 touchpads: x_max 1404, y_max 768 */
+static int replay_elantech_command(struct ps2dev *ps2dev, unsigned char *param,
+				   int command)
+{
+	static const unsigned char fw_id[] = { 0x35, 0x7c, 0x00 };
+
+	if (command == PSMOUSE_CMD_GETINFO)
+		memcpy(param, fw_id, sizeof(fw_id));
+
+	return 0;
+}
+
+/*
+ * What elantech_init() does once the firmware version is known, minus
+ * putting the touchpad into absolute mode and creating the attributes.
+ */
+static int replay_elantech_init(struct psmouse *psmouse,
+				unsigned int fw_version)
+{
+	int (*command)(struct ps2dev *, unsigned char *, int) =
+		replay_ps2_command;
+	struct elantech_data *etd;
+	int error;
+
+	psmouse->private = etd = kzalloc(sizeof(struct elantech_data),
+					 GFP_KERNEL);
+	if (!etd)
+		return -ENOMEM;
+
+	setup_timer(&etd->frame_timer, elantech_frame_timeout_v4,
+		    (unsigned long)psmouse);
+
+	etd->fw_version = fw_version;
+	etd->capabilities[1] = 18;		/* v4 trace lines */
+	if (elantech_set_properties(etd)) {
+		kfree(etd);
+		return -ENODEV;
+	}
+
+	replay_ps2_command = replay_elantech_command;
+	error = elantech_set_input_params(psmouse);
+	replay_ps2_command = command;
+	if (error) {
+		kfree(etd);
+		return -ENODEV;
+	}
+
+	elantech_select_handler(psmouse);
+	if (replay_elantech_generic)
+		psmouse->protocol_handler = elantech_process_byte;
+
+	psmouse->validate_header = elantech_validate_header;
+	psmouse->burst_handler = elantech_process_burst;
+	psmouse->disconnect = elantech_disconnect;
+	psmouse->pktsize = etd->hw_version > 1 ? 6 : 4;
+
+	return 0;
+}
+
+#define REPLAY_ELANTECH_INIT(name, fw_version)				\
+static int replay_elantech_init_##name(struct psmouse *psmouse)		\
+{									\
+	return replay_elantech_init(psmouse, fw_version);		\
+}
+
+REPLAY_ELANTECH_INIT(v1, 0x020000)
+REPLAY_ELANTECH_INIT(v2, 0x020800)
+REPLAY_ELANTECH_INIT(v3, 0x050000)
+REPLAY_ELANTECH_INIT(v4, 0x060000)
+
+static void replay_elantech_fill(unsigned char *buf, int count,
+				 unsigned int *seed)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		buf[i] = replay_rand(seed);
+}
+
+/* Byte 0: n1 n0 p2 p1 1 p3 R L, with odd parity over bytes 1 to 3 */
+static int replay_elantech_packet_v1(unsigned char *buf, unsigned int *seed)
+{
+	replay_elantech_fill(buf, 4, seed);
+	buf[0] = (buf[0] & 0xc3) | 0x08 |
+		 elantech_parity[buf[1]] << 4 |
+		 elantech_parity[buf[2]] << 5 |
+		 elantech_parity[buf[3]] << 2;
+	return 4;
+}
+
+/* Touchpads that report pressure, all packets have the same constants */
+static int replay_elantech_packet_v2(unsigned char *buf, unsigned int *seed)
+{
+	replay_elantech_fill(buf, 6, seed);
+	buf[0] = (buf[0] & 0xf3) | 0x04;
+	buf[3] = (buf[3] & 0xf0) | 0x02;
+	return 6;
+}
+
+/* Head packets, two finger touches as a head and tail pair */
+static int replay_elantech_packet_v3(unsigned char *buf, unsigned int *seed)
+{
+	replay_elantech_fill(buf, 12, seed);
+	buf[0] = (buf[0] & 0xf3) | 0x04;
+	buf[3] = (buf[3] & 0x30) | 0x02;
+	if ((buf[0] & 0xc0) != 0x80)
+		return 6;
+
+	buf[6] = (buf[6] & 0x33) | 0x8c;
+	buf[9] = (buf[9] & 0x31) | 0x0c;
+	return 12;
+}
+
+/* Status, head and motion packets for fingers 1 to 5 */
+static int replay_elantech_packet_v4(unsigned char *buf, unsigned int *seed)
+{
+	replay_elantech_fill(buf, 6, seed);
+	buf[0] = (buf[0] & 0x13) | 0x04;
+
+	switch (replay_rand(seed) % 4) {
+	case 0:
+		buf[3] = 0x10;
+		break;
+	case 1:
+		buf[3] = 0x11 | (1 + replay_rand(seed) % 5) << 5;
+		break;
+	default:
+		buf[0] |= (1 + replay_rand(seed) % 5) << 5;
+		buf[3] = 0x12 | (replay_rand(seed) % 6) << 5;
+		break;
+	}
+
+	return 6;
+}
+
+const struct replay_profile replay_elantech_profiles[] = {
+	{ "elantech-v1", replay_elantech_init_v1,
+	  replay_elantech_packet_v1, 12500 },
+	{ "elantech-v2", replay_elantech_init_v2,
+	  replay_elantech_packet_v2, 12500 },
+	{ "elantech-v3", replay_elantech_init_v3,
+	  replay_elantech_packet_v3, 12500 },
+	{ "elantech-v4", replay_elantech_init_v4,
+	  replay_elantech_packet_v4, 8000 },
+	{ NULL }
+};
+
+/* The v1 parity table against counting the bits, as it was filled at init */
+int replay_check_elantech_parity(void)
+{
+	int i, failed = 0;
+
+	for (i = 0; i < ARRAY_SIZE(elantech_parity); i++) {
+		if (elantech_parity[i] == !(hweight8(i) & 1))
+			continue;
+
+		printf("parity of %#04x: %d\n", i, elantech_parity[i]);
+		failed++;
+	}
+
+	return failed;
+}
+
+/*
+ * A v3 or v4 touchpad as far as detecting it and setting its registers
+ * goes: the magic knock, the firmware version query, register access
+ * through custom commands, and RESET_DIS putting the registers back to
+ * their defaults. Every command it is sent is counted.
+ */
+static struct {
+	unsigned int fw_version;
+	unsigned char regs[ETP_REG_COUNT];
+	unsigned char defaults[ETP_REG_COUNT];
+	unsigned char last[5];		/* Previous commands, newest first */
+	unsigned char custom[4];	/* Bytes sent after ETP_PS2_CUSTOM_COMMAND */
+	unsigned char param[5];		/* Arguments of the previous commands */
+	int ncustom;
+	unsigned long commands;
+} replay_elan;
+
+static unsigned char *replay_elan_reg(unsigned char reg)
+{
+	if (reg < ETP_REG_FIRST || reg > ETP_REG_LAST)
+		return NULL;
+
+	return &replay_elan.regs[reg - ETP_REG_FIRST];
+}
+
+static void replay_elan_getinfo(unsigned char *param)
+{
+	unsigned char *reg, query = 0;
+	int i;
+
+	memset(param, 0, 3);
+
+	if (replay_elan.ncustom == 2 &&
+	    replay_elan.custom[0] == ETP_REGISTER_READWRITE) {
+		reg = replay_elan_reg(replay_elan.custom[1]);
+		param[replay_elan.fw_version >= 0x060000 ? 1 : 0] =
+			reg ? *reg : 0;
+		return;
+	}
+
+	if (replay_elan.last[0] == 0xe6 && replay_elan.last[1] == 0xe6 &&
+	    replay_elan.last[2] == 0xe6) {
+		param[0] = 0x3c;
+		param[1] = 0x03;
+		param[2] = 0xc8;
+		return;
+	}
+
+	/* Sliced query, E6 then the command in four E8 nibbles */
+	for (i = 0; i < 4; i++) {
+		if (replay_elan.last[3 - i] != 0xe8)
+			return;
+		query |= (replay_elan.param[3 - i] & 3) << (6 - 2 * i);
+	}
+
+	if (replay_elan.last[4] == 0xe6 && query == ETP_FW_VERSION_QUERY) {
+		param[0] = replay_elan.fw_version >> 16;
+		param[1] = replay_elan.fw_version >> 8;
+		param[2] = replay_elan.fw_version;
+	}
+}
+
+static void replay_elan_setscale11(void)
+{
+	unsigned char *reg;
+
+	if (replay_elan.ncustom == 3 &&
+	    replay_elan.custom[0] == ETP_REGISTER_READWRITE) {
+		reg = replay_elan_reg(replay_elan.custom[1]);
+		if (reg)
+			*reg = replay_elan.custom[2];
+	} else if (replay_elan.ncustom == 4 &&
+		   replay_elan.custom[0] == ETP_REGISTER_READWRITE &&
+		   replay_elan.custom[2] == ETP_REGISTER_READWRITE) {
+		reg = replay_elan_reg(replay_elan.custom[1]);
+		if (reg)
+			*reg = replay_elan.custom[3];
+	}
+}
+
+static int replay_elan_command(struct ps2dev *ps2dev, unsigned char *param,
+			       int command)
+{
+	unsigned char cmd = command & 0xff;
+	bool custom = replay_elan.last[0] == ETP_PS2_CUSTOM_COMMAND;
+
+	replay_elan.commands++;
+
+	if (custom) {
+		if (replay_elan.ncustom < ARRAY_SIZE(replay_elan.custom))
+			replay_elan.custom[replay_elan.ncustom++] = cmd;
+		/* Not a command of its own, and may look like one */
+		cmd = 0;
+	} else if (cmd == (PSMOUSE_CMD_GETINFO & 0xff)) {
+		replay_elan_getinfo(param);
+		replay_elan.ncustom = 0;
+	} else if (cmd == (PSMOUSE_CMD_SETSCALE11 & 0xff)) {
+		replay_elan_setscale11();
+		replay_elan.ncustom = 0;
+	} else if (cmd == (PSMOUSE_CMD_RESET_DIS & 0xff)) {
+		memcpy(replay_elan.regs, replay_elan.defaults,
+		       sizeof(replay_elan.regs));
+		replay_elan.ncustom = 0;
+	}
+
+	memmove(replay_elan.last + 1, replay_elan.last,
+		sizeof(replay_elan.last) - 1);
+	memmove(replay_elan.param + 1, replay_elan.param,
+		sizeof(replay_elan.param) - 1);
+	replay_elan.last[0] = cmd;
+	replay_elan.param[0] = (command >> 12) & 0xf ? param[0] : 0;
+
+	return 0;
+}
+
+/*
+ * Reconnecting sends fewer commands than connecting did: the first init
+ * learns the register default, after which a register is only written
+ * if its default is not what absolute mode needs. The register must end
+ * up right either way.
+ */
+int replay_check_elantech_reconnect(void)
+{
+	static const struct {
+		const char *profile;
+		unsigned int fw_version;
+		unsigned char reg, val, def;
+	} cases[] = {
+		{ "elantech-v3", 0x050000, 0x10, 0x0b, 0x0b },
+		{ "elantech-v3", 0x050000, 0x10, 0x0b, 0x00 },
+		{ "elantech-v4", 0x060000, 0x07, 0x01, 0x01 },
+		{ "elantech-v4", 0x060000, 0x07, 0x01, 0x00 },
+	};
+	static struct serio serio = {
+		.phys	= "isa0060/serio1",
+	};
+	int (*command)(struct ps2dev *, unsigned char *, int) =
+		replay_ps2_command;
+	const struct replay_profile *profile;
+	unsigned long detect, init, reconnect;
+	struct psmouse *psmouse;
+	int i, failed = 0;
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		for (profile = replay_elantech_profiles; profile->name; profile++)
+			if (!strcmp(profile->name, cases[i].profile))
+				break;
+
+		psmouse = replay_connect(&serio, profile);
+		if (!psmouse)
+			return failed + 1;
+
+		memset(&replay_elan, 0, sizeof(replay_elan));
+		replay_elan.fw_version = cases[i].fw_version;
+		memset(replay_elan.defaults, 0xff, sizeof(replay_elan.defaults));
+		replay_elan.defaults[cases[i].reg - ETP_REG_FIRST] =
+			cases[i].def;
+		replay_ps2_command = replay_elan_command;
+
+		/* What connecting does, less the queries elantech_init() adds */
+		if (elantech_detect(psmouse, false))
+			failed++;
+		detect = replay_elan.commands;
+		if (elantech_set_absolute_mode(psmouse) ||
+		    *replay_elan_reg(cases[i].reg) != cases[i].val)
+			failed++;
+		init = replay_elan.commands;
+
+		replay_elan.commands = 0;
+		if (elantech_reconnect(psmouse) ||
+		    *replay_elan_reg(cases[i].reg) != cases[i].val)
+			failed++;
+		reconnect = replay_elan.commands;
+
+		if (reconnect >= init ||
+		    (cases[i].def == cases[i].val && reconnect != detect)) {
+			printf("%s, default %#04x: %lu commands to connect, %lu to reconnect\n",
+			       cases[i].profile, cases[i].def, init, reconnect);
+			failed++;
+		}
+
+		replay_ps2_command = command;
+		replay_disconnect(psmouse);
+	}
+
+	return failed;
+}
+
+#define REPLAY_V4_STATUS(fingers)	{ 0x04, fingers, 0x00, 0x10, 0x00, 0x00 }
+#define REPLAY_V4_HEAD(id)		{ 0x04, 0x12, 0x34, 0x11 | (id) << 5, 0x02, 0x00 }
+#define REPLAY_V4_MOTION(id, sid)	{ 0x04 | (id) << 5, 0x01, 0x01, 0x12 | (sid) << 5, 0x01, 0x01 }
+
+/*
+ * v4 scan frames of two and three fingers, as the packets arrive, and
+ * how many input_sync() calls the driver should make for them: one per
+ * status packet and one per complete frame. A frame that loses its last
+ * packet is flushed by frame_timer, and not before ETP_V4_FRAME_TIMEOUT.
+ */
+int replay_check_elantech_frames(void)
+{
+	static const unsigned char two[][6] = {
+		REPLAY_V4_STATUS(0x03),
+		REPLAY_V4_HEAD(1), REPLAY_V4_HEAD(2),
+		REPLAY_V4_MOTION(1, 2),
+		REPLAY_V4_MOTION(1, 2),
+	};
+	static const unsigned char three[][6] = {
+		REPLAY_V4_STATUS(0x07),
+		REPLAY_V4_HEAD(1), REPLAY_V4_HEAD(2), REPLAY_V4_HEAD(3),
+		REPLAY_V4_MOTION(1, 2), REPLAY_V4_MOTION(3, 0),
+		REPLAY_V4_MOTION(3, 0), REPLAY_V4_MOTION(1, 2),
+		/* A slot seen twice closes the frame, then the frame stalls */
+		REPLAY_V4_HEAD(1), REPLAY_V4_HEAD(1),
+	};
+	static const struct {
+		const char *name;
+		const unsigned char (*packets)[6];
+		int count;
+		unsigned long syncs;	/* Before the stalled frame times out */
+	} cases[] = {
+		{ "two fingers", two, ARRAY_SIZE(two), 4 },
+		{ "three fingers", three, ARRAY_SIZE(three), 5 },
+	};
+	static struct serio serio = {
+		.phys	= "isa0060/serio1",
+	};
+	const struct replay_profile *profile;
+	struct psmouse *psmouse;
+	unsigned long syncs;
+	int i, j, failed = 0;
+
+	for (profile = replay_elantech_profiles; profile->name; profile++)
+		if (!strcmp(profile->name, "elantech-v4"))
+			break;
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		psmouse = replay_connect(&serio, profile);
+		if (!psmouse)
+			return failed + 1;
+
+		memset(&replay_out, 0, sizeof(replay_out));
+		replay_port = &serio;
+
+		/* Packets of a frame come back to back, about 5 ms apart */
+		for (j = 0; j < cases[i].count; j++) {
+			replay_bytes(&serio, cases[i].packets[j], 6);
+			replay_advance(5);
+		}
+
+		syncs = replay_out.syncs;
+		replay_advance(ETP_V4_FRAME_TIMEOUT - 5);
+		if (syncs != cases[i].syncs || replay_out.syncs != syncs) {
+			printf("%s: %lu syncs, %lu by the timeout, expected %lu\n",
+			       cases[i].name, syncs, replay_out.syncs,
+			       cases[i].syncs);
+			failed++;
+		}
+
+		/* Only the three finger frame was left incomplete */
+		replay_advance(1);
+		if (replay_out.syncs != syncs + (cases[i].packets == three)) {
+			printf("%s: %lu syncs after the timeout\n",
+			       cases[i].name, replay_out.syncs);
+			failed++;
+		}
+
+		replay_disconnect(psmouse);
+	}
+
+	return failed;
+}
@@ -0,0 +1,154 @@
+/*
+ * Synaptics profiles for the replay harness.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#include "../../src/synaptics.c"
+
+#include "replay.h"
+
+/* Keep the generic decoder instead of the specialised ones */
+bool replay_synaptics_generic;
+
+/*
+ * What synaptics_init() does once the touchpad has been queried, minus
+ * talking to it. The pass-through port is not created, so its packets
+ * are dropped.
+ */
+static int replay_synaptics_init(struct psmouse *psmouse,
+				 unsigned long model_id,
+				 unsigned long capabilities,
+				 unsigned long ext_cap_0c)
+{
+	struct synaptics_data *priv;
+
+	psmouse->private = priv = kzalloc(sizeof(struct synaptics_data),
+					  GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+
+	priv->model_id = model_id;
+	priv->capabilities = capabilities;
+	priv->ext_cap_0c = ext_cap_0c;
+	priv->pkt_type = SYN_MODEL_NEWABS(model_id) ? SYN_NEWABS : SYN_OLDABS;
+
+	set_input_params(psmouse->dev, priv);
+
+	/*
+	 * The generic decoder would pick a specialised one after the first
+	 * packet; with the validation mode settled it stays in place.
+	 */
+	if (replay_synaptics_generic && priv->pkt_type == SYN_NEWABS)
+		priv->pkt_type = SYN_NEWABS_STRICT;
+
+	synaptics_select_decoder(psmouse);
+	if (replay_synaptics_generic)
+		psmouse->protocol_handler = synaptics_process_byte;
+
+	psmouse->validate_header = synaptics_validate_header;
+	psmouse->burst_handler = synaptics_process_burst;
+	psmouse->disconnect = synaptics_disconnect;
+	psmouse->pktsize = 6;
+	psmouse->resync_time = 0;
+
+	return 0;
+}
+
+/* Extended, middle button, multifinger and palm detection */
+#define SYN_REPLAY_CAPS	((1 << 23) | (1 << 18) | (1 << 1) | (1 << 0))
+#define SYN_REPLAY_PT	(1 << 7)	/* Pass-through port */
+
+#define REPLAY_SYNAPTICS_INIT(name, model_id, capabilities, ext_cap_0c)	\
+static int replay_synaptics_init_##name(struct psmouse *psmouse)	\
+{									\
+	return replay_synaptics_init(psmouse, model_id, capabilities,	\
+				     ext_cap_0c);			\
+}
+
+REPLAY_SYNAPTICS_INIT(oldabs, 0, 0, 0)
+REPLAY_SYNAPTICS_INIT(newabs, 1 << 7, SYN_REPLAY_CAPS, 0)
+REPLAY_SYNAPTICS_INIT(newabs_pt, 1 << 7, SYN_REPLAY_CAPS | SYN_REPLAY_PT, 0)
+REPLAY_SYNAPTICS_INIT(agm, 1 << 7, SYN_REPLAY_CAPS, 0x080000)
+REPLAY_SYNAPTICS_INIT(image_sensor, 1 << 7, SYN_REPLAY_CAPS | SYN_REPLAY_PT,
+		      0x080800)
+
+static void replay_synaptics_fill(unsigned char *buf, unsigned int *seed)
+{
+	int i;
+
+	for (i = 0; i < 6; i++)
+		buf[i] = replay_rand(seed);
+}
+
+static int replay_synaptics_packet_oldabs(unsigned char *buf,
+					  unsigned int *seed)
+{
+	replay_synaptics_fill(buf, seed);
+	buf[0] |= 0xc0;
+	buf[1] &= ~0x60;
+	buf[3] = 0x80 | (buf[3] & 0x3f);
+	buf[4] &= ~0x60;
+	return 6;
+}
+
+/* Strict NEWABS packets with any W, so also AGM and pass-through ones */
+static int replay_synaptics_packet_newabs(unsigned char *buf,
+					  unsigned int *seed)
+{
+	replay_synaptics_fill(buf, seed);
+	buf[0] = 0x80 | (buf[0] & 0x37);
+	buf[3] = 0xc0 | (buf[3] & 0x37);
+
+	switch (replay_rand(seed) % 4) {
+	case 0:
+		/* Pass-through */
+		buf[0] = 0x84 | (buf[0] & 0x03);
+		buf[3] = 0xc4 | (buf[3] & 0x33);
+		break;
+	case 1:
+		/* W == 2: AGM, AGM-CONTACT with a plausible mt_state */
+		buf[0] = 0x84 | (buf[0] & 0x03);
+		buf[3] = 0xc0 | (buf[3] & 0x33);
+		if (buf[5] & 0x20) {
+			buf[5] = 0x20 | (buf[5] & 0x0f);
+			buf[1] %= 6;
+			buf[2] %= 5;
+			buf[4] %= 5;
+		}
+		break;
+	}
+
+	return 6;
+}
+
+const struct replay_profile replay_synaptics_profiles[] = {
+	{ "synaptics-oldabs", replay_synaptics_init_oldabs,
+	  replay_synaptics_packet_oldabs, 12500 },
+	{ "synaptics-newabs", replay_synaptics_init_newabs,
+	  replay_synaptics_packet_newabs, 12500 },
+	{ "synaptics-newabs-pt", replay_synaptics_init_newabs_pt,
+	  replay_synaptics_packet_newabs, 12500 },
+	{ "synaptics-agm", replay_synaptics_init_agm,
+	  replay_synaptics_packet_newabs, 12500 },
+	{ "synaptics-image-sensor", replay_synaptics_init_image_sensor,
+	  replay_synaptics_packet_newabs, 12500 },
+	{ NULL }
+};
+
+/* For synaptics-mt.c */
+
+void replay_synaptics_report_mt_data(struct psmouse *psmouse,
+				     struct synaptics_mt_state *mt_state,
+				     const struct synaptics_hw_state *sgm)
+{
+	synaptics_report_mt_data(psmouse, mt_state, sgm);
+}
+
+void replay_synaptics_image_sensor_process(struct psmouse *psmouse,
+					   struct synaptics_hw_state *sgm)
+{
+	synaptics_image_sensor_process(psmouse, sgm);
+}
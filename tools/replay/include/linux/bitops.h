@@ -0,0 +1,2 @@
+/* Replay harness shim, everything is in kstub.h */
+#include "kstub.h"
@@ -0,0 +1,90 @@
+/*
+ * Input device shim for the replay harness. Drivers report events as
+ * usual; every event updates a running hash and per type counters in
+ * the device so that two runs can be compared, see replay.c.
+ */
+
+#ifndef _REPLAY_LINUX_INPUT_H
+#define _REPLAY_LINUX_INPUT_H
+
+#include "kstub.h"
+#include <linux/input-event-codes.h>
+
+#define BUS_I8042		0x11
+#define MT_TOOL_FINGER		0
+
+struct input_id {
+	u16 bustype;
+	u16 vendor;
+	u16 product;
+	u16 version;
+};
+
+struct input_dev {
+	const char *name;
+	const char *phys;
+	struct input_id id;
+	struct device dev;
+
+	unsigned long propbit[BITS_TO_LONGS(INPUT_PROP_CNT)];
+	unsigned long evbit[BITS_TO_LONGS(EV_CNT)];
+	unsigned long keybit[BITS_TO_LONGS(KEY_CNT)];
+	unsigned long relbit[BITS_TO_LONGS(REL_CNT)];
+	unsigned long absbit[BITS_TO_LONGS(ABS_CNT)];
+	unsigned long key[BITS_TO_LONGS(KEY_CNT)];
+
+	/* Harness state */
+	unsigned int tag;		/* Allocation order, for the hash */
+};
+
+void input_event(struct input_dev *dev, unsigned int type, unsigned int code,
+		 int value);
+
+static inline void input_report_key(struct input_dev *dev, unsigned int code,
+				    int value)
+{
+	input_event(dev, EV_KEY, code, !!value);
+}
+
+static inline void input_report_rel(struct input_dev *dev, unsigned int code,
+				    int value)
+{
+	input_event(dev, EV_REL, code, value);
+}
+
+static inline void input_report_abs(struct input_dev *dev, unsigned int code,
+				    int value)
+{
+	input_event(dev, EV_ABS, code, value);
+}
+
+static inline void input_sync(struct input_dev *dev)
+{
+	input_event(dev, EV_SYN, SYN_REPORT, 0);
+}
+
+struct input_dev *input_allocate_device(void);
+void input_free_device(struct input_dev *dev);
+int input_register_device(struct input_dev *dev);
+void input_unregister_device(struct input_dev *dev);
+
+static inline void input_set_abs_params(struct input_dev *dev,
+					unsigned int axis, int min, int max,
+					int fuzz, int flat)
+{
+	__set_bit(EV_ABS, dev->evbit);
+	__set_bit(axis, dev->absbit);
+}
+
+static inline void input_abs_set_res(struct input_dev *dev, unsigned int axis,
+				     int val)
+{
+}
+
+static inline void input_set_capability(struct input_dev *dev,
+					unsigned int type, unsigned int code)
+{
+	__set_bit(type, dev->evbit);
+}
+
+#endif /* _REPLAY_LINUX_INPUT_H */
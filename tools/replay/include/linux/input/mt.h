@@ -0,0 +1,44 @@
+/* Multitouch shim for the replay harness, see linux/input.h */
+
+#ifndef _REPLAY_LINUX_INPUT_MT_H
+#define _REPLAY_LINUX_INPUT_MT_H
+
+#include <linux/input.h>
+
+static inline int input_mt_init_slots(struct input_dev *dev,
+				      unsigned int num_slots)
+{
+	__set_bit(ABS_MT_SLOT, dev->absbit);
+	return 0;
+}
+
+static inline void input_mt_slot(struct input_dev *dev, int slot)
+{
+	input_event(dev, EV_ABS, ABS_MT_SLOT, slot);
+}
+
+static inline void input_mt_report_slot_state(struct input_dev *dev,
+					      unsigned int tool_type,
+					      bool active)
+{
+	input_event(dev, EV_ABS, ABS_MT_TRACKING_ID, active ? 1 : -1);
+	if (active)
+		input_event(dev, EV_ABS, ABS_MT_TOOL_TYPE, tool_type);
+}
+
+static inline void input_mt_report_finger_count(struct input_dev *dev,
+						int count)
+{
+	input_event(dev, EV_KEY, BTN_TOOL_FINGER, count == 1);
+	input_event(dev, EV_KEY, BTN_TOOL_DOUBLETAP, count == 2);
+	input_event(dev, EV_KEY, BTN_TOOL_TRIPLETAP, count == 3);
+	input_event(dev, EV_KEY, BTN_TOOL_QUADTAP, count == 4);
+}
+
+static inline void input_mt_report_pointer_emulation(struct input_dev *dev,
+						     bool use_count)
+{
+	input_event(dev, EV_KEY, BTN_TOUCH, use_count);
+}
+
+#endif /* _REPLAY_LINUX_INPUT_MT_H */
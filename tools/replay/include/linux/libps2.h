@@ -0,0 +1,93 @@
+/*
+ * libps2 shim for the replay harness. There is no device behind the
+ * port: commands go to replay_ps2_command, which fails them unless a
+ * test installs its own responder.
+ */
+
+#ifndef _REPLAY_LINUX_LIBPS2_H
+#define _REPLAY_LINUX_LIBPS2_H
+
+#include "kstub.h"
+#include <linux/serio.h>
+
+#define PS2_CMD_GETID		0x02f2
+#define PS2_CMD_RESET_BAT	0x02ff
+
+#define PS2_RET_BAT		0xaa
+#define PS2_RET_ID		0x00
+#define PS2_RET_ACK		0xfa
+#define PS2_RET_NAK		0xfe
+
+#define PS2_FLAG_ACK		1
+#define PS2_FLAG_CMD		2
+#define PS2_FLAG_CMD1		4
+#define PS2_FLAG_WAITID		8
+#define PS2_FLAG_NAK		16
+
+struct ps2dev {
+	struct serio *serio;
+	struct mutex cmd_mutex;
+	unsigned long flags;
+	unsigned char cmdbuf[8];
+	unsigned char cmdcnt;
+	unsigned char nak;
+	wait_queue_head_t wait;
+};
+
+extern int (*replay_ps2_command)(struct ps2dev *ps2dev, unsigned char *param,
+				 int command);
+extern int (*replay_ps2_sendbyte)(struct ps2dev *ps2dev, unsigned char byte,
+				  int timeout);
+
+static inline void ps2_init(struct ps2dev *ps2dev, struct serio *serio)
+{
+	ps2dev->serio = serio;
+}
+
+static inline int __ps2_command(struct ps2dev *ps2dev, unsigned char *param,
+				int command)
+{
+	return replay_ps2_command(ps2dev, param, command);
+}
+
+static inline int ps2_command(struct ps2dev *ps2dev, unsigned char *param,
+			      int command)
+{
+	return replay_ps2_command(ps2dev, param, command);
+}
+
+static inline int ps2_sendbyte(struct ps2dev *ps2dev, unsigned char byte,
+			       int timeout)
+{
+	return replay_ps2_sendbyte(ps2dev, byte, timeout);
+}
+
+/* Only what ps2_sendbyte() waits for, an ACK or a NAK */
+static inline int ps2_handle_ack(struct ps2dev *ps2dev, unsigned char data)
+{
+	switch (data) {
+	case PS2_RET_ACK:
+		ps2dev->nak = 0;
+		break;
+
+	case PS2_RET_NAK:
+		ps2dev->nak = PS2_RET_NAK;
+		break;
+
+	default:
+		return 0;
+	}
+
+	ps2dev->flags &= ~PS2_FLAG_ACK;
+	wake_up(&ps2dev->wait);
+
+	return 1;
+}
+
+#define ps2_begin_command(ps2dev)	mutex_lock(&(ps2dev)->cmd_mutex)
+#define ps2_end_command(ps2dev)		mutex_unlock(&(ps2dev)->cmd_mutex)
+#define ps2_drain(ps2dev, maxbytes, timeout)	do { } while (0)
+#define ps2_handle_response(ps2dev, data)	0
+#define ps2_cmd_aborted(ps2dev)			do { } while (0)
+
+#endif /* _REPLAY_LINUX_LIBPS2_H */
@@ -0,0 +1,102 @@
+/*
+ * serio shim for the replay harness. The port lock is a counter so
+ * the harness can check what runs with it held; serio_interrupt()
+ * delivers bytes to whatever driver the harness attached.
+ */
+
+#ifndef _REPLAY_LINUX_SERIO_H
+#define _REPLAY_LINUX_SERIO_H
+
+#include "kstub.h"
+
+#define SERIO_TIMEOUT		1
+#define SERIO_PARITY		2
+#define SERIO_FRAME		4
+
+#define SERIO_ANY		0xff
+#define SERIO_8042		0x01
+#define SERIO_PS_PSTHRU		0x05
+
+struct serio_device_id {
+	unsigned char type;
+	unsigned char extra;
+	unsigned char id;
+	unsigned char proto;
+};
+
+struct serio_driver;
+
+struct serio {
+	void *port_data;
+	char name[32];
+	char phys[32];
+	struct serio_device_id id;
+	int (*write)(struct serio *, unsigned char);
+	int (*open)(struct serio *);
+	void (*close)(struct serio *);
+	int (*start)(struct serio *);
+	void (*stop)(struct serio *);
+	struct serio *parent;
+	struct serio *child;
+	struct list_head children;
+	struct serio_driver *drv;
+	struct device dev;
+
+	/* Harness state */
+	void *drvdata;
+	int rx_paused;			/* serio_pause_rx() depth */
+	unsigned long reconnects;	/* serio_reconnect() requests */
+};
+
+struct serio_driver {
+	const char *description;
+	const struct serio_device_id *id_table;
+	irqreturn_t (*interrupt)(struct serio *, unsigned char, unsigned int);
+	int (*connect)(struct serio *, struct serio_driver *drv);
+	int (*reconnect)(struct serio *);
+	void (*disconnect)(struct serio *);
+	void (*cleanup)(struct serio *);
+	struct {
+		const char *name;
+	} driver;
+};
+
+#define to_serio_port(d)	container_of(d, struct serio, dev)
+
+static inline void *serio_get_drvdata(struct serio *serio)
+{
+	return serio->drvdata;
+}
+
+static inline void serio_set_drvdata(struct serio *serio, void *data)
+{
+	serio->drvdata = data;
+}
+
+static inline void serio_pause_rx(struct serio *serio)
+{
+	serio->rx_paused++;
+}
+
+static inline void serio_continue_rx(struct serio *serio)
+{
+	serio->rx_paused--;
+}
+
+static inline void serio_reconnect(struct serio *serio)
+{
+	serio->reconnects++;
+}
+
+#define serio_open(serio, drv)		0
+#define serio_close(serio)		do { } while (0)
+#define serio_register_port(serio)	do { } while (0)
+#define serio_unregister_child_port(serio)	do { } while (0)
+#define serio_register_driver(drv)	0
+#define serio_unregister_driver(drv)	do { } while (0)
+
+irqreturn_t serio_interrupt(struct serio *serio, unsigned char data,
+			    unsigned int flags);
+int serio_write(struct serio *serio, unsigned char data);
+
+#endif /* _REPLAY_LINUX_SERIO_H */
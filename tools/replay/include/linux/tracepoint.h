@@ -0,0 +1,13 @@
+/* Tracepoint shim for the replay harness: every trace_*() is empty */
+
+#ifndef _REPLAY_LINUX_TRACEPOINT_H
+#define _REPLAY_LINUX_TRACEPOINT_H
+
+#include "kstub.h"
+
+#define TP_PROTO(args...)	args
+#define TP_ARGS(args...)	args
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print)	\
+	static inline void trace_##name(proto) { }
+
+#endif /* _REPLAY_LINUX_TRACEPOINT_H */
@@ -0,0 +1,245 @@
+/*
+ * Kernel services for the replay harness, see kstub.h.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#include <time.h>
+
+#include <linux/input.h>
+#include <linux/libps2.h>
+#include <linux/serio.h>
+
+#include "replay.h"
+
+volatile unsigned long jiffies;
+int replay_verbose;
+unsigned long replay_slept_ms;
+unsigned int replay_next_tag;
+struct replay_output replay_out;
+struct serio *replay_port;
+
+u64 local_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* Sleeping only moves jiffies, tests look at replay_slept_ms */
+void msleep(unsigned int msecs)
+{
+	replay_slept_ms += msecs;
+	replay_advance(msecs);
+}
+
+/* Input devices */
+
+struct input_dev *input_allocate_device(void)
+{
+	struct input_dev *dev = calloc(1, sizeof(struct input_dev));
+
+	if (dev)
+		dev->tag = replay_next_tag++;
+	return dev;
+}
+
+void input_free_device(struct input_dev *dev)
+{
+	free(dev);
+}
+
+int input_register_device(struct input_dev *dev)
+{
+	return 0;
+}
+
+void input_unregister_device(struct input_dev *dev)
+{
+	free(dev);
+}
+
+void input_event(struct input_dev *dev, unsigned int type, unsigned int code,
+		 int value)
+{
+	if (type == EV_KEY) {
+		if (value)
+			__set_bit(code, dev->key);
+		else
+			__clear_bit(code, dev->key);
+	}
+
+	replay_out.events++;
+	if (type == EV_SYN)
+		replay_out.syncs++;
+	if (replay_port && replay_port->rx_paused)
+		replay_out.locked_events++;
+
+	/* FNV-1a style, over everything reported in order */
+	replay_out.hash = (replay_out.hash ^ ((u64)dev->tag << 56 ^
+					      (u64)type << 48 ^
+					      (u64)code << 32 ^ (u32)value)) *
+			  0x100000001b3ULL;
+}
+
+/* Timers, fired by replay_advance() */
+
+static struct timer_list *timers;
+
+void setup_timer(struct timer_list *timer, void (*fn)(unsigned long),
+		 unsigned long data)
+{
+	memset(timer, 0, sizeof(*timer));
+	timer->function = fn;
+	timer->data = data;
+}
+
+int mod_timer(struct timer_list *timer, unsigned long expires)
+{
+	int was_pending = timer->pending;
+
+	timer->expires = expires;
+	if (!was_pending) {
+		timer->pending = true;
+		timer->next = timers;
+		timers = timer;
+	}
+	return was_pending;
+}
+
+int del_timer(struct timer_list *timer)
+{
+	struct timer_list **p;
+
+	if (!timer->pending)
+		return 0;
+
+	for (p = &timers; *p; p = &(*p)->next) {
+		if (*p == timer) {
+			*p = timer->next;
+			break;
+		}
+	}
+	timer->pending = false;
+	return 1;
+}
+
+static void replay_run_timers(void)
+{
+	struct timer_list *timer;
+	bool again;
+
+	do {
+		again = false;
+		for (timer = timers; timer; timer = timer->next) {
+			if (time_after_eq(jiffies, timer->expires)) {
+				del_timer(timer);
+				timer->function(timer->data);
+				again = true;
+				break;
+			}
+		}
+	} while (again);
+}
+
+void replay_advance(unsigned int msecs)
+{
+	while (msecs--) {
+		jiffies++;
+		replay_run_timers();
+	}
+}
+
+/* Work items, run by replay_run_work() */
+
+static struct work_struct *work_head, **work_tail = &work_head;
+
+bool schedule_work(struct work_struct *work)
+{
+	if (work->pending)
+		return false;
+
+	work->pending = true;
+	work->next = NULL;
+	*work_tail = work;
+	work_tail = &work->next;
+	return true;
+}
+
+bool cancel_work_sync(struct work_struct *work)
+{
+	struct work_struct **p;
+
+	if (!work->pending)
+		return false;
+
+	for (p = &work_head; *p; p = &(*p)->next) {
+		if (*p == work) {
+			*p = work->next;
+			if (!*p)
+				work_tail = p;
+			break;
+		}
+	}
+	work->pending = false;
+	return true;
+}
+
+void replay_run_work(void)
+{
+	struct work_struct *work;
+
+	while ((work = work_head)) {
+		work_head = work->next;
+		if (!work_head)
+			work_tail = &work_head;
+		work->pending = false;
+		work->func(work);
+	}
+}
+
+/* The port: bytes from the "device" and commands to it */
+
+irqreturn_t serio_interrupt(struct serio *serio, unsigned char data,
+			    unsigned int flags)
+{
+	irqreturn_t ret;
+
+	/* The interrupt handler runs with the port lock held */
+	serio_pause_rx(serio);
+	ret = serio->drv->interrupt(serio, data, flags);
+	serio_continue_rx(serio);
+
+	return ret;
+}
+
+/* Unless a test installs its own device every byte is acknowledged */
+int serio_write(struct serio *serio, unsigned char data)
+{
+	if (serio->write)
+		return serio->write(serio, data);
+
+	serio_interrupt(serio, PS2_RET_ACK, 0);
+	return 0;
+}
+
+/* Unless a test says otherwise the device acknowledges every command */
+static int replay_ack_command(struct ps2dev *ps2dev, unsigned char *param,
+			      int command)
+{
+	return 0;
+}
+
+static int replay_ack_sendbyte(struct ps2dev *ps2dev, unsigned char byte,
+			       int timeout)
+{
+	return 0;
+}
+
+int (*replay_ps2_command)(struct ps2dev *ps2dev, unsigned char *param,
+			  int command) = replay_ack_command;
+int (*replay_ps2_sendbyte)(struct ps2dev *ps2dev, unsigned char byte,
+			   int timeout) = replay_ack_sendbyte;
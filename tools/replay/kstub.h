@@ -0,0 +1,479 @@
+/*
+ * Minimal kernel environment for building the psmouse sources in
+ * userspace, see replay.c. Only what the drivers use is provided, and
+ * only as far as it matters for decoding packets: the device
+ * acknowledges every command unless a test installs a responder, sysfs
+ * and module plumbing do nothing, timers and work items run when the
+ * harness asks for it.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#ifndef _REPLAY_KSTUB_H
+#define _REPLAY_KSTUB_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+
+typedef int8_t s8;
+typedef uint8_t u8;
+typedef int16_t s16;
+typedef uint16_t u16;
+typedef int32_t s32;
+typedef uint32_t u32;
+typedef long long s64;
+typedef unsigned long long u64;
+typedef u32 __u32;
+typedef u16 __u16;
+typedef unsigned int gfp_t;
+
+#ifndef KBUILD_MODNAME
+#define KBUILD_MODNAME		"psmouse"
+#endif
+#ifndef KBUILD_BASENAME
+#define KBUILD_BASENAME		"psmouse"
+#endif
+
+/* Compiler and generic helpers */
+
+#define __init
+#define __exit
+#define __initdata
+#define __initconst
+#define __devinit
+#define __read_mostly
+#undef __always_inline
+#define __always_inline		inline __attribute__((always_inline))
+#define noinline		__attribute__((noinline))
+#define __maybe_unused		__attribute__((unused))
+#define __packed		__attribute__((packed))
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+#define barrier()		__asm__ __volatile__("" : : : "memory")
+#define smp_wmb()		barrier()
+#define smp_rmb()		barrier()
+#define smp_mb()		barrier()
+#define ACCESS_ONCE(x)		(*(volatile __typeof__(x) *)&(x))
+#define __stringify_1(x)	#x
+#define __stringify(x)		__stringify_1(x)
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+#define BUILD_BUG_ON(cond)	((void)sizeof(char[1 - 2 * !!(cond)]))
+#define BUG()			abort()
+#define BUG_ON(cond)		do { if (cond) abort(); } while (0)
+#define WARN_ON(cond)							\
+({									\
+	int __c = !!(cond);						\
+	if (__c)							\
+		fprintf(stderr, "WARN_ON(%s) at %s:%d\n",		\
+			#cond, __FILE__, __LINE__);			\
+	__c;								\
+})
+#define WARN_ON_ONCE(cond)	WARN_ON(cond)
+
+#define min(a, b)		((a) < (b) ? (a) : (b))
+#define max(a, b)		((a) > (b) ? (a) : (b))
+#define min_t(t, a, b)		((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b)		((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define min3(a, b, c)		min(min(a, b), c)
+#define max3(a, b, c)		max(max(a, b), c)
+#define clamp(v, lo, hi)	min(max(v, lo), hi)
+#define clamp_val(v, lo, hi)	clamp(v, lo, hi)
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+#define U8_MAX			((u8)~0U)
+
+static inline u64 div_u64(u64 a, u32 b) { return a / b; }
+static inline u64 div64_u64(u64 a, u64 b) { return a / b; }
+static inline s64 div_s64(s64 a, s32 b) { return a / b; }
+
+/* Bits */
+
+#define BITS_PER_BYTE		8
+#define BITS_PER_LONG		(sizeof(long) * BITS_PER_BYTE)
+#define BIT(n)			(1UL << (n))
+#define BIT_MASK(n)		(1UL << ((n) % BITS_PER_LONG))
+#define BIT_WORD(n)		((n) / BITS_PER_LONG)
+#define BITS_TO_LONGS(n)	DIV_ROUND_UP(n, BITS_PER_LONG)
+#define DECLARE_BITMAP(name, bits)	unsigned long name[BITS_TO_LONGS(bits)]
+
+static inline void __set_bit(int nr, unsigned long *addr)
+{
+	addr[BIT_WORD(nr)] |= BIT_MASK(nr);
+}
+static inline void __clear_bit(int nr, unsigned long *addr)
+{
+	addr[BIT_WORD(nr)] &= ~BIT_MASK(nr);
+}
+#define set_bit(nr, addr)	__set_bit(nr, addr)
+#define clear_bit(nr, addr)	__clear_bit(nr, addr)
+static inline int test_bit(int nr, const unsigned long *addr)
+{
+	return (addr[BIT_WORD(nr)] >> (nr % BITS_PER_LONG)) & 1;
+}
+static inline int __test_and_change_bit(int nr, unsigned long *addr)
+{
+	int old = test_bit(nr, addr);
+
+	addr[BIT_WORD(nr)] ^= BIT_MASK(nr);
+	return old;
+}
+
+#define hweight8(w)		__builtin_popcount((u8)(w))
+#define hweight16(w)		__builtin_popcount((u16)(w))
+#define hweight32(w)		__builtin_popcount((u32)(w))
+#define hweight_long(w)		__builtin_popcountl(w)
+#define __ffs(w)		((unsigned long)__builtin_ctzl(w))
+#define __fls(w)		((unsigned long)(BITS_PER_LONG - 1 - __builtin_clzl(w)))
+#define ffz(w)			__ffs(~(unsigned long)(w))
+static inline int fls(unsigned int x) { return x ? 32 - __builtin_clz(x) : 0; }
+#define ilog2(n)		((int)(BITS_PER_LONG - 1 - __builtin_clzl(n)))
+#define is_power_of_2(n)	((n) != 0 && (((n) & ((n) - 1)) == 0))
+
+static inline u8 bitrev8(u8 x)
+{
+	x = (x >> 4) | (x << 4);
+	x = ((x & 0xcc) >> 2) | ((x & 0x33) << 2);
+	return ((x & 0xaa) >> 1) | ((x & 0x55) << 1);
+}
+static inline u32 bitrev32(u32 x)
+{
+	return ((u32)bitrev8(x) << 24) | ((u32)bitrev8(x >> 8) << 16) |
+	       ((u32)bitrev8(x >> 16) << 8) | bitrev8(x >> 24);
+}
+
+/* Time. jiffies only moves when the harness says so. */
+
+#define HZ			1000
+#define MSEC_PER_SEC		1000L
+#define USEC_PER_MSEC		1000L
+#define NSEC_PER_USEC		1000L
+#define NSEC_PER_MSEC		1000000L
+#define USEC_PER_SEC		1000000L
+#define NSEC_PER_SEC		1000000000L
+
+extern volatile unsigned long jiffies;
+u64 local_clock(void);
+
+#define time_after(a, b)	((long)((b) - (a)) < 0)
+#define time_before(a, b)	time_after(b, a)
+#define time_after_eq(a, b)	((long)((a) - (b)) >= 0)
+#define time_before_eq(a, b)	time_after_eq(b, a)
+static inline unsigned long msecs_to_jiffies(unsigned int m) { return m; }
+static inline unsigned int jiffies_to_msecs(unsigned long j) { return j; }
+static inline unsigned long usecs_to_jiffies(unsigned int u)
+{
+	return DIV_ROUND_UP(u, 1000);
+}
+void msleep(unsigned int msecs);
+#define ssleep(secs)		msleep((secs) * 1000)
+#define udelay(n)		do { } while (0)
+#define mdelay(n)		do { } while (0)
+
+/*
+ * Nothing else runs while the harness waits, so waiting moves jiffies
+ * on until the condition holds, which takes a timer doing what the
+ * interrupt would have done.
+ */
+void replay_advance(unsigned int msecs);
+typedef struct {
+	int dummy;
+} wait_queue_head_t;
+#define init_waitqueue_head(wq)	do { } while (0)
+#define wake_up(wq)		do { } while (0)
+#define wait_event_timeout(wq, condition, timeout)			\
+({									\
+	long __left = (timeout);					\
+									\
+	while (!(condition) && __left > 0) {				\
+		replay_advance(1);					\
+		__left--;						\
+	}								\
+	(condition) ? max(__left, 1L) : 0L;				\
+})
+
+/* Memory */
+
+#define GFP_KERNEL		0
+#define GFP_ATOMIC		1
+static inline void *kzalloc(size_t size, gfp_t flags) { return calloc(1, size); }
+static inline void *kmalloc(size_t size, gfp_t flags) { return malloc(size); }
+static inline void *kcalloc(size_t n, size_t size, gfp_t flags)
+{
+	return calloc(n, size);
+}
+static inline void kfree(const void *p) { free((void *)p); }
+static inline char *kstrdup(const char *s, gfp_t flags) { return strdup(s); }
+
+/* Strings */
+
+static inline int strict_strtoul(const char *cp, unsigned int base,
+				 unsigned long *res)
+{
+	char *end;
+
+	*res = strtoul(cp, &end, base);
+	if (end == cp || (*end && !(*end == '\n' && !end[1])))
+		return -EINVAL;
+	return 0;
+}
+#define kstrtoul(cp, base, res)	strict_strtoul(cp, base, res)
+#define simple_strtoul		strtoul
+
+static inline int scnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(buf, size, fmt, args);
+	va_end(args);
+
+	if (len >= (int)size)
+		len = size ? size - 1 : 0;
+	return len;
+}
+
+static inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+
+	if (size) {
+		size_t n = len >= size ? size - 1 : len;
+
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return len;
+}
+
+/* Lists, only as far as serio->children goes */
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+#define list_empty(head)	((head)->next == (head) || !(head)->next)
+
+/* Logging, quiet unless replay_verbose is set */
+
+extern int replay_verbose;
+#define KERN_DEBUG	"<7>"
+#define KERN_INFO	"<6>"
+#define KERN_NOTICE	"<5>"
+#define KERN_WARNING	"<4>"
+#define KERN_ERR	"<3>"
+#define printk(fmt, ...) \
+	do { if (replay_verbose) fprintf(stderr, fmt, ##__VA_ARGS__); } while (0)
+#ifndef pr_fmt
+#define pr_fmt(fmt)	fmt
+#endif
+#define pr_err(fmt, ...)	printk(pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_warn(fmt, ...)	printk(pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_info(fmt, ...)	printk(pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_debug(fmt, ...)	printk(pr_fmt(fmt), ##__VA_ARGS__)
+#define dev_printk(level, dev, fmt, ...)	printk(fmt, ##__VA_ARGS__)
+#define dev_dbg(dev, fmt, ...)		printk(fmt, ##__VA_ARGS__)
+#define dev_info(dev, fmt, ...)		printk(fmt, ##__VA_ARGS__)
+#define dev_notice(dev, fmt, ...)	printk(fmt, ##__VA_ARGS__)
+#define dev_warn(dev, fmt, ...)		printk(fmt, ##__VA_ARGS__)
+#define dev_err(dev, fmt, ...)		printk(fmt, ##__VA_ARGS__)
+
+/* Modules and parameters */
+
+struct module;
+#define THIS_MODULE		((struct module *)NULL)
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+#define MODULE_PARM_DESC(name, desc)
+#define MODULE_DEVICE_TABLE(type, name)
+#define EXPORT_SYMBOL(sym)
+#define EXPORT_SYMBOL_GPL(sym)
+
+struct kernel_param;
+struct kernel_param_ops {
+	int (*set)(const char *val, const struct kernel_param *kp);
+	int (*get)(char *buffer, const struct kernel_param *kp);
+};
+struct kernel_param {
+	const char *name;
+	const struct kernel_param_ops *ops;
+	void *arg;
+};
+#define __param_check(name, p, type)
+#define module_param_named(name, value, type, perm)
+#define module_param(name, type, perm)
+#define module_param_cb(name, ops, arg, perm)
+#define module_init(fn)		int replay_module_init(void) { return fn(); }
+#define module_exit(fn)		void replay_module_exit(void) { fn(); }
+
+/* Locking: the harness is single threaded, locks only check nesting */
+
+struct mutex {
+	int locked;
+};
+#define DEFINE_MUTEX(name)	struct mutex name = { 0 }
+#define mutex_init(m)		((m)->locked = 0)
+#define mutex_lock(m)		((m)->locked++)
+#define mutex_unlock(m)		((m)->locked--)
+#define mutex_lock_interruptible(m)	(mutex_lock(m), 0)
+#define mutex_is_locked(m)	((m)->locked != 0)
+
+typedef struct {
+	int locked;
+} spinlock_t;
+#define DEFINE_SPINLOCK(name)	spinlock_t name = { 0 }
+#define spin_lock_init(l)	((l)->locked = 0)
+#define spin_lock(l)		((l)->locked++)
+#define spin_unlock(l)		((l)->locked--)
+#define spin_lock_bh(l)		spin_lock(l)
+#define spin_unlock_bh(l)	spin_unlock(l)
+#define spin_lock_irq(l)	spin_lock(l)
+#define spin_unlock_irq(l)	spin_unlock(l)
+#define spin_lock_irqsave(l, f)	((void)(f), spin_lock(l))
+#define spin_unlock_irqrestore(l, f)	((void)(f), spin_unlock(l))
+#define spin_is_locked(l)	((l)->locked != 0)
+
+#define might_sleep()		do { } while (0)
+#define in_interrupt()		0
+
+/* Timers and work, run by replay_run_timers()/replay_run_work() */
+
+struct timer_list {
+	unsigned long expires;
+	void (*function)(unsigned long);
+	unsigned long data;
+	bool pending;
+	struct timer_list *next;
+};
+
+void setup_timer(struct timer_list *timer, void (*fn)(unsigned long),
+		 unsigned long data);
+int mod_timer(struct timer_list *timer, unsigned long expires);
+int del_timer(struct timer_list *timer);
+#define del_timer_sync(t)	del_timer(t)
+#define timer_pending(t)	((t)->pending)
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+struct work_struct {
+	work_func_t func;
+	bool pending;
+	struct work_struct *next;
+};
+struct delayed_work {
+	struct work_struct work;
+};
+struct workqueue_struct {
+	int dummy;
+};
+
+#define INIT_WORK(w, fn)	do { (w)->func = (fn); (w)->pending = false; } while (0)
+#define INIT_DELAYED_WORK(w, fn)	INIT_WORK(&(w)->work, fn)
+#define to_delayed_work(w)	container_of(w, struct delayed_work, work)
+bool schedule_work(struct work_struct *work);
+#define queue_work(wq, w)	schedule_work(w)
+#define queue_delayed_work(wq, w, delay)	schedule_work(&(w)->work)
+bool cancel_work_sync(struct work_struct *work);
+#define cancel_delayed_work_sync(w)	cancel_work_sync(&(w)->work)
+#define flush_work(w)		do { } while (0)
+#define flush_workqueue(wq)	do { } while (0)
+#define create_singlethread_workqueue(name)	\
+	((struct workqueue_struct *)calloc(1, sizeof(struct workqueue_struct)))
+#define destroy_workqueue(wq)	free(wq)
+
+/* kfifo, enough of it for fixed size fifos of records */
+
+#define DECLARE_KFIFO(fifo, type, size)					\
+	struct {							\
+		unsigned int in, out;					\
+		type buf[size];						\
+	} fifo
+#define INIT_KFIFO(fifo)	((fifo).in = (fifo).out = 0)
+#define kfifo_size(fifo)	ARRAY_SIZE((fifo)->buf)
+#define kfifo_len(fifo)		((fifo)->in - (fifo)->out)
+#define kfifo_is_empty(fifo)	((fifo)->in == (fifo)->out)
+#define kfifo_reset(fifo)	((fifo)->in = (fifo)->out = 0)
+#define kfifo_reset_out(fifo)	((fifo)->out = (fifo)->in)
+#define kfifo_put(fifo, val)						\
+({									\
+	int __ok = kfifo_len(fifo) < kfifo_size(fifo);			\
+	if (__ok) {							\
+		(fifo)->buf[(fifo)->in % kfifo_size(fifo)] = *(val);	\
+		(fifo)->in++;						\
+	}								\
+	__ok;								\
+})
+#define kfifo_out(fifo, dst, n)						\
+({									\
+	unsigned int __i, __n = min_t(unsigned int, n, kfifo_len(fifo)); \
+	for (__i = 0; __i < __n; __i++)					\
+		(dst)[__i] = (fifo)->buf[(fifo)->out++ % kfifo_size(fifo)]; \
+	__n;								\
+})
+
+/* Device model and sysfs */
+
+struct kobject {
+	int dummy;
+};
+struct device {
+	struct kobject kobj;
+	struct device *parent;
+};
+struct attribute {
+	const char *name;
+	unsigned int mode;
+};
+struct attribute_group {
+	struct attribute **attrs;
+};
+struct device_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct device *dev, struct device_attribute *attr,
+			char *buf);
+	ssize_t (*store)(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t count);
+};
+#define S_IRUGO			0444
+#define S_IWUSR			0200
+#define sysfs_create_group(kobj, grp)	((void)(kobj), (void)(grp), 0)
+#define sysfs_remove_group(kobj, grp)	((void)(kobj), (void)(grp))
+
+struct dentry;
+
+/* DMI, nothing ever matches */
+
+struct dmi_system_id {
+	int (*callback)(const struct dmi_system_id *);
+	const char *ident;
+	struct {
+		int slot;
+		const char *substr;
+	} matches[4];
+	void *driver_data;
+};
+#define DMI_MATCH(a, b)		{ a, b }
+enum { DMI_SYS_VENDOR, DMI_PRODUCT_NAME, DMI_PRODUCT_VERSION,
+       DMI_BOARD_VENDOR, DMI_BOARD_NAME };
+#define dmi_check_system(list)		0
+#define dmi_get_system_info(field)	""
+
+/* Interrupts */
+
+typedef int irqreturn_t;
+#define IRQ_NONE		0
+#define IRQ_HANDLED		1
+
+#endif /* _REPLAY_KSTUB_H */
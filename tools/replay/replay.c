@@ -0,0 +1,725 @@
+/*
+ * Packet replay harness for the psmouse protocol decoders.
+ *
+ * The decoders in src/ are built in userspace against the stubs in
+ * kstub.h and fed either a generated stream of packets or bytes read from
+ * a file. Events reported to the input devices are counted and hashed, so
+ * two ways of decoding the same stream can be compared, and the time spent
+ * is measured.
+ *
+ *   replay -t			run the checks
+ *   replay -b [-n packets]	decoder throughput for every profile, and
+ *				microbenchmarks of single decoder steps
+ *   replay -p profile file	decode a hex dump, e.g. from the trace ring
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#include <unistd.h>
+
+#include <linux/input.h>
+#include <linux/serio.h>
+#include <linux/libps2.h>
+
+#include "../../src/psmouse.h"
+#include "replay.h"
+
+static struct serio replay_serio = {
+	.phys	= "isa0060/serio1",
+};
+
+static const struct replay_profile *replay_profiles[] = {
+	replay_alps_profiles,
+	replay_synaptics_profiles,
+	replay_elantech_profiles,
+	NULL
+};
+
+/* How bytes get to the protocol handlers */
+enum replay_mode {
+	REPLAY_DIRECT,		/* From the interrupt */
+	REPLAY_DEFERRED,	/* From the work item, through burst handlers */
+	REPLAY_BYTEWISE,	/* From the work item, byte by byte */
+	REPLAY_MODES
+};
+
+static const char * const replay_mode_names[] = {
+	"direct", "deferred", "bytewise"
+};
+
+struct replay_result {
+	unsigned long bytes;
+	unsigned long packets;
+	unsigned long bad_data;
+	unsigned long realigned;
+	unsigned long rx_overruns;
+	struct replay_output out;
+	u64 ns;
+};
+
+static const struct replay_profile *replay_find_profile(const char *name)
+{
+	const struct replay_profile *profile;
+	int i;
+
+	for (i = 0; replay_profiles[i]; i++)
+		for (profile = replay_profiles[i]; profile->name; profile++)
+			if (!strcmp(profile->name, name))
+				return profile;
+
+	return NULL;
+}
+
+static struct psmouse *replay_start(const struct replay_profile *profile,
+				    enum replay_mode mode)
+{
+	struct psmouse *psmouse;
+
+	memset(&replay_out, 0, sizeof(replay_out));
+	replay_port = &replay_serio;
+
+	psmouse = replay_connect(&replay_serio, profile);
+	if (!psmouse) {
+		fprintf(stderr, "%s: setup failed\n", profile->name);
+		return NULL;
+	}
+
+	if (mode != REPLAY_DIRECT && replay_set_deferred(psmouse, true)) {
+		replay_disconnect(psmouse);
+		return NULL;
+	}
+
+	if (mode == REPLAY_BYTEWISE)
+		psmouse->burst_handler = NULL;
+
+	return psmouse;
+}
+
+static void replay_finish(struct psmouse *psmouse,
+			  struct replay_result *res)
+{
+	/* Let flush timers fire */
+	replay_run_work();
+	replay_advance(1000);
+
+	res->bytes = psmouse->stats.bytes;
+	res->packets = psmouse->stats.packets;
+	res->bad_data = psmouse->stats.bad_data;
+	res->realigned = psmouse->stats.realigned;
+	res->rx_overruns = psmouse->stats.rx_overruns;
+	res->out = replay_out;
+
+	replay_disconnect(psmouse);
+}
+
+/*
+ * Decode units generated packet units of the profile. Queued bytes are
+ * decoded after every unit, which is less than the queue holds, and
+ * time moves on every 1 to 3 units, the same way in direct and deferred
+ * mode, so that both see the same timers fire.
+ */
+static int replay_stream(const struct replay_profile *profile,
+			 enum replay_mode mode,
+			 unsigned int seed, int units,
+			 struct replay_result *res)
+{
+	struct psmouse *psmouse;
+	unsigned char buf[64];
+	unsigned int sched = seed ^ 0x5a5a5a5a;
+	unsigned int us = 0;
+	int i, len, group = 0;
+	u64 start;
+
+	psmouse = replay_start(profile, mode);
+	if (!psmouse)
+		return -1;
+
+	start = local_clock();
+
+	for (i = 0; i < units; i++) {
+		len = profile->packet(buf, &seed);
+		replay_bytes(&replay_serio, buf, len);
+		replay_run_work();
+		us += profile->gap_us;
+
+		if (group-- == 0 || i == units - 1) {
+			replay_advance(us / 1000);
+			us %= 1000;
+			group = replay_rand(&sched) % 3;
+		}
+	}
+
+	res->ns = local_clock() - start;
+	replay_finish(psmouse, res);
+
+	return 0;
+}
+
+/* Checks, each returns the number of failures */
+
+static int replay_check_streams(void)
+{
+	const struct replay_profile *profile;
+	struct replay_result res;
+	int i, mode, failed = 0;
+
+	for (i = 0; replay_profiles[i]; i++) {
+		for (profile = replay_profiles[i]; profile->name; profile++) {
+			for (mode = 0; mode < REPLAY_MODES; mode++) {
+				if (replay_stream(profile, mode, 1, 2000, &res) ||
+				    !res.packets || res.bad_data ||
+				    !res.out.syncs) {
+					printf("%s %s: %lu packets, %lu bad, %lu syncs\n",
+					       profile->name,
+					       replay_mode_names[mode],
+					       res.packets, res.bad_data,
+					       res.out.syncs);
+					failed++;
+				}
+			}
+		}
+	}
+
+	return failed;
+}
+
+/*
+ * A byte with the high bit set ends a V3 packet early. Realigning finds a
+ * bare PS/2 packet in what was buffered, and the header after it must
+ * not be thrown away with the rest of the window.
+ */
+static int replay_check_realign(void)
+{
+	static const unsigned char data[] = {
+		0x8f,				/* Stray header */
+		0x08, 0x01, 0x01,		/* Bare PS/2 packet */
+		0xcf, 0x10, 0x10, 0x00, 0x10, 0x3f,	/* Trackstick packet */
+	};
+	struct replay_result res;
+	int (*sendbyte)(struct ps2dev *, unsigned char, int) =
+		replay_ps2_sendbyte;
+	struct psmouse *psmouse;
+	int failed = 0;
+
+	psmouse = replay_start(replay_find_profile("alps-v3"), REPLAY_DIRECT);
+	if (!psmouse)
+		return 1;
+
+	replay_bytes(&replay_serio, data, sizeof(data));
+	if (psmouse->out_of_sync_cnt || psmouse->pktcnt)
+		failed++;
+
+	replay_finish(psmouse, &res);
+	if (res.realigned != 1 || res.packets != 2 || res.bad_data != 1)
+		failed++;
+
+	if (failed)
+		printf("realign: %lu realigned, %lu packets, %lu bad\n",
+		       res.realigned, res.packets, res.bad_data);
+
+	return failed;
+}
+
+/*
+ * In deferred mode nothing may be reported with the port lock held, and
+ * both locks must be free again when the work is done.
+ */
+static int replay_check_deferred_unlocked(void)
+{
+	const struct replay_profile *profile;
+	struct psmouse *psmouse;
+	unsigned char buf[64];
+	unsigned int seed = 1;
+	int i, n, len, failed = 0;
+
+	for (i = 0; replay_profiles[i]; i++) {
+		for (profile = replay_profiles[i]; profile->name; profile++) {
+			psmouse = replay_start(profile, REPLAY_DEFERRED);
+			if (!psmouse)
+				return 1;
+
+			for (n = 0; n < 500; n++) {
+				len = profile->packet(buf, &seed);
+				replay_bytes(&replay_serio, buf, len);
+				replay_run_work();
+				replay_advance(profile->gap_us / 1000);
+			}
+
+			if (!replay_out.events || replay_out.locked_events ||
+			    replay_serio.rx_paused ||
+			    spin_is_locked(&psmouse->rx_lock)) {
+				printf("%s: %lu of %lu events with the port locked\n",
+				       profile->name, replay_out.locked_events,
+				       replay_out.events);
+				failed++;
+			}
+
+			replay_disconnect(psmouse);
+		}
+	}
+
+	return failed;
+}
+
+/*
+ * Bytes queued before a state change are not decoded after it, and
+ * decoding picks up again once the device is activated.
+ */
+static int replay_check_deferred_state_change(void)
+{
+	static const unsigned char packet[] = {
+		0xcf, 0x10, 0x10, 0x00, 0x10, 0x3f,	/* V3 trackstick */
+	};
+	struct psmouse *psmouse;
+	int failed = 0;
+
+	psmouse = replay_start(replay_find_profile("alps-v3"),
+			       REPLAY_DEFERRED);
+	if (!psmouse)
+		return 1;
+
+	replay_bytes(&replay_serio, packet, sizeof(packet));
+	replay_bytes(&replay_serio, packet, 3);
+	psmouse_set_state(psmouse, PSMOUSE_CMD_MODE);
+	replay_run_work();
+	if (replay_out.events || psmouse->pktcnt)
+		failed++;
+
+	psmouse_set_state(psmouse, PSMOUSE_ACTIVATED);
+	replay_bytes(&replay_serio, packet, sizeof(packet));
+	replay_run_work();
+	if (psmouse->stats.packets != 1 || !replay_out.syncs)
+		failed++;
+
+	replay_disconnect(psmouse);
+
+	return failed;
+}
+
+/*
+ * The burst handlers decode whole packets straight from the queue; the
+ * result must be what decoding byte by byte reports, from the interrupt
+ * or from the work item.
+ */
+static int replay_check_burst(void)
+{
+	const struct replay_profile *profile;
+	struct replay_result direct, res;
+	unsigned int seed;
+	int i, mode, failed = 0;
+
+	for (i = 0; replay_profiles[i]; i++) {
+		for (profile = replay_profiles[i]; profile->name; profile++) {
+			for (seed = 1; seed <= 4; seed++) {
+				if (replay_stream(profile, REPLAY_DIRECT, seed,
+						  5000, &direct))
+					return failed + 1;
+
+				for (mode = REPLAY_DEFERRED; mode < REPLAY_MODES;
+				     mode++) {
+					if (replay_stream(profile, mode, seed,
+							  5000, &res))
+						return failed + 1;
+
+					if (!res.rx_overruns &&
+					    direct.out.hash == res.out.hash &&
+					    direct.out.events == res.out.events &&
+					    direct.packets == res.packets)
+						continue;
+
+					printf("%s %s seed %u: %lu/%lu events, %lu/%lu packets\n",
+					       profile->name,
+					       replay_mode_names[mode], seed,
+					       direct.out.events,
+					       res.out.events,
+					       direct.packets, res.packets);
+					failed++;
+				}
+			}
+		}
+	}
+
+	return failed;
+}
+
+/* A device that needs 100 ms to ACK, and always refuses 0x88 */
+static unsigned int replay_slow_sends;
+static unsigned char replay_slow_answer;
+static struct timer_list replay_slow_timer;
+
+static void replay_slow_answer_fn(unsigned long data)
+{
+	serio_interrupt(&replay_serio, replay_slow_answer, 0);
+}
+
+static int replay_slow_write(struct serio *serio, unsigned char byte)
+{
+	replay_slow_sends++;
+	replay_slow_answer = byte == 0x88 ? PS2_RET_NAK : PS2_RET_ACK;
+	mod_timer(&replay_slow_timer, jiffies + msecs_to_jiffies(100));
+
+	return 0;
+}
+
+static int replay_slow_sendbyte(struct ps2dev *ps2dev, unsigned char byte,
+				int timeout)
+{
+	replay_slow_sends++;
+	if (timeout < 100)
+		return -1;
+
+	return byte == 0x88 ? PS2_RET_NAK : 0;
+}
+
+/*
+ * An ACK slower than the round trip estimate is waited for in the same
+ * transaction, the byte is never sent twice, and bytes the device
+ * refuses always get the full timeout.
+ */
+static int replay_check_sendbyte_retry(void)
+{
+	int (*sendbyte)(struct ps2dev *, unsigned char, int) =
+		replay_ps2_sendbyte;
+	struct psmouse *psmouse;
+	unsigned long start;
+	unsigned int rttvar;
+	int failed = 0;
+
+	psmouse = replay_start(replay_find_profile("alps-v3"), REPLAY_DIRECT);
+	if (!psmouse)
+		return 1;
+
+	setup_timer(&replay_slow_timer, replay_slow_answer_fn, 0);
+	replay_serio.write = replay_slow_write;
+	replay_ps2_sendbyte = replay_slow_sendbyte;
+
+	psmouse->rtt_samples = 8;
+	psmouse->srtt_us = 500;
+	psmouse->rttvar_us = 100;
+	rttvar = psmouse->rttvar_us;
+
+	replay_slow_sends = 0;
+	start = jiffies;
+	if (psmouse_sendbyte(psmouse, 0xf3, 200) || replay_slow_sends != 1 ||
+	    jiffies - start != 100 || psmouse->rttvar_us <= rttvar)
+		failed++;
+
+	/* Nothing measured yet, the full timeout is all there is */
+	psmouse->rtt_samples = 0;
+	replay_slow_sends = 0;
+	if (psmouse_sendbyte(psmouse, 0xf3, 50) != -1 || replay_slow_sends != 1)
+		failed++;
+	del_timer(&replay_slow_timer);
+
+	replay_slow_sends = 0;
+	if (psmouse_sendbyte_nak(psmouse, 0x88, 200) != PS2_RET_NAK ||
+	    replay_slow_sends != 1)
+		failed++;
+
+	replay_serio.write = NULL;
+	replay_ps2_sendbyte = sendbyte;
+	replay_disconnect(psmouse);
+
+	return failed;
+}
+
+/*
+ * Replays every profile of a driver twice with the same seeds, once with
+ * the handler specialised for the device and once with the generic one
+ * (*generic set), and compares what they report.
+ */
+static int replay_check_generic(const struct replay_profile *profiles,
+				bool *generic)
+{
+	const struct replay_profile *profile;
+	struct replay_result ref, res;
+	unsigned int seed;
+	int mode, error, failed = 0;
+
+	for (profile = profiles; profile->name; profile++) {
+		for (seed = 1; seed <= 4; seed++) {
+			for (mode = REPLAY_DIRECT; mode <= REPLAY_DEFERRED;
+			     mode++) {
+				*generic = true;
+				error = replay_stream(profile, mode, seed,
+						      5000, &ref);
+				*generic = false;
+				if (error || replay_stream(profile, mode, seed,
+							   5000, &res))
+					return failed + 1;
+
+				if (ref.out.hash == res.out.hash &&
+				    ref.out.events == res.out.events &&
+				    ref.packets == res.packets)
+					continue;
+
+				printf("%s %s seed %u: %lu/%lu events, %lu/%lu packets\n",
+				       profile->name, replay_mode_names[mode],
+				       seed, ref.out.events,
+				       res.out.events, ref.packets,
+				       res.packets);
+				failed++;
+			}
+		}
+	}
+
+	return failed;
+}
+
+/* What synaptics_select_decoder() picks against synaptics_process_byte() */
+static int replay_check_synaptics_decoders(void)
+{
+	return replay_check_generic(replay_synaptics_profiles,
+				    &replay_synaptics_generic);
+}
+
+/* What elantech_select_handler() picks against elantech_process_byte() */
+static int replay_check_elantech_handlers(void)
+{
+	return replay_check_generic(replay_elantech_profiles,
+				    &replay_elantech_generic);
+}
+
+static const struct {
+	const char *name;
+	int (*fn)(void);
+} replay_checks[] = {
+	{ "generated streams decode cleanly", replay_check_streams },
+	{ "realign replays the bytes after a short packet",
+	  replay_check_realign },
+	{ "deferred decoding runs with the port unlocked",
+	  replay_check_deferred_unlocked },
+	{ "deferred bytes do not survive a state change",
+	  replay_check_deferred_state_change },
+	{ "burst decoding reports what byte decoding does",
+	  replay_check_burst },
+	{ "slow acks are waited for, never resent",
+	  replay_check_sendbyte_retry },
+	{ "alps bitmap tables match the division",
+	  replay_check_alps_bitmap_tables },
+	{ "alps bitmap runs match the bit loop",
+	  replay_check_alps_bitmap_runs },
+	{ "alps init tables match what goes on the wire",
+	  replay_check_alps_init_tables },
+	{ "alps v5 init matches the windows driver capture",
+	  replay_check_alps_init_capture },
+	{ "synaptics specialised decoders match the generic one",
+	  replay_check_synaptics_decoders },
+	{ "synaptics mt table matches the finger count functions",
+	  replay_check_synaptics_mt },
+	{ "elantech per-version handlers match the generic one",
+	  replay_check_elantech_handlers },
+	{ "elantech parity table matches the bit count",
+	  replay_check_elantech_parity },
+	{ "elantech reconnect only writes registers off their default",
+	  replay_check_elantech_reconnect },
+	{ "elantech v4 scan frames get one sync each",
+	  replay_check_elantech_frames },
+};
+
+static int replay_check(void)
+{
+	int i, failed, total = 0;
+
+	for (i = 0; i < ARRAY_SIZE(replay_checks); i++) {
+		failed = replay_checks[i].fn();
+		printf("%-56s %s\n", replay_checks[i].name,
+		       failed ? "FAILED" : "ok");
+		total += failed;
+	}
+
+	return total ? 1 : 0;
+}
+
+static void replay_bench(int units)
+{
+	const struct replay_profile *profile;
+	struct replay_result res;
+	int i, mode;
+
+	printf("%-24s %-8s %12s %10s %12s\n",
+	       "profile", "mode", "packets/s", "ns/packet", "events/packet");
+
+	for (i = 0; replay_profiles[i]; i++) {
+		for (profile = replay_profiles[i]; profile->name; profile++) {
+			for (mode = 0; mode < REPLAY_MODES; mode++) {
+				if (replay_stream(profile, mode, 1, units, &res) ||
+				    !res.packets)
+					continue;
+
+				printf("%-24s %-8s %12.0f %10.1f %12.2f\n",
+				       profile->name,
+				       replay_mode_names[mode],
+				       res.packets * 1e9 / res.ns,
+				       (double)res.ns / res.packets,
+				       (double)res.out.events / res.packets);
+			}
+		}
+	}
+}
+
+/* The handlers specialised for the device against the generic ones */
+static void replay_bench_generic(const char *title,
+				 const struct replay_profile *profiles,
+				 bool *generic, int units)
+{
+	static const char * const names[] = { "special", "generic" };
+	const struct replay_profile *profile;
+	struct replay_result res;
+	int i;
+
+	printf("\n%-24s %-8s %12s %10s %12s\n",
+	       title, "", "packets/s", "ns/packet", "events/packet");
+
+	for (profile = profiles; profile->name; profile++) {
+		for (i = 0; i < 2; i++) {
+			*generic = i;
+			if (replay_stream(profile, REPLAY_DIRECT, 1, units,
+					  &res) || !res.packets)
+				continue;
+
+			printf("%-24s %-8s %12.0f %10.1f %12.2f\n",
+			       profile->name, names[i],
+			       res.packets * 1e9 / res.ns,
+			       (double)res.ns / res.packets,
+			       (double)res.out.events / res.packets);
+		}
+	}
+	*generic = false;
+}
+
+/* Bytes as hex, separated by anything that is not a hex digit */
+static int replay_file(const struct replay_profile *profile,
+		       const char *path, enum replay_mode mode)
+{
+	struct replay_result res;
+	struct psmouse *psmouse;
+	unsigned char data;
+	unsigned int value;
+	FILE *f;
+	int c, digits = 0;
+	u64 start;
+
+	f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+
+	psmouse = replay_start(profile, mode);
+	if (!psmouse)
+		return 1;
+
+	start = local_clock();
+	value = 0;
+	do {
+		c = fgetc(f);
+		if (c != EOF && isxdigit(c) && digits < 2) {
+			value = value * 16 + (isdigit(c) ? c - '0' :
+					      tolower(c) - 'a' + 10);
+			digits++;
+			continue;
+		}
+		if (digits) {
+			data = value;
+			replay_bytes(&replay_serio, &data, 1);
+			replay_run_work();
+			value = digits = 0;
+		}
+	} while (c != EOF);
+	res.ns = local_clock() - start;
+
+	if (f != stdin)
+		fclose(f);
+
+	replay_finish(psmouse, &res);
+
+	printf("bytes: %lu\npackets: %lu\nbad_data: %lu\nrealigned: %lu\n"
+	       "events: %lu\nsyncs: %lu\nhash: %016llx\nns_per_packet: %llu\n",
+	       res.bytes, res.packets, res.bad_data, res.realigned,
+	       res.out.events, res.out.syncs, res.out.hash,
+	       res.packets ? res.ns / res.packets : 0ULL);
+
+	return 0;
+}
+
+static void replay_usage(void)
+{
+	const struct replay_profile *profile;
+	int i;
+
+	fprintf(stderr,
+		"usage: replay -t [-v]\n"
+		"       replay -b [-n packets]\n"
+		"       replay -p profile [-d] [-v] file|-\n"
+		"profiles:");
+	for (i = 0; replay_profiles[i]; i++)
+		for (profile = replay_profiles[i]; profile->name; profile++)
+			fprintf(stderr, " %s", profile->name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+	const struct replay_profile *profile = NULL;
+	enum replay_mode mode = REPLAY_DIRECT;
+	bool check = false, bench = false;
+	int units = 100000;
+	int opt;
+
+	replay_module_init();
+
+	while ((opt = getopt(argc, argv, "tbn:p:dv")) != -1) {
+		switch (opt) {
+		case 't':
+			check = true;
+			break;
+		case 'b':
+			bench = true;
+			break;
+		case 'n':
+			units = atoi(optarg);
+			break;
+		case 'p':
+			profile = replay_find_profile(optarg);
+			if (!profile) {
+				replay_usage();
+				return 2;
+			}
+			break;
+		case 'd':
+			mode = REPLAY_DEFERRED;
+			break;
+		case 'v':
+			replay_verbose = 1;
+			break;
+		default:
+			replay_usage();
+			return 2;
+		}
+	}
+
+	if (profile && optind == argc - 1)
+		return replay_file(profile, argv[optind], mode);
+
+	if (!check && !bench) {
+		replay_usage();
+		return 2;
+	}
+
+	if (bench) {
+		replay_bench(units);
+		replay_bench_generic("synaptics decoder",
+				     replay_synaptics_profiles,
+				     &replay_synaptics_generic, units);
+		replay_bench_generic("elantech handler",
+				     replay_elantech_profiles,
+				     &replay_elantech_generic, units);
+		replay_bench_alps_bitmap();
+		replay_bench_synaptics_mt();
+	}
+
+	return check ? replay_check() : 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Packet replay harness for the psmouse protocol decoders.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#ifndef _REPLAY_H
+#define _REPLAY_H
+
+#include "kstub.h"
+
+struct psmouse;
+struct serio;
+
+/* What the decoders reported, all input devices together */
+struct replay_output {
+	unsigned long events;
+	unsigned long syncs;
+	unsigned long locked_events;	/* Reported with the port paused */
+	u64 hash;
+};
+
+extern struct replay_output replay_out;
+extern struct serio *replay_port;	/* Checked by input_event() */
+extern unsigned long replay_slept_ms;
+extern unsigned int replay_next_tag;
+
+/* kstub.c */
+void replay_run_work(void);
+
+/*
+ * A device profile: how to set up the protocol without talking to the
+ * hardware, and a generator for a plausible stream of its packets.
+ */
+struct replay_profile {
+	const char *name;
+	int (*init)(struct psmouse *psmouse);
+	int (*packet)(unsigned char *buf, unsigned int *seed);
+	unsigned int gap_us;		/* Between packets */
+};
+
+extern const struct replay_profile replay_alps_profiles[];
+extern const struct replay_profile replay_synaptics_profiles[];
+extern const struct replay_profile replay_elantech_profiles[];
+
+/* drv-base.c, the psmouse core */
+struct psmouse *replay_connect(struct serio *serio,
+			       const struct replay_profile *profile);
+void replay_disconnect(struct psmouse *psmouse);
+int replay_set_deferred(struct psmouse *psmouse, bool enable);
+void replay_bytes(struct serio *serio, const unsigned char *data, int count);
+
+/* module_init(psmouse_init), see kstub.h */
+int replay_module_init(void);
+
+/* drv-alps.c */
+struct alps_data;
+void replay_alps_bitmap_setup(struct alps_data *priv, int x_max, int x_bits,
+			      int y_max, int y_bits);
+int replay_alps_process_bitmap(struct alps_data *priv,
+			       unsigned int x_map, unsigned int y_map,
+			       int *x1, int *y1, int *x2, int *y2);
+int replay_check_alps_init_tables(void);
+int replay_check_alps_init_capture(void);
+
+/* alps-bitmap.c */
+int replay_check_alps_bitmap_tables(void);
+int replay_check_alps_bitmap_runs(void);
+void replay_bench_alps_bitmap(void);
+
+/* drv-synaptics.c */
+extern bool replay_synaptics_generic;
+struct synaptics_mt_state;
+struct synaptics_hw_state;
+void replay_synaptics_report_mt_data(struct psmouse *psmouse,
+				     struct synaptics_mt_state *mt_state,
+				     const struct synaptics_hw_state *sgm);
+void replay_synaptics_image_sensor_process(struct psmouse *psmouse,
+					   struct synaptics_hw_state *sgm);
+
+/* drv-elantech.c */
+extern bool replay_elantech_generic;
+int replay_check_elantech_parity(void);
+int replay_check_elantech_reconnect(void);
+int replay_check_elantech_frames(void);
+
+/* synaptics-mt.c */
+int replay_check_synaptics_mt(void);
+void replay_bench_synaptics_mt(void);
+
+static inline unsigned int replay_rand(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+#endif /* _REPLAY_H */
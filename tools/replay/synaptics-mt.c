@@ -0,0 +1,478 @@
+/*
+ * Synaptics image sensor finger tracking: the table driven
+ * synaptics_image_sensor_process() against the per finger count
+ * functions it replaced.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#include <linux/input.h>
+#include <linux/serio.h>
+#include <linux/libps2.h>
+
+#include "../../src/psmouse.h"
+#include "../../src/synaptics.h"
+#include "replay.h"
+
+static void synaptics_mt_state_set(struct synaptics_mt_state *state, int count,
+				   int sgm, int agm)
+{
+	state->count = count;
+	state->sgm = sgm;
+	state->agm = agm;
+}
+
+/* Handle case where mt_state->count = 0 */
+static void synaptics_image_sensor_0f(struct synaptics_data *priv,
+				      struct synaptics_mt_state *mt_state)
+{
+	synaptics_mt_state_set(mt_state, 0, -1, -1);
+	priv->mt_state_lost = false;
+}
+
+/* Handle case where mt_state->count = 1 */
+static void synaptics_image_sensor_1f(struct synaptics_data *priv,
+				      struct synaptics_mt_state *mt_state)
+{
+	struct synaptics_hw_state *agm = &priv->agm;
+	struct synaptics_mt_state *old = &priv->mt_state;
+
+	/*
+	 * If the last AGM was (0,0,0), and there is only one finger left,
+	 * then we absolutely know that SGM contains slot 0, and all other
+	 * fingers have been removed.
+	 */
+	if (priv->agm_pending && agm->z == 0) {
+		synaptics_mt_state_set(mt_state, 1, 0, -1);
+		priv->mt_state_lost = false;
+		return;
+	}
+
+	switch (old->count) {
+	case 0:
+		synaptics_mt_state_set(mt_state, 1, 0, -1);
+		break;
+	case 1:
+		/*
+		 * If mt_state_lost, then the previous transition was 3->1,
+		 * and SGM now contains either slot 0 or 1, but we don't know
+		 * which.  So, we just assume that the SGM now contains slot 1.
+		 *
+		 * If pending AGM and either:
+		 *   (a) the previous SGM slot contains slot 0, or
+		 *   (b) there was no SGM slot
+		 * then, the SGM now contains slot 1
+		 *
+		 * Case (a) happens with very rapid "drum roll" gestures, where
+		 * slot 0 finger is lifted and a new slot 1 finger touches
+		 * within one reporting interval.
+		 *
+		 * Case (b) happens if initially two or more fingers tap
+		 * briefly, and all but one lift before the end of the first
+		 * reporting interval.
+		 *
+		 * (In both these cases, slot 0 will becomes empty, so SGM
+		 * contains slot 1 with the new finger)
+		 *
+		 * Else, if there was no previous SGM, it now contains slot 0.
+		 *
+		 * Otherwise, SGM still contains the same slot.
+		 */
+		if (priv->mt_state_lost ||
+		    (priv->agm_pending && old->sgm <= 0))
+			synaptics_mt_state_set(mt_state, 1, 1, -1);
+		else if (old->sgm == -1)
+			synaptics_mt_state_set(mt_state, 1, 0, -1);
+		break;
+	case 2:
+		/*
+		 * If mt_state_lost, we don't know which finger SGM contains.
+		 *
+		 * So, report 1 finger, but with both slots empty.
+		 * We will use slot 1 on subsequent 1->1
+		 */
+		if (priv->mt_state_lost) {
+			synaptics_mt_state_set(mt_state, 1, -1, -1);
+			break;
+		}
+		/*
+		 * Since the last AGM was NOT (0,0,0), it was the finger in
+		 * slot 0 that has been removed.
+		 * So, SGM now contains previous AGM's slot, and AGM is now
+		 * empty.
+		 */
+		synaptics_mt_state_set(mt_state, 1, old->agm, -1);
+		break;
+	case 3:
+		/*
+		 * Since last AGM was not (0,0,0), we don't know which finger
+		 * is left.
+		 *
+		 * So, report 1 finger, but with both slots empty.
+		 * We will use slot 1 on subsequent 1->1
+		 */
+		synaptics_mt_state_set(mt_state, 1, -1, -1);
+		priv->mt_state_lost = true;
+		break;
+	case 4:
+	case 5:
+		/* mt_state was updated by AGM-CONTACT packet */
+		break;
+	}
+}
+
+/* Handle case where mt_state->count = 2 */
+static void synaptics_image_sensor_2f(struct synaptics_data *priv,
+				      struct synaptics_mt_state *mt_state)
+{
+	struct synaptics_mt_state *old = &priv->mt_state;
+
+	switch (old->count) {
+	case 0:
+		synaptics_mt_state_set(mt_state, 2, 0, 1);
+		break;
+	case 1:
+		/*
+		 * If previous SGM contained slot 1 or higher, SGM now contains
+		 * slot 0 (the newly touching finger) and AGM contains SGM's
+		 * previous slot.
+		 *
+		 * Otherwise, SGM still contains slot 0 and AGM now contains
+		 * slot 1.
+		 */
+		if (old->sgm >= 1)
+			synaptics_mt_state_set(mt_state, 2, 0, old->sgm);
+		else
+			synaptics_mt_state_set(mt_state, 2, 0, 1);
+		break;
+	case 2:
+		/*
+		 * If mt_state_lost, SGM now contains either finger 1 or 2, but
+		 * we don't know which.
+		 * So, we just assume that the SGM contains slot 0 and AGM 1.
+		 */
+		if (priv->mt_state_lost)
+			synaptics_mt_state_set(mt_state, 2, 0, 1);
+		/*
+		 * Otherwise, use the same mt_state, since it either hasn't
+		 * changed, or was updated by a recently received AGM-CONTACT
+		 * packet.
+		 */
+		break;
+	case 3:
+		/*
+		 * 3->2 transitions have two unsolvable problems:
+		 *  1) no indication is given which finger was removed
+		 *  2) no way to tell if agm packet was for finger 3
+		 *     before 3->2, or finger 2 after 3->2.
+		 *
+		 * So, report 2 fingers, but empty all slots.
+		 * We will guess slots [0,1] on subsequent 2->2.
+		 */
+		synaptics_mt_state_set(mt_state, 2, -1, -1);
+		priv->mt_state_lost = true;
+		break;
+	case 4:
+	case 5:
+		/* mt_state was updated by AGM-CONTACT packet */
+		break;
+	}
+}
+
+/* Handle case where mt_state->count = 3 */
+static void synaptics_image_sensor_3f(struct synaptics_data *priv,
+				      struct synaptics_mt_state *mt_state)
+{
+	struct synaptics_mt_state *old = &priv->mt_state;
+
+	switch (old->count) {
+	case 0:
+		synaptics_mt_state_set(mt_state, 3, 0, 2);
+		break;
+	case 1:
+		/*
+		 * If previous SGM contained slot 2 or higher, SGM now contains
+		 * slot 0 (one of the newly touching fingers) and AGM contains
+		 * SGM's previous slot.
+		 *
+		 * Otherwise, SGM now contains slot 0 and AGM contains slot 2.
+		 */
+		if (old->sgm >= 2)
+			synaptics_mt_state_set(mt_state, 3, 0, old->sgm);
+		else
+			synaptics_mt_state_set(mt_state, 3, 0, 2);
+		break;
+	case 2:
+		/*
+		 * If the AGM previously contained slot 3 or higher, then the
+		 * newly touching finger is in the lowest available slot.
+		 *
+		 * If SGM was previously 1 or higher, then the new SGM is
+		 * now slot 0 (with a new finger), otherwise, the new finger
+		 * is now in a hidden slot between 0 and AGM's slot.
+		 *
+		 * In all such cases, the SGM now contains slot 0, and the AGM
+		 * continues to contain the same slot as before.
+		 */
+		if (old->agm >= 3) {
+			synaptics_mt_state_set(mt_state, 3, 0, old->agm);
+			break;
+		}
+
+		/*
+		 * After some 3->1 and all 3->2 transitions, we lose track
+		 * of which slot is reported by SGM and AGM.
+		 *
+		 * For 2->3 in this state, report 3 fingers, but empty all
+		 * slots, and we will guess (0,2) on a subsequent 0->3.
+		 *
+		 * To userspace, the resulting transition will look like:
+		 *    2:[0,1] -> 3:[-1,-1] -> 3:[0,2]
+		 */
+		if (priv->mt_state_lost) {
+			synaptics_mt_state_set(mt_state, 3, -1, -1);
+			break;
+		}
+
+		/*
+		 * If the (SGM,AGM) really previously contained slots (0, 1),
+		 * then we cannot know what slot was just reported by the AGM,
+		 * because the 2->3 transition can occur either before or after
+		 * the AGM packet. Thus, this most recent AGM could contain
+		 * either the same old slot 1 or the new slot 2.
+		 * Subsequent AGMs will be reporting slot 2.
+		 *
+		 * To userspace, the resulting transition will look like:
+		 *    2:[0,1] -> 3:[0,-1] -> 3:[0,2]
+		 */
+		synaptics_mt_state_set(mt_state, 3, 0, -1);
+		break;
+	case 3:
+		/*
+		 * If, for whatever reason, the previous agm was invalid,
+		 * Assume SGM now contains slot 0, AGM now contains slot 2.
+		 */
+		if (old->agm <= 2)
+			synaptics_mt_state_set(mt_state, 3, 0, 2);
+		/*
+		 * mt_state either hasn't changed, or was updated by a recently
+		 * received AGM-CONTACT packet.
+		 */
+		break;
+
+	case 4:
+	case 5:
+		/* mt_state was updated by AGM-CONTACT packet */
+		break;
+	}
+}
+
+/* Handle case where mt_state->count = 4, or = 5 */
+static void synaptics_image_sensor_45f(struct synaptics_data *priv,
+				       struct synaptics_mt_state *mt_state)
+{
+	/* mt_state was updated correctly by AGM-CONTACT packet */
+	priv->mt_state_lost = false;
+}
+
+/* synaptics_image_sensor_process() before the transition table */
+static noinline void
+synaptics_image_sensor_process_old(struct psmouse *psmouse,
+				   struct synaptics_hw_state *sgm)
+{
+	struct synaptics_data *priv = psmouse->private;
+	struct synaptics_hw_state *agm = &priv->agm;
+	struct synaptics_mt_state mt_state;
+
+	/* Initialize using current mt_state (as updated by last agm) */
+	mt_state = agm->mt_state;
+
+	/*
+	 * Update mt_state using the new finger count and current mt_state.
+	 */
+	if (sgm->z == 0)
+		synaptics_image_sensor_0f(priv, &mt_state);
+	else if (sgm->w >= 4)
+		synaptics_image_sensor_1f(priv, &mt_state);
+	else if (sgm->w == 0)
+		synaptics_image_sensor_2f(priv, &mt_state);
+	else if (sgm->w == 1 && mt_state.count <= 3)
+		synaptics_image_sensor_3f(priv, &mt_state);
+	else
+		synaptics_image_sensor_45f(priv, &mt_state);
+
+	/* Send resulting input events to user space */
+	replay_synaptics_report_mt_data(psmouse, &mt_state, sgm);
+
+	/* Store updated mt_state */
+	priv->mt_state = agm->mt_state = mt_state;
+	priv->agm_pending = false;
+}
+
+typedef void (*synaptics_mt_fn)(struct psmouse *psmouse,
+				struct synaptics_hw_state *sgm);
+
+static noinline void
+synaptics_image_sensor_process_cur(struct psmouse *psmouse,
+				   struct synaptics_hw_state *sgm)
+{
+	replay_synaptics_image_sensor_process(psmouse, sgm);
+}
+
+/*
+ * The values tried for every slot and count of the previous and the
+ * current mt_state, including the invalid ones a confused touchpad can
+ * leave behind, and for the SGM packet.
+ */
+static const int synaptics_mt_values[] = { -3, -2, -1, 0, 1, 2, 3, 4, 5, 6, 200 };
+static const int synaptics_mt_z[] = { 0, 5 };
+static const int synaptics_mt_w[] = { 0, 1, 2, 3, 4, 5, 15 };
+
+#define SYN_MT_NV	ARRAY_SIZE(synaptics_mt_values)
+#define SYN_MT_CASES	(SYN_MT_NV * SYN_MT_NV * SYN_MT_NV * SYN_MT_NV *	\
+			 3 * 3 * 2 * 2 * 2 * 2 * ARRAY_SIZE(synaptics_mt_w))
+
+static struct synaptics_data synaptics_mt_priv;
+static struct psmouse synaptics_mt_psmouse;
+
+/* Sets up case number n of SYN_MT_CASES */
+static void synaptics_mt_case(unsigned long n, struct synaptics_data *priv,
+			      struct synaptics_hw_state *sgm)
+{
+	const int *v = synaptics_mt_values;
+
+#define SYN_MT_NEXT(count)	({ int __i = n % (count); n /= (count); __i; })
+	memset(priv, 0, sizeof(*priv));
+	memset(sgm, 0, sizeof(*sgm));
+	priv->mt_state.count = v[SYN_MT_NEXT(SYN_MT_NV)];
+	priv->mt_state.sgm = v[SYN_MT_NEXT(SYN_MT_NV)];
+	priv->mt_state.agm = v[SYN_MT_NEXT(SYN_MT_NV)];
+	priv->agm.mt_state.count = v[SYN_MT_NEXT(SYN_MT_NV)];
+	/* Valid slots only, as parsed from an AGM-CONTACT packet */
+	priv->agm.mt_state.sgm = v[2 + SYN_MT_NEXT(3)];
+	priv->agm.mt_state.agm = v[3 + SYN_MT_NEXT(3)];
+	priv->mt_state_lost = SYN_MT_NEXT(2);
+	priv->agm_pending = SYN_MT_NEXT(2);
+	priv->agm.z = synaptics_mt_z[SYN_MT_NEXT(2)];
+	sgm->z = synaptics_mt_z[SYN_MT_NEXT(2)];
+	sgm->w = synaptics_mt_w[SYN_MT_NEXT(ARRAY_SIZE(synaptics_mt_w))];
+#undef SYN_MT_NEXT
+}
+
+static void synaptics_mt_run(synaptics_mt_fn fn, struct synaptics_data *priv,
+			     struct synaptics_hw_state *sgm)
+{
+	synaptics_mt_priv = *priv;
+	memset(&replay_out, 0, sizeof(replay_out));
+	fn(&synaptics_mt_psmouse, sgm);
+	*priv = synaptics_mt_priv;
+}
+
+static int synaptics_mt_setup(void)
+{
+	synaptics_mt_psmouse.private = &synaptics_mt_priv;
+	synaptics_mt_psmouse.dev = input_allocate_device();
+
+	return synaptics_mt_psmouse.dev ? 0 : -ENOMEM;
+}
+
+static void synaptics_mt_teardown(void)
+{
+	input_free_device(synaptics_mt_psmouse.dev);
+	synaptics_mt_psmouse.dev = NULL;
+}
+
+/*
+ * Every combination of previous mt_state, last AGM-CONTACT packet, flags
+ * and finger count ends in the same mt_state and reports the same events.
+ */
+int replay_check_synaptics_mt(void)
+{
+	struct synaptics_data a, b;
+	struct synaptics_hw_state sgm;
+	struct replay_output out;
+	unsigned long n;
+	int failed = 0;
+
+	if (synaptics_mt_setup())
+		return 1;
+
+	for (n = 0; n < SYN_MT_CASES && failed < 10; n++) {
+		synaptics_mt_case(n, &a, &sgm);
+		b = a;
+
+		synaptics_mt_run(synaptics_image_sensor_process_old, &a, &sgm);
+		out = replay_out;
+		synaptics_mt_run(synaptics_image_sensor_process_cur, &b, &sgm);
+
+		if (!memcmp(&a, &b, sizeof(a)) &&
+		    out.events == replay_out.events &&
+		    out.hash == replay_out.hash)
+			continue;
+
+		synaptics_mt_case(n, &b, &sgm);
+		printf("case %lu: %d,%d,%d agm %d,%d,%d lost %d pending %d z %d/%d w %d\n",
+		       n, b.mt_state.count, b.mt_state.sgm, b.mt_state.agm,
+		       b.agm.mt_state.count, b.agm.mt_state.sgm,
+		       b.agm.mt_state.agm, b.mt_state_lost, b.agm_pending,
+		       b.agm.z, sgm.z, sgm.w);
+		failed++;
+	}
+
+	synaptics_mt_teardown();
+
+	return failed;
+}
+
+/* Runs every case once, returns the ns spent; fn NULL only sets up */
+static u64 synaptics_mt_bench_one(synaptics_mt_fn fn)
+{
+	struct synaptics_data priv;
+	struct synaptics_hw_state sgm;
+	unsigned long n;
+	u64 ns;
+
+	memset(&replay_out, 0, sizeof(replay_out));
+	ns = local_clock();
+	for (n = 0; n < SYN_MT_CASES; n++) {
+		synaptics_mt_case(n, &priv, &sgm);
+		synaptics_mt_priv = priv;
+		if (fn)
+			fn(&synaptics_mt_psmouse, &sgm);
+		else
+			barrier();
+	}
+
+	return local_clock() - ns;
+}
+
+/* The time includes reporting the events, but not setting up the case */
+void replay_bench_synaptics_mt(void)
+{
+	static const struct {
+		const char *name;
+		synaptics_mt_fn fn;
+	} impls[] = {
+		{ "per finger count", synaptics_image_sensor_process_old },
+		{ "table", synaptics_image_sensor_process_cur },
+	};
+	u64 setup, ns;
+	int i;
+
+	if (synaptics_mt_setup())
+		return;
+
+	printf("\n%-24s %12s %12s %20s\n",
+	       "synaptics image sensor", "ns/call", "", "event hash");
+	setup = synaptics_mt_bench_one(NULL);
+	for (i = 0; i < ARRAY_SIZE(impls); i++) {
+		ns = synaptics_mt_bench_one(impls[i].fn);
+		ns = ns > setup ? ns - setup : 0;
+		printf("%-24s %12.1f %12s %20llx\n", impls[i].name,
+		       (double)ns / SYN_MT_CASES, "", replay_out.hash);
+	}
+
+	synaptics_mt_teardown();
+}